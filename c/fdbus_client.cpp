@@ -387,9 +387,10 @@ fdb_bool_t fdb_client_invoke_sync(fdb_client_t *handle,
     {
         ret_msg->sid = fdb_msg->session();
         ret_msg->msg_code = fdb_msg->code();
-        ret_msg->msg_data = fdb_msg->getPayloadBuffer();
         // avoid buffer from being released.
         ret_msg->msg_buffer = fdb_msg->ownBuffer();
+        ret_msg->msg_data = ret_msg->msg_buffer ?
+                    (uint8_t *)ret_msg->msg_buffer + fdb_msg->getPayloadOffset() : 0;
         ret_msg->data_size = fdb_msg->getPayloadSize();
         ret_msg->status = error_code;
     }
@@ -559,9 +560,10 @@ fdb_bool_t fdb_client_get_event_sync(fdb_client_t *handle,
         ret_msg->sid = fdb_msg->session();
         ret_msg->msg_code = fdb_msg->code();
         ret_msg->topic = fdb_msg->topic().empty() ? 0 : fdb_msg->topic().c_str();
-        ret_msg->msg_data = fdb_msg->getPayloadBuffer();
         // avoid buffer from being released.
         ret_msg->msg_buffer = fdb_msg->ownBuffer();
+        ret_msg->msg_data = ret_msg->msg_buffer ?
+                    (uint8_t *)ret_msg->msg_buffer + fdb_msg->getPayloadOffset() : 0;
         ret_msg->data_size = fdb_msg->getPayloadSize();
         ret_msg->status = error_code;
     }
@@ -9,6 +9,22 @@ add_executable(fdbjobtest
     ${PACKAGE_SOURCE_ROOT}/example/job/job_test.cpp
 )
 
+add_executable(fdbjobbench
+    ${PACKAGE_SOURCE_ROOT}/example/job/job_queue_bench.cpp
+)
+
+add_executable(fdbfanoutbench
+    ${PACKAGE_SOURCE_ROOT}/example/broadcast/broadcast_fanout_bench.cpp
+)
+
+add_executable(fdbserializebench
+    ${PACKAGE_SOURCE_ROOT}/example/serialize/serialize_bench.cpp
+)
+
+add_executable(fdbcontainerbench
+    ${PACKAGE_SOURCE_ROOT}/example/container/entity_container_bench.cpp
+)
+
 add_executable(fdbclienttest
     ${PACKAGE_SOURCE_ROOT}/example/client-server/fdb_test_client.cpp
     ${IDL_GEN_ROOT}/idl-gen/common.base.Example.pb.cc
@@ -29,4 +45,4 @@ add_executable(fdbappfwtest
     ${IDL_GEN_ROOT}/idl-gen/common.base.Example.pb.cc
 )
 
-install(TARGETS fdbobjtest fdbjobtest fdbclienttest fdbservertest fdbntfcentertest fdbappfwtest RUNTIME DESTINATION usr/bin)
+install(TARGETS fdbobjtest fdbjobtest fdbjobbench fdbfanoutbench fdbserializebench fdbcontainerbench fdbclienttest fdbservertest fdbntfcentertest fdbappfwtest RUNTIME DESTINATION usr/bin)
@@ -30,6 +30,7 @@ add_executable(lsclt
 add_executable(logsvc
     ${PACKAGE_SOURCE_ROOT}/log/main_log_server.cpp
     ${PACKAGE_SOURCE_ROOT}/log/CLogFileManager.cpp
+    ${PACKAGE_SOURCE_ROOT}/log/CLogBinFileManager.cpp
     ${PACKAGE_SOURCE_ROOT}/log/fdb_log_config.cpp
 )
 
@@ -38,6 +39,10 @@ add_executable(logviewer
     ${PACKAGE_SOURCE_ROOT}/log/fdb_log_config.cpp
 )
 
+add_executable(logconv
+    ${PACKAGE_SOURCE_ROOT}/log/main_log_converter.cpp
+)
+
 add_executable(fdbxclient
     ${PACKAGE_SOURCE_ROOT}/server/main_xclient.cpp
 )
@@ -54,4 +59,4 @@ add_executable(lsevt
     ${PACKAGE_SOURCE_ROOT}/server/main_le.cpp
 )
 
-install(TARGETS name_server host_server lssvc lshost lsclt logsvc logviewer fdbxclient fdbxserver ntfcenter lsevt RUNTIME DESTINATION usr/bin)
+install(TARGETS name_server host_server lssvc lshost lsclt logsvc logviewer logconv fdbxclient fdbxserver ntfcenter lsevt RUNTIME DESTINATION usr/bin)
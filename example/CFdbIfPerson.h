@@ -21,14 +21,7 @@
 class CCar : public IFdbParcelable
 {
 public:
-    void serialize(CFdbSimpleSerializer &serializer) const
-    {
-        serializer << mBrand << mModel << mPrice;
-    }
-    void deserialize(CFdbSimpleDeserializer &deserializer)
-    {
-        deserializer >> mBrand >> mModel >> mPrice;
-    }
+    FDB_SCHEMA_FIELDS(mBrand, mModel, mPrice)
 
     std::string mBrand;
     std::string mModel;
@@ -46,14 +39,7 @@ protected:
 class CPerson : public IFdbParcelable
 {
 public:
-    void serialize(CFdbSimpleSerializer &serializer) const
-    {
-        serializer << mName << mAge << mCars << mAddress << mSalary << mPrivateInfo;
-    }
-    void deserialize(CFdbSimpleDeserializer &deserializer)
-    {
-        deserializer >> mName >> mAge >> mCars >> mAddress >> mSalary >> mPrivateInfo;
-    }
+    FDB_SCHEMA_FIELDS(mName, mAge, mCars, mAddress, mSalary, mPrivateInfo)
     std::string mName;
     uint8_t mAge;
     int32_t mSalary;
@@ -0,0 +1,227 @@
+/*
+ * Copyright (C) 2015   Jeremy Chen jeremy_cz@yahoo.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Measure cost of broadcast fan-out: a server broadcasts an event to 1, 10,
+ * 100... subscribers, each of which is a client connected through its own
+ * session. Time spent by server context to send the broadcasts and time
+ * until all subscribers receive them are printed. With -a the subscribers
+ * are held while sending so that fan-out cost is not mixed with receiving.
+ */
+#include <common_base/fdbus.h>
+#include <common_base/CNanoTimer.h>
+#include <iostream>
+#include <vector>
+#include <atomic>
+#include <string>
+#ifndef __WIN32__
+#include <sys/resource.h>
+#endif
+
+#define FDB_BENCH_EVENT         1
+#define FDB_BENCH_URL           "ipc:///tmp/fdb-fanout-bench"
+// give up waiting for delivery after the time
+#define FDB_BENCH_TIMEOUT       10000
+
+static std::atomic<uint32_t> fdb_online(0);
+static std::atomic<uint64_t> fdb_received(0);
+static std::atomic<bool> fdb_hold_clients(false);
+
+/* a job keeping subscribers from reading so that only sending is measured */
+class CHoldJob : public CBaseJob
+{
+protected:
+    void run(CBaseWorker *worker, Ptr &ref)
+    {
+        while (fdb_hold_clients.load(std::memory_order_acquire))
+        {
+            sysdep_sleep(1);
+        }
+    }
+};
+
+class CBenchServer : public CBaseServer
+{
+public:
+    CBenchServer()
+        : CBaseServer("fanout_bench_server")
+    {}
+};
+
+class CBenchClient : public CBaseClient
+{
+public:
+    CBenchClient(CFdbBaseContext *context)
+        : CBaseClient("fanout_bench_client", 0, context)
+    {}
+protected:
+    void onOnline(FdbSessionId_t sid, bool is_first)
+    {
+        fdb_online.fetch_add(1, std::memory_order_relaxed);
+    }
+    void onBroadcast(CBaseJob::Ptr &msg_ref)
+    {
+        fdb_received.fetch_add(1, std::memory_order_relaxed);
+    }
+};
+
+static void raiseFdLimit(uint32_t nr_subscribers)
+{
+#ifndef __WIN32__
+    // each subscriber takes one fd at both sides
+    struct rlimit limit;
+    if (!getrlimit(RLIMIT_NOFILE, &limit) && (limit.rlim_cur < (nr_subscribers * 2 + 64)))
+    {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+#endif
+}
+
+static bool waitFor(std::atomic<uint64_t> &counter, uint64_t expected)
+{
+    CNanoTimer timer;
+    timer.start();
+    while (counter.load(std::memory_order_relaxed) < expected)
+    {
+        if (timer.snapshotMilliseconds() > FDB_BENCH_TIMEOUT)
+        {
+            return false;
+        }
+        sysdep_sleep(1);
+    }
+    return true;
+}
+
+static void runBenchmark(CBenchServer &server, CFdbBaseContext *client_context,
+                         uint32_t nr_subscribers, uint32_t nr_broadcasts, uint32_t payload_size,
+                         bool hold_clients)
+{
+    std::vector<CBenchClient *> clients;
+    fdb_online = 0;
+    for (uint32_t i = 0; i < nr_subscribers; ++i)
+    {
+        auto client = new CBenchClient(client_context);
+        client->connect(FDB_BENCH_URL);
+        clients.push_back(client);
+    }
+    CNanoTimer timer;
+    timer.start();
+    while (fdb_online.load(std::memory_order_relaxed) < nr_subscribers)
+    {
+        if (timer.snapshotMilliseconds() > FDB_BENCH_TIMEOUT)
+        {
+            std::cout << "only " << fdb_online << "/" << nr_subscribers << " subscribers are online!" << std::endl;
+            break;
+        }
+        sysdep_sleep(1);
+    }
+    for (auto it = clients.begin(); it != clients.end(); ++it)
+    {
+        CFdbMsgSubscribeList subscribe_list;
+        CFdbBaseObject::addNotifyItem(subscribe_list, FDB_BENCH_EVENT);
+        (*it)->subscribeSync(subscribe_list);
+    }
+
+    std::vector<uint8_t> payload(payload_size, 0x5a);
+    fdb_received = 0;
+    if (hold_clients)
+    {
+        fdb_hold_clients = true;
+        client_context->sendAsync(new CHoldJob());
+    }
+    timer.start();
+    for (uint32_t i = 0; i < nr_broadcasts; ++i)
+    {
+        server.broadcast(FDB_BENCH_EVENT, payload.data(), payload_size);
+    }
+    // broadcasts are queued before the flush job
+    FDB_CONTEXT->flush();
+    auto send_elapse = timer.snapshotMicroseconds();
+    fdb_hold_clients = false;
+    uint64_t expected = (uint64_t)nr_subscribers * nr_broadcasts;
+    bool done = waitFor(fdb_received, expected);
+    auto total_elapse = timer.snapshotMicroseconds();
+
+    std::cout << "subscribers " << nr_subscribers
+              << ": send " << send_elapse << " us ("
+              << (send_elapse * 1000 / expected) << " ns per subscriber per broadcast); "
+              << "deliver " << fdb_received << "/" << expected << " in " << total_elapse << " us"
+              << (done ? "" : " (timeout)") << std::endl;
+
+    for (auto it = clients.begin(); it != clients.end(); ++it)
+    {
+        (*it)->prepareDestroy();
+        delete *it;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int32_t help = 0;
+    uint32_t max_subscribers = 1000;
+    uint32_t nr_broadcasts = 1000;
+    uint32_t payload_size = 1024;
+    int32_t async_write = 0;
+    const struct fdb_option core_options[] = {
+        { FDB_OPTION_INTEGER, "subscribers", 'n', &max_subscribers},
+        { FDB_OPTION_INTEGER, "broadcasts", 'm', &nr_broadcasts},
+        { FDB_OPTION_INTEGER, "size", 's', &payload_size},
+        { FDB_OPTION_BOOLEAN, "async", 'a', &async_write},
+        { FDB_OPTION_BOOLEAN, "help", 'h', &help}
+    };
+    fdb_parse_options(core_options, ARRAY_LENGTH(core_options), &argc, argv);
+
+    if (help)
+    {
+        std::cout << "Usage: fdbfanoutbench[ -n subscribers][ -m broadcasts][ -s size][ -a]" << std::endl;
+        std::cout << "    -n subscribers: max number of subscribers; 1, 10, 100... up to it are measured" << std::endl;
+        std::cout << "    -m broadcasts: number of broadcasts for each round" << std::endl;
+        std::cout << "    -s size: payload size of each broadcast" << std::endl;
+        std::cout << "    -a: if set, server writes asynchronously and subscribers do not read until" << std::endl;
+        std::cout << "        all broadcasts are sent, so that only cost of sending is measured" << std::endl;
+        exit(0);
+    }
+    if (!nr_broadcasts)
+    {
+        nr_broadcasts = 1;
+    }
+
+    std::cout << "broadcasts: " << nr_broadcasts << ", payload size: " << payload_size
+              << ", async write: " << (async_write ? "true" : "false") << std::endl;
+
+    raiseFdLimit(max_subscribers);
+    FDB_CONTEXT->start();
+    auto client_context = new CFdbBaseContext("fanout_bench_clients");
+    client_context->start();
+
+    auto server = new CBenchServer();
+    server->enableAysncWrite(!!async_write);
+    server->bind(FDB_BENCH_URL);
+
+    for (uint32_t nr_subscribers = 1; nr_subscribers <= max_subscribers; nr_subscribers *= 10)
+    {
+        runBenchmark(*server, client_context, nr_subscribers, nr_broadcasts, payload_size, !!async_write);
+    }
+
+    server->prepareDestroy();
+    delete server;
+    client_context->exit();
+    client_context->join();
+    FDB_CONTEXT->exit();
+    FDB_CONTEXT->join();
+    return 0;
+}
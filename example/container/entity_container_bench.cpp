@@ -0,0 +1,147 @@
+/*
+ * Copyright (C) 2015   Jeremy Chen jeremy_cz@yahoo.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Compare CEntityContainer (std::map) against CEntitySlotMap as table of
+ * pending requests of a session: requests are added until the given number
+ * is outstanding, then each reply looks up its request in random order,
+ * removes it and a new request takes its place. Ids of replied requests
+ * are looked up again to check that stale ids are not found.
+ */
+#include <common_base/fdbus.h>
+#include <common_base/CNanoTimer.h>
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <random>
+
+typedef CEntityContainer<FdbMsgSn_t, CBaseJob::Ptr> tMapTable;
+typedef CEntitySlotMap<FdbMsgSn_t, CBaseJob::Ptr> tSlotTable;
+
+static uint64_t benchMap(const CBaseJob::Ptr &job, uint32_t outstanding, uint32_t rounds,
+                         std::vector<uint32_t> &order, uint32_t &errors)
+{
+    tMapTable table;
+    std::vector<FdbMsgSn_t> sns(outstanding);
+    CBaseJob::Ptr ref = job;
+
+    CNanoTimer timer;
+    timer.start();
+    for (uint32_t i = 0; i < outstanding; ++i)
+    {
+        sns[i] = table.allocateEntityId();
+        table.insertEntry(sns[i], ref);
+    }
+    for (uint32_t r = 0; r < rounds; ++r)
+    {
+        for (auto it = order.begin(); it != order.end(); ++it)
+        {
+            bool found;
+            tMapTable::EntryContainer_t::iterator pos;
+            auto &entry = table.retrieveEntry(sns[*it], pos, found);
+            if (!found || !entry)
+            {
+                errors++;
+                continue;
+            }
+            table.deleteEntry(pos);
+            sns[*it] = table.allocateEntityId();
+            table.insertEntry(sns[*it], ref);
+        }
+    }
+    return timer.snapshotMicroseconds();
+}
+
+static uint64_t benchSlot(const CBaseJob::Ptr &job, uint32_t outstanding, uint32_t rounds,
+                          std::vector<uint32_t> &order, uint32_t &errors)
+{
+    tSlotTable table;
+    std::vector<FdbMsgSn_t> sns(outstanding);
+    CBaseJob::Ptr ref = job;
+
+    CNanoTimer timer;
+    timer.start();
+    for (uint32_t i = 0; i < outstanding; ++i)
+    {
+        sns[i] = table.insertEntry(ref);
+    }
+    for (uint32_t r = 0; r < rounds; ++r)
+    {
+        for (auto it = order.begin(); it != order.end(); ++it)
+        {
+            CBaseJob::Ptr entry;
+            if (!table.removeEntry(sns[*it], entry) || !entry)
+            {
+                errors++;
+                continue;
+            }
+            auto stale = sns[*it];
+            sns[*it] = table.insertEntry(ref);
+            if (table.retrieveEntry(stale))
+            {
+                errors++;
+            }
+        }
+    }
+    return timer.snapshotMicroseconds();
+}
+
+int main(int argc, char **argv)
+{
+    int32_t help = 0;
+    uint32_t outstanding = 100000;
+    uint32_t rounds = 10;
+    const struct fdb_option core_options[] = {
+        { FDB_OPTION_INTEGER, "outstanding", 'n', &outstanding},
+        { FDB_OPTION_INTEGER, "rounds", 'r', &rounds},
+        { FDB_OPTION_BOOLEAN, "help", 'h', &help}
+    };
+    fdb_parse_options(core_options, ARRAY_LENGTH(core_options), &argc, argv);
+
+    if (help)
+    {
+        std::cout << "Usage: fdbcontainerbench[ -n outstanding][ -r rounds]" << std::endl;
+        std::cout << "    -n outstanding: number of requests waiting for reply" << std::endl;
+        std::cout << "    -r rounds: times each outstanding request is replied and replaced" << std::endl;
+        exit(0);
+    }
+    if (!outstanding)
+    {
+        outstanding = 1;
+    }
+
+    std::vector<uint32_t> order(outstanding);
+    for (uint32_t i = 0; i < outstanding; ++i)
+    {
+        order[i] = i;
+    }
+    std::mt19937 rng(12345);
+    std::shuffle(order.begin(), order.end(), rng);
+
+    CBaseJob::Ptr job(new CBaseJob());
+    uint64_t ops = (uint64_t)outstanding * (rounds + 1);
+    uint32_t map_errors = 0;
+    uint32_t slot_errors = 0;
+    auto map_us = benchMap(job, outstanding, rounds, order, map_errors);
+    auto slot_us = benchSlot(job, outstanding, rounds, order, slot_errors);
+
+    std::cout << outstanding << " outstanding requests, " << ops << " requests in total" << std::endl;
+    std::cout << "CEntityContainer: " << map_us * 1000 / ops << " ns per request"
+              << (map_errors ? " - LOOKUP ERROR!" : "") << std::endl;
+    std::cout << "CEntitySlotMap: " << slot_us * 1000 / ops << " ns per request"
+              << (slot_errors ? " - LOOKUP ERROR!" : "") << std::endl;
+    return 0;
+}
@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2015   Jeremy Chen jeremy_cz@yahoo.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Measure contention of job queue: several producer workers send jobs to
+ * one consumer worker as fast as possible, with mutex protected queue and
+ * with lock-free queue respectively.
+ */
+#include <common_base/fdbus.h>
+#include <common_base/CNanoTimer.h>
+#include <iostream>
+#include <vector>
+#include <atomic>
+
+static std::atomic<uint32_t> fdb_jobs_done(0);
+
+/* a job doing nothing but counting */
+class CCountJob : public CBaseJob
+{
+protected:
+    void run(CBaseWorker *worker, Ptr &ref)
+    {
+        fdb_jobs_done.fetch_add(1, std::memory_order_relaxed);
+    }
+};
+
+/* a job sending jobs to consumer at producer thread */
+class CProduceJob : public CBaseJob
+{
+public:
+    CProduceJob(CBaseWorker *consumer, uint32_t nr_jobs, bool urgent)
+        : mConsumer(consumer)
+        , mNrJobs(nr_jobs)
+        , mUrgent(urgent)
+    {}
+protected:
+    void run(CBaseWorker *worker, Ptr &ref)
+    {
+        for (uint32_t i = 0; i < mNrJobs; ++i)
+        {
+            mConsumer->sendAsync(new CCountJob(), mUrgent);
+        }
+    }
+private:
+    CBaseWorker *mConsumer;
+    uint32_t mNrJobs;
+    bool mUrgent;
+};
+
+static void runBenchmark(uint32_t flag, uint32_t nr_producers, uint32_t nr_jobs, bool urgent)
+{
+    CBaseWorker consumer("consumer");
+    consumer.start(flag);
+    std::vector<CBaseWorker *> producers;
+    for (uint32_t i = 0; i < nr_producers; ++i)
+    {
+        auto producer = new CBaseWorker("producer");
+        producer->start();
+        producers.push_back(producer);
+    }
+
+    fdb_jobs_done = 0;
+    CNanoTimer timer;
+    timer.start();
+    for (auto it = producers.begin(); it != producers.end(); ++it)
+    {
+        (*it)->sendAsync(new CProduceJob(&consumer, nr_jobs, urgent));
+    }
+    for (auto it = producers.begin(); it != producers.end(); ++it)
+    {
+        (*it)->flush();
+    }
+    // all jobs are queued before the flush job
+    consumer.flush(0, urgent);
+    auto elapse = timer.snapshotMicroseconds();
+
+    uint64_t total = (uint64_t)nr_producers * nr_jobs;
+    std::cout << ((flag & FDB_WORKER_LOCKFREE_QUEUE) ? "lock-free" : "mutex    ")
+              << ((flag & FDB_WORKER_ENABLE_FD_LOOP) ? " fd loop    " : " thread loop")
+              << ": " << fdb_jobs_done << "/" << total << " jobs in " << elapse << " us; "
+              << (elapse ? total * 1000000 / elapse : 0) << " jobs/s" << std::endl;
+
+    for (auto it = producers.begin(); it != producers.end(); ++it)
+    {
+        (*it)->exit();
+        (*it)->join();
+        delete *it;
+    }
+    consumer.exit();
+    consumer.join();
+}
+
+int main(int argc, char **argv)
+{
+    int32_t help = 0;
+    uint32_t nr_producers = 4;
+    uint32_t nr_jobs = 200000;
+    int32_t urgent = 0;
+    const struct fdb_option core_options[] = {
+        { FDB_OPTION_INTEGER, "producers", 'p', &nr_producers},
+        { FDB_OPTION_INTEGER, "jobs", 'n', &nr_jobs},
+        { FDB_OPTION_BOOLEAN, "urgent", 'u', &urgent},
+        { FDB_OPTION_BOOLEAN, "help", 'h', &help}
+    };
+    fdb_parse_options(core_options, ARRAY_LENGTH(core_options), &argc, argv);
+
+    if (help)
+    {
+        std::cout << "Usage: fdbjobbench[ -p producers][ -n jobs][ -u]" << std::endl;
+        std::cout << "    -p producers: number of producer threads" << std::endl;
+        std::cout << "    -n jobs: number of jobs sent by each producer" << std::endl;
+        std::cout << "    -u: if set, jobs are sent to urgent queue" << std::endl;
+        exit(0);
+    }
+
+    std::cout << "producers: " << nr_producers << ", jobs per producer: " << nr_jobs
+              << ", urgent: " << (urgent ? "true" : "false") << std::endl;
+
+    runBenchmark(FDB_WORKER_ENABLE_FD_LOOP, nr_producers, nr_jobs, !!urgent);
+    runBenchmark(FDB_WORKER_ENABLE_FD_LOOP | FDB_WORKER_LOCKFREE_QUEUE, nr_producers, nr_jobs, !!urgent);
+    runBenchmark(FDB_WORKER_DEFAULT, nr_producers, nr_jobs, !!urgent);
+    runBenchmark(FDB_WORKER_LOCKFREE_QUEUE, nr_producers, nr_jobs, !!urgent);
+    return 0;
+}
@@ -0,0 +1,310 @@
+/*
+ * Copyright (C) 2015   Jeremy Chen jeremy_cz@yahoo.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Compare serializing with compile-time schema (FDB_SCHEMA_FIELDS) against
+ * the hand written operator<< path, using message header, CPerson of the
+ * example and an array of integers. The legacy classes below are what the
+ * schema classes looked like before; both must give the same bytes.
+ * Also compare deserializing a large blob into CFdbByteArrayExt, which
+ * copies, against CFdbByteArrayView, which points into the buffer, and
+ * building plus parsing message head in legacy and compact encoding.
+ */
+#include <common_base/fdbus.h>
+#include <common_base/CNanoTimer.h>
+#include "../../utils/CFdbIfMessageHeader.h"
+#include "../CFdbIfPerson.h"
+#include <iostream>
+
+class CLegacyCar : public IFdbParcelable
+{
+public:
+    void serialize(CFdbSimpleSerializer &serializer) const
+    {
+        serializer << mBrand << mModel << mPrice;
+    }
+    void deserialize(CFdbSimpleDeserializer &deserializer)
+    {
+        deserializer >> mBrand >> mModel >> mPrice;
+    }
+    std::string mBrand;
+    std::string mModel;
+    int32_t mPrice;
+};
+
+class CLegacyPerson : public IFdbParcelable
+{
+public:
+    void serialize(CFdbSimpleSerializer &serializer) const
+    {
+        serializer << mName << mAge << mCars << mAddress << mSalary << mPrivateInfo;
+    }
+    void deserialize(CFdbSimpleDeserializer &deserializer)
+    {
+        deserializer >> mName >> mAge >> mCars >> mAddress >> mSalary >> mPrivateInfo;
+    }
+    std::string mName;
+    uint8_t mAge;
+    int32_t mSalary;
+    std::string mAddress;
+    CFdbParcelableArray<CLegacyCar> mCars;
+    CFdbParcelableArray<CFdbByteArray<20>> mPrivateInfo;
+};
+
+class CLegacyHeader : public IFdbParcelable
+{
+public:
+    void serialize(CFdbSimpleSerializer &serializer) const
+    {
+        serializer << (uint8_t)mType << mSn << mCode << mFlag << mObjId
+                   << mPayloadSize << (uint8_t)mQOS << mOptions;
+        serializer << mFilter << mSendArriveTime;
+    }
+    void deserialize(CFdbSimpleDeserializer &deserializer)
+    {
+    }
+    EFdbMessageType mType;
+    int32_t mSn;
+    int32_t mCode;
+    uint32_t mFlag;
+    uint32_t mObjId;
+    uint32_t mPayloadSize;
+    EFdbQOS mQOS;
+    uint8_t mOptions;
+    std::string mFilter;
+    uint64_t mSendArriveTime;
+};
+
+// array serialized element by element
+class CLegacyIntArray : public IFdbParcelable
+{
+public:
+    void serialize(CFdbSimpleSerializer &serializer) const
+    {
+        serializer << (fdb_struct_arr_len_t)mPool.size();
+        for (auto it = mPool.begin(); it != mPool.end(); ++it)
+        {
+            serializer << *it;
+        }
+    }
+    void deserialize(CFdbSimpleDeserializer &deserializer)
+    {
+    }
+    std::vector<int32_t> mPool;
+};
+
+class CIntArray : public IFdbParcelable
+{
+public:
+    FDB_SCHEMA_FIELDS(mArray)
+    CFdbParcelableArray<int32_t> mArray;
+};
+
+template <typename T>
+static uint64_t measure(const T &data, uint32_t iterations, std::vector<uint8_t> &output)
+{
+    CFdbSimpleSerializer serializer;
+    CNanoTimer timer;
+    timer.start();
+    for (uint32_t i = 0; i < iterations; ++i)
+    {
+        serializer.reset();
+        serializer << data;
+    }
+    auto elapse = timer.snapshotMicroseconds();
+    output.assign(serializer.buffer(), serializer.buffer() + serializer.bufferSize());
+    return elapse * 1000 / iterations;
+}
+
+template <typename L, typename S>
+static void compare(const char *name, const L &legacy, const S &schema, uint32_t iterations)
+{
+    std::vector<uint8_t> legacy_output;
+    std::vector<uint8_t> schema_output;
+    auto legacy_ns = measure(legacy, iterations, legacy_output);
+    auto schema_ns = measure(schema, iterations, schema_output);
+    std::cout << name << " (" << schema_output.size() << " bytes): operator<< "
+              << legacy_ns << " ns, schema " << schema_ns << " ns"
+              << ((legacy_output == schema_output) ? "" : " - OUTPUT MISMATCH!") << std::endl;
+}
+
+template <typename T>
+static uint64_t measureDeserialize(const CFdbSimpleSerializer &serializer, uint32_t iterations, int32_t &size)
+{
+    CNanoTimer timer;
+    timer.start();
+    for (uint32_t i = 0; i < iterations; ++i)
+    {
+        T blob;
+        CFdbSimpleDeserializer deserializer(serializer.buffer(), serializer.bufferSize());
+        deserializer >> blob;
+        size = deserializer.error() ? -1 : blob.size();
+    }
+    return timer.snapshotMicroseconds() * 1000 / iterations;
+}
+
+static void compareBlob(int32_t blob_size, uint32_t iterations)
+{
+    std::vector<uint8_t> data(blob_size, 0x5a);
+    CFdbByteArrayView view(data.data(), blob_size);
+    CFdbSimpleSerializer serializer;
+    serializer << view;
+
+    int32_t ext_size = 0;
+    int32_t view_size = 0;
+    auto ext_ns = measureDeserialize<CFdbByteArrayExt>(serializer, iterations, ext_size);
+    auto view_ns = measureDeserialize<CFdbByteArrayView>(serializer, iterations, view_size);
+    std::cout << "deserialize blob (" << blob_size << " bytes): CFdbByteArrayExt "
+              << ext_ns << " ns, CFdbByteArrayView " << view_ns << " ns"
+              << (((ext_size == blob_size) && (view_size == blob_size)) ? "" : " - SIZE MISMATCH!")
+              << std::endl;
+}
+
+static void compareHead(const NFdbBase::CFdbMessageHeader &header, uint32_t iterations)
+{
+    uint8_t buffer[256];
+    NFdbBase::CFdbMessageHeader legacy_decoded;
+    NFdbBase::CFdbMessageHeader compact_decoded;
+    int32_t legacy_size = -1;
+    int32_t compact_size = -1;
+
+    CNanoTimer timer;
+    timer.start();
+    for (uint32_t i = 0; i < iterations; ++i)
+    {
+        CFdbParcelableBuilder builder(header);
+        legacy_size = builder.build();
+        builder.toBuffer(buffer, legacy_size);
+        legacy_decoded.parse(buffer, legacy_size);
+    }
+    auto legacy_ns = timer.snapshotMicroseconds() * 1000 / iterations;
+
+    timer.start();
+    for (uint32_t i = 0; i < iterations; ++i)
+    {
+        compact_size = header.compactSize();
+        header.encodeCompact(buffer);
+        compact_decoded.parse(buffer, compact_size);
+    }
+    auto compact_ns = timer.snapshotMicroseconds() * 1000 / iterations;
+
+    bool same = (legacy_decoded.object_id() == compact_decoded.object_id()) &&
+                (legacy_decoded.broadcast_filter() == compact_decoded.broadcast_filter()) &&
+                (legacy_decoded.send_or_arrive_time() == compact_decoded.send_or_arrive_time()) &&
+                (compact_decoded.object_id() == header.object_id());
+    std::cout << "build and parse head: legacy (" << legacy_size << " bytes) " << legacy_ns
+              << " ns, compact (" << compact_size << " bytes) " << compact_ns << " ns"
+              << (same ? "" : " - HEAD MISMATCH!") << std::endl;
+}
+
+template <typename P, typename C>
+static void fillPerson(P &person, uint32_t nr_cars)
+{
+    person.mName = "Zhang San";
+    person.mAge = 30;
+    person.mSalary = 10000;
+    person.mAddress = "No. 1, Zhongshan Road, Shanghai";
+    for (uint32_t i = 0; i < nr_cars; ++i)
+    {
+        C *car = person.mCars.Add();
+        car->mBrand = "Audi";
+        car->mModel = "A6L";
+        car->mPrice = 400000 + i;
+    }
+    for (int32_t i = 0; i < 2; ++i)
+    {
+        auto info = person.mPrivateInfo.Add();
+        for (int32_t j = 0; j < info->size(); ++j)
+        {
+            info->vbuffer()[j] = (uint8_t)(i + j);
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int32_t help = 0;
+    uint32_t iterations = 1000000;
+    uint32_t nr_cars = 3;
+    uint32_t array_size = 1024;
+    uint32_t blob_size = 4096;
+    const struct fdb_option core_options[] = {
+        { FDB_OPTION_INTEGER, "iterations", 'n', &iterations},
+        { FDB_OPTION_INTEGER, "cars", 'c', &nr_cars},
+        { FDB_OPTION_INTEGER, "array", 'a', &array_size},
+        { FDB_OPTION_INTEGER, "blob", 'b', &blob_size},
+        { FDB_OPTION_BOOLEAN, "help", 'h', &help}
+    };
+    fdb_parse_options(core_options, ARRAY_LENGTH(core_options), &argc, argv);
+
+    if (help)
+    {
+        std::cout << "Usage: fdbserializebench[ -n iterations][ -c cars][ -a array size][ -b blob size]" << std::endl;
+        std::cout << "    -n iterations: number of times each object is serialized" << std::endl;
+        std::cout << "    -c cars: number of cars owned by the person" << std::endl;
+        std::cout << "    -a array size: number of integers in the array" << std::endl;
+        std::cout << "    -b blob size: size in kB of the blob to deserialize" << std::endl;
+        exit(0);
+    }
+    if (!iterations)
+    {
+        iterations = 1;
+    }
+
+    CLegacyHeader legacy_header;
+    legacy_header.mType = FDB_MT_BROADCAST;
+    legacy_header.mSn = 12345;
+    legacy_header.mCode = 100;
+    legacy_header.mFlag = 0x1000;
+    legacy_header.mObjId = 3;
+    legacy_header.mPayloadSize = 1024;
+    legacy_header.mQOS = FDB_QOS_RELIABLE;
+    legacy_header.mOptions = (1 << 1) | (1 << 2);
+    legacy_header.mFilter = "filter";
+    legacy_header.mSendArriveTime = 1234567890123ULL;
+
+    NFdbBase::CFdbMessageHeader header;
+    header.set_type(FDB_MT_BROADCAST);
+    header.set_serial_number(12345);
+    header.set_code(100);
+    header.set_flag(0x1000);
+    header.set_object_id(3);
+    header.set_payload_size(1024);
+    header.qos(FDB_QOS_RELIABLE);
+    header.set_broadcast_filter("filter");
+    header.set_send_or_arrive_time(1234567890123ULL);
+    compare("CFdbMessageHeader", legacy_header, header, iterations);
+    compareHead(header, iterations);
+
+    CLegacyPerson legacy_person;
+    fillPerson<CLegacyPerson, CLegacyCar>(legacy_person, nr_cars);
+    CPerson person;
+    fillPerson<CPerson, CCar>(person, nr_cars);
+    compare("CPerson", legacy_person, person, iterations);
+
+    CLegacyIntArray legacy_array;
+    CIntArray array;
+    for (uint32_t i = 0; i < array_size; ++i)
+    {
+        legacy_array.mPool.push_back((int32_t)i);
+        array.mArray.Add((int32_t)i);
+    }
+    compare("int32 array", legacy_array, array, iterations / 10 + 1);
+
+    compareBlob((int32_t)blob_size * 1024, iterations / 1000 + 1);
+
+    return 0;
+}
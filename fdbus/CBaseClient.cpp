@@ -19,9 +19,29 @@
 #include <common_base/CBaseSocketFactory.h>
 #include <common_base/CFdbSession.h>
 #include <utils/CFdbIfMessageHeader.h>
+#include "CIntraNameProxy.h"
 #include <utils/Log.h>
 
-#define FDB_CLIENT_RECONNECT_WAIT_MS    1
+CClientSocket::CConnectWatch::CConnectWatch(CClientSocket *socket, int fd)
+    : CBaseFdWatch(fd, POLLOUT)
+    , mSocket(socket)
+{
+}
+
+void CClientSocket::CConnectWatch::onOutput()
+{
+    mSocket->completeConnect();
+}
+
+void CClientSocket::CConnectWatch::onHup()
+{
+    mSocket->completeConnect();
+}
+
+void CClientSocket::CConnectWatch::onError()
+{
+    mSocket->completeConnect();
+}
 
 CClientSocket::CClientSocket(CBaseClient *owner
                              , FdbSocketId_t skid
@@ -30,13 +50,20 @@ CClientSocket::CClientSocket(CBaseClient *owner
                              , int32_t udp_port)
     : CFdbSessionContainer(skid, owner, socket, udp_port)
     , mConnectedHost(host_name ? host_name : "")
+    , mConnecting(false)
+    , mConnectRetries(0)
+    , mConnectInterval(FDB_ADDRESS_CONNECT_RETRY_INTERVAL)
+    , mConnectWatch(0)
+    , mConnectTimer(FDB_ADDRESS_CONNECT_TIMEOUT, false, this, &CClientSocket::onConnectTimer)
 {
+    mConnectTimer.attach(owner->context(), false);
 }
 
 CClientSocket::~CClientSocket()
 {
     // so that onSessionDeleted() will not be called upon session destroy
     enableSessionDestroyHook(false);
+    dropConnectWatch();
 }
 
 CFdbSession *CClientSocket::connect()
@@ -64,6 +91,133 @@ CFdbSession *CClientSocket::connect()
     return session;
 }
 
+CFdbSession *CClientSocket::startConnect()
+{
+    mConnecting = true;
+    mConnectRetries = 0;
+    mConnectInterval = FDB_ADDRESS_CONNECT_RETRY_INTERVAL;
+    auto session = tryConnect();
+    if (session)
+    {
+        mConnecting = false;
+    }
+    return session;
+}
+
+// one attempt of connect; return the session if connected at once
+CFdbSession *CClientSocket::tryConnect()
+{
+    auto socket = fdb_dynamic_cast_if_available<CClientSocketImp *>(mSocket);
+    bool blocking_mode = (mSocket->getAddress().mType == FDB_SOCKET_IPC) ?
+                          mOwner->enableIpcBlockingMode() : mOwner->enableTcpBlockingMode();
+    CSocketImp *sock_imp = 0;
+    mConnectRetries++;
+    auto ret = socket->startConnect(blocking_mode);
+    if (ret > 0)
+    {
+        mConnectWatch = new CConnectWatch(this, socket->getFd());
+        mConnectWatch->attach(mOwner->context());
+        mConnectTimer.enableOneShot(FDB_ADDRESS_CONNECT_TIMEOUT);
+        return 0;
+    }
+    if (ret == 0)
+    {
+        sock_imp = socket->finishConnect();
+    }
+    if (sock_imp)
+    {
+        return new CFdbSession(FDB_INVALID_ID, this, sock_imp);
+    }
+    retryConnect();
+    return 0;
+}
+
+void CClientSocket::retryConnect()
+{
+    if (mConnectRetries >= FDB_ADDRESS_CONNECT_RETRY_NR)
+    {
+        mConnecting = false;
+        return;
+    }
+    mConnectTimer.enableOneShot(mConnectInterval);
+    mConnectInterval *= 2;
+    if (mConnectInterval > FDB_ADDRESS_CONNECT_MAX_INTERVAL)
+    {
+        mConnectInterval = FDB_ADDRESS_CONNECT_MAX_INTERVAL;
+    }
+}
+
+void CClientSocket::completeConnect()
+{
+    mConnectTimer.disable();
+    dropConnectWatch();
+    auto socket = fdb_dynamic_cast_if_available<CClientSocketImp *>(mSocket);
+    auto sock_imp = socket->finishConnect();
+    CFdbSession *session = 0;
+    if (sock_imp)
+    {
+        session = new CFdbSession(FDB_INVALID_ID, this, sock_imp);
+    }
+    else
+    {
+        retryConnect();
+    }
+    onConnectDone(session);
+}
+
+void CClientSocket::onConnectTimer(CMethodLoopTimer<CClientSocket> *timer)
+{
+    if (mConnectWatch)
+    {
+        // connect in progress takes too long
+        dropConnectWatch();
+        auto socket = fdb_dynamic_cast_if_available<CClientSocketImp *>(mSocket);
+        socket->cancelConnect();
+        retryConnect();
+        onConnectDone(0);
+    }
+    else
+    {
+        onConnectDone(tryConnect());
+    }
+}
+
+void CClientSocket::onConnectDone(CFdbSession *session)
+{
+    auto client = fdb_dynamic_cast_if_available<CBaseClient *>(mOwner);
+    if (session)
+    {
+        mConnecting = false;
+        // this might be deleted if session can not be set up
+        if (client->setupSession(this, session))
+        {
+            auto name_proxy = FDB_CONTEXT->getNameProxy();
+            if (name_proxy)
+            {
+                name_proxy->onServerConnected(client, this);
+            }
+        }
+    }
+    else if (!mConnecting)
+    {
+        LOG_E("CClientSocket: fail to connect to %s@%s!\n", client->nsName().c_str(),
+              mSocket->getAddress().mUrl.c_str());
+        client->deleteSocket(mSkid);
+    }
+}
+
+void CClientSocket::dropConnectWatch()
+{
+    if (mConnectWatch)
+    {
+        mConnectWatch->attach(0);
+        // fd is owned by the socket
+        mConnectWatch->descriptor(-1);
+        delete mConnectWatch;
+        mConnectWatch = 0;
+    }
+}
+
 void CClientSocket::disconnect()
 {
     if (mSocket)
@@ -87,11 +241,12 @@ void CClientSocket::onSessionDeleted(CFdbSession *session)
         // always connect to server
         if (!client->requestServiceAddress())
         {
-            if (FDB_CLIENT_RECONNECT_WAIT_MS)
+            auto sk = client->doConnect(url.c_str());
+            if (sk && sk->connecting())
             {
-                sysdep_sleep(FDB_CLIENT_RECONNECT_WAIT_MS);
+                LOG_E("CClientSocket: shutdown and reconnecting to %s@%s...\n", client->nsName().c_str(), url.c_str());
             }
-            if (client->doConnect(url.c_str()))
+            else if (sk)
             {
                 LOG_E("CClientSocket: shutdown but reconnected to %s@%s.\n", client->nsName().c_str(), url.c_str());
             }
@@ -167,7 +322,12 @@ void CBaseClient::cbConnect(CBaseWorker *worker, CMethodJob<CBaseClient> *job, C
     }
 
     auto sk = doConnect(url);
-    if (sk)
+    if (sk && sk->connecting())
+    {
+        // onOnline() tells when it is connected
+        the_job->mSid = FDB_INVALID_ID;
+    }
+    else if (sk)
     {
         CFdbSession *session = sk->getDefaultSession();
         if (session)
@@ -227,6 +387,12 @@ CClientSocket *CBaseClient::doConnect(const char *url, const char *host_name, in
         return fdb_dynamic_cast_if_available<CClientSocket *>(session->container());
     }
 
+    auto pending = pendingSocket(addr);
+    if (pending)
+    {
+        return pending;
+    }
+
     if (connected())
     {
         doDisconnect();
@@ -239,32 +405,79 @@ CClientSocket *CBaseClient::doConnect(const char *url, const char *host_name, in
         auto sk = new CClientSocket(this, skid, client_imp, host_name, udp_port);
         addSocket(sk);
 
-        auto session = sk->connect();
-        if (session)
+        CFdbSession *session;
+        if (enableAsyncConnect())
         {
-            registerSession(session);
-            session->attach(mContext);
-            if (addConnectedSession(sk, session))
+            session = sk->startConnect();
+            if (!session && sk->connecting())
             {
-                activateReconnect(true);
+                // setupSession() is called once connected
                 return sk;
             }
-            else
-            {
-                delete session;
-                deleteSocket(skid);
-                return 0;
-            }
         }
         else
         {
-            deleteSocket(skid);
+            session = sk->connect();
         }
+
+        if (session)
+        {
+            return setupSession(sk, session) ? sk : 0;
+        }
+        deleteSocket(skid);
     }
 
     return 0;
 }
 
+bool CBaseClient::setupSession(CClientSocket *sk, CFdbSession *session)
+{
+    if (!registerSession(session))
+    {
+        delete session;
+        deleteSocket(sk->skid());
+        return false;
+    }
+    session->attach(mContext);
+    if (addConnectedSession(sk, session))
+    {
+        activateReconnect(true);
+        return true;
+    }
+    delete session;
+    deleteSocket(sk->skid());
+    return false;
+}
+
+// socket connecting to addr; connect to any other address is dropped
+CClientSocket *CBaseClient::pendingSocket(const CFdbSocketAddr &addr)
+{
+    CClientSocket *pending = 0;
+    std::vector<FdbSocketId_t> dropped;
+    auto &containers = getContainer();
+    for (auto it = containers.begin(); it != containers.end(); ++it)
+    {
+        auto sk = fdb_dynamic_cast_if_available<CClientSocket *>(it->second);
+        if (!sk || !sk->connecting())
+        {
+            continue;
+        }
+        if (!pending && !sk->getSocket()->getAddress().mUrl.compare(addr.mUrl))
+        {
+            pending = sk;
+        }
+        else
+        {
+            dropped.push_back(it->first);
+        }
+    }
+    for (auto it = dropped.begin(); it != dropped.end(); ++it)
+    {
+        deleteSocket(*it);
+    }
+    return pending;
+}
+
 class CDisconnectClientJob : public CMethodJob<CBaseClient>
 {
 public:
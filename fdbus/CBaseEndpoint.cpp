@@ -30,6 +30,10 @@ CBaseEndpoint::CBaseEndpoint(const char *name, CBaseWorker *worker, CFdbBaseCont
     , mSnAllocator(1)
     , mEpid(FDB_INVALID_ID)
     , mEventRouter(this)
+    , mUDPBatchSize(FDB_UDP_DEFAULT_BATCH_SIZE)
+    , mOutputHighMark(0)
+    , mOutputLowMark(0)
+    , mBackpressurePolicy(FDB_BP_DROP_NEWEST)
 {
     autoRemove(false);
     mContext = context ? context : FDB_CONTEXT;
@@ -42,7 +46,7 @@ CBaseEndpoint::CBaseEndpoint(const char *name, CBaseWorker *worker, CFdbBaseCont
 
 CBaseEndpoint::~CBaseEndpoint()
 {
-    if (!mSessionContainer.getContainer().empty())
+    if (!mSessionContainer.empty())
     {
         LOG_E("~CBaseEndpoint: Unable to destroy context since there are active sessions!\n");
     }
@@ -280,6 +284,61 @@ void CBaseEndpoint::kickOut(FdbSessionId_t sid)
     mContext->sendAsyncEndeavor(new CKickOutSessionJob(this, sid));
 }
 
+void CBaseEndpoint::setOutputWatermark(int32_t high_mark, int32_t low_mark,
+                                       EFdbBackpressurePolicy policy)
+{
+    if (high_mark < 0)
+    {
+        high_mark = 0;
+    }
+    if ((low_mark <= 0) || (low_mark > high_mark))
+    {
+        low_mark = high_mark / 2;
+    }
+    mOutputHighMark = high_mark;
+    mOutputLowMark = low_mark;
+    mBackpressurePolicy = policy;
+}
+
+class CFlowStatisticsJob : public CMethodJob<CBaseEndpoint>
+{
+public:
+    CFlowStatisticsJob(CBaseEndpoint *object, FdbSessionId_t sid, CFdbFlowStatistics &stats)
+        : CMethodJob<CBaseEndpoint>(object, &CBaseEndpoint::callGetFlowStatistics, JOB_FORCE_RUN)
+        , mSid(sid)
+        , mStats(stats)
+        , mFound(false)
+    {
+    }
+
+    FdbSessionId_t mSid;
+    CFdbFlowStatistics &mStats;
+    bool mFound;
+};
+
+void CBaseEndpoint::callGetFlowStatistics(CBaseWorker *worker,
+                CMethodJob<CBaseEndpoint> *job, CBaseJob::Ptr &ref)
+{
+    auto the_job = fdb_dynamic_cast_if_available<CFlowStatisticsJob *>(job);
+    auto session = getSession(the_job->mSid);
+    if (session)
+    {
+        session->getFlowStatistics(the_job->mStats);
+        the_job->mFound = true;
+    }
+}
+
+bool CBaseEndpoint::getFlowStatistics(FdbSessionId_t sid, CFdbFlowStatistics &stats)
+{
+    auto job = new CFlowStatisticsJob(this, sid, stats);
+    CBaseJob::Ptr ref(job);
+    if (!mContext->sendSyncEndeavor(ref))
+    {
+        return false;
+    }
+    return job->mFound;
+}
+
 CFdbBaseObject *CBaseEndpoint::getObject(CFdbMessage *msg, bool server_only)
 {
     auto obj_id = msg->objectId();
@@ -633,6 +692,8 @@ void CBaseEndpoint::onSidebandInvoke(CBaseJob::Ptr &msg_ref)
             }
             session->senderName(sinfo.sender_name().c_str());
             session->pid((CBASE_tProcId)sinfo.pid());
+            session->compactHead(sinfo.compact_head() && enableCompactHead());
+            session->udpFragment(sinfo.udp_fragment());
             std::string peer_ip;
             int32_t udp_port = FDB_INET_PORT_INVALID;
             if (sinfo.has_udp_port())
@@ -685,6 +746,11 @@ void CBaseEndpoint::updateSessionInfo(CFdbSession *session)
     NFdbBase::FdbSessionInfo sinfo_sent;
     sinfo_sent.set_sender_name(mName.c_str());
     sinfo_sent.set_pid((uint32_t)CBaseThread::getPid());
+    if (enableCompactHead())
+    {
+        sinfo_sent.set_compact_head();
+    }
+    sinfo_sent.set_udp_fragment();
     if (FDB_VALID_PORT(udp_port))
     {
         sinfo_sent.set_udp_port(udp_port);
@@ -780,34 +846,32 @@ void CBaseEndpoint::onPublish(CBaseJob::Ptr &msg_ref)
     mEventRouter.routeMessage(msg_ref);
 }
 
-void CBaseEndpoint::registerSession(CFdbSession *session)
+bool CBaseEndpoint::registerSession(CFdbSession *session)
 {
-    auto sid = mSessionContainer.allocateEntityId();
+    auto sid = mSessionContainer.insertEntry(session);
+    if (!fdbValidFdbId(sid))
+    {
+        LOG_E("CBaseEndpoint: too many sessions at %s!\n", name().c_str());
+        return false;
+    }
     session->sid(sid);
-    mSessionContainer.insertEntry(sid, session);
+    return true;
 }
 
 CFdbSession *CBaseEndpoint::getSession(FdbSessionId_t session_id)
 {
-    CFdbSession *session = 0;
-    mSessionContainer.retrieveEntry(session_id, session);
-    return session;
+    auto entry = mSessionContainer.retrieveEntry(session_id);
+    return entry ? *entry : 0;
 }
 
 void CBaseEndpoint::unregisterSession(FdbSessionId_t session_id)
 {
-    CFdbSession *session = 0;
-    auto it = mSessionContainer.retrieveEntry(session_id, session);
-    if (session)
-    {
-        mSessionContainer.deleteEntry(it);
-    }
+    mSessionContainer.deleteEntry(session_id);
 }
 
 void CBaseEndpoint::deleteSession(FdbSessionId_t session_id)
 {
-    CFdbSession *session = 0;
-    (void)mSessionContainer.retrieveEntry(session_id, session);
+    auto session = getSession(session_id);
     if (session)
     {
         delete session;
@@ -816,10 +880,9 @@ void CBaseEndpoint::deleteSession(FdbSessionId_t session_id)
 
 void CBaseEndpoint::deleteSession(CFdbSessionContainer *container)
 {
-    auto &session_tbl = mSessionContainer.getContainer();
-    for (auto it = session_tbl.begin(); it != session_tbl.end();)
+    for (auto it = mSessionContainer.begin(); it != mSessionContainer.end();)
     {
-        CFdbSession *session = it->second;
+        CFdbSession *session = *it;
         ++it;
         if (session->container() == container)
         {
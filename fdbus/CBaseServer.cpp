@@ -44,8 +44,17 @@ void CServerSocket::onInput()
     if (sock_imp)
     {
         auto session = new CFdbSession(FDB_INVALID_ID, this, sock_imp);
-        mOwner->registerSession(session);
-        session->attach(worker());
+        if (!mOwner->registerSession(session))
+        {
+            // closes the accepted connection
+            delete session;
+            return;
+        }
+        auto io_worker = mOwner->context()->ioWorker(session->sid());
+        if (!io_worker || !session->attachIoWorker(io_worker))
+        {
+            session->attach(worker());
+        }
         if (!mOwner->addConnectedSession(this, session))
         {
             delete session;
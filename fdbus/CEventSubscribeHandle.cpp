@@ -16,7 +16,132 @@
 
 #include <common_base/CEventSubscribeHandle.h>
 #include <common_base/CFdbSession.h>
+#include <common_base/CFdbSessionContainer.h>
 #include <common_base/CFdbMessage.h>
+#include <utility>
+
+CEventSubscribeHandle::CEventSubscribeHandle()
+    : mScanDepth(0)
+{
+    // filter "" is always interned as mAnyTopic and never released
+    CTopic any_topic;
+    any_topic.mRefCount = 1;
+    mTopics.push_back(any_topic);
+    mTopicIds[""] = mAnyTopic;
+}
+
+uint32_t CEventSubscribeHandle::internTopic(const char *filter)
+{
+    if (!filter || (filter[0] == '\0'))
+    {
+        return mAnyTopic;
+    }
+    auto it = mTopicIds.find(filter);
+    if (it != mTopicIds.end())
+    {
+        mTopics[it->second].mRefCount++;
+        return it->second;
+    }
+
+    uint32_t topic;
+    if (mFreeTopics.empty())
+    {
+        topic = (uint32_t)mTopics.size();
+        mTopics.push_back(CTopic());
+    }
+    else
+    {
+        topic = mFreeTopics.back();
+        mFreeTopics.pop_back();
+    }
+    mTopics[topic].mName = filter;
+    mTopics[topic].mRefCount = 1;
+    mTopicIds[filter] = topic;
+    return topic;
+}
+
+void CEventSubscribeHandle::releaseTopic(uint32_t topic)
+{
+    if (topic == mAnyTopic)
+    {
+        return;
+    }
+    auto &the_topic = mTopics[topic];
+    if (--the_topic.mRefCount == 0)
+    {
+        mTopicIds.erase(the_topic.mName);
+        the_topic.mName.clear();
+        mFreeTopics.push_back(topic);
+    }
+}
+
+uint32_t CEventSubscribeHandle::findTopic(const char *filter) const
+{
+    if (!filter || (filter[0] == '\0'))
+    {
+        return mAnyTopic;
+    }
+    auto it = mTopicIds.find(filter);
+    return (it == mTopicIds.end()) ? mInvalidTopic : it->second;
+}
+
+CEventSubscribeHandle::tSubscriberTbl *CEventSubscribeHandle::findSubscribers(FdbMsgCode_t event)
+{
+    auto it = mEventTable.find(event);
+    return (it == mEventTable.end()) ? 0 : &it->second;
+}
+
+void CEventSubscribeHandle::dropEmptyEvent(FdbMsgCode_t event)
+{
+    if (mScanDepth)
+    {
+        // broadcast() is still walking the table; it is dropped next time
+        return;
+    }
+    auto it = mEventTable.find(event);
+    if ((it != mEventTable.end()) && it->second.empty())
+    {
+        mEventTable.erase(it);
+    }
+}
+
+/*
+ * Remove subscriber at index by moving the last one into the hole, and do
+ * the same for its back reference in session table. Empty tables are not
+ * erased here since the caller might be walking them.
+ */
+void CEventSubscribeHandle::removeSubscriber(tSubscriberTbl &subscribers, uint32_t index)
+{
+    auto session = subscribers[index].mSession;
+    auto slot = subscribers[index].mSessionSlot;
+    releaseTopic(subscribers[index].mTopic);
+
+    auto it_refs = mSessionTable.find(session);
+    if (it_refs != mSessionTable.end())
+    {
+        auto &refs = it_refs->second;
+        if (slot != (refs.size() - 1))
+        {
+            refs[slot] = refs.back();
+            auto &moved_ref = refs[slot];
+            (*moved_ref.mSubscribers)[moved_ref.mIndex].mSessionSlot = slot;
+        }
+        refs.pop_back();
+    }
+
+    auto last = (uint32_t)(subscribers.size() - 1);
+    if (index != last)
+    {
+        subscribers[index] = subscribers[last];
+        auto &moved = subscribers[index];
+        auto it_moved_refs = mSessionTable.find(moved.mSession);
+        if (it_moved_refs != mSessionTable.end())
+        {
+            it_moved_refs->second[moved.mSessionSlot].mIndex = index;
+        }
+    }
+    subscribers.pop_back();
+}
 
 void CEventSubscribeHandle::subscribe(CFdbSession *session,
                                FdbMsgCode_t msg,
@@ -24,12 +149,38 @@ void CEventSubscribeHandle::subscribe(CFdbSession *session,
                                const char *filter,
                                CFdbSubscribeType type)
 {
-    if (!filter)
+    auto topic = internTopic(filter);
+    auto &subscribers = mEventTable[msg];
+    auto &refs = mSessionTable[session];
+    for (auto it = refs.begin(); it != refs.end(); ++it)
     {
-        filter = "";
+        if (it->mSubscribers == &subscribers)
+        {
+            auto &subscriber = subscribers[it->mIndex];
+            if ((subscriber.mObjId == obj_id) && (subscriber.mTopic == topic))
+            {
+                // already subscribed: only type is updated
+                subscriber.mType = type;
+                releaseTopic(topic);
+                return;
+            }
+        }
     }
-    auto &subitem = mEventSubscribeTable[msg][session][obj_id][filter];
-    subitem.mType = type;
+
+    CSubscriber subscriber;
+    subscriber.mSession = session;
+    subscriber.mObjId = obj_id;
+    subscriber.mTopic = topic;
+    subscriber.mType = type;
+    subscriber.mSessionSlot = (uint32_t)refs.size();
+
+    CSubscriberRef ref;
+    ref.mEvent = msg;
+    ref.mSubscribers = &subscribers;
+    ref.mIndex = (uint32_t)subscribers.size();
+
+    subscribers.push_back(subscriber);
+    refs.push_back(ref);
 }
 
 void CEventSubscribeHandle::unsubscribe(CFdbSession *session,
@@ -37,271 +188,278 @@ void CEventSubscribeHandle::unsubscribe(CFdbSession *session,
                                  FdbObjectId_t obj_id,
                                  const char *filter)
 {
-    SubscribeTable_t &subscribe_table = mEventSubscribeTable;
-    
-    auto it_sessions = subscribe_table.find(msg);
-    if (it_sessions != subscribe_table.end())
-    {
-        auto &sessions = it_sessions->second;
-        auto it_objects = sessions.find(session);
-        if (it_objects != sessions.end())
+    auto it_refs = mSessionTable.find(session);
+    auto subscribers = findSubscribers(msg);
+    if ((it_refs == mSessionTable.end()) || !subscribers)
+    {
+        return;
+    }
+    // null filter removes subscribers of all filters
+    auto topic = filter ? findTopic(filter) : mInvalidTopic;
+    if (filter && (topic == mInvalidTopic))
+    {
+        return;
+    }
+
+    auto &refs = it_refs->second;
+    // walk backward since removal moves the last reference to the hole
+    for (int32_t i = (int32_t)refs.size() - 1; i >= 0; --i)
+    {
+        auto &ref = refs[i];
+        if (ref.mSubscribers != subscribers)
         {
-            auto &objects = it_objects->second;
-            auto it_subitems = objects.find(obj_id);
-            if (it_subitems != objects.end())
-            {
-                if (filter)
-                {
-                    auto &subitems = it_subitems->second;
-                    auto it_subitem = subitems.find(filter);
-                    if (it_subitem != subitems.end())
-                    {
-                        subitems.erase(it_subitem);
-                    }
-                    if (subitems.empty())
-                    {
-                        objects.erase(it_subitems);
-                    }
-                }
-                else
-                {
-                    objects.erase(it_subitems);
-                }
-            }
-            if (objects.empty())
-            {
-                sessions.erase(it_objects);
-            }
+            continue;
         }
-        if (sessions.empty())
+        auto &subscriber = (*subscribers)[ref.mIndex];
+        if ((subscriber.mObjId == obj_id) && (!filter || (subscriber.mTopic == topic)))
         {
-            subscribe_table.erase(it_sessions);
+            removeSubscriber(*subscribers, ref.mIndex);
         }
     }
+
+    if (refs.empty())
+    {
+        mSessionTable.erase(it_refs);
+    }
+    dropEmptyEvent(msg);
 }
 
 void CEventSubscribeHandle::unsubscribe(CFdbSession *session)
 {
-    SubscribeTable_t &subscribe_table = mEventSubscribeTable;
-
-    for (auto it_sessions = subscribe_table.begin();
-            it_sessions != subscribe_table.end();)
+    auto it_refs = mSessionTable.find(session);
+    if (it_refs == mSessionTable.end())
     {
-        auto the_it_sessions = it_sessions;
-        ++it_sessions;
+        return;
+    }
 
-        auto &sessions = the_it_sessions->second;
-        auto it_objects = sessions.find(session);
-        if (it_objects != sessions.end())
-        {
-            sessions.erase(it_objects);
-        }
-        if (sessions.empty())
-        {
-            subscribe_table.erase(the_it_sessions);
-        }
+    auto &refs = it_refs->second;
+    while (!refs.empty())
+    {
+        auto ref = refs.back();
+        removeSubscriber(*ref.mSubscribers, ref.mIndex);
+        dropEmptyEvent(ref.mEvent);
     }
+    mSessionTable.erase(it_refs);
 }
 
 void CEventSubscribeHandle::unsubscribe(FdbObjectId_t obj_id)
 {
-    SubscribeTable_t &subscribe_table = mEventSubscribeTable;
-
-    for (auto it_sessions = subscribe_table.begin();
-            it_sessions != subscribe_table.end();)
+    for (auto it_event = mEventTable.begin(); it_event != mEventTable.end();)
     {
-        auto the_it_sessions = it_sessions;
-        ++it_sessions;
-
-        auto &sessions = the_it_sessions->second;
-        for (auto it_objects = sessions.begin();
-                it_objects != sessions.end();)
+        auto &subscribers = it_event->second;
+        for (uint32_t i = 0; i < subscribers.size();)
         {
-            auto the_it_objects = it_objects;
-            ++it_objects;
-
-            auto &objects = the_it_objects->second;
-            auto it_subitems = objects.find(obj_id);
-            if (it_subitems != objects.end())
+            if (subscribers[i].mObjId == obj_id)
             {
-                objects.erase(it_subitems);
+                removeSubscriber(subscribers, i);
             }
-            if (objects.empty())
+            else
             {
-                sessions.erase(the_it_objects);
+                ++i;
             }
         }
-        if (sessions.empty())
+        if (subscribers.empty() && !mScanDepth)
+        {
+            it_event = mEventTable.erase(it_event);
+        }
+        else
         {
-            subscribe_table.erase(the_it_sessions);
+            ++it_event;
+        }
+    }
+
+    for (auto it_refs = mSessionTable.begin(); it_refs != mSessionTable.end();)
+    {
+        if (it_refs->second.empty())
+        {
+            it_refs = mSessionTable.erase(it_refs);
+        }
+        else
+        {
+            ++it_refs;
         }
     }
 }
 
 void CEventSubscribeHandle::broadcastOneMsg(CFdbSession *session,
                                      CFdbMessage *msg,
-                                     CSubscribeItem &sub_item)
+                                     CSubscriber &sub_item,
+                                     bool batch_udp)
 {
     if ((sub_item.mType == FDB_SUB_TYPE_NORMAL) || msg->manualUpdate())
     {
-        if ((msg->qos() == FDB_QOS_RELIABLE) || !session->sendUDPMessage(msg))
+        if ((msg->qos() == FDB_QOS_RELIABLE) || !session->sendUDPMessage(msg, batch_udp))
         {
             session->sendMessage(msg);
         }
+        else if (batch_udp)
+        {
+            auto container = session->container();
+            for (auto it = mUDPBatches.begin(); it != mUDPBatches.end(); ++it)
+            {
+                if (*it == container)
+                {
+                    return;
+                }
+            }
+            mUDPBatches.push_back(container);
+        }
     }
 }
 
-void CEventSubscribeHandle::broadcast(CFdbMessage *msg, FdbMsgCode_t event)
+void CEventSubscribeHandle::flushUDPBatches()
 {
-    SubscribeTable_t &subscribe_table = mEventSubscribeTable;
+    for (auto it = mUDPBatches.begin(); it != mUDPBatches.end(); ++it)
+    {
+        (*it)->flushUDPBatch();
+    }
+    mUDPBatches.clear();
+}
 
-    auto it_sessions = subscribe_table.find(event);
-    if (it_sessions != subscribe_table.end())
+void CEventSubscribeHandle::broadcast(CFdbMessage *msg, FdbMsgCode_t event)
+{
+    auto subscribers = findSubscribers(event);
+    if (!subscribers)
+    {
+        return;
+    }
+    // topic not interned by anyone only matches filter ""
+    auto topic = findTopic(msg->topic().c_str());
+    /*
+     * Sending might dispatch input and change subscribers, so index rather
+     * than iterator is used and the subscriber is copied before sending.
+     */
+    mScanDepth++;
+    for (uint32_t i = 0; i < subscribers->size(); ++i)
     {
-        auto filter = msg->topic().c_str();
-        auto &sessions = it_sessions->second;
-        for (auto it_objects = sessions.begin();
-                it_objects != sessions.end(); ++it_objects)
+        auto subscriber = (*subscribers)[i];
+        /*
+         * If filter doesn't match, check who registers filter "".
+         * It represents any filter.
+         */
+        if ((subscriber.mTopic == topic) ||
+                ((subscriber.mTopic == mAnyTopic) && (topic != mAnyTopic)))
         {
-            auto session = it_objects->first;
-            auto &objects = it_objects->second;
-            for (auto it_subitems = objects.begin();
-                    it_subitems != objects.end(); ++it_subitems)
+            /*
+             * Head is built in encoding of the first subscriber and only
+             * object id is patched for the rest; if pending output still
+             * holds the head, a copy of the head is patched and payload is
+             * shared rather than copied.
+             */
+            if (!msg->patchObjectId(subscriber.mObjId))
             {
-                auto object_id = it_subitems->first;
-                msg->updateObjectId(object_id); // send to the specific object.
-                auto &subitems = it_subitems->second;
-                auto it_subitem = subitems.find(filter);
-                if (it_subitem != subitems.end())
-                {
-                    broadcastOneMsg(session, msg, it_subitem->second);
-                }
-                /*
-                 * If filter doesn't match, check who registers filter "".
-                 * It represents any filter.
-                 */
-                if (filter[0] != '\0')
-                {
-                    auto it_subitem = subitems.find("");
-                    if (it_subitem != subitems.end())
-                    {
-                        broadcastOneMsg(session, msg, it_subitem->second);
-                    }
-                }
+                msg->updateObjectId(subscriber.mObjId); // send to the specific object.
             }
+            broadcastOneMsg(subscriber.mSession, msg, subscriber, true);
         }
     }
+    mScanDepth--;
+    if (!mScanDepth)
+    {
+        // datagrams to all UDP subscribers go with a system call per batch
+        flushUDPBatches();
+    }
+    dropEmptyEvent(event);
 }
 
 bool CEventSubscribeHandle::broadcast(CFdbMessage *msg, CFdbSession *session, FdbMsgCode_t event)
 {
-    SubscribeTable_t &subscribe_table = mEventSubscribeTable;
+    auto subscribers = findSubscribers(event);
+    auto it_refs = mSessionTable.find(session);
+    if (!subscribers || (it_refs == mSessionTable.end()))
+    {
+        return false;
+    }
 
-    bool sent = false;
-    auto it_sessions = subscribe_table.find(event);
-    if (it_sessions != subscribe_table.end())
+    auto topic = findTopic(msg->topic().c_str());
+    auto obj_id = msg->objectId();
+    CSubscriber *exact_match = 0;
+    CSubscriber *any_match = 0;
+    auto &refs = it_refs->second;
+    for (auto it = refs.begin(); it != refs.end(); ++it)
     {
-        auto &sessions = it_sessions->second;
-        auto it_objects = sessions.find(session);
-        if (it_objects != sessions.end())
+        if (it->mSubscribers != subscribers)
         {
-            auto &objects = it_objects->second;
-            auto it_subitems = objects.find(msg->objectId());
-            if (it_subitems != objects.end())
-            {
-                auto filter = msg->topic().c_str();
-                auto &subitems = it_subitems->second;
-                auto it_subitem = subitems.find(filter);
-                if (it_subitem != subitems.end())
-                {
-                    broadcastOneMsg(session, msg, it_subitem->second);
-                    sent = true;
-                }
-                else if (filter[0] != '\0')
-                {
-                    auto it_subitem = subitems.find("");
-                    if (it_subitem != subitems.end())
-                    {
-                        broadcastOneMsg(session, msg, it_subitem->second);
-                        sent = true;
-                    }
-                }
-            }
+            continue;
+        }
+        auto &subscriber = (*subscribers)[it->mIndex];
+        if (subscriber.mObjId != obj_id)
+        {
+            continue;
+        }
+        if (subscriber.mTopic == topic)
+        {
+            exact_match = &subscriber;
+            break;
+        }
+        if (subscriber.mTopic == mAnyTopic)
+        {
+            any_match = &subscriber;
         }
     }
-    return sent;
+
+    auto matched = exact_match ? exact_match : any_match;
+    if (!matched)
+    {
+        return false;
+    }
+    auto subscriber = *matched;
+    broadcastOneMsg(session, msg, subscriber);
+    return true;
 }
 
-void CEventSubscribeHandle::getSubscribeTable(SessionTable_t &sessions, tFdbFilterSets &filter_tbl)
+void CEventSubscribeHandle::getSubscribeTable(const tSubscriberTbl &subscribers,
+                                              tFdbFilterSets &filter_tbl)
 {
-    for (auto it_objects = sessions.begin(); it_objects != sessions.end(); ++it_objects)
+    for (auto it = subscribers.begin(); it != subscribers.end(); ++it)
     {
-        auto &objects = it_objects->second;
-        for (auto it_subitems = objects.begin(); it_subitems != objects.end(); ++it_subitems)
+        if (it->mType == FDB_SUB_TYPE_NORMAL)
         {
-            auto &subitems = it_subitems->second;
-            for (auto it_subitem = subitems.begin(); it_subitem != subitems.end(); ++it_subitem)
-            {
-                auto &subitem = it_subitem->second;
-                if (subitem.mType == FDB_SUB_TYPE_NORMAL)
-                {
-                    filter_tbl.insert(it_subitem->first);
-                }
-            }
+            filter_tbl.insert(mTopics[it->mTopic].mName);
         }
     }
 }
 
 void CEventSubscribeHandle::getSubscribeTable(tFdbSubscribeMsgTbl &table)
 {
-    SubscribeTable_t &subscribe_table = mEventSubscribeTable;
-
-    for (auto it_sessions = subscribe_table.begin();
-            it_sessions != subscribe_table.end(); ++it_sessions)
+    for (auto it_event = mEventTable.begin(); it_event != mEventTable.end(); ++it_event)
     {
-        auto &filter_table = table[it_sessions->first];
-        auto &sessions = it_sessions->second;
-        getSubscribeTable(sessions, filter_table);
+        if (it_event->second.empty())
+        {
+            continue;
+        }
+        auto &filter_table = table[it_event->first];
+        getSubscribeTable(it_event->second, filter_table);
     }
 }
 
 void CEventSubscribeHandle::getSubscribeTable(FdbMsgCode_t code, tFdbFilterSets &filters)
 {
-    SubscribeTable_t &subscribe_table = mEventSubscribeTable;
-
-    auto it_sessions = subscribe_table.find(code);
-    if (it_sessions != subscribe_table.end())
+    auto subscribers = findSubscribers(code);
+    if (subscribers)
     {
-        auto &sessions = it_sessions->second;
-        getSubscribeTable(sessions, filters);
+        getSubscribeTable(*subscribers, filters);
     }
 }
 
 void CEventSubscribeHandle::getSubscribeTable(FdbMsgCode_t code, CFdbSession *session,
                                               tFdbFilterSets &filter_tbl)
 {
-    SubscribeTable_t &subscribe_table = mEventSubscribeTable;
-
-    auto it_sessions = subscribe_table.find(code);
-    if (it_sessions != subscribe_table.end())
+    auto subscribers = findSubscribers(code);
+    auto it_refs = mSessionTable.find(session);
+    if (!subscribers || (it_refs == mSessionTable.end()))
+    {
+        return;
+    }
+    auto &refs = it_refs->second;
+    for (auto it = refs.begin(); it != refs.end(); ++it)
     {
-        auto &sessions = it_sessions->second;
-        auto it_objects = sessions.find(session);
-        if (it_objects != sessions.end())
+        if (it->mSubscribers == subscribers)
         {
-            auto &objects = it_objects->second;
-            for (auto it_subitems = objects.begin();
-                    it_subitems != objects.end(); ++it_subitems)
+            auto &subscriber = (*subscribers)[it->mIndex];
+            if (subscriber.mType == FDB_SUB_TYPE_NORMAL)
             {
-                auto &subitems = it_subitems->second;
-                for (auto it_subitem = subitems.begin(); it_subitem != subitems.end(); ++it_subitem)
-                {
-                    auto &subitem = it_subitem->second;
-                    if (subitem.mType == FDB_SUB_TYPE_NORMAL)
-                    {
-                        filter_tbl.insert(it_subitem->first);
-                    }
-                }
+                filter_tbl.insert(mTopics[subscriber.mTopic].mName);
             }
         }
     }
@@ -310,57 +468,44 @@ void CEventSubscribeHandle::getSubscribeTable(FdbMsgCode_t code, CFdbSession *se
 void CEventSubscribeHandle::getSubscribeTable(FdbMsgCode_t code, const char *filter,
                                               tSubscribedSessionSets &session_tbl)
 {
-    SubscribeTable_t &subscribe_table = mEventSubscribeTable;
+    auto subscribers = findSubscribers(code);
+    if (!subscribers)
+    {
+        return;
+    }
+    auto topic = findTopic(filter);
 
-    auto it_sessions = subscribe_table.find(code);
-    if (it_sessions != subscribe_table.end())
+    /*
+     * Filter "" represents any filter, but only for objects which do not
+     * subscribe the filter itself.
+     */
+    std::set<std::pair<CFdbSession *, FdbObjectId_t> > exact_objects;
+    if (topic != mAnyTopic)
     {
-        if (!filter)
-        {
-            filter = "";
-        }
-        auto &sessions = it_sessions->second;
-        for (auto it_objects = sessions.begin();
-                it_objects != sessions.end(); ++it_objects)
+        for (auto it = subscribers->begin(); it != subscribers->end(); ++it)
         {
-            auto session = it_objects->first;
-            auto &objects = it_objects->second;
-            for (auto it_subitems = objects.begin();
-                    it_subitems != objects.end(); ++it_subitems)
+            if (it->mTopic == topic)
             {
-                auto &subitems = it_subitems->second;
-                auto it_subitem = subitems.find(filter);
-                if (it_subitem == subitems.end())
-                {
-                    /*
-                     * If filter doesn't match, check who registers filter "".
-                     * It represents any filter.
-                     */
-                    if (filter[0] != '\0')
-                    {
-                        auto it_subitem = subitems.find("");
-                        if (it_subitem != subitems.end())
-                        {
-                            auto &subitem = it_subitem->second;
-                            if (subitem.mType == FDB_SUB_TYPE_NORMAL)
-                            {
-                                session_tbl.insert(session);
-                                break;
-                            }
-                        }
-                    }
-                }
-                else
-                {
-                    auto &subitem = it_subitem->second;
-                    if (subitem.mType == FDB_SUB_TYPE_NORMAL)
-                    {
-                        session_tbl.insert(session);
-                        break;
-                    }
-                }
+                exact_objects.insert(std::make_pair(it->mSession, it->mObjId));
             }
         }
     }
-}
 
+    for (auto it = subscribers->begin(); it != subscribers->end(); ++it)
+    {
+        if (it->mType != FDB_SUB_TYPE_NORMAL)
+        {
+            continue;
+        }
+        if (it->mTopic == topic)
+        {
+            session_tbl.insert(it->mSession);
+        }
+        else if ((topic != mAnyTopic) && (it->mTopic == mAnyTopic) &&
+                 (exact_objects.find(std::make_pair(it->mSession, it->mObjId)) ==
+                  exact_objects.end()))
+        {
+            session_tbl.insert(it->mSession);
+        }
+    }
+}
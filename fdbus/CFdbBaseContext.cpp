@@ -18,12 +18,14 @@
 #include <common_base/CFdbContext.h>
 #include <common_base/CBaseEndpoint.h>
 #include <common_base/CFdbSession.h>
+#include <common_base/CFdbBufferPool.h>
 #include <utils/Log.h>
 #include <iostream>
 
 CFdbBaseContext::CFdbBaseContext(const char *worker_name)
     : CBaseWorker(worker_name)
     , mCtxId(FDB_INVALID_ID)
+    , mBufferPool(new CFdbBufferPool())
 {
 
 }
@@ -55,6 +57,36 @@ CFdbBaseContext::~CFdbBaseContext()
     {
         std::cout << "CFdbBaseContext: Unable to destroy context since there are active endpoint!" << std::endl;
     }
+    for (auto it = mIoWorkers.begin(); it != mIoWorkers.end(); ++it)
+    {
+        (*it)->exit();
+        (*it)->join();
+        delete *it;
+    }
+    // buffers held by messages are still valid until released
+    mBufferPool->destroy();
+}
+
+bool CFdbBaseContext::enableIoWorkers(uint32_t nr_workers)
+{
+    if (!mIoWorkers.empty())
+    {
+        LOG_E("CFdbBaseContext: I/O workers are already enabled!\n");
+        return false;
+    }
+    for (uint32_t i = 0; i < nr_workers; ++i)
+    {
+        auto worker_name = name() + "-io" + std::to_string(i);
+        auto io_worker = new CFdbBaseContext(worker_name.c_str());
+        if (!io_worker->start())
+        {
+            LOG_E("CFdbBaseContext: Unable to start I/O worker %s!\n", worker_name.c_str());
+            delete io_worker;
+            break;
+        }
+        mIoWorkers.push_back(io_worker);
+    }
+    return mIoWorkers.size() == nr_workers;
 }
 
 CBaseEndpoint *CFdbBaseContext::getEndpoint(FdbEndpointId_t endpoint_id)
@@ -1639,7 +1639,7 @@ bool CFdbBaseObject::registerEventHandle(const CFdbEventDispatcher::CEvtHandleTb
     mEvtDispather.registerCallback(evt_tbl, &handle_tbl);
     if (reg_handle)
     {
-        reg_handle->insert(reg_handle->end(), handle_tbl.begin(), handle_tbl.end());
+        reg_handle->insert(handle_tbl.begin(), handle_tbl.end());
     }
 
     if (mEndpoint->connected())
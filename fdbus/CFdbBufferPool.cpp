@@ -0,0 +1,283 @@
+/*
+ * Copyright (C) 2015   Jeremy Chen jeremy_cz@yahoo.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <common_base/CFdbBufferPool.h>
+#include <utils/Log.h>
+#ifndef __WIN32__
+#include <sys/mman.h>
+#endif
+
+#define FDB_POOL_BIG_CLASS          -1
+// big buffers are rounded up to the size
+#define FDB_POOL_BIG_ALIGN          (64 * 1024)
+// big buffers not less than the size are backed by huge pages
+#define FDB_POOL_HUGE_PAGE_SIZE     (2 * 1024 * 1024)
+
+#define fdbPoolClassSize(_cls) (1 << (FDB_POOL_MIN_BLOCK_SHIFT + (_cls)))
+#define fdbPoolRoundUp(_size, _align) ((((_size) + (_align) - 1) / (_align)) * (_align))
+
+CFdbBufferPool::CFdbBufferPool()
+    : mBigHits(0)
+    , mBigMisses(0)
+    , mRefCount(1)
+{
+    for (int32_t i = 0; i < FDB_POOL_NR_SMALL_CLASSES; ++i)
+    {
+        mSmallClasses[i].mFreeList = 0;
+        mSmallClasses[i].mHits = 0;
+        mSmallClasses[i].mMisses = 0;
+    }
+}
+
+CFdbBufferPool::~CFdbBufferPool()
+{
+    for (int32_t i = 0; i < FDB_POOL_NR_SMALL_CLASSES; ++i)
+    {
+        auto &slabs = mSmallClasses[i].mSlabs;
+        for (auto it = slabs.begin(); it != slabs.end(); ++it)
+        {
+            free(*it);
+        }
+    }
+    for (auto it = mCachedBig.begin(); it != mCachedBig.end(); ++it)
+    {
+        unmapBig(*it);
+    }
+}
+
+void CFdbBufferPool::destroy()
+{
+    unref();
+}
+
+void CFdbBufferPool::unref()
+{
+    if (mRefCount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    {
+        delete this;
+    }
+}
+
+CFdbBufferPool::CBlockHead *CFdbBufferPool::allocSmall(int32_t cls)
+{
+    auto &small = mSmallClasses[cls];
+    std::lock_guard<std::mutex> _l(small.mLock);
+    if (small.mFreeList)
+    {
+        auto head = small.mFreeList;
+        small.mFreeList = head->mNext;
+        small.mHits++;
+        return head;
+    }
+
+    int32_t block_size = fdbPoolClassSize(cls);
+    int32_t slab_size = FDB_POOL_SLAB_SIZE;
+    if (slab_size < (block_size << 1))
+    {
+        slab_size = block_size << 1;
+    }
+    auto slab = (uint8_t *)malloc(slab_size);
+    if (!slab)
+    {
+        return 0;
+    }
+    small.mSlabs.push_back(slab);
+    small.mMisses++;
+
+    // the first block is returned; the rest goes to free list
+    int32_t nr_blocks = slab_size / block_size;
+    for (int32_t i = nr_blocks - 1; i > 0; --i)
+    {
+        auto head = (CBlockHead *)(slab + i * block_size);
+        head->mNext = small.mFreeList;
+        small.mFreeList = head;
+    }
+    return (CBlockHead *)slab;
+}
+
+CFdbBufferPool::CBlockHead *CFdbBufferPool::mapBig(int32_t capacity)
+{
+#ifdef __WIN32__
+    auto head = (CBlockHead *)malloc(capacity);
+#else
+    auto mem = mmap(0, capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+    if (mem == MAP_FAILED)
+    {
+        return 0;
+    }
+#ifdef MADV_HUGEPAGE
+    if (capacity >= FDB_POOL_HUGE_PAGE_SIZE)
+    {
+        // only a hint; fall back to normal pages silently
+        madvise(mem, capacity, MADV_HUGEPAGE);
+    }
+#endif
+    auto head = (CBlockHead *)mem;
+#endif
+    if (head)
+    {
+        head->mCapacity = capacity;
+    }
+    return head;
+}
+
+void CFdbBufferPool::unmapBig(CBlockHead *head)
+{
+#ifdef __WIN32__
+    free(head);
+#else
+    munmap(head, head->mCapacity);
+#endif
+}
+
+CFdbBufferPool::CBlockHead *CFdbBufferPool::allocBig(int32_t block_size)
+{
+    {
+        std::lock_guard<std::mutex> _l(mBigLock);
+        // best fit from cached big buffers
+        auto best = mCachedBig.end();
+        for (auto it = mCachedBig.begin(); it != mCachedBig.end(); ++it)
+        {
+            if (((*it)->mCapacity >= block_size) &&
+                ((best == mCachedBig.end()) || ((*it)->mCapacity < (*best)->mCapacity)))
+            {
+                best = it;
+            }
+        }
+        if (best != mCachedBig.end())
+        {
+            auto head = *best;
+            mCachedBig.erase(best);
+            mBigHits++;
+            return head;
+        }
+        mBigMisses++;
+    }
+
+    int32_t align = (block_size >= FDB_POOL_HUGE_PAGE_SIZE) ? FDB_POOL_HUGE_PAGE_SIZE : FDB_POOL_BIG_ALIGN;
+    int64_t capacity = fdbPoolRoundUp((int64_t)block_size, align);
+    if (capacity > INT32_MAX)
+    {
+        return 0;
+    }
+    return mapBig((int32_t)capacity);
+}
+
+uint8_t *CFdbBufferPool::alloc(int32_t size)
+{
+    if ((size < 0) || (size > (INT32_MAX - FDB_POOL_BIG_ALIGN)))
+    {
+        return 0;
+    }
+
+    int32_t block_size = size + mHeadSize;
+    int32_t cls = 0;
+    while ((cls < FDB_POOL_NR_SMALL_CLASSES) && (fdbPoolClassSize(cls) < block_size))
+    {
+        cls++;
+    }
+
+    CBlockHead *head;
+    if (cls < FDB_POOL_NR_SMALL_CLASSES)
+    {
+        head = allocSmall(cls);
+        if (head)
+        {
+            head->mCapacity = fdbPoolClassSize(cls);
+        }
+    }
+    else
+    {
+        cls = FDB_POOL_BIG_CLASS;
+        head = allocBig(block_size);
+    }
+    if (!head)
+    {
+        LOG_E("CFdbBufferPool: unable to allocate buffer of size %d!\n", size);
+        return 0;
+    }
+
+    head->mPool = this;
+    head->mClass = cls;
+    head->mSize = size;
+    mRefCount.fetch_add(1, std::memory_order_relaxed);
+    return (uint8_t *)head + mHeadSize;
+}
+
+void CFdbBufferPool::releaseBlock(CBlockHead *head)
+{
+    if (head->mClass == FDB_POOL_BIG_CLASS)
+    {
+        CBlockHead *evicted = 0;
+        {
+            std::lock_guard<std::mutex> _l(mBigLock);
+            mCachedBig.push_front(head);
+            if (mCachedBig.size() > FDB_POOL_MAX_CACHED_BIG)
+            {
+                // drop the least recently used one
+                evicted = mCachedBig.back();
+                mCachedBig.pop_back();
+            }
+        }
+        if (evicted)
+        {
+            unmapBig(evicted);
+        }
+    }
+    else
+    {
+        auto &small = mSmallClasses[head->mClass];
+        std::lock_guard<std::mutex> _l(small.mLock);
+        head->mNext = small.mFreeList;
+        small.mFreeList = head;
+    }
+    unref();
+}
+
+void CFdbBufferPool::release(uint8_t *buffer)
+{
+    if (buffer)
+    {
+        auto head = (CBlockHead *)(buffer - mHeadSize);
+        head->mPool->releaseBlock(head);
+    }
+}
+
+int32_t CFdbBufferPool::size(const uint8_t *buffer)
+{
+    return buffer ? ((const CBlockHead *)(buffer - mHeadSize))->mSize : 0;
+}
+
+void CFdbBufferPool::getStatistics(CStatistics &stat)
+{
+    stat.mSmallHits = 0;
+    stat.mSmallMisses = 0;
+    stat.mNrSlabs = 0;
+    for (int32_t i = 0; i < FDB_POOL_NR_SMALL_CLASSES; ++i)
+    {
+        auto &small = mSmallClasses[i];
+        std::lock_guard<std::mutex> _l(small.mLock);
+        stat.mSmallHits += small.mHits;
+        stat.mSmallMisses += small.mMisses;
+        stat.mNrSlabs += (uint32_t)small.mSlabs.size();
+    }
+
+    std::lock_guard<std::mutex> _l(mBigLock);
+    stat.mBigHits = mBigHits;
+    stat.mBigMisses = mBigMisses;
+    stat.mNrCachedBig = (uint32_t)mCachedBig.size();
+}
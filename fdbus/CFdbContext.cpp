@@ -30,6 +30,8 @@ CFdbContext::CFdbContext()
     , mEnableLogger(true)
     , mEnableLogCache(true)
     , mLogCacheSize(0)
+    , mLogBatchSize(0)
+    , mLogBatchLatency(0)
 {
 #ifdef __WIN32__
     WORD wVersionRequested;
@@ -76,6 +78,10 @@ bool CFdbContext::asyncReady()
             cache_size = mLogCacheSize ? mLogCacheSize : FDB_DEFAULT_LOG_CACHE_SIZE;
         }
         auto logger = new CLogProducer(cache_size);
+        if (mLogBatchSize > 0)
+        {
+            logger->enableBatch(mLogBatchSize, mLogBatchLatency);
+        }
         std::string svc_url;
         logger->getDefaultSvcUrl(svc_url);
         logger->doConnect(svc_url.c_str());
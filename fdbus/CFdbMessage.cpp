@@ -22,6 +22,7 @@
 #include <common_base/CFdbSession.h>
 #include <common_base/CLogProducer.h>
 #include <common_base/CFdbBaseObject.h>
+#include <common_base/CFdbBufferPool.h>
 #include <utils/Log.h>
 #include <utils/CFdbIfMessageHeader.h>
 
@@ -141,7 +142,7 @@ CFdbMessage::CFdbMessage(NFdbBase::CFdbMessageHeader &head
     , mSid(sid)
     , mOid(head.object_id())
     , mBuffer(buffer)
-    , mFlag((head.flag() & MSG_GLOBAL_FLAG_MASK) | MSG_FLAG_EXTERNAL_BUFFER)
+    , mFlag((head.flag() & MSG_GLOBAL_FLAG_MASK) | MSG_FLAG_POOLED_BUFFER)
     , mTimer(0)
     , mStringData(peer_name ? peer_name : "None")
     , mTimeStamp(0)
@@ -171,13 +172,19 @@ CFdbMessage::CFdbMessage(NFdbBase::CFdbMessageHeader &head
     , mSid(session->sid())
     , mOid(head.object_id())
     , mBuffer(session->payloadBuffer())
-    , mFlag((head.flag() & MSG_GLOBAL_FLAG_MASK) | MSG_FLAG_EXTERNAL_BUFFER)
+    , mFlag((head.flag() & MSG_GLOBAL_FLAG_MASK) | MSG_FLAG_POOLED_BUFFER)
     , mTimer(0)
     , mStringData(session->senderName())
     , mTimeStamp(0)
     , mQOS(head.qos())
     , mContext(0)
 {
+    if (session->payloadRef())
+    {
+        // e.g. payload in shared memory
+        mSharedBuffer = session->payloadRef();
+        mFlag &= ~MSG_FLAG_POOLED_BUFFER;
+    }
     if (head.has_broadcast_filter())
     {
         mFilter = head.broadcast_filter().c_str();
@@ -232,22 +239,24 @@ CFdbMessage::CFdbMessage(FdbMsgCode_t code
 
 CFdbMessage::CFdbMessage(const CFdbMessage *msg)
 {
+    mSharedBuffer = msg->shareBuffer();
+    mHeadBuffer = msg->mHeadBuffer;
     mType = msg->mType;
     mCode = msg->mCode;
     mSn = msg->mSn;
     mPayloadSize = msg->mPayloadSize;
-    mHeadSize = mMaxHeadSize;
-    mOffset = 0;
-    mBuffer = 0;
+    mHeadSize = msg->mHeadSize;
+    mOffset = msg->mOffset;
+    mBuffer = mSharedBuffer.get();
     mEpid = msg->mEpid;
     mSid = msg->mSid;
     mOid = msg->mOid;
-    mFlag = msg->mFlag;
+    // the shared buffer is released by whoever drops it at last
+    mFlag = msg->mFlag & ~(MSG_FLAG_POOLED_BUFFER | MSG_FLAG_EXTERNAL_BUFFER);
     mTimer = 0;
     mTimeStamp = 0;
     mQOS = msg->mQOS;
     mContext = msg->mContext;
-    allocCopyRawBuffer(msg->getPayloadBuffer(), mPayloadSize);
 }
 
 CFdbMessage::~CFdbMessage()
@@ -652,9 +661,9 @@ bool CFdbMessage::update(CBaseJob::Ptr &msg_ref
     return msg ? msg->subscribe(msg_ref, FDB_MSG_TX_SYNC, FDB_CODE_UPDATE, timeout) : false;
 }
 
-bool CFdbMessage::buildHeader()
+bool CFdbMessage::buildHeader(bool compact)
 {
-    if (mFlag & MSG_FLAG_HEAD_OK)
+    if ((mFlag & MSG_FLAG_HEAD_OK) && (!(mFlag & MSG_FLAG_HEAD_COMPACT) == !compact))
     {
         return true;
     }
@@ -664,6 +673,14 @@ bool CFdbMessage::buildHeader()
         // accomodate head.
         serialize(0, 0);
     }
+    else if (mSharedBuffer && (getPayloadOffset() != (int32_t)maxReservedSize()))
+    {
+        /*
+         * Received buffer shared with others, e.g. receive buffer of
+         * session, has no room for head: take a copy of the payload
+         */
+        unshareBuffer();
+    }
     NFdbBase::CFdbMessageHeader msg_hdr;
     msg_hdr.set_type(mType);
     msg_hdr.set_serial_number(mSn);
@@ -685,31 +702,136 @@ bool CFdbMessage::buildHeader()
         msg_hdr.set_broadcast_filter(filter);
     }
 
+    int32_t head_size;
+    if (compact)
+    {
+        head_size = msg_hdr.compactSize();
+        if ((head_size > mMaxHeadSize) || (head_size < 0))
+        {
+            // optional field too long for TLV; peer accepts legacy head as well
+            compact = false;
+        }
+    }
     CFdbParcelableBuilder builder(msg_hdr);
-    int32_t head_size = builder.build();
+    if (!compact)
+    {
+        head_size = builder.build();
+    }
     if ((head_size > mMaxHeadSize) || (head_size < 0))
     {
         LOG_E("CFdbMessage: Message %d of Session %d: Head is too long or error!\n", (int32_t)mCode, (int32_t)mSid);
         return false;
     }
+    // pending output might still refer to the old head
+    auto head_buffer = writableHead(false);
     mHeadSize = head_size;
     int32_t head_offset = maxReservedSize() - head_size;
     int32_t prefix_offset = head_offset - mPrefixSize;
     mOffset = prefix_offset;
 
-    if (!builder.toBuffer(mBuffer + head_offset, head_size))
+    if (compact)
     {
-        return false;
+        // written in place without intermediate buffer
+        msg_hdr.encodeCompact(head_buffer + head_offset);
+        mFlag |= MSG_FLAG_HEAD_COMPACT;
+    }
+    else
+    {
+        if (!builder.toBuffer(head_buffer + head_offset, head_size))
+        {
+            return false;
+        }
+        mFlag &= ~MSG_FLAG_HEAD_COMPACT;
     }
 
     // Update offset and head size according to actual head size
     CFdbMsgPrefix prefix(getRawDataSize(), mHeadSize);
-    prefix.serialize(getRawBuffer());
+    prefix.serialize(head_buffer + mOffset);
 
     mFlag |= MSG_FLAG_HEAD_OK;
     return true;
 }
 
+bool CFdbMessage::patchObjectId(FdbObjectId_t object_id)
+{
+    if (!(mFlag & MSG_FLAG_HEAD_OK) || !mBuffer)
+    {
+        return false;
+    }
+    if (object_id == mOid)
+    {
+        return true;
+    }
+    auto head = writableHead(true) + mOffset + mPrefixSize;
+    if (!NFdbBase::CFdbMessageHeader::patchObjectId(head, mHeadSize, object_id))
+    {
+        return false;
+    }
+    mOid = object_id;
+    return true;
+}
+
+uint8_t *CFdbMessage::writableHead(bool keep_head)
+{
+    if (mHeadBuffer)
+    {
+        if (mHeadBuffer.use_count() == 1)
+        {
+            return mHeadBuffer.get();
+        }
+    }
+    else if (!mSharedBuffer || (mSharedBuffer.use_count() == 1))
+    {
+        return mBuffer;
+    }
+
+    /*
+     * Head is held by pending output: build the new one in a buffer of its
+     * own at the same offset so that payload is shared instead of copied.
+     */
+    std::shared_ptr<uint8_t> head_buffer(new uint8_t[maxReservedSize()],
+                                         std::default_delete<uint8_t[]>());
+    if (keep_head)
+    {
+        auto old_buffer = mHeadBuffer ? mHeadBuffer.get() : mBuffer;
+        memcpy(head_buffer.get() + mOffset, old_buffer + mOffset, mPrefixSize + mHeadSize);
+    }
+    mHeadBuffer = head_buffer;
+    return mHeadBuffer.get();
+}
+
+int32_t CFdbMessage::getFrame(CFdbIoVec *vecs) const
+{
+    if (!mBuffer)
+    {
+        return 0;
+    }
+    if (!mHeadBuffer)
+    {
+        vecs[0].mData = mBuffer + mOffset;
+        vecs[0].mSize = getRawDataSize();
+        return 1;
+    }
+    vecs[0].mData = mHeadBuffer.get() + mOffset;
+    vecs[0].mSize = mPrefixSize + mHeadSize;
+    vecs[1].mData = mBuffer + getPayloadOffset();
+    vecs[1].mSize = mPayloadSize;
+    return 2;
+}
+
+void CFdbMessage::shareFrame(std::shared_ptr<uint8_t> *buffer_refs)
+{
+    if (mHeadBuffer)
+    {
+        buffer_refs[0] = mHeadBuffer;
+        buffer_refs[1] = mSharedBuffer;
+    }
+    else
+    {
+        buffer_refs[0] = shareBuffer();
+    }
+}
+
 void CFdbMessage::freeRawBuffer()
 {
     if (mBuffer)
@@ -791,7 +913,21 @@ bool CFdbMessage::serialize(const void *buffer, int32_t size, const CFdbBaseObje
 
 void CFdbMessage::releaseBuffer()
 {
-    if (mFlag & MSG_FLAG_EXTERNAL_BUFFER)
+    mHeadBuffer.reset();
+    if (mSharedBuffer)
+    {
+        // freed by whoever drops the buffer at last
+        mSharedBuffer.reset();
+        mBuffer = 0;
+        mFlag &= ~MSG_FLAG_POOLED_BUFFER;
+    }
+    else if (mFlag & MSG_FLAG_POOLED_BUFFER)
+    {
+        CFdbBufferPool::release(mBuffer);
+        mBuffer = 0;
+        mFlag &= ~MSG_FLAG_POOLED_BUFFER;
+    }
+    else if (mFlag & MSG_FLAG_EXTERNAL_BUFFER)
     {
         freeRawBuffer();
     }
@@ -803,15 +939,87 @@ void CFdbMessage::releaseBuffer()
 }
 
 void CFdbMessage::replaceBuffer(uint8_t *buffer, int32_t payload_size,
-                                int32_t head_size, int32_t offset)
+                                int32_t head_size, int32_t offset, bool pooled)
 {
     releaseBuffer();
+    if (pooled)
+    {
+        mFlag |= MSG_FLAG_POOLED_BUFFER;
+    }
     mBuffer = buffer;
     mPayloadSize = payload_size;
     mHeadSize = head_size;
     mOffset = offset;
 }
 
+void CFdbMessage::replaceBuffer(const std::shared_ptr<uint8_t> &buffer, int32_t payload_size,
+                                int32_t head_size)
+{
+    releaseBuffer();
+    mSharedBuffer = buffer;
+    mBuffer = buffer.get();
+    mPayloadSize = payload_size;
+    mHeadSize = head_size;
+    mOffset = 0;
+}
+
+const std::shared_ptr<uint8_t> &CFdbMessage::shareBuffer() const
+{
+    if (mBuffer && !mSharedBuffer)
+    {
+        // buffer flags are ignored from now on: mSharedBuffer owns mBuffer
+        if (mFlag & MSG_FLAG_POOLED_BUFFER)
+        {
+            mSharedBuffer.reset(mBuffer, CFdbBufferPool::release);
+        }
+        else
+        {
+            mSharedBuffer.reset(mBuffer, std::default_delete<uint8_t[]>());
+        }
+    }
+    return mSharedBuffer;
+}
+
+void CFdbMessage::unshareBuffer()
+{
+    if (!mSharedBuffer)
+    {
+        return;
+    }
+    auto shared_buffer = mSharedBuffer;
+    auto payload = shared_buffer.get() + getPayloadOffset();
+    mSharedBuffer.reset();
+    mHeadBuffer.reset();
+    mBuffer = 0;
+    // head is not copied and should be built again
+    mOffset = 0;
+    mHeadSize = mMaxHeadSize;
+    mFlag &= ~(MSG_FLAG_HEAD_OK | MSG_FLAG_POOLED_BUFFER);
+    mFlag |= MSG_FLAG_EXTERNAL_BUFFER;
+    allocCopyRawBuffer(payload, mPayloadSize);
+}
+
+void *CFdbMessage::ownBuffer()
+{
+    if (mSharedBuffer)
+    {
+        // can not take the buffer away from pending output; own a copy
+        unshareBuffer();
+    }
+    else if (mFlag & MSG_FLAG_POOLED_BUFFER)
+    {
+        // user releases with delete[]; pooled buffer can not go that way
+        auto size = CFdbBufferPool::size(mBuffer);
+        auto buf = new uint8_t[size];
+        memcpy(buf, mBuffer, size);
+        releaseBuffer();
+        return buf;
+    }
+    void *buf = mBuffer;
+    mBuffer = 0;
+    return buf;
+}
+
 void CFdbMessage::doRequest(Ptr &ref)
 {
     bool success = true;
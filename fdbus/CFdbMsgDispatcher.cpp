@@ -14,7 +14,6 @@
  * limitations under the License.
  */
 
-#include <algorithm>
 #include <utils/Log.h>
 #include <common_base/CFdbMsgDispatcher.h>
 
@@ -73,7 +72,7 @@ void CFdbEventDispatcher::registerCallback(const CEvtHandleTbl &evt_tbl,
         mRegistryTbl[code][topic][id] = *it;
         if (registered_evt_tbl)
         {
-            registered_evt_tbl->push_back(id);
+            registered_evt_tbl->insert(id);
         }
     }
 }
@@ -95,9 +94,7 @@ bool CFdbEventDispatcher::processMessage(CBaseJob::Ptr &msg_ref, CFdbBaseObject
             {
                 for (auto it_callback = callbacks.begin(); it_callback != callbacks.end(); ++it_callback)
                 {
-                    auto reg_id = it_callback->first;
-                    auto it_reg_id = std::find(registered_evt_tbl->begin(), registered_evt_tbl->end(), reg_id);
-                    if (it_reg_id != registered_evt_tbl->end())
+                    if (registered_evt_tbl->find(it_callback->first) != registered_evt_tbl->end())
                     {
                         handles_to_invoke.push_back(&(it_callback->second));
                     }
@@ -122,19 +119,23 @@ bool CFdbEventDispatcher::processMessage(CBaseJob::Ptr &msg_ref, CFdbBaseObject
                 return true;
             }
             
-            auto next_msg = new CFdbMessage(msg);
-            CFdbMessage *cur_msg;
+            /*
+             * Clone the message for each of the other handles before the
+             * message is migrated to worker and might be modified there.
+             * Clones share payload with the message rather than copy it.
+             */
+            std::vector<CBaseJob::Ptr> clones;
+            for (auto it_callback = handles_to_invoke.begin() + 1;
+                    it_callback != handles_to_invoke.end(); ++it_callback)
+            {
+                clones.push_back(CBaseJob::Ptr(new CFdbMessage(msg)));
+            }
             fdbMigrateCallback(msg_ref, msg, handle->mCallback, handle->mWorker, obj);
-            for (auto it_callback = handles_to_invoke.begin() + 1; it_callback != handles_to_invoke.end();)
+            for (uint32_t i = 0; i < clones.size(); ++i)
             {
-                cur_msg = next_msg;
-                auto cur_it = it_callback++;
-                if (it_callback != handles_to_invoke.end())
-                {
-                    next_msg = new CFdbMessage(msg);
-                }
-                CBaseJob::Ptr cur_msg_ref(cur_msg);
-                fdbMigrateCallback(cur_msg_ref, cur_msg, (*cur_it)->mCallback, (*cur_it)->mWorker, obj);
+                auto cur_handle = handles_to_invoke[i + 1];
+                auto cur_msg = castToMessage<CFdbMessage *>(clones[i]);
+                fdbMigrateCallback(clones[i], cur_msg, cur_handle->mCallback, cur_handle->mWorker, obj);
             }
         }
     }
@@ -21,15 +21,215 @@
 #include <common_base/CLogProducer.h>
 #include <common_base/CSocketImp.h>
 #include <common_base/CFdbRawMsgBuilder.h>
+#include <common_base/CFdbBufferPool.h>
+#include <common_base/CFdbShmChannel.h>
+#include <common_base/CFdEventLoop.h>
 #include <utils/Log.h>
 #include <utils/CFdbIfMessageHeader.h>
 
 #define FDB_SEND_RETRIES (1024 * 10)
 #define FDB_SEND_DELAY 2
-#define FDB_SEND_MAX_RECURSIVE 128
 
 #define FDB_RECV_RETRIES FDB_SEND_RETRIES
 #define FDB_RECV_DELAY FDB_SEND_DELAY
+// interval to check frames released in shared memory while congested
+#define FDB_SHM_RELEASE_POLL_INTERVAL 10
+
+#define FDB_STREAM_RX_BUFFER_SIZE (64 * 1024)
+// message larger than this is received directly to its own buffer
+#define FDB_STREAM_DIRECT_SIZE (FDB_STREAM_RX_BUFFER_SIZE / 4)
+/*
+ * message not smaller than this is dispatched in place from receive buffer;
+ * smaller one is copied out so that it doesn't pin the whole buffer
+ */
+#define FDB_STREAM_ALIAS_SIZE (FDB_STREAM_RX_BUFFER_SIZE / 16)
+// at most so many bytes are read directly upon each POLLIN
+#define FDB_STREAM_READ_BUDGET (256 * 1024)
+
+/*
+ * Jobs between context of endpoint and I/O worker of a session. Jobs to
+ * the context look up the session by id since it might be destroyed in
+ * the meantime. Jobs to the I/O worker refer to the session directly: the
+ * session is detached from the I/O worker synchronously before destroyed.
+ */
+static CFdbSession *fdbFindIoSession(CFdbBaseContext *context, FdbEndpointId_t epid,
+                                     FdbSessionId_t sid, CFdbSession *session)
+{
+    auto endpoint = context->getEndpoint(epid);
+    return (endpoint && (endpoint->getSession(sid) == session)) ? session : 0;
+}
+
+class CSessionInputJob : public CBaseJob
+{
+public:
+    CSessionInputJob(CFdbSession *session, const CFdbMsgPrefix &prefix, uint8_t *buffer,
+                     const std::shared_ptr<uint8_t> &buffer_ref)
+        : mSession(session)
+        , mSid(session->sid())
+        , mEndpointId(session->mIoEndpointId)
+        , mContext(session->mIoContext)
+        , mPrefix(prefix)
+        , mBuffer(buffer)
+        , mBufferRef(buffer_ref)
+    {}
+    ~CSessionInputJob()
+    {
+        CFdbBufferPool::release(mBuffer);
+    }
+protected:
+    void run(CBaseWorker *worker, Ptr &ref)
+    {
+        auto session = fdbFindIoSession(mContext, mEndpointId, mSid, mSession);
+        if (session)
+        {
+            auto buffer = mBuffer;
+            mBuffer = 0;
+            session->processStreamPayload(mPrefix, buffer, mBufferRef);
+            mBufferRef.reset();
+        }
+    }
+private:
+    CFdbSession *mSession;
+    FdbSessionId_t mSid;
+    FdbEndpointId_t mEndpointId;
+    CFdbBaseContext *mContext;
+    CFdbMsgPrefix mPrefix;
+    // pooled buffer of its own, or null if held by mBufferRef
+    uint8_t *mBuffer;
+    std::shared_ptr<uint8_t> mBufferRef;
+};
+
+class CSessionHupJob : public CBaseJob
+{
+public:
+    CSessionHupJob(CFdbSession *session)
+        : mSession(session)
+        , mSid(session->sid())
+        , mEndpointId(session->mIoEndpointId)
+        , mContext(session->mIoContext)
+    {}
+protected:
+    void run(CBaseWorker *worker, Ptr &ref)
+    {
+        auto session = fdbFindIoSession(mContext, mEndpointId, mSid, mSession);
+        if (session)
+        {
+            session->destroy();
+        }
+    }
+private:
+    CFdbSession *mSession;
+    FdbSessionId_t mSid;
+    FdbEndpointId_t mEndpointId;
+    CFdbBaseContext *mContext;
+};
+
+class CSessionOutputJob : public CBaseJob
+{
+public:
+    CSessionOutputJob(CFdbSession *session, const std::shared_ptr<uint8_t> *buffer_refs,
+                      const CFdbIoVec *vecs, int32_t count, bool droppable)
+        : mSession(session)
+        , mCount(count)
+        , mDroppable(droppable)
+    {
+        for (int32_t i = 0; i < count; ++i)
+        {
+            mBufferRefs[i] = buffer_refs[i];
+            mVecs[i] = vecs[i];
+        }
+    }
+protected:
+    void run(CBaseWorker *worker, Ptr &ref)
+    {
+        mSession->writeOutput(mBufferRefs, mVecs, mCount, mDroppable);
+    }
+private:
+    CFdbSession *mSession;
+    std::shared_ptr<uint8_t> mBufferRefs[FDB_MSG_MAX_FRAME_PIECES];
+    CFdbIoVec mVecs[FDB_MSG_MAX_FRAME_PIECES];
+    int32_t mCount;
+    bool mDroppable;
+};
+
+class CSessionFlowJob : public CBaseJob
+{
+public:
+    CSessionFlowJob(CFdbSession *session, CFdbFlowStatistics &stats)
+        : CBaseJob(JOB_FORCE_RUN)
+        , mSession(session)
+        , mStats(stats)
+    {}
+protected:
+    void run(CBaseWorker *worker, Ptr &ref)
+    {
+        mSession->collectFlowStatistics(mStats);
+    }
+private:
+    CFdbSession *mSession;
+    CFdbFlowStatistics &mStats;
+};
+
+class CSessionBackpressureJob : public CBaseJob
+{
+public:
+    CSessionBackpressureJob(CFdbSession *session, bool congested)
+        : mSession(session)
+        , mSid(session->sid())
+        , mEndpointId(session->mIoEndpointId)
+        , mContext(session->mIoContext)
+        , mCongested(congested)
+    {}
+protected:
+    void run(CBaseWorker *worker, Ptr &ref)
+    {
+        auto session = fdbFindIoSession(mContext, mEndpointId, mSid, mSession);
+        if (session)
+        {
+            session->mContainer->owner()->onBackpressure(mSid, mCongested);
+        }
+    }
+private:
+    CFdbSession *mSession;
+    FdbSessionId_t mSid;
+    FdbEndpointId_t mEndpointId;
+    CFdbBaseContext *mContext;
+    bool mCongested;
+};
+
+class CSessionFatalJob : public CBaseJob
+{
+public:
+    CSessionFatalJob(CFdbSession *session)
+        : mSession(session)
+    {}
+protected:
+    void run(CBaseWorker *worker, Ptr &ref)
+    {
+        mSession->fatalError(true);
+    }
+private:
+    CFdbSession *mSession;
+};
+
+class CSessionDetachJob : public CBaseJob
+{
+public:
+    CSessionDetachJob(CFdbSession *session)
+        : CBaseJob(JOB_FORCE_RUN)
+        , mSession(session)
+    {}
+    void run(CBaseWorker *worker, Ptr &ref)
+    {
+        auto loop = fdb_dynamic_cast_if_available<CFdEventLoop *>(worker->getLoop());
+        if (loop)
+        {
+            loop->removeWatch(mSession);
+        }
+    }
+private:
+    CFdbSession *mSession;
+};
 
 CFdbSession::CFdbSession(FdbSessionId_t sid, CFdbSessionContainer *container, CSocketImp *socket)
     : CBaseFdWatch(socket->getFd(), POLLIN | POLLHUP | POLLERR)
@@ -37,14 +237,32 @@ CFdbSession::CFdbSession(FdbSessionId_t sid, CFdbSessionContainer *container, CS
     , mContainer(container)
     , mSocket(socket)
     , mSecurityLevel(FDB_SECURITY_LEVEL_NONE)
-    , mRecursiveDepth(0)
     , mPid(0)
+    , mCompactHead(false)
+    , mUDPFragment(false)
     , mPayloadBuffer(0)
+    , mRxBuffer(0)
+    , mRxBegin(0)
+    , mRxEnd(0)
+    , mRxPayload(0)
+    , mPayloadReceived(0)
+    , mDestroyed(0)
+    , mIoWorker(0)
+    , mIoContext(0)
+    , mIoEndpointId(FDB_INVALID_ID)
+    , mCongested(false)
+    , mShmReleaseTimer(this, FDB_SHM_RELEASE_POLL_INTERVAL)
 {
+    memset(&mFlowStats, 0, sizeof(mFlowStats));
     mUDPAddr.mPort = FDB_INET_PORT_INVALID;
     mUDPAddr.mType = FDB_SOCKET_UDP;
 
-    if (mContainer->owner()->enableAysncRead())
+    auto endpoint = mContainer->owner();
+    if (endpoint->enableStreamRead())
+    {
+        setRxBuffer(endpoint->context()->bufferPool()->alloc(FDB_STREAM_RX_BUFFER_SIZE));
+    }
+    if (!mRxBuffer && endpoint->enableAysncRead())
     {
         submitInput(mPrefixBuffer, sizeof(mPrefixBuffer), false);
     }
@@ -52,19 +270,23 @@ CFdbSession::CFdbSession(FdbSessionId_t sid, CFdbSessionContainer *container, CS
 
 CFdbSession::~CFdbSession()
 {
-    auto &sn_generator = mPendingMsgTable.getContainer();
-    while (!sn_generator.empty())
+    // I/O worker should not touch the session any more
+    detachIoWorker();
+
+    while (!mPendingMsgTable.empty())
     {
-        auto it = sn_generator.begin();
-        terminateMessage(it->second, NFdbBase::FDB_ST_PEER_VANISH,
+        CBaseJob::Ptr msg_ref;
+        mPendingMsgTable.removeEntry(mPendingMsgTable.begin().id(), msg_ref);
+        terminateMessage(msg_ref, NFdbBase::FDB_ST_PEER_VANISH,
                          "Message is destroyed due to broken connection.");
-        mPendingMsgTable.deleteEntry(it);
     }
 
     mContainer->owner()->deleteConnectedSession(this);
     mContainer->owner()->unsubscribeSession(this);
     mContainer->owner()->unregisterSession(mSid);
 
+    // remove from the loop while the descriptor is still valid
+    attach(0);
     if (mSocket)
     {
         delete mSocket;
@@ -72,9 +294,22 @@ CFdbSession::~CFdbSession()
     }
     descriptor(0);
 
+    if (mDestroyed)
+    {
+        *mDestroyed = true;
+    }
+    // big message partially received
+    CFdbBufferPool::release(mRxPayload);
+    // freed once messages dispatched in place are released as well
+    mRxBufferRef.reset();
+
     mContainer->callSessionDestroyHook(this);
 }
 
+/*
+ * Write as much as the socket takes at once; the rest is parked and
+ * written upon POLLOUT so that the context is never blocked by the peer.
+ */
 bool CFdbSession::sendMessage(const uint8_t *buffer, int32_t size)
 {
     if (fatalError() || !buffer)
@@ -82,59 +317,30 @@ bool CFdbSession::sendMessage(const uint8_t *buffer, int32_t size)
         return false;
     }
 
-    int32_t cnt = 0;
-    int32_t retries = FDB_SEND_RETRIES;
-    mRecursiveDepth++;
-    while (1)
+    auto consumed = tryOutput(buffer, size, 0, 0);
+    if (consumed < 0)
     {
-        cnt = mSocket->send((uint8_t *)buffer, size);
-        if (cnt < 0)
-        {
-            break;
-        }
-        buffer += cnt;
-        size -= cnt;
-        retries--;
-        if ((size <= 0) || (retries <= 0))
-        {
-            break;
-        }
-        if (mRecursiveDepth < FDB_SEND_MAX_RECURSIVE)
-        {
-            worker()->dispatchInput(FDB_SEND_DELAY >> 1);
-            sysdep_sleep(FDB_SEND_DELAY >> 1);
-        }
-        else
-        {
-            // Sorry just slow down...
-            sysdep_sleep(FDB_SEND_DELAY);
-        }
+        LOG_E("CFdbSession: error or peer drops when writing %d bytes!\n", size);
+        return false;
     }
-    mRecursiveDepth--;
-
-    if ((cnt < 0) || (size > 0))
+    if (consumed < size)
     {
-        if (cnt < 0)
-        {
-            LOG_E("CFdbSession: error or peer drops when writing %d bytes!\n", size);
-        }
-        else
-        {
-            LOG_E("CFdbSession: fail to write %d bytes!\n", size);
-        }
-        fatalError(true);
-        return false;
+        queueOutput(std::shared_ptr<uint8_t>(), buffer, size, consumed, 0, 0);
+        updateCongestion();
     }
-
     return true;
 }
 
 bool CFdbSession::sendMessage(CFdbMessage *msg)
 {
-    if (!msg->buildHeader())
+    if (!msg->buildHeader(mCompactHead))
     {
         return false;
     }
+    if (mIoWorker)
+    {
+        return postOutput(msg);
+    }
 
     bool ret = true;
     if (mContainer->owner()->enableAysncWrite())
@@ -153,7 +359,7 @@ bool CFdbSession::sendMessage(CFdbMessage *msg)
                 builder.toBuffer(buffer, size);
                 need_release = true;
             }
-            submitOutput(msg->getRawBuffer(), msg->getRawDataSize(), buffer, size);
+            submitOutput(msg, buffer, size);
             if (need_release)
             {
                 delete[] buffer;
@@ -161,31 +367,365 @@ bool CFdbSession::sendMessage(CFdbMessage *msg)
         }
         else
         {
-            submitOutput(msg->getRawBuffer(), msg->getRawDataSize(), 0, 0);
+            submitOutput(msg, 0, 0);
         }
     }
     else
     {
-        if (sendMessage(msg->getRawBuffer(), msg->getRawDataSize()))
+        // log is sent at once rather than after the message is written
+        submitOutput(msg, 0, 0);
+        if (fatalError())
+        {
+            LOG_E("CFdbSession: error or peer drops when writing %d bytes!\n",
+                  msg->getRawDataSize());
+            ret = false;
+        }
+        else if (msg->isLogEnabled())
         {
-            if (msg->isLogEnabled())
+            auto logger = FDB_CONTEXT->getLogger();
+            if (logger)
             {
-                auto logger = FDB_CONTEXT->getLogger();
-                if (logger)
-                {
-                    logger->logFDBus(msg, mSenderName.c_str(), mContainer->owner());
-                }
+                logger->logFDBus(msg, mSenderName.c_str(), mContainer->owner());
             }
         }
-        else
+    }
+
+    return ret;
+}
+
+void CFdbSession::submitOutput(CFdbMessage *msg, const uint8_t *log_buffer, int32_t log_size)
+{
+    auto msg_size = msg->getRawDataSize();
+    bool droppable = msg->type() == FDB_MT_BROADCAST;
+    bool admitted = false;
+#ifdef CONFIG_FDB_SHM
+    if (mSocket->shmChannel() && (msg_size >= FDB_SHM_MIN_FRAME_SIZE))
+    {
+        // frame in the ring is pending until the peer releases it
+        if (!admitOutput(msg_size, droppable))
         {
-            ret = false;
+            return;
+        }
+        admitted = true;
+        uint8_t doorbell[FDB_SHM_DOORBELL_SIZE];
+        if (putShmFrame(msg, doorbell))
+        {
+            auto consumed = tryOutput(doorbell, sizeof(doorbell), log_buffer, log_size);
+            if (consumed < 0)
+            {
+                // the peer never gets the doorbell: slot has to be freed here
+                mSocket->shmChannel()->cancelFrame(doorbell);
+                return;
+            }
+            if (consumed < (int32_t)sizeof(doorbell))
+            {
+                queueOutput(std::shared_ptr<uint8_t>(), doorbell, sizeof(doorbell), consumed,
+                            log_buffer, log_size);
+            }
+            updateCongestion();
+            return;
         }
     }
+#endif
+    CFdbIoVec vecs[FDB_MSG_MAX_FRAME_PIECES];
+    auto count = msg->getFrame(vecs);
+    auto consumed = tryOutput(vecs, count, log_buffer, log_size);
+    if ((consumed >= 0) && (consumed < msg_size))
+    {
+        // message partially written has to be completed
+        if (!consumed && !admitted && !admitOutput(msg_size, droppable))
+        {
+            return;
+        }
+        // hold message buffer instead of copying until the rest is written
+        std::shared_ptr<uint8_t> buffer_refs[FDB_MSG_MAX_FRAME_PIECES];
+        msg->shareFrame(buffer_refs);
+        queueOutput(buffer_refs, vecs, count, consumed, log_buffer, log_size, droppable);
+        updateCongestion();
+    }
+}
 
-    return ret;
+void CFdbSession::writeOutput(const std::shared_ptr<uint8_t> *buffer_refs, const CFdbIoVec *vecs,
+                              int32_t count, bool droppable)
+{
+    int32_t size = 0;
+    for (int32_t i = 0; i < count; ++i)
+    {
+        size += vecs[i].mSize;
+    }
+    auto consumed = tryOutput(vecs, count, 0, 0);
+    if ((consumed >= 0) && (consumed < size))
+    {
+        if (!consumed && !admitOutput(size, droppable))
+        {
+            return;
+        }
+        queueOutput(buffer_refs, vecs, count, consumed, 0, 0, droppable);
+        updateCongestion();
+    }
+}
+
+/*
+ * Apply backpressure policy of endpoint before queuing a message of size
+ * bytes. Return false if the message should not be queued.
+ */
+bool CFdbSession::admitOutput(int32_t size, bool droppable)
+{
+    auto endpoint = mContainer->owner();
+    auto high_mark = endpoint->outputHighMark();
+    if (!high_mark || (pendingOutputSize() < high_mark))
+    {
+        return true;
+    }
+
+    auto policy = endpoint->backpressurePolicy();
+    if (policy == FDB_BP_BLOCK)
+    {
+        // never wait for the peer here: other sessions share the thread
+        mFlowStats.mBlocks++;
+        flushOutput(endpoint->outputLowMark());
+        if (fatalError())
+        {
+            return false;
+        }
+        updateCongestion();
+        if (pendingOutputSize() < high_mark)
+        {
+            return true;
+        }
+    }
+    else if (policy == FDB_BP_DROP_OLDEST)
+    {
+        auto dropped = dropOutput(pendingOutputSize() + size - high_mark,
+                                  mFlowStats.mDroppedMessages);
+        mFlowStats.mDroppedBytes += dropped;
+        updateCongestion();
+        if (pendingOutputSize() < high_mark)
+        {
+            return true;
+        }
+    }
+    else if (policy != FDB_BP_DROP_NEWEST)
+    {
+        LOG_E("CFdbSession: drop %s since %lld bytes of output are pending!\n",
+              mSenderName.c_str(), (long long)pendingOutputSize());
+        fatalError(true);
+        return false;
+    }
+
+    // drop the new message if possible
+    if (droppable)
+    {
+        mFlowStats.mDroppedMessages++;
+        mFlowStats.mDroppedBytes += size;
+        return false;
+    }
+    if (pendingOutputSize() + size <= (int64_t)high_mark * FDB_BP_HARD_LIMIT_SCALE)
+    {
+        return true;
+    }
+    LOG_E("CFdbSession: drop %s since %lld bytes of output are pending!\n",
+          mSenderName.c_str(), (long long)pendingOutputSize());
+    fatalError(true);
+    return false;
+}
+
+// output queued at socket and frames in shared memory not released by peer
+int64_t CFdbSession::pendingOutputSize()
+{
+    auto size = getPendingOutputSize();
+#ifdef CONFIG_FDB_SHM
+    auto shm = mSocket->shmChannel();
+    if (shm)
+    {
+        size += shm->pendingSize();
+    }
+#endif
+    return size;
+}
+
+void CFdbSession::updateCongestion()
+{
+    auto endpoint = mContainer->owner();
+    auto high_mark = endpoint->outputHighMark();
+    auto pending = pendingOutputSize();
+    if (pending > mFlowStats.mPeakPendingBytes)
+    {
+        mFlowStats.mPeakPendingBytes = pending;
+    }
+    if (mCongested)
+    {
+        if (!high_mark || (pending <= endpoint->outputLowMark()))
+        {
+            mCongested = false;
+            pollShmRelease(false);
+            notifyBackpressure(false);
+        }
+    }
+    else if (high_mark && (pending >= high_mark))
+    {
+        mCongested = true;
+        mFlowStats.mCongestions++;
+        pollShmRelease(true);
+        notifyBackpressure(true);
+    }
+}
+
+void CFdbSession::pollShmRelease(bool enable)
+{
+#ifdef CONFIG_FDB_SHM
+    // frames are put to shared memory only at the context
+    if (mIoWorker || !mSocket->shmChannel())
+    {
+        return;
+    }
+    if (enable)
+    {
+        if (!mShmReleaseTimer.worker())
+        {
+            mShmReleaseTimer.attach(mContainer->owner()->context(), false);
+        }
+        mShmReleaseTimer.enable();
+    }
+    else if (mShmReleaseTimer.worker())
+    {
+        mShmReleaseTimer.disable();
+    }
+#endif
 }
 
+void CFdbSession::onShmReleaseTimer(CMethodLoopTimer<CFdbSession> *timer)
+{
+    updateCongestion();
+}
+
+void CFdbSession::notifyBackpressure(bool congested)
+{
+    if (mIoWorker)
+    {
+        mIoContext->sendAsync(new CSessionBackpressureJob(this, congested));
+    }
+    else
+    {
+        mContainer->owner()->onBackpressure(mSid, congested);
+    }
+}
+
+void CFdbSession::onOutputWritten()
+{
+    if (mCongested)
+    {
+        updateCongestion();
+    }
+}
+
+void CFdbSession::getFlowStatistics(CFdbFlowStatistics &stats)
+{
+    if (mIoWorker)
+    {
+        // counters are updated at the I/O worker
+        memset(&stats, 0, sizeof(stats));
+        mIoWorker->sendSync(new CSessionFlowJob(this, stats));
+        return;
+    }
+    collectFlowStatistics(stats);
+}
+
+void CFdbSession::collectFlowStatistics(CFdbFlowStatistics &stats)
+{
+    stats = mFlowStats;
+    stats.mPendingBytes = pendingOutputSize();
+}
+
+/*
+ * Message buffer is shared with the I/O worker rather than copied; it is
+ * written there in the order of posting.
+ */
+bool CFdbSession::postOutput(CFdbMessage *msg)
+{
+    CFdbIoVec vecs[FDB_MSG_MAX_FRAME_PIECES];
+    auto count = msg->getFrame(vecs);
+    if (!count)
+    {
+        return false;
+    }
+    std::shared_ptr<uint8_t> buffer_refs[FDB_MSG_MAX_FRAME_PIECES];
+    msg->shareFrame(buffer_refs);
+    if (!mIoWorker->sendAsync(new CSessionOutputJob(this, buffer_refs, vecs, count,
+                                                    msg->type() == FDB_MT_BROADCAST)))
+    {
+        return false;
+    }
+    if (msg->isLogEnabled())
+    {
+        auto logger = FDB_CONTEXT->getLogger();
+        if (logger)
+        {
+            logger->logFDBus(msg, mSenderName.c_str(), mContainer->owner());
+        }
+    }
+    return true;
+}
+
+#ifdef CONFIG_FDB_SHM
+bool CFdbSession::putShmFrame(CFdbMessage *msg, uint8_t *doorbell)
+{
+    auto shm = mSocket->shmChannel();
+    if (!shm || (msg->getRawDataSize() < FDB_SHM_MIN_FRAME_SIZE))
+    {
+        return false;
+    }
+    if (!shm->txReady())
+    {
+        // region is sent with a doorbell of its own, which can not break into pending output
+        if (getPendingChunkSize())
+        {
+            return false;
+        }
+        auto sent = shm->sendRegion(mSocket->getFd(), doorbell);
+        if (sent <= 0)
+        {
+            return false;
+        }
+        if (sent < FDB_SHM_DOORBELL_SIZE)
+        {
+            if (!sendMessage(doorbell + sent, FDB_SHM_DOORBELL_SIZE - sent))
+            {
+                return false;
+            }
+        }
+    }
+    CFdbIoVec vecs[FDB_MSG_MAX_FRAME_PIECES];
+    auto count = msg->getFrame(vecs);
+    return shm->putFrame(vecs, count, doorbell);
+}
+
+void CFdbSession::processShmDoorbell(const uint8_t *data, int32_t size)
+{
+    auto shm = mSocket->shmChannel();
+    std::shared_ptr<uint8_t> frame_ref;
+    bool ok = shm && shm->getFrame(data, size, frame_ref, mMsgPrefix);
+    // doorbell itself is not needed any more
+    releasePayload();
+    if (!ok)
+    {
+        LOG_E("CFdbSession: Session %d: bad doorbell of shared memory!\n", mSid);
+        raiseFatalError();
+        return;
+    }
+    if (!frame_ref)
+    {
+        // region of peer is received
+        return;
+    }
+
+    mPayloadRef = frame_ref;
+    mPayloadBuffer = frame_ref.get();
+    processPayload(mPayloadBuffer + CFdbMessage::mPrefixSize,
+                   mMsgPrefix.mTotalLength - CFdbMessage::mPrefixSize);
+}
+#endif
+
 bool CFdbSession::sendMessage(CBaseJob::Ptr &ref)
 {
     auto msg = castToMessage<CFdbMessage *>(ref);
@@ -193,16 +733,27 @@ bool CFdbSession::sendMessage(CBaseJob::Ptr &ref)
     {
         return false;
     }
-    msg->sn(mPendingMsgTable.allocateEntityId());
+    // sn is taken from the slot holding the message before it is sent
+    auto sn = mPendingMsgTable.insertEntry(ref);
+    if (!fdbValidFdbId(sn))
+    {
+        msg->setStatusMsg(NFdbBase::FDB_ST_UNABLE_TO_SEND, "Too many pending messages!");
+        if (!msg->sync())
+        {
+            mContainer->owner()->doReply(ref);
+        }
+        return false;
+    }
+    msg->sn(sn);
     if (sendMessage(msg))
     {
         msg->replaceBuffer(0); // free buffer to save memory
         msg->clearLogData();
-        mPendingMsgTable.insertEntry(msg->sn(), ref);
         return true;
     }
     else
     {
+        mPendingMsgTable.deleteEntry(sn);
         msg->setStatusMsg(NFdbBase::FDB_ST_UNABLE_TO_SEND, "Fail when sending message!");
         if (!msg->sync())
         {
@@ -212,9 +763,9 @@ bool CFdbSession::sendMessage(CBaseJob::Ptr &ref)
     }
 }
 
-bool CFdbSession::sendUDPMessage(CFdbMessage *msg)
+bool CFdbSession::sendUDPMessage(CFdbMessage *msg, bool batch)
 {
-    return mContainer->sendUDPmessage(msg, mUDPAddr);
+    return mContainer->sendUDPmessage(msg, mUDPAddr, mCompactHead, batch, mUDPFragment);
 }
 
 bool CFdbSession::receiveData(uint8_t *buf, int32_t size)
@@ -273,11 +824,8 @@ void CFdbSession::parsePrefix(const uint8_t *data, int32_t size)
      * The leading CFdbMessage::mPrefixSize bytes are not used; just for
      * keeping uniform structure
      */
-    try
-    {
-        mPayloadBuffer = new uint8_t[mMsgPrefix.mTotalLength];
-    }
-    catch (...)
+    mPayloadBuffer = mContainer->owner()->context()->bufferPool()->alloc(mMsgPrefix.mTotalLength);
+    if (!mPayloadBuffer)
     {
         LOG_E("CFdbSession: Session %d: Unable to allocate buffer of size %d!\n",
                 mSid, mMsgPrefix.mTotalLength);
@@ -285,29 +833,42 @@ void CFdbSession::parsePrefix(const uint8_t *data, int32_t size)
     }
 }
 
+void CFdbSession::releasePayload()
+{
+    if (mPayloadRef)
+    {
+        mPayloadRef.reset();
+    }
+    else
+    {
+        CFdbBufferPool::release(mPayloadBuffer);
+    }
+    mPayloadBuffer = 0;
+}
+
 void CFdbSession::processPayload(const uint8_t *data, int32_t size)
 {
     if (size < 0)
     {
-        if (mPayloadBuffer)
-        {
-            delete[] mPayloadBuffer;
-            mPayloadBuffer = 0;
-        }
+        releasePayload();
         return;
     }
 
+#ifdef CONFIG_FDB_SHM
+    if (!mMsgPrefix.mHeadLength)
+    {
+        // doorbell of message in shared memory
+        processShmDoorbell(data, size);
+        return;
+    }
+#endif
+
     NFdbBase::CFdbMessageHeader head;
-    CFdbParcelableParser parser(head);
-    if (!parser.parse(data, mMsgPrefix.mHeadLength))
+    if (!head.parse(data, mMsgPrefix.mHeadLength))
     {
         LOG_E("CFdbSession: Session %d: Unable to deserialize message head!\n", mSid);
-        if (mPayloadBuffer)
-        {
-            delete[] mPayloadBuffer;
-            mPayloadBuffer = 0;
-        }
-        fatalError(true);
+        releasePayload();
+        raiseFatalError();
         return;
     }
 
@@ -346,13 +907,14 @@ void CFdbSession::processPayload(const uint8_t *data, int32_t size)
             break;
         default:
             LOG_E("CFdbSession: Message %d: Unknown type!\n", (int32_t)head.serial_number());
-            delete[] mPayloadBuffer;
-            mPayloadBuffer = 0;
-            fatalError(true);
+            releasePayload();
+            raiseFatalError();
             break;
     }
 
+    // buffer is taken by the message if any
     mPayloadBuffer = 0;
+    mPayloadRef.reset();
 }
 
 int32_t CFdbSession::writeStream(const uint8_t *data, int32_t size)
@@ -360,6 +922,11 @@ int32_t CFdbSession::writeStream(const uint8_t *data, int32_t size)
     return mSocket->send((uint8_t *)data, size);
 }
 
+int32_t CFdbSession::writeStream(const CFdbIoVec *vecs, int32_t count)
+{
+    return mSocket->send(vecs, count);
+}
+
 int32_t CFdbSession::readStream(uint8_t *data, int32_t size)
 {
     return mSocket->recv(data, size);
@@ -383,8 +950,144 @@ void CFdbSession::onInputReady(const uint8_t *data, int32_t size)
     }
 }
 
+void CFdbSession::onStreamInput()
+{
+    if (mDestroyed)
+    {
+        // called from dispatchInput() during dispatching; leave data to next round
+        return;
+    }
+
+    int32_t cnt;
+    if (mRxPayload)
+    {
+        // receive the rest of big message directly to its buffer
+        int32_t size = (int32_t)mRxPrefix.mTotalLength - CFdbMessage::mPrefixSize - mPayloadReceived;
+        cnt = mSocket->recv(mRxPayload + CFdbMessage::mPrefixSize + mPayloadReceived,
+                            (size > FDB_STREAM_READ_BUDGET) ? FDB_STREAM_READ_BUDGET : size);
+        if (cnt >= 0)
+        {
+            mPayloadReceived += cnt;
+            if (cnt < size)
+            {
+                return;
+            }
+        }
+    }
+    else
+    {
+        if ((mRxEnd == FDB_STREAM_RX_BUFFER_SIZE) && !compactRxBuffer())
+        {
+            fatalError(true);
+            return;
+        }
+        cnt = mSocket->recv(mRxBuffer + mRxEnd, FDB_STREAM_RX_BUFFER_SIZE - mRxEnd);
+        if (cnt > 0)
+        {
+            mRxEnd += cnt;
+        }
+    }
+    if (cnt < 0)
+    {
+        LOG_E("CFdbSession: error or peer drops when reading!\n");
+        fatalError(true);
+        return;
+    }
+
+    bool destroyed = false;
+    mDestroyed = &destroyed;
+    if (mRxPayload)
+    {
+        mPayloadReceived = 0;
+        dispatchStreamPayload();
+        if (destroyed)
+        {
+            return;
+        }
+    }
+
+    // dispatch all complete messages in receive buffer
+    while (!fatalError() && ((mRxEnd - mRxBegin) >= CFdbMessage::mPrefixSize))
+    {
+        auto rx_data = mRxBuffer + mRxBegin;
+        int32_t rx_size = mRxEnd - mRxBegin;
+        mRxPrefix.deserialize(rx_data);
+        int32_t total_size = (int32_t)mRxPrefix.mTotalLength;
+        if (total_size < CFdbMessage::mPrefixSize)
+        {
+            LOG_E("CFdbSession: Session %d: bad message length %u!\n", mSid, mRxPrefix.mTotalLength);
+            fatalError(true);
+            break;
+        }
+
+        if ((rx_size < total_size) && (total_size <= FDB_STREAM_DIRECT_SIZE))
+        {
+            // wait for the rest; make sure the message fits in receive buffer
+            if (((mRxBegin + total_size) > FDB_STREAM_RX_BUFFER_SIZE) && !compactRxBuffer())
+            {
+                fatalError(true);
+            }
+            break;
+        }
+
+        if (rx_size >= total_size)
+        {
+            if (total_size >= FDB_STREAM_ALIAS_SIZE)
+            {
+                // dispatched in place: the message holds receive buffer instead of a copy
+                mRxPayloadRef = std::shared_ptr<uint8_t>(mRxBufferRef, rx_data);
+            }
+            else
+            {
+                mRxPayload = rxBufferPool()->alloc(total_size);
+                if (!mRxPayload)
+                {
+                    LOG_E("CFdbSession: Session %d: Unable to allocate buffer of size %d!\n", mSid, total_size);
+                    fatalError(true);
+                    break;
+                }
+                memcpy(mRxPayload, rx_data, total_size);
+            }
+            mRxBegin += total_size;
+            dispatchStreamPayload();
+            if (destroyed)
+            {
+                return;
+            }
+            continue;
+        }
+
+        mRxPayload = rxBufferPool()->alloc(total_size);
+        if (!mRxPayload)
+        {
+            LOG_E("CFdbSession: Session %d: Unable to allocate buffer of size %d!\n", mSid, total_size);
+            fatalError(true);
+            break;
+        }
+        // too big for receive buffer: the rest goes to its own buffer
+        mPayloadReceived = rx_size - CFdbMessage::mPrefixSize;
+        memcpy(mRxPayload + CFdbMessage::mPrefixSize, rx_data + CFdbMessage::mPrefixSize,
+               mPayloadReceived);
+        mRxBegin = mRxEnd;
+        break;
+    }
+
+    // start over unless messages dispatched in place still refer to the data
+    if ((mRxBegin == mRxEnd) && (mRxBufferRef.use_count() == 1))
+    {
+        mRxBegin = mRxEnd = 0;
+    }
+    mDestroyed = 0;
+}
+
 void CFdbSession::onInput()
 {
+    if (mRxBuffer)
+    {
+        onStreamInput();
+        return;
+    }
+
     if (receiveData(mPrefixBuffer, sizeof(mPrefixBuffer)))
     {
         parsePrefix(mPrefixBuffer, sizeof(mPrefixBuffer));
@@ -408,12 +1111,162 @@ void CFdbSession::onError()
 }
 
 void CFdbSession::onHup()
+{
+    if (mIoWorker)
+    {
+        // session can only be destroyed at context of endpoint
+        disable();
+        mIoContext->sendAsync(new CSessionHupJob(this));
+        return;
+    }
+    destroy();
+}
+
+void CFdbSession::destroy()
 {
     auto endpoint = mContainer->owner();
     delete this;
     endpoint->checkAutoRemove();
 }
 
+void CFdbSession::raiseFatalError()
+{
+    if (mIoWorker)
+    {
+        // socket is owned by the I/O worker
+        mIoWorker->sendAsync(new CSessionFatalJob(this));
+    }
+    else
+    {
+        fatalError(true);
+    }
+}
+
+bool CFdbSession::attachIoWorker(CFdbBaseContext *io_worker)
+{
+    if (!mRxBuffer)
+    {
+        // messages are framed at the I/O worker in stream read mode
+        setRxBuffer(io_worker->bufferPool()->alloc(FDB_STREAM_RX_BUFFER_SIZE));
+        if (!mRxBuffer)
+        {
+            return false;
+        }
+        cancelInput();
+    }
+    auto endpoint = mContainer->owner();
+    mIoContext = endpoint->context();
+    mIoEndpointId = endpoint->epid();
+    // set before attaching since input might come at once
+    mIoWorker = io_worker;
+    if (!attach(io_worker))
+    {
+        mIoWorker = 0;
+        return false;
+    }
+    return true;
+}
+
+void CFdbSession::detachIoWorker()
+{
+    if (!mIoWorker)
+    {
+        return;
+    }
+    if (!mIoWorker->sendSync(new CSessionDetachJob(this)))
+    {
+        // the worker is not running: nobody else touches its loop
+        auto loop = fdb_dynamic_cast_if_available<CFdEventLoop *>(mIoWorker->getLoop());
+        if (loop)
+        {
+            loop->removeWatch(this);
+        }
+    }
+    mWorker = 0;
+    mIoWorker = 0;
+}
+
+CFdbBufferPool *CFdbSession::rxBufferPool()
+{
+    return (mIoWorker ? mIoWorker : mContainer->owner()->context())->bufferPool();
+}
+
+void CFdbSession::dispatchStreamPayload()
+{
+    auto buffer = mRxPayload;
+    mRxPayload = 0;
+    std::shared_ptr<uint8_t> buffer_ref;
+    buffer_ref.swap(mRxPayloadRef);
+    if (mIoWorker)
+    {
+        // dispatched at context in the order received
+        mIoContext->sendAsync(new CSessionInputJob(this, mRxPrefix, buffer, buffer_ref));
+    }
+    else
+    {
+        processStreamPayload(mRxPrefix, buffer, buffer_ref);
+    }
+}
+
+void CFdbSession::processStreamPayload(const CFdbMsgPrefix &prefix, uint8_t *buffer,
+                                       const std::shared_ptr<uint8_t> &buffer_ref)
+{
+    mMsgPrefix = prefix;
+    if (buffer_ref)
+    {
+        // message taken from receive buffer holds it by the reference
+        mPayloadRef = buffer_ref;
+        mPayloadBuffer = buffer_ref.get();
+    }
+    else
+    {
+        mPayloadBuffer = buffer;
+    }
+    processPayload(mPayloadBuffer + CFdbMessage::mPrefixSize,
+                   mMsgPrefix.mTotalLength - CFdbMessage::mPrefixSize);
+}
+
+void CFdbSession::setRxBuffer(uint8_t *buffer)
+{
+    mRxBuffer = buffer;
+    if (buffer)
+    {
+        mRxBufferRef.reset(buffer, CFdbBufferPool::release);
+    }
+    else
+    {
+        mRxBufferRef.reset();
+    }
+}
+
+/*
+ * Move data not parsed yet to the front of receive buffer. If messages
+ * dispatched in place still refer to the buffer, the data goes to a new
+ * one instead and the old one is freed along with the last message.
+ */
+bool CFdbSession::compactRxBuffer()
+{
+    int32_t size = mRxEnd - mRxBegin;
+    if (mRxBufferRef.use_count() > 1)
+    {
+        auto buffer = rxBufferPool()->alloc(FDB_STREAM_RX_BUFFER_SIZE);
+        if (!buffer)
+        {
+            LOG_E("CFdbSession: Session %d: Unable to allocate receive buffer!\n", mSid);
+            return false;
+        }
+        memcpy(buffer, mRxBuffer + mRxBegin, size);
+        setRxBuffer(buffer);
+    }
+    else
+    {
+        memmove(mRxBuffer, mRxBuffer + mRxBegin, size);
+    }
+    mRxBegin = 0;
+    mRxEnd = size;
+    return true;
+}
+
 void CFdbSession::doRequest(NFdbBase::CFdbMessageHeader &head)
 {
     auto msg = new CFdbMessage(head, this);
@@ -484,10 +1337,9 @@ void CFdbSession::doRequest(NFdbBase::CFdbMessageHeader &head)
 
 void CFdbSession::doResponse(NFdbBase::CFdbMessageHeader &head)
 {
-    bool found;
-    PendingMsgTable_t::EntryContainer_t::iterator it;
-    CBaseJob::Ptr &msg_ref = mPendingMsgTable.retrieveEntry(head.serial_number(), it, found);
-    if (found)
+    // message is taken out of the table so that it is held by msg_ref only
+    CBaseJob::Ptr msg_ref;
+    if (mPendingMsgTable.removeEntry(head.serial_number(), msg_ref))
     {
         auto msg = castToMessage<CFdbMessage *>(msg_ref);
         auto object_id = head.object_id();
@@ -496,9 +1348,7 @@ void CFdbSession::doResponse(NFdbBase::CFdbMessageHeader &head)
             LOG_E("CFdbSession: object id of response %d does not match that in request: %d\n",
                     object_id, msg->objectId());
             terminateMessage(msg_ref, NFdbBase::FDB_ST_OBJECT_NOT_FOUND, "Object ID does not match.");
-            mPendingMsgTable.deleteEntry(it);
-            delete[] mPayloadBuffer;
-            mPayloadBuffer = 0;
+            releasePayload();
             return;
         }
 
@@ -507,7 +1357,14 @@ void CFdbSession::doResponse(NFdbBase::CFdbMessageHeader &head)
         {
             msg->update(head, mMsgPrefix);
             msg->decodeDebugInfo(head);
-            msg->replaceBuffer(mPayloadBuffer, head.payload_size(), mMsgPrefix.mHeadLength);
+            if (mPayloadRef)
+            {
+                msg->replaceBuffer(mPayloadRef, head.payload_size(), mMsgPrefix.mHeadLength);
+            }
+            else
+            {
+                msg->replaceBuffer(mPayloadBuffer, head.payload_size(), mMsgPrefix.mHeadLength, 0, true);
+            }
             if (!msg->sync())
             {
                 switch (head.type())
@@ -547,11 +1404,10 @@ void CFdbSession::doResponse(NFdbBase::CFdbMessageHeader &head)
         }
         else
         {
-            delete[] mPayloadBuffer;
+            releasePayload();
         }
 
         msg_ref->terminate(msg_ref);
-        mPendingMsgTable.deleteEntry(it);
     }
 }
 
@@ -560,12 +1416,10 @@ void CFdbSession::doBroadcast(NFdbBase::CFdbMessageHeader &head)
     CFdbMessage *msg = 0;
     if (head.flag() & MSG_FLAG_INITIAL_RESPONSE)
     {
-        bool found;
-        PendingMsgTable_t::EntryContainer_t::iterator it;
-        CBaseJob::Ptr &msg_ref = mPendingMsgTable.retrieveEntry(head.serial_number(), it, found);
-        if (found)
+        auto entry = mPendingMsgTable.retrieveEntry(head.serial_number());
+        if (entry)
         {
-            auto outgoing_msg = castToMessage<CFdbMessage *>(msg_ref);
+            auto outgoing_msg = castToMessage<CFdbMessage *>(*entry);
             msg = outgoing_msg->clone(head, this);
         }
     }
@@ -719,13 +1573,10 @@ void CFdbSession::terminateMessage(CBaseJob::Ptr &job, int32_t status, const cha
 
 void CFdbSession::terminateMessage(FdbMsgSn_t msg_sn, int32_t status, const char *reason)
 {
-    bool found;
-    PendingMsgTable_t::EntryContainer_t::iterator it;
-    CBaseJob::Ptr &job = mPendingMsgTable.retrieveEntry(msg_sn, it, found);
-    if (found)
+    CBaseJob::Ptr job;
+    if (mPendingMsgTable.removeEntry(msg_sn, job))
     {
         terminateMessage(job, status, reason);
-        mPendingMsgTable.deleteEntry(it);
     }
 }
 
@@ -738,11 +1589,8 @@ void CFdbSession::getSessionInfo(CFdbSessionInfo &info)
 
 CFdbMessage *CFdbSession::peepPendingMessage(FdbMsgSn_t sn)
 {
-    bool found;
-    
-    PendingMsgTable_t::EntryContainer_t::iterator it;
-    CBaseJob::Ptr &job = mPendingMsgTable.retrieveEntry(sn, it, found);
-    return found ? castToMessage<CFdbMessage *>(job) : 0;
+    auto entry = mPendingMsgTable.retrieveEntry(sn);
+    return entry ? castToMessage<CFdbMessage *>(*entry) : 0;
 }
 
 void CFdbSession::securityLevel(int32_t level)
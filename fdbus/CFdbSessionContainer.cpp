@@ -187,9 +187,23 @@ bool CFdbSessionContainer::bindUDPSocket(const char *ip_address, int32_t udp_por
     return false;
 }
 
-bool CFdbSessionContainer::sendUDPmessage(CFdbMessage *msg, const CFdbSocketAddr &dest_addr)
+bool CFdbSessionContainer::sendUDPmessage(CFdbMessage *msg, const CFdbSocketAddr &dest_addr,
+                                          bool compact_head, bool batch, bool fragment)
 {
-    return mUDPSession ? mUDPSession->sendMessage(msg, dest_addr) : false;
+    if (!mUDPSession)
+    {
+        return false;
+    }
+    return batch ? mUDPSession->queueMessage(msg, dest_addr, compact_head, fragment) :
+                   mUDPSession->sendMessage(msg, dest_addr, compact_head, fragment);
+}
+
+void CFdbSessionContainer::flushUDPBatch()
+{
+    if (mUDPSession)
+    {
+        mUDPSession->flushBatch();
+    }
 }
 
 bool CFdbSessionContainer::getUDPSocketInfo(CFdbSocketInfo &info)
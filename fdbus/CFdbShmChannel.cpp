@@ -0,0 +1,558 @@
+/*
+ * Copyright (C) 2015   Jeremy Chen jeremy_cz@yahoo.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <common_base/CFdbShmChannel.h>
+
+#ifdef CONFIG_FDB_SHM
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <atomic>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <common_base/CFdbMessage.h>
+#include <utils/Log.h>
+
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC                 0x0001U
+#endif
+
+// the same as CFdbMessage::mPrefixSize
+#define FDB_SHM_PREFIX_SIZE         ((int32_t)sizeof(CFdbMsgPrefix))
+#define FDB_SHM_MAGIC               0x4D484446 // "FDHM"
+// region starts with the head; slots follow it
+#define FDB_SHM_REGION_HEAD_SIZE    64
+// each slot starts with its state followed by the frame
+#define FDB_SHM_SLOT_HEAD_SIZE      16
+#define FDB_SHM_SLOT_ALIGN          64
+// peer region larger than this is rejected
+#define FDB_SHM_MAX_REGION_SIZE     (256 * 1024 * 1024)
+
+#define FDB_SHM_SLOT_FREE           0
+#define FDB_SHM_SLOT_BUSY           1
+
+// type of doorbell
+#define FDB_SHM_DOORBELL_REGION     1
+#define FDB_SHM_DOORBELL_FRAME      2
+
+#define fdbShmRoundUp(_size, _align) ((((_size) + (_align) - 1) / (_align)) * (_align))
+
+struct CFdbShmRegionHead
+{
+    uint32_t mMagic;
+    uint32_t mSize;
+};
+
+struct CFdbShmSlotHead
+{
+    // written by sender when sent and by receiver when handed back
+    std::atomic<uint32_t> mState;
+};
+
+/*
+ * Region of peer mapped for receiving. It is held by the channel and by
+ * each frame being dispatched so that it is unmapped after the last frame
+ * is released even if the connection is gone.
+ */
+class CFdbShmRxRegion
+{
+public:
+    CFdbShmRxRegion(uint8_t *base, uint32_t size)
+        : mBase(base)
+        , mSize(size)
+        , mRefCount(1)
+    {
+    }
+
+    uint8_t *base() const
+    {
+        return mBase;
+    }
+
+    uint32_t size() const
+    {
+        return mSize;
+    }
+
+    void ref()
+    {
+        mRefCount.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void unref()
+    {
+        if (mRefCount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            delete this;
+        }
+    }
+
+private:
+    uint8_t *mBase;
+    uint32_t mSize;
+    std::atomic<int32_t> mRefCount;
+
+    ~CFdbShmRxRegion()
+    {
+        munmap(mBase, mSize);
+    }
+};
+
+// hand slot of a frame back to sender; nothing but the state is touched
+class CFdbShmFrameReleaser
+{
+public:
+    CFdbShmFrameReleaser(CFdbShmRxRegion *region)
+        : mRegion(region)
+    {
+    }
+
+    void operator()(uint8_t *frame)
+    {
+        auto slot = (CFdbShmSlotHead *)(frame - FDB_SHM_SLOT_HEAD_SIZE);
+        slot->mState.store(FDB_SHM_SLOT_FREE, std::memory_order_release);
+        mRegion->unref();
+    }
+
+private:
+    CFdbShmRxRegion *mRegion;
+};
+
+static void fdbShmSetU32(uint8_t *buffer, uint32_t value)
+{
+    buffer[0] = (uint8_t)((value >> 0) & 0xff);
+    buffer[1] = (uint8_t)((value >> 8) & 0xff);
+    buffer[2] = (uint8_t)((value >> 16) & 0xff);
+    buffer[3] = (uint8_t)((value >> 24) & 0xff);
+}
+
+static uint32_t fdbShmGetU32(const uint8_t *buffer)
+{
+    return (buffer[0] << 0) | (buffer[1] << 8) | (buffer[2] << 16) | (buffer[3] << 24);
+}
+
+/*
+ * Doorbell is a message without head: prefix of which has head length 0,
+ * followed by type, offset and size of frame in the ring of sender.
+ */
+static void fdbShmBuildDoorbell(uint8_t *doorbell, uint32_t type, uint32_t offset, uint32_t size)
+{
+    CFdbMsgPrefix prefix(FDB_SHM_DOORBELL_SIZE, 0);
+    prefix.serialize(doorbell);
+    auto body = doorbell + FDB_SHM_PREFIX_SIZE;
+    fdbShmSetU32(body, type);
+    fdbShmSetU32(body + 4, offset);
+    fdbShmSetU32(body + 8, size);
+    fdbShmSetU32(body + 12, 0);
+}
+
+CFdbShmChannel::CFdbShmChannel()
+    : mTxFd(-1)
+    , mTxBase(0)
+    , mTxSize(0)
+    , mTxHead(FDB_SHM_REGION_HEAD_SIZE)
+    , mTxSent(false)
+    , mTxBroken(false)
+    , mTxUsed(0)
+    , mRxRegion(0)
+    , mRxPendingFd(-1)
+{
+}
+
+CFdbShmChannel::~CFdbShmChannel()
+{
+    if (mTxBase)
+    {
+        // frames in flight are dropped along with the connection
+        munmap(mTxBase, mTxSize);
+    }
+    if (mTxFd >= 0)
+    {
+        close(mTxFd);
+    }
+    if (mRxRegion)
+    {
+        mRxRegion->unref();
+    }
+    if (mRxPendingFd >= 0)
+    {
+        close(mRxPendingFd);
+    }
+}
+
+int32_t CFdbShmChannel::recv(int sock_fd, uint8_t *data, int32_t size)
+{
+    struct iovec iov;
+    iov.iov_base = data;
+    iov.iov_len = size;
+
+    // credentials come along if SO_PASSCRED is set for peercred
+    union
+    {
+        struct cmsghdr mAlign;
+        char mBuffer[CMSG_SPACE(sizeof(int)) + CMSG_SPACE(sizeof(struct ucred))];
+    } control;
+
+    struct msghdr hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.msg_iov = &iov;
+    hdr.msg_iovlen = 1;
+    hdr.msg_control = control.mBuffer;
+    hdr.msg_controllen = sizeof(control.mBuffer);
+
+    ssize_t ret;
+    do
+    {
+        ret = recvmsg(sock_fd, &hdr, MSG_CMSG_CLOEXEC);
+    } while ((ret < 0) && (errno == EINTR));
+
+    if (ret < 0)
+    {
+        return ((errno == EAGAIN) || (errno == EWOULDBLOCK)) ? 0 : -1;
+    }
+
+    for (auto cmsg = CMSG_FIRSTHDR(&hdr); cmsg; cmsg = CMSG_NXTHDR(&hdr, cmsg))
+    {
+        if ((cmsg->cmsg_level != SOL_SOCKET) || (cmsg->cmsg_type != SCM_RIGHTS))
+        {
+            continue;
+        }
+        int32_t nr_fds = (int32_t)((cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+        for (int32_t i = 0; i < nr_fds; ++i)
+        {
+            int fd;
+            memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+            if (mRxPendingFd >= 0)
+            {
+                close(mRxPendingFd);
+            }
+            mRxPendingFd = fd;
+        }
+    }
+
+    // peer is closed
+    return ret ? (int32_t)ret : -1;
+}
+
+bool CFdbShmChannel::createRegion()
+{
+    mTxFd = (int)syscall(__NR_memfd_create, "fdb-shm", MFD_CLOEXEC);
+    if (mTxFd < 0)
+    {
+        LOG_E("CFdbShmChannel: unable to create memfd: %d!\n", errno);
+        return false;
+    }
+    if (ftruncate(mTxFd, FDB_SHM_REGION_SIZE) < 0)
+    {
+        LOG_E("CFdbShmChannel: unable to resize memfd: %d!\n", errno);
+        return false;
+    }
+    auto mem = mmap(0, FDB_SHM_REGION_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, mTxFd, 0);
+    if (mem == MAP_FAILED)
+    {
+        LOG_E("CFdbShmChannel: unable to map memfd: %d!\n", errno);
+        return false;
+    }
+
+    mTxBase = (uint8_t *)mem;
+    mTxSize = FDB_SHM_REGION_SIZE;
+    auto head = (CFdbShmRegionHead *)mTxBase;
+    head->mMagic = FDB_SHM_MAGIC;
+    head->mSize = mTxSize;
+    return true;
+}
+
+int32_t CFdbShmChannel::sendRegion(int sock_fd, uint8_t *doorbell)
+{
+    if (mTxBroken)
+    {
+        return -1;
+    }
+    if (!mTxBase && !createRegion())
+    {
+        mTxBroken = true;
+        return -1;
+    }
+
+    fdbShmBuildDoorbell(doorbell, FDB_SHM_DOORBELL_REGION, 0, mTxSize);
+    struct iovec iov;
+    iov.iov_base = doorbell;
+    iov.iov_len = FDB_SHM_DOORBELL_SIZE;
+
+    union
+    {
+        struct cmsghdr mAlign;
+        char mBuffer[CMSG_SPACE(sizeof(int))];
+    } control;
+    memset(&control, 0, sizeof(control));
+
+    struct msghdr hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.msg_iov = &iov;
+    hdr.msg_iovlen = 1;
+    hdr.msg_control = control.mBuffer;
+    hdr.msg_controllen = sizeof(control.mBuffer);
+    auto cmsg = CMSG_FIRSTHDR(&hdr);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &mTxFd, sizeof(int));
+
+    ssize_t ret;
+    do
+    {
+        ret = sendmsg(sock_fd, &hdr, MSG_NOSIGNAL);
+    } while ((ret < 0) && (errno == EINTR));
+
+    if (ret < 0)
+    {
+        if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+        {
+            return 0;
+        }
+        LOG_E("CFdbShmChannel: unable to send region: %d!\n", errno);
+        mTxBroken = true;
+        return -1;
+    }
+
+    // fd goes with the first byte; the mapping is all we need from now on
+    close(mTxFd);
+    mTxFd = -1;
+    mTxSent = true;
+    return (int32_t)ret;
+}
+
+void CFdbShmChannel::reclaimSlots()
+{
+    while (!mTxSlots.empty())
+    {
+        auto &slot = mTxSlots.front();
+        if (!slot.mSkip)
+        {
+            auto head = (CFdbShmSlotHead *)(mTxBase + slot.mOffset);
+            if (head->mState.load(std::memory_order_acquire) != FDB_SHM_SLOT_FREE)
+            {
+                break;
+            }
+        }
+        mTxUsed -= slot.mSize;
+        mTxSlots.pop_front();
+    }
+}
+
+int32_t CFdbShmChannel::allocSlot(uint32_t size)
+{
+    reclaimSlots();
+    uint32_t begin = FDB_SHM_REGION_HEAD_SIZE;
+    uint32_t offset;
+    if (mTxSlots.empty())
+    {
+        // start over to get the most contiguous space
+        if ((mTxSize - begin) < size)
+        {
+            return -1;
+        }
+        offset = begin;
+    }
+    else
+    {
+        // the oldest slot in use; free space is in [mTxHead, tail)
+        uint32_t tail = mTxSlots.front().mOffset;
+        if (mTxHead > tail)
+        {
+            if ((mTxSize - mTxHead) >= size)
+            {
+                offset = mTxHead;
+            }
+            else if ((tail - begin) >= size)
+            {
+                if (mTxHead < mTxSize)
+                {
+                    CTxSlot skip = {mTxHead, mTxSize - mTxHead, true};
+                    mTxSlots.push_back(skip);
+                    mTxUsed += skip.mSize;
+                }
+                offset = begin;
+            }
+            else
+            {
+                return -1;
+            }
+        }
+        else if ((tail - mTxHead) >= size)
+        {
+            offset = mTxHead;
+        }
+        else
+        {
+            return -1;
+        }
+    }
+
+    CTxSlot slot = {offset, size, false};
+    mTxSlots.push_back(slot);
+    mTxUsed += size;
+    mTxHead = offset + size;
+    auto head = (CFdbShmSlotHead *)(mTxBase + offset);
+    head->mState.store(FDB_SHM_SLOT_BUSY, std::memory_order_relaxed);
+    return (int32_t)offset;
+}
+
+bool CFdbShmChannel::putFrame(const CFdbIoVec *vecs, int32_t count, uint8_t *doorbell)
+{
+    int32_t size = 0;
+    for (int32_t i = 0; i < count; ++i)
+    {
+        size += vecs[i].mSize;
+    }
+    if (!mTxSent || (size <= 0))
+    {
+        return false;
+    }
+    int64_t slot_size = fdbShmRoundUp((int64_t)size + FDB_SHM_SLOT_HEAD_SIZE, FDB_SHM_SLOT_ALIGN);
+    if (slot_size > (mTxSize - FDB_SHM_REGION_HEAD_SIZE))
+    {
+        return false;
+    }
+    auto offset = allocSlot((uint32_t)slot_size);
+    if (offset < 0)
+    {
+        // ring is full: the frame goes through socket
+        return false;
+    }
+    auto frame = mTxBase + offset + FDB_SHM_SLOT_HEAD_SIZE;
+    for (int32_t i = 0; i < count; ++i)
+    {
+        memcpy(frame, vecs[i].mData, vecs[i].mSize);
+        frame += vecs[i].mSize;
+    }
+    fdbShmBuildDoorbell(doorbell, FDB_SHM_DOORBELL_FRAME, (uint32_t)offset, (uint32_t)size);
+    return true;
+}
+
+void CFdbShmChannel::cancelFrame(const uint8_t *doorbell)
+{
+    auto offset = fdbShmGetU32(doorbell + FDB_SHM_PREFIX_SIZE + 4);
+    if (!mTxSlots.empty() && !mTxSlots.back().mSkip && (mTxSlots.back().mOffset == offset))
+    {
+        // the latest slot: give the space back at once
+        mTxUsed -= mTxSlots.back().mSize;
+        mTxSlots.pop_back();
+        mTxHead = offset;
+        return;
+    }
+    for (auto it = mTxSlots.begin(); it != mTxSlots.end(); ++it)
+    {
+        if (!it->mSkip && (it->mOffset == offset))
+        {
+            auto head = (CFdbShmSlotHead *)(mTxBase + offset);
+            head->mState.store(FDB_SHM_SLOT_FREE, std::memory_order_release);
+            break;
+        }
+    }
+    reclaimSlots();
+}
+
+int64_t CFdbShmChannel::pendingSize()
+{
+    reclaimSlots();
+    return mTxUsed;
+}
+
+bool CFdbShmChannel::mapRegion()
+{
+    int fd = mRxPendingFd;
+    mRxPendingFd = -1;
+    if (fd < 0)
+    {
+        LOG_E("CFdbShmChannel: region is not received!\n");
+        return false;
+    }
+
+    struct stat st;
+    void *mem = MAP_FAILED;
+    if ((fstat(fd, &st) == 0) && (st.st_size >= FDB_SHM_REGION_HEAD_SIZE) &&
+            (st.st_size <= FDB_SHM_MAX_REGION_SIZE))
+    {
+        mem = mmap(0, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (mem == MAP_FAILED)
+    {
+        LOG_E("CFdbShmChannel: unable to map region of peer!\n");
+        return false;
+    }
+
+    auto head = (CFdbShmRegionHead *)mem;
+    if ((head->mMagic != FDB_SHM_MAGIC) || (head->mSize != (uint32_t)st.st_size))
+    {
+        LOG_E("CFdbShmChannel: bad region from peer!\n");
+        munmap(mem, st.st_size);
+        return false;
+    }
+
+    if (mRxRegion)
+    {
+        mRxRegion->unref();
+    }
+    mRxRegion = new CFdbShmRxRegion((uint8_t *)mem, (uint32_t)st.st_size);
+    return true;
+}
+
+bool CFdbShmChannel::getFrame(const uint8_t *body, int32_t size, std::shared_ptr<uint8_t> &frame_ref,
+                              CFdbMsgPrefix &prefix)
+{
+    frame_ref.reset();
+    if (size != (FDB_SHM_DOORBELL_SIZE - FDB_SHM_PREFIX_SIZE))
+    {
+        return false;
+    }
+    auto type = fdbShmGetU32(body);
+    auto offset = fdbShmGetU32(body + 4);
+    auto frame_size = fdbShmGetU32(body + 8);
+    if (type == FDB_SHM_DOORBELL_REGION)
+    {
+        return mapRegion();
+    }
+    if ((type != FDB_SHM_DOORBELL_FRAME) || !mRxRegion)
+    {
+        return false;
+    }
+
+    // never trust the peer: frame should be inside the region
+    if ((offset < FDB_SHM_REGION_HEAD_SIZE) || (offset % FDB_SHM_SLOT_ALIGN) ||
+            (frame_size < (uint32_t)FDB_SHM_PREFIX_SIZE) ||
+            (((uint64_t)offset + FDB_SHM_SLOT_HEAD_SIZE + frame_size) > mRxRegion->size()))
+    {
+        return false;
+    }
+
+    auto frame = mRxRegion->base() + offset + FDB_SHM_SLOT_HEAD_SIZE;
+    // read once: the peer is able to change it at any time
+    prefix.deserialize(frame);
+    if ((prefix.mTotalLength != frame_size) || !prefix.mHeadLength ||
+            (prefix.mHeadLength > (frame_size - FDB_SHM_PREFIX_SIZE)))
+    {
+        return false;
+    }
+    mRxRegion->ref();
+    frame_ref.reset(frame, CFdbShmFrameReleaser(mRxRegion));
+    return true;
+}
+#endif
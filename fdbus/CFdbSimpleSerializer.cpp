@@ -103,13 +103,11 @@ void CFdbSimpleSerializer::addMemory(uint32_t size)
     uint32_t old_total = mTotalSize;
     if (new_pos > mTotalSize)
     {
-        if (size < FDB_SER_BUFFER_BLOCK_SIZE)
+        // grow geometrically so that appending many small pieces is linear
+        mTotalSize = new_pos + FDB_SER_BUFFER_BLOCK_SIZE;
+        if (mTotalSize < old_total * 2)
         {
-            mTotalSize += FDB_SER_BUFFER_BLOCK_SIZE;
-        }
-        else
-        {
-            mTotalSize += size + FDB_SER_BUFFER_BLOCK_SIZE;
+            mTotalSize = old_total * 2;
         }
     }
     if (mTotalSize > old_total)
@@ -141,10 +139,7 @@ void CFdbSimpleSerializer::addBasicType(const uint8_t *p_data, int32_t size)
 void CFdbSimpleSerializer::addRawData(const uint8_t *p_data, int32_t size)
 {
     addMemory(size);
-    for (int32_t i = 0; i < size; ++i)
-    {
-        mBuffer[mPos + i] = p_data[i];
-    }
+    memcpy(mBuffer + mPos, p_data, size);
     mPos += size;
 }
 
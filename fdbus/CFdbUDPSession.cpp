@@ -21,26 +21,70 @@
 #include <common_base/CLogProducer.h>
 #include <common_base/CSocketImp.h>
 #include <common_base/CFdbMessage.h>
+#include <common_base/CFdbBufferPool.h>
+#include <common_base/CBaseSysDep.h>
+#include <common_base/CBaseThread.h>
 #include <utils/Log.h>
 #include <utils/CFdbIfMessageHeader.h>
 
 #define FDB_UDP_RECEIVE_BUFFER_SIZE     (64 * 1024 - 1)
+// datagram larger than this takes receive buffer away instead of copying
+#define FDB_UDP_HANDOVER_SIZE           (FDB_UDP_RECEIVE_BUFFER_SIZE / 4)
+// datagram larger than this is sent at once instead of being queued
+#define FDB_UDP_QUEUE_SIZE              (4 * 1024)
 
 CFdbUDPSession::CFdbUDPSession(CFdbSessionContainer *container, CSocketImp *socket)
     : CBaseFdWatch(socket->getFd(), POLLIN | POLLHUP | POLLERR)
     , mContainer(container)
     , mSocket(socket)
+    , mNrRxBuffers(1)
+    , mDestroyed(0)
+    , mTxCount(0)
+    , mTxSize(0)
+    , mReassemblySize(0)
+    , mTxMsgId(0)
 {
+    memset(mRxBuffers, 0, sizeof(mRxBuffers));
+    mSenderId = (uint32_t)(sysdep_getsystemtime_nano() ^ ((uint64_t)CBaseThread::getPid() << 16) ^
+                           (uint64_t)(uintptr_t)this);
+}
+
+static void fdbPutLE32(uint8_t *buffer, uint32_t value)
+{
+    buffer[0] = (uint8_t)((value >> 0) & 0xff);
+    buffer[1] = (uint8_t)((value >> 8) & 0xff);
+    buffer[2] = (uint8_t)((value >> 16) & 0xff);
+    buffer[3] = (uint8_t)((value >> 24) & 0xff);
+}
+
+static uint32_t fdbGetLE32(const uint8_t *buffer)
+{
+    return ((uint32_t)buffer[0] << 0) | ((uint32_t)buffer[1] << 8) |
+           ((uint32_t)buffer[2] << 16) | ((uint32_t)buffer[3] << 24);
 }
 
 CFdbUDPSession::~CFdbUDPSession()
 {
     mContainer->mUDPSession = 0;
+    // remove from the loop while the descriptor is still valid
+    attach(0);
     if (mSocket)
     {
         delete mSocket;
         mSocket = 0;
     }
+    for (int32_t i = 0; i < FDB_UDP_MAX_BATCH_SIZE; ++i)
+    {
+        CFdbBufferPool::release(mRxBuffers[i]);
+    }
+    while (!mReassemblyTbl.empty())
+    {
+        dropReassembly(mReassemblyTbl.begin());
+    }
+    if (mDestroyed)
+    {
+        *mDestroyed = true;
+    }
     descriptor(0);
 }
 
@@ -54,13 +98,122 @@ bool CFdbUDPSession::sendMessage(const uint8_t *buffer, int32_t size, const CFdb
     return false;
 }
 
-bool CFdbUDPSession::sendMessage(CFdbMessage *msg, const CFdbSocketAddr &dest_addr)
+/*
+ * Fragments are cut from pieces of the frame in place; a fragment across
+ * two pieces takes the second one as tail of its datagram.
+ */
+bool CFdbUDPSession::sendFragments(const CFdbIoVec *vecs, int32_t count, int32_t size,
+                                   const CFdbSocketAddr &dest_addr)
+{
+    if (!FDB_VALID_PORT(dest_addr.mPort) || dest_addr.mAddr.empty())
+    {
+        return false;
+    }
+    int32_t nr_fragments = (size + FDB_UDP_FRAGMENT_DATA_SIZE - 1) / FDB_UDP_FRAGMENT_DATA_SIZE;
+    mFragmentHeads.resize(nr_fragments * FDB_UDP_FRAGMENT_HEAD_SIZE);
+    uint32_t msg_id = mTxMsgId++;
+
+    CFdbDatagram datagrams[FDB_UDP_MAX_BATCH_SIZE];
+    int32_t sent = 0;
+    while (sent < nr_fragments)
+    {
+        int32_t batch = nr_fragments - sent;
+        if (batch > FDB_UDP_MAX_BATCH_SIZE)
+        {
+            batch = FDB_UDP_MAX_BATCH_SIZE;
+        }
+        for (int32_t i = 0; i < batch; ++i)
+        {
+            int32_t offset = (sent + i) * FDB_UDP_FRAGMENT_DATA_SIZE;
+            int32_t piece = size - offset;
+            if (piece > FDB_UDP_FRAGMENT_DATA_SIZE)
+            {
+                piece = FDB_UDP_FRAGMENT_DATA_SIZE;
+            }
+            auto head = mFragmentHeads.data() + (sent + i) * FDB_UDP_FRAGMENT_HEAD_SIZE;
+            CFdbMsgPrefix prefix(FDB_UDP_FRAGMENT_HEAD_SIZE + piece, 0);
+            prefix.serialize(head);
+            fdbPutLE32(head + CFdbMessage::mPrefixSize, mSenderId);
+            fdbPutLE32(head + CFdbMessage::mPrefixSize + 4, msg_id);
+            fdbPutLE32(head + CFdbMessage::mPrefixSize + 8, (uint32_t)size);
+            fdbPutLE32(head + CFdbMessage::mPrefixSize + 12, (uint32_t)offset);
+
+            // piece of frame where the fragment starts
+            int32_t vec_idx = 0;
+            int32_t in_vec = offset;
+            while ((vec_idx < count - 1) && (in_vec >= vecs[vec_idx].mSize))
+            {
+                in_vec -= vecs[vec_idx++].mSize;
+            }
+            int32_t data_size = vecs[vec_idx].mSize - in_vec;
+            if (data_size > piece)
+            {
+                data_size = piece;
+            }
+
+            datagrams[i].mHead = head;
+            datagrams[i].mHeadSize = FDB_UDP_FRAGMENT_HEAD_SIZE;
+            datagrams[i].mData = vecs[vec_idx].mData + in_vec;
+            datagrams[i].mSize = data_size;
+            if ((data_size < piece) && (vec_idx < count - 1))
+            {
+                datagrams[i].mTail = vecs[vec_idx + 1].mData;
+                datagrams[i].mTailSize = piece - data_size;
+            }
+            else
+            {
+                datagrams[i].mTail = 0;
+                datagrams[i].mTailSize = 0;
+            }
+            datagrams[i].mDestAddr = &dest_addr;
+        }
+        auto ret = mSocket->send(datagrams, batch);
+        if (ret <= 0)
+        {
+            // fragments already sent are dropped by the peer upon timeout
+            return false;
+        }
+        sent += ret;
+    }
+    return true;
+}
+
+bool CFdbUDPSession::sendMessage(CFdbMessage *msg, const CFdbSocketAddr &dest_addr,
+                                 bool compact_head, bool fragment)
 {
-    if (!msg->buildHeader())
+    if (!msg->buildHeader(compact_head))
     {
         return false;
     }
-    if (sendMessage(msg->getRawBuffer(), msg->getRawDataSize(), dest_addr))
+    int32_t size = msg->getRawDataSize();
+    CFdbIoVec vecs[FDB_MSG_MAX_FRAME_PIECES];
+    auto count = msg->getFrame(vecs);
+    bool ok;
+    if (size <= FDB_UDP_MAX_DATAGRAM_SIZE)
+    {
+        if (count == 1)
+        {
+            ok = sendMessage(vecs[0].mData, size, dest_addr);
+        }
+        else
+        {
+            // head built apart from payload goes ahead of it in the same datagram
+            CFdbDatagram datagram = {vecs[0].mData, vecs[0].mSize, vecs[1].mData, vecs[1].mSize,
+                                     0, 0, &dest_addr};
+            ok = FDB_VALID_PORT(dest_addr.mPort) && !dest_addr.mAddr.empty() &&
+                 (mSocket->send(&datagram, 1) == 1);
+        }
+    }
+    else if (fragment && (size <= FDB_UDP_MAX_MESSAGE_SIZE))
+    {
+        ok = sendFragments(vecs, count, size, dest_addr);
+    }
+    else
+    {
+        // let caller fall back to TCP
+        ok = false;
+    }
+    if (ok)
     {
         if (msg->isLogEnabled())
         {
@@ -75,15 +228,156 @@ bool CFdbUDPSession::sendMessage(CFdbMessage *msg, const CFdbSocketAddr &dest_ad
     return false;
 }
 
-int32_t CFdbUDPSession::receiveData(uint8_t *buf, int32_t size)
+int32_t CFdbUDPSession::batchSize() const
 {
-    return mSocket->recv(buf, size);
+    int32_t size = mContainer->owner()->udpBatchSize();
+    if (size > FDB_UDP_MAX_BATCH_SIZE)
+    {
+        return FDB_UDP_MAX_BATCH_SIZE;
+    }
+    return (size < 1) ? 1 : size;
+}
+
+bool CFdbUDPSession::queueMessage(CFdbMessage *msg, const CFdbSocketAddr &dest_addr,
+                                  bool compact_head, bool fragment)
+{
+    if (!FDB_VALID_PORT(dest_addr.mPort) || dest_addr.mAddr.empty())
+    {
+        return false;
+    }
+    if (!msg->buildHeader(compact_head))
+    {
+        return false;
+    }
+    int32_t size = msg->getRawDataSize();
+    if (size > FDB_UDP_QUEUE_SIZE)
+    {
+        return sendMessage(msg, dest_addr, compact_head, fragment);
+    }
+
+    if (mTxCount == (int32_t)mTxDatagrams.size())
+    {
+        mTxDatagrams.resize(mTxCount + 1);
+    }
+    auto &datagram = mTxDatagrams[mTxCount++];
+    datagram.mOffset = mTxSize;
+    datagram.mSize = size;
+    datagram.mDestAddr.mAddr = dest_addr.mAddr;
+    datagram.mDestAddr.mPort = dest_addr.mPort;
+    if ((int32_t)mTxBuffer.size() < (mTxSize + size))
+    {
+        mTxBuffer.resize(mTxSize + size);
+    }
+    CFdbIoVec vecs[FDB_MSG_MAX_FRAME_PIECES];
+    auto count = msg->getFrame(vecs);
+    for (int32_t i = 0; i < count; ++i)
+    {
+        memcpy(mTxBuffer.data() + mTxSize, vecs[i].mData, vecs[i].mSize);
+        mTxSize += vecs[i].mSize;
+    }
+
+    if (msg->isLogEnabled())
+    {
+        auto logger = FDB_CONTEXT->getLogger();
+        if (logger)
+        {
+            logger->logFDBus(msg, 0, mContainer->owner());
+        }
+    }
+    if (mTxCount >= batchSize())
+    {
+        flushBatch();
+    }
+    return true;
+}
+
+void CFdbUDPSession::flushBatch()
+{
+    CFdbDatagram datagrams[FDB_UDP_MAX_BATCH_SIZE];
+    int32_t sent = 0;
+    while (sent < mTxCount)
+    {
+        int32_t count = mTxCount - sent;
+        if (count > FDB_UDP_MAX_BATCH_SIZE)
+        {
+            count = FDB_UDP_MAX_BATCH_SIZE;
+        }
+        for (int32_t i = 0; i < count; ++i)
+        {
+            auto &queued = mTxDatagrams[sent + i];
+            datagrams[i].mHeadSize = 0;
+            datagrams[i].mData = mTxBuffer.data() + queued.mOffset;
+            datagrams[i].mSize = queued.mSize;
+            datagrams[i].mTailSize = 0;
+            datagrams[i].mDestAddr = &queued.mDestAddr;
+        }
+        auto ret = mSocket->send(datagrams, count);
+        if (ret <= 0)
+        {
+            // best efforts: the rest is dropped as if lost
+            LOG_E("CFdbUDPSession: fail to send %d datagrams!\n", mTxCount - sent);
+            break;
+        }
+        sent += ret;
+    }
+    mTxCount = 0;
+    mTxSize = 0;
 }
 
 void CFdbUDPSession::onInput()
 {
-    uint8_t rx_buffer[FDB_UDP_RECEIVE_BUFFER_SIZE];
-    int32_t rx_size = receiveData(rx_buffer, sizeof(rx_buffer));
+    auto pool = mContainer->owner()->context()->bufferPool();
+    int32_t max_batch = batchSize();
+    if (mNrRxBuffers > max_batch)
+    {
+        mNrRxBuffers = max_batch;
+    }
+    for (int32_t i = 0; i < mNrRxBuffers; ++i)
+    {
+        if (!mRxBuffers[i])
+        {
+            mRxBuffers[i] = pool->alloc(FDB_UDP_RECEIVE_BUFFER_SIZE);
+            if (!mRxBuffers[i])
+            {
+                if (!i)
+                {
+                    return;
+                }
+                mNrRxBuffers = i;
+                break;
+            }
+        }
+    }
+
+    int32_t rx_sizes[FDB_UDP_MAX_BATCH_SIZE];
+    int32_t received = mSocket->recv(mRxBuffers, FDB_UDP_RECEIVE_BUFFER_SIZE, rx_sizes, mNrRxBuffers);
+    if ((received == mNrRxBuffers) && (mNrRxBuffers < max_batch))
+    {
+        // more might be pending: take more at a time from next round
+        mNrRxBuffers *= 2;
+        if (mNrRxBuffers > max_batch)
+        {
+            mNrRxBuffers = max_batch;
+        }
+    }
+
+    // dispatch all datagrams in one pass
+    bool destroyed = false;
+    mDestroyed = &destroyed;
+    for (int32_t i = 0; (i < received) && !fatalError(); ++i)
+    {
+        processDatagram(mRxBuffers[i], rx_sizes[i]);
+        if (destroyed)
+        {
+            return;
+        }
+    }
+    mDestroyed = 0;
+}
+
+void CFdbUDPSession::processDatagram(uint8_t *&rx_buffer, int32_t rx_size)
+{
+    auto pool = mContainer->owner()->context()->bufferPool();
     if (rx_size < CFdbMessage::mPrefixSize)
     {
         return;
@@ -94,6 +388,11 @@ void CFdbUDPSession::onInput()
     {
         return;
     }
+    if (!prefix.mHeadLength)
+    {
+        processFragment(rx_buffer, (int32_t)prefix.mTotalLength);
+        return;
+    }
 
     int32_t data_size = prefix.mTotalLength - CFdbMessage::mPrefixSize;
     if (data_size < 0)
@@ -105,26 +404,140 @@ void CFdbUDPSession::onInput()
      * keeping uniform structure
      */
     uint8_t *whole_buf;
-    try
+    if (prefix.mTotalLength > FDB_UDP_HANDOVER_SIZE)
     {
-        whole_buf = new uint8_t[prefix.mTotalLength];
+        whole_buf = rx_buffer;
+        rx_buffer = 0;
     }
-    catch (...)
+    else
+    {
+        whole_buf = pool->alloc(prefix.mTotalLength);
+        if (!whole_buf)
+        {
+            LOG_E("CFdbUDPSession: Unable to allocate buffer of size %d!\n",
+                    CFdbMessage::mPrefixSize + data_size);
+            fatalError(true);
+            return;
+        }
+        memcpy(whole_buf + CFdbMessage::mPrefixSize, rx_buffer + CFdbMessage::mPrefixSize, data_size);
+    }
+    dispatchMessage(prefix, whole_buf);
+}
+
+void CFdbUDPSession::dropReassembly(tReassemblyTbl::iterator it)
+{
+    CFdbBufferPool::release(it->second.mBuffer);
+    mReassemblySize -= it->second.mMsgSize;
+    mReassemblyTbl.erase(it);
+}
+
+void CFdbUDPSession::processFragment(const uint8_t *data, int32_t size)
+{
+    if (size <= FDB_UDP_FRAGMENT_HEAD_SIZE)
     {
-        LOG_E("CFdbUDPSession: Unable to allocate buffer of size %d!\n",
-                CFdbMessage::mPrefixSize + data_size);
-        fatalError(true);
         return;
     }
+    auto frag_head = data + CFdbMessage::mPrefixSize;
+    uint32_t sender_id = fdbGetLE32(frag_head);
+    uint32_t msg_id = fdbGetLE32(frag_head + 4);
+    uint32_t msg_size = fdbGetLE32(frag_head + 8);
+    uint32_t offset = fdbGetLE32(frag_head + 12);
+    uint32_t piece = (uint32_t)(size - FDB_UDP_FRAGMENT_HEAD_SIZE);
+    if ((msg_size > FDB_UDP_MAX_MESSAGE_SIZE) || (msg_size <= (uint32_t)CFdbMessage::mPrefixSize) ||
+        (offset % FDB_UDP_FRAGMENT_DATA_SIZE) || (offset >= msg_size) || (piece > (msg_size - offset)) ||
+        ((piece != FDB_UDP_FRAGMENT_DATA_SIZE) && ((offset + piece) != msg_size)))
+    {
+        return;
+    }
+
+    // drop incomplete messages which time out
+    auto now = sysdep_getsystemtime_milli();
+    for (auto it = mReassemblyTbl.begin(); it != mReassemblyTbl.end();)
+    {
+        auto the_it = it++;
+        if ((now - the_it->second.mStartTime) > FDB_UDP_REASSEMBLY_TIMEOUT)
+        {
+            dropReassembly(the_it);
+        }
+    }
+
+    uint64_t key = ((uint64_t)sender_id << 32) | msg_id;
+    auto it = mReassemblyTbl.find(key);
+    if (it == mReassemblyTbl.end())
+    {
+        // make room by dropping the oldest
+        while (!mReassemblyTbl.empty() &&
+               ((mReassemblySize + (int32_t)msg_size) > FDB_UDP_REASSEMBLY_MEMORY))
+        {
+            auto oldest = mReassemblyTbl.begin();
+            for (auto it_old = mReassemblyTbl.begin(); it_old != mReassemblyTbl.end(); ++it_old)
+            {
+                if (it_old->second.mStartTime < oldest->second.mStartTime)
+                {
+                    oldest = it_old;
+                }
+            }
+            dropReassembly(oldest);
+        }
+        auto buffer = mContainer->owner()->context()->bufferPool()->alloc((int32_t)msg_size);
+        if (!buffer)
+        {
+            return;
+        }
+        auto &reassembly = mReassemblyTbl[key];
+        reassembly.mBuffer = buffer;
+        reassembly.mMsgSize = (int32_t)msg_size;
+        reassembly.mNrReceived = 0;
+        reassembly.mStartTime = now;
+        reassembly.mReceived.assign((msg_size + FDB_UDP_FRAGMENT_DATA_SIZE - 1) /
+                                    FDB_UDP_FRAGMENT_DATA_SIZE, false);
+        mReassemblySize += (int32_t)msg_size;
+        it = mReassemblyTbl.find(key);
+    }
+
+    auto &reassembly = it->second;
+    uint32_t index = offset / FDB_UDP_FRAGMENT_DATA_SIZE;
+    if ((reassembly.mMsgSize != (int32_t)msg_size) || reassembly.mReceived[index])
+    {
+        // duplicated or from a different message of the same id
+        return;
+    }
+    reassembly.mReceived[index] = true;
+    reassembly.mNrReceived++;
+    memcpy(reassembly.mBuffer + offset, data + FDB_UDP_FRAGMENT_HEAD_SIZE, piece);
+    if (reassembly.mNrReceived < (int32_t)reassembly.mReceived.size())
+    {
+        return;
+    }
+
+    // complete: the message is taken from the table
+    auto whole_buf = reassembly.mBuffer;
+    mReassemblySize -= reassembly.mMsgSize;
+    mReassemblyTbl.erase(it);
+    CFdbMsgPrefix prefix(whole_buf);
+    if ((prefix.mTotalLength != msg_size) || !prefix.mHeadLength)
+    {
+        CFdbBufferPool::release(whole_buf);
+        return;
+    }
+    dispatchMessage(prefix, whole_buf);
+}
+
+void CFdbUDPSession::dispatchMessage(CFdbMsgPrefix &prefix, uint8_t *whole_buf)
+{
     uint8_t *head_start = whole_buf + CFdbMessage::mPrefixSize;
-    memcpy(head_start, rx_buffer + CFdbMessage::mPrefixSize, data_size);
+    if (prefix.mHeadLength > (prefix.mTotalLength - CFdbMessage::mPrefixSize))
+    {
+        LOG_E("CFdbUDPSession: bad head length %u!\n", prefix.mHeadLength);
+        CFdbBufferPool::release(whole_buf);
+        return;
+    }
 
     NFdbBase::CFdbMessageHeader head;
-    CFdbParcelableParser parser(head);
-    if (!parser.parse(head_start, prefix.mHeadLength))
+    if (!head.parse(head_start, prefix.mHeadLength))
     {
         LOG_E("CFdbUDPSession: Unable to deserialize message head!\n");
-        delete[] whole_buf;
+        CFdbBufferPool::release(whole_buf);
         fatalError(true);
         return;
     }
@@ -140,7 +553,7 @@ void CFdbUDPSession::onInput()
         break;
         default:
             LOG_E("CFdbUDPSession: Message %d: Unknown type!\n", (int32_t)head.serial_number());
-            delete[] whole_buf;
+            CFdbBufferPool::release(whole_buf);
         break;
     }
 }
@@ -247,21 +247,24 @@ void CIntraNameProxy::doConnectToServer(CFdbBaseContext *context, FdbEndpointId_
 
                     auto session_container = client->doConnect(it->tcp_ipc_url().c_str(),
                                                                host_name.c_str(), udp_port);
-                    if (session_container)
+                    if (session_container && session_container->connecting())
                     {
-                        if (client->UDPEnabled() && (it->address_type() != FDB_SOCKET_IPC)
-                            && (udp_port > FDB_INET_PORT_NOBIND))
+                        // UDP is checked by onServerConnected() once connected
+                        LOG_I("CIntraNameProxy: Server: %s, address %s is being connected.\n",
+                                svc_name, it->tcp_ipc_url().c_str());
+                        break;
+                    }
+                    else if (session_container)
+                    {
+                        auto udp_state = checkUDPPort(client, session_container,
+                                                      it->address_type(), udp_port);
+                        if (udp_state < 0)
+                        {
+                            failure_count++;
+                        }
+                        else if (udp_state > 0)
                         {
-                            CFdbSocketInfo socket_info;
-                            if (!session_container->getUDPSocketInfo(socket_info) ||
-                                (!FDB_VALID_PORT(socket_info.mAddress->mPort)))
-                            {
-                                failure_count++;
-                            }
-                            else
-                            {
-                                success_count++;
-                            }
+                            success_count++;
                         }
                         LOG_E("CIntraNameProxy: Server: %s, address %s is connected.\n",
                                 svc_name, it->tcp_ipc_url().c_str());
@@ -310,6 +313,41 @@ void CIntraNameProxy::doConnectToServer(CFdbBaseContext *context, FdbEndpointId_
     }
 }
 
+int32_t CIntraNameProxy::checkUDPPort(CBaseClient *client, CFdbSessionContainer *container,
+                                      int32_t address_type, int32_t udp_port)
+{
+    if (!client->UDPEnabled() || (address_type == FDB_SOCKET_IPC) ||
+            (udp_port <= FDB_INET_PORT_NOBIND))
+    {
+        return 0;
+    }
+    CFdbSocketInfo socket_info;
+    if (!container->getUDPSocketInfo(socket_info) || !FDB_VALID_PORT(socket_info.mAddress->mPort))
+    {
+        return -1;
+    }
+    return 1;
+}
+
+void CIntraNameProxy::onServerConnected(CBaseClient *client, CFdbSessionContainer *container)
+{
+    CFdbSocketInfo socket_info;
+    if (!container->getSocketInfo(socket_info))
+    {
+        return;
+    }
+    if (checkUDPPort(client, container, socket_info.mAddress->mType, container->pendingUDPPort()) < 0)
+    {
+        /*
+         * Only this client is known to fail: as doConnectToServer() does for
+         * a single failure, request another UDP port for it.
+         */
+        auto svc_name = client->nsName().c_str();
+        LOG_E("CIntraNameProxy: Server: %s: requesting next UDP...\n", svc_name);
+        listenOnService(svc_name, client->context()->ctxId(), client->epid());
+    }
+}
+
 void CIntraNameProxy::onBroadcast(CBaseJob::Ptr &msg_ref)
 {
     auto msg = castToMessage<CFdbMessage *>(msg_ref);
@@ -57,6 +57,11 @@ public:
         mEnableReconnectToNS = enb;
     }
     void registerNsWatchdogListener(tNsWatchdogListenerFn &watchdog_listener);
+    /*
+     * Called once connect to server in progress is done so that UDP port
+     * allocated by name server is checked as if connected at once.
+     */
+    void onServerConnected(CBaseClient *client, CFdbSessionContainer *container);
     
 protected:
     void onReply(CBaseJob::Ptr &msg_ref);
@@ -102,6 +107,12 @@ private:
     
     void doConnectToServer(CFdbBaseContext *context, FdbEndpointId_t ep_id,
                            NFdbBase::FdbMsgAddressList &msg_addr_list, bool is_init_response);
+    /*
+     * Check UDP port allocated by name server for a connected client.
+     * Return 1 if bound, -1 if not, or 0 if UDP is not used.
+     */
+    static int32_t checkUDPPort(CBaseClient *client, CFdbSessionContainer *container,
+                                int32_t address_type, int32_t udp_port);
     void doBindAddress(CFdbBaseContext *context, FdbEndpointId_t ep_id,
                        NFdbBase::FdbMsgAddressList &msg_addr_list, bool force_rebind);
     void doRegisterNsWatchdogListener(tNsWatchdogListenerFn &watchdog_listener);
@@ -15,140 +15,222 @@
  */
 
 #include "CFdbLogCache.h"
+#include <string.h>
 #include <common_base/CFdbSession.h>
 #include <common_base/CBaseEndpoint.h>
 #include <common_base/CLogProducer.h>
 
-CFdbLogCache::CDataItem::CDataItem(const uint8_t *log_data, int32_t size, FdbEventCode_t code, uint32_t id)
-    : mLogData(((size > 0) && log_data) ? new uint8_t[size] : 0)
-    , mSize(size)
-    , mCode(code)
-    , mId(id)
+// same byte order as CFdbSimpleSerializer
+static void putInt32(uint8_t *buffer, int32_t value)
 {
-    if (mLogData && log_data)
+    for (int32_t i = 0; i < 4; ++i)
     {
-        memcpy(mLogData, log_data, size);
+        buffer[i] = (uint8_t)((uint32_t)value >> (i * 8));
     }
 }
 
-CFdbLogCache::CDataItem::~CDataItem()
+static int32_t getInt32(const uint8_t *buffer)
 {
-    if (mLogData)
+    uint32_t value = 0;
+    for (int32_t i = 0; i < 4; ++i)
     {
-        delete[] mLogData;
+        value |= (uint32_t)buffer[i] << (i * 8);
     }
+    return (int32_t)value;
 }
 
-void CFdbLogCache::removeAll()
+CFdbLogCache::~CFdbLogCache()
 {
-    while (!mCache.empty())
+    if (mArena)
     {
-        auto head = mCache.front();
-        mCache.pop_front();
-        delete head;
+        delete[] mArena;
     }
-    mFull = false;
+}
+
+void CFdbLogCache::removeAll()
+{
     mCacheSize = 0;
+    mHead = 0;
+    mTail = 0;
+    mWrapped = false;
+    mFull = false;
 }
 
-CFdbLogCache::~CFdbLogCache()
+int32_t CFdbLogCache::recordSizeAt(int32_t offset) const
 {
-    removeAll();
+    return recordSize(getInt32(mArena + offset + 4));
 }
 
 void CFdbLogCache::popOne()
 {
-    if (mCache.empty())
+    if (!mCacheSize)
     {
         return;
     }
-    auto head = mCache.front();
-    mCacheSize -= head->mSize + sizeof(CDataItem);
-    if (mCacheSize < 0)
+    auto size = recordSizeAt(mHead);
+    mHead += size;
+    mCacheSize -= size;
+    if (!mCacheSize)
     {
-        removeAll();
+        mHead = 0;
+        mTail = 0;
+        mWrapped = false;
     }
-
-    if (mCache.empty())
+    else if (mWrapped && (mHead >= mDataEnd))
     {
-        mCacheSize = 0;
-    }
-    else
-    {
-        mCache.pop_front();
-        delete head;
+        mHead = 0;
+        mWrapped = false;
     }
 }
 
-void CFdbLogCache::push(const uint8_t *log_data, int32_t size, FdbEventCode_t code)
+int32_t CFdbLogCache::reserve(int32_t size)
 {
-    if (!mMaxSize || (size <= 0))
+    if (size > mMaxSize)
     {
-        return;
+        mFull = true;
+        return -1;
     }
-    if (mStopIfFull)
+    while (true)
     {
-        if ((mCacheSize + size + (int32_t)sizeof(CDataItem)) > mMaxSize)
+        if (!mCacheSize)
         {
-            mFull = true;
-            return;
+            mHead = 0;
+            mTail = 0;
+            mWrapped = false;
         }
-    }
-    else
-    {
-        while ((mCacheSize + size + (int32_t)sizeof(CDataItem)) > mMaxSize)
+        if (mWrapped)
         {
-            mFull = true;
-            popOne();
-            if (mCache.empty())
+            if ((mHead - mTail) >= size)
             {
-                break;
+                return mTail;
             }
         }
+        else
+        {
+            if ((mMaxSize - mTail) >= size)
+            {
+                return mTail;
+            }
+            if (mHead >= size)
+            {
+                // leave the end of arena unused and wrap to the beginning
+                mDataEnd = mTail;
+                mWrapped = true;
+                mTail = 0;
+                return mTail;
+            }
+        }
+        mFull = true;
+        if (mStopIfFull)
+        {
+            return -1;
+        }
+        popOne();
     }
-
-    mCacheSize += size + sizeof(CDataItem);
-    mCache.push_back(new CDataItem(log_data, size, code, mDataId++));
 }
 
-void CFdbLogCache::dump(CLogProducer *log_producer)
+void CFdbLogCache::push(const uint8_t *log_data, int32_t size, FdbEventCode_t code)
 {
-    while (!mCache.empty())
+    if (!mMaxSize || (size <= 0))
     {
-        auto item = mCache.front();
-        log_producer->sendLog(item->mCode, item->mLogData, item->mSize);
-        mCache.pop_front();
-        delete item;
+        return;
     }
-    mCacheSize = 0;
-    mDataId = 0;
-    mFull = 0;
+    if (!mArena)
+    {
+        mArena = new uint8_t[mMaxSize];
+    }
+    auto record_size = recordSize(size);
+    auto offset = reserve(record_size);
+    if (offset < 0)
+    {
+        return;
+    }
+
+    auto record = mArena + offset;
+    putInt32(record, (int32_t)code);
+    putInt32(record + 4, size);
+    memcpy(record + FDB_LOG_CACHE_RECORD_HEAD_SIZE, log_data, size);
+    mTail = offset + record_size;
+    mCacheSize += record_size;
 }
 
-void CFdbLogCache::dump(CFdbBaseObject *object, CFdbSession *session, int32_t size)
+void CFdbLogCache::forEachChunk(int32_t max_chunk_size, int32_t size, tChunkFn chunk_fn) const
 {
-    if (!size)
+    if (!mCacheSize || !size)
     {
         return;
     }
+    int32_t seg_begin[2] = {mHead, 0};
+    int32_t seg_end[2] = {mWrapped ? mDataEnd : mTail, mTail};
+    int32_t nr_segs = mWrapped ? 2 : 1;
     int32_t size_sent = 0;
-    for (auto it = mCache.begin(); it != mCache.end(); ++it)
+    for (int32_t i = 0; i < nr_segs; ++i)
     {
-        CFdbMessage msg((*it)->mCode, object, 0, FDB_INVALID_ID, FDB_INVALID_ID, FDB_QOS_RELIABLE);
-        if (!msg.serialize((*it)->mLogData, (*it)->mSize, object))
+        auto chunk_begin = seg_begin[i];
+        auto pos = chunk_begin;
+        while (pos < seg_end[i])
         {
-            continue;
+            auto record_size = recordSizeAt(pos);
+            if ((pos > chunk_begin) && ((pos + record_size - chunk_begin) > max_chunk_size))
+            {
+                chunk_fn(mArena + chunk_begin, pos - chunk_begin);
+                chunk_begin = pos;
+            }
+            pos += record_size;
+            size_sent += record_size - FDB_LOG_CACHE_RECORD_HEAD_SIZE;
+            if ((size > 0) && (size_sent > size))
+            {
+                chunk_fn(mArena + chunk_begin, pos - chunk_begin);
+                return;
+            }
         }
-        object->broadcast(&msg, session);
-
-        size_sent += (*it)->mSize;
-        if ((size > 0) && (size_sent > size))
+        if (pos > chunk_begin)
         {
-            break;
+            chunk_fn(mArena + chunk_begin, pos - chunk_begin);
         }
     }
 }
 
+void CFdbLogCache::dump(CLogProducer *log_producer)
+{
+    bool batch = log_producer->mBatchMaxSize > 0;
+    forEachChunk(batch ? FDB_LOG_CACHE_DUMP_CHUNK_SIZE : 0, -1,
+        [log_producer, batch](const uint8_t *chunk, int32_t size)
+        {
+            if (batch)
+            {
+                log_producer->sendBatch(chunk, size);
+            }
+            else
+            {
+                log_producer->sendLog(getInt32(chunk), chunk + FDB_LOG_CACHE_RECORD_HEAD_SIZE,
+                                      size - FDB_LOG_CACHE_RECORD_HEAD_SIZE);
+            }
+        });
+    removeAll();
+}
+
+void CFdbLogCache::dump(CFdbBaseObject *object, CFdbSession *session, int32_t size, bool batch)
+{
+    forEachChunk(batch ? FDB_LOG_CACHE_DUMP_CHUNK_SIZE : 0, size,
+        [object, session, batch](const uint8_t *chunk, int32_t size)
+        {
+            FdbEventCode_t code = NFdbBase::NTF_LOG_BATCH;
+            if (!batch)
+            {
+                code = getInt32(chunk);
+                chunk += FDB_LOG_CACHE_RECORD_HEAD_SIZE;
+                size -= FDB_LOG_CACHE_RECORD_HEAD_SIZE;
+            }
+            CFdbMessage msg(code, object, 0, FDB_INVALID_ID, FDB_INVALID_ID, FDB_QOS_RELIABLE);
+            if (!msg.serialize(chunk, size, object))
+            {
+                return;
+            }
+            object->broadcast(&msg, session);
+        });
+}
+
 void CFdbLogCache::resize(int32_t max_size)
 {
     if ((max_size < 0) || (max_size == mMaxSize))
@@ -158,11 +240,29 @@ void CFdbLogCache::resize(int32_t max_size)
     while (mCacheSize > max_size)
     {
         popOne();
-        if (mCache.empty())
-        {
-            break;
-        }
     }
+
+    uint8_t *arena = 0;
+    int32_t data_size = 0;
+    if (mCacheSize)
+    {
+        // move the remaining records to the beginning of new arena
+        arena = new uint8_t[max_size];
+        forEachChunk(mMaxSize, -1, [arena, &data_size](const uint8_t *chunk, int32_t size)
+            {
+                memcpy(arena + data_size, chunk, size);
+                data_size += size;
+            });
+    }
+    // otherwise arena is allocated on next push
+    if (mArena)
+    {
+        delete[] mArena;
+    }
+    mArena = arena;
     mMaxSize = max_size;
+    mCacheSize = data_size;
+    mHead = 0;
+    mTail = data_size;
+    mWrapped = false;
 }
-
@@ -17,20 +17,36 @@
 #ifndef _CFDBLOGCACHE_H_
 #define _CFDBLOGCACHE_H_
 
-#include <deque>
+#include <functional>
 #include <common_base/common_defs.h>
 
 class CFdbSession;
 class CFdbBaseObject;
 class CLogProducer;
 
+/*
+ * Logs are cached in a fixed-size byte ring allocated once. Each record is
+ * [int32 code][int32 size][log data] in little endian, which is exactly the
+ * format of REQ_LOG_BATCH/NTF_LOG_BATCH, so that contiguous part of the ring
+ * can be sent as a batch without re-encoding. A record never wraps: if it
+ * does not fit at the end of the ring, it is placed at the beginning and the
+ * end of valid data before wrapping is remembered.
+ */
+#define FDB_LOG_CACHE_RECORD_HEAD_SIZE  8
+// max size of a batch sent when dumping cache
+#define FDB_LOG_CACHE_DUMP_CHUNK_SIZE   (64 * 1024)
+
 class CFdbLogCache
 {
 public:
     CFdbLogCache(int32_t max_size, bool stop_if_full = false)
-        : mMaxSize((max_size < 0) ? 0 : max_size)
+        : mArena(0)
+        , mMaxSize((max_size < 0) ? 0 : max_size)
         , mCacheSize(0)
-        , mDataId(0)
+        , mHead(0)
+        , mTail(0)
+        , mDataEnd(0)
+        , mWrapped(false)
         , mStopIfFull(stop_if_full)
         , mFull(false)
     {
@@ -38,7 +54,12 @@ public:
     ~CFdbLogCache();
     void push(const uint8_t *log_data, int32_t size, FdbEventCode_t code);
     void dump(CLogProducer *log_producer);
-    void dump(CFdbBaseObject *object, CFdbSession *session, int32_t size);
+    /*
+     * Send cached logs to session, oldest first, until more than size bytes
+     * are sent (size < 0 for all). If batch is true, logs are sent in
+     * NTF_LOG_BATCH messages; otherwise one message for each log.
+     */
+    void dump(CFdbBaseObject *object, CFdbSession *session, int32_t size, bool batch = false);
     void resize(int32_t max_size);
     int32_t size() const
     {
@@ -55,25 +76,31 @@ public:
     }
 
 private:
-    struct CDataItem
-    {
-        uint8_t *mLogData;
-        int32_t mSize;
-        FdbEventCode_t mCode;
-        uint32_t mId;
-        CDataItem(const uint8_t *log_data, int32_t size, FdbEventCode_t code, uint32_t id);
-        ~CDataItem();
-    };
-    typedef std::deque<CDataItem *> tCache;
-    tCache mCache;
+    typedef std::function<void(const uint8_t *chunk, int32_t size)> tChunkFn;
+    uint8_t *mArena;
     int32_t mMaxSize;
+    // size of all records in the ring
     int32_t mCacheSize;
-    uint32_t mDataId;
+    // offset of the oldest record
+    int32_t mHead;
+    // offset where the next record is written
+    int32_t mTail;
+    // end of records between mHead and end of arena when mWrapped is true
+    int32_t mDataEnd;
+    // records are in [mHead, mDataEnd) followed by [0, mTail)
+    bool mWrapped;
     bool mStopIfFull;
     bool mFull;
 
+    static int32_t recordSize(int32_t size)
+    {
+        return FDB_LOG_CACHE_RECORD_HEAD_SIZE + size;
+    }
+    int32_t recordSizeAt(int32_t offset) const;
+    int32_t reserve(int32_t size);
     void popOne();
     void removeAll();
+    void forEachChunk(int32_t max_chunk_size, int32_t size, tChunkFn chunk_fn) const;
 };
 
 #endif
@@ -0,0 +1,192 @@
+/*
+ * Copyright (C) 2015   Jeremy Chen jeremy_cz@yahoo.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <iostream>
+#include <chrono>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+#ifndef __WIN32__
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+#include "CLogBinFileManager.h"
+
+CLogBinFileManager::CLogBinFileManager(const char *log_path,
+                                       const char *base_name,
+                                       int64_t max_total_size,
+                                       int64_t max_file_size)
+    : CLogFileManager(log_path, base_name, max_total_size, max_file_size)
+    , mFd(-1)
+    , mBase(0)
+    , mMappedSize(0)
+    , mHead(0)
+    , mIndex(0)
+{
+    setFileSuffix(FDB_LOG_BIN_SUFFIX);
+}
+
+CLogBinFileManager::~CLogBinFileManager()
+{
+    closeFile();
+}
+
+int64_t CLogBinFileManager::dataOffset(int64_t file_size, uint32_t &index_capacity)
+{
+    index_capacity = (uint32_t)(file_size / FDB_LOG_BIN_INDEX_INTERVAL + 1);
+    return FDB_LOG_BIN_ALIGN_UP((int64_t)sizeof(CLogBinFileHead) +
+                                (int64_t)index_capacity * (int64_t)sizeof(CLogBinIndexEntry));
+}
+
+bool CLogBinFileManager::openFile(const char *abs_path, int64_t size)
+{
+#ifdef __WIN32__
+    std::cout << "CLogBinFileManager: Error! binary log storage is not supported!" << std::endl;
+    return false;
+#else
+    int64_t file_size = mMaxFileSize;
+    if (file_size > FDB_LOG_BIN_MAX_FILE_SIZE)
+    {
+        file_size = FDB_LOG_BIN_MAX_FILE_SIZE;
+    }
+    uint32_t index_capacity;
+    auto data_offset = dataOffset(file_size, index_capacity);
+    if ((data_offset + recordSize(size)) > file_size)
+    {
+        // a single record larger than a file takes a file alone
+        file_size = data_offset + recordSize(size);
+        if (file_size > FDB_LOG_BIN_MAX_FILE_SIZE)
+        {
+            return false;
+        }
+    }
+
+    mFd = open(abs_path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (mFd < 0)
+    {
+        std::cout << "CLogBinFileManager: Error! unable to create " << abs_path << std::endl;
+        return false;
+    }
+    // allocate the whole file at once so that writing to the mapping never
+    // hits a hole when storage is full
+    bool allocated = ftruncate(mFd, (off_t)file_size) == 0;
+#ifdef __LINUX__
+    if (allocated)
+    {
+        auto ret = posix_fallocate(mFd, 0, (off_t)file_size);
+        allocated = (ret == 0) || (ret == EINVAL) || (ret == EOPNOTSUPP);
+    }
+#endif
+    void *mem = allocated ?
+                mmap(0, (size_t)file_size, PROT_READ | PROT_WRITE, MAP_SHARED, mFd, 0) : MAP_FAILED;
+    if (mem == MAP_FAILED)
+    {
+        std::cout << "CLogBinFileManager: Error! unable to allocate " << abs_path << std::endl;
+        close(mFd);
+        mFd = -1;
+        unlink(abs_path);
+        return false;
+    }
+
+    mBase = (uint8_t *)mem;
+    mMappedSize = file_size;
+    mHead = (CLogBinFileHead *)mBase;
+    mIndex = (CLogBinIndexEntry *)(mBase + sizeof(CLogBinFileHead));
+    mHead->mMagic = FDB_LOG_BIN_MAGIC;
+    mHead->mVersion = FDB_LOG_BIN_VERSION;
+    mHead->mHeadSize = (uint16_t)sizeof(CLogBinFileHead);
+    mHead->mIndexOffset = (uint32_t)sizeof(CLogBinFileHead);
+    mHead->mIndexCapacity = index_capacity;
+    mHead->mIndexCount = 0;
+    mHead->mDataOffset = (uint32_t)data_offset;
+    mHead->mDataEnd = (uint32_t)data_offset;
+    mHead->mRecordCount = 0;
+    mHead->mFirstTime = 0;
+    mHead->mLastTime = 0;
+    return true;
+#endif
+}
+
+int64_t CLogBinFileManager::closeFile()
+{
+    int64_t file_size = 0;
+#ifndef __WIN32__
+    if (mBase)
+    {
+        file_size = mHead->mDataEnd;
+        munmap(mBase, (size_t)mMappedSize);
+        mBase = 0;
+        mHead = 0;
+        mIndex = 0;
+        mMappedSize = 0;
+    }
+    if (mFd >= 0)
+    {
+        // give back space allocated but not used
+        if (ftruncate(mFd, (off_t)file_size) < 0)
+        {
+            std::cout << "CLogBinFileManager: Error! unable to truncate log file" << std::endl;
+        }
+        close(mFd);
+        mFd = -1;
+    }
+#endif
+    return file_size;
+}
+
+bool CLogBinFileManager::fileFull(int64_t size)
+{
+    return !mBase || ((mHead->mDataEnd + recordSize(size)) > mMappedSize);
+}
+
+bool CLogBinFileManager::store(FdbMsgCode_t code, const void *data, int32_t size)
+{
+    if (!logEnabled() || !data || (size <= 0))
+    {
+        return false;
+    }
+    if (!checkFileSize(size) || !mBase)
+    {
+        return false;
+    }
+
+    auto now = (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+                            std::chrono::system_clock::now().time_since_epoch()).count();
+    uint32_t offset = mHead->mDataEnd;
+    auto record = (CLogBinRecordHead *)(mBase + offset);
+    record->mCode = code;
+    record->mTime = now;
+    memcpy(record + 1, data, size);
+    // publish the record after its content is in place
+    record->mSize = (uint32_t)size;
+
+    if ((mHead->mIndexCount < mHead->mIndexCapacity) &&
+        ((offset - mHead->mDataOffset) >= mHead->mIndexCount * FDB_LOG_BIN_INDEX_INTERVAL))
+    {
+        auto &entry = mIndex[mHead->mIndexCount++];
+        entry.mOffset = offset;
+        entry.mRecord = mHead->mRecordCount;
+        entry.mTime = now;
+    }
+    if (!mHead->mRecordCount)
+    {
+        mHead->mFirstTime = now;
+    }
+    mHead->mLastTime = now;
+    mHead->mRecordCount++;
+    mHead->mDataEnd = (uint32_t)(offset + recordSize(size));
+    return true;
+}
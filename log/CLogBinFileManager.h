@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2015   Jeremy Chen jeremy_cz@yahoo.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _CLOGBINFILEMANAGER_H_
+#define _CLOGBINFILEMANAGER_H_
+
+#include "CLogFileManager.h"
+
+/*
+ * Layout of binary log file (host byte order):
+ * [CLogBinFileHead][CLogBinIndexEntry x mIndexCapacity][record][record]...
+ * Each record is a CLogBinRecordHead followed by the payload of log message,
+ * i.e. the data built by CFdbSimpleSerializer at log producer, and is padded
+ * to FDB_LOG_BIN_ALIGN. mSize of a record is written last so that a record
+ * with 0 size marks the end of valid data even if log server is killed.
+ */
+#define FDB_LOG_BIN_MAGIC           0x474c4246 // "FBLG"
+#define FDB_LOG_BIN_VERSION         1
+#define FDB_LOG_BIN_SUFFIX          "fdblog"
+#define FDB_LOG_BIN_ALIGN           8
+// one index entry every such amount of record data
+#define FDB_LOG_BIN_INDEX_INTERVAL  (16 * 1024)
+// offsets are 32bit
+#define FDB_LOG_BIN_MAX_FILE_SIZE   (1024 * 1024 * 1024)
+
+#define FDB_LOG_BIN_ALIGN_UP(_size) \
+    (((_size) + FDB_LOG_BIN_ALIGN - 1) & ~(int64_t)(FDB_LOG_BIN_ALIGN - 1))
+
+struct CLogBinFileHead
+{
+    uint32_t mMagic;
+    uint16_t mVersion;
+    uint16_t mHeadSize;
+    uint32_t mIndexOffset;
+    uint32_t mIndexCapacity;
+    uint32_t mIndexCount;
+    uint32_t mDataOffset;
+    uint32_t mDataEnd;
+    uint32_t mRecordCount;
+    // wall time in milliseconds of first and last record
+    uint64_t mFirstTime;
+    uint64_t mLastTime;
+};
+
+struct CLogBinIndexEntry
+{
+    uint32_t mOffset;
+    uint32_t mRecord;
+    uint64_t mTime;
+};
+
+struct CLogBinRecordHead
+{
+    uint32_t mSize;
+    // NFdbBase::NTF_FDBUS_LOG or NFdbBase::NTF_TRACE_LOG
+    int32_t mCode;
+    // wall time in milliseconds when log server receives the log
+    uint64_t mTime;
+};
+
+class CLogBinFileManager : public CLogFileManager
+{
+public:
+    CLogBinFileManager(const char *log_path,
+                       const char *base_name = 0,
+                       int64_t max_total_size = 0,
+                       int64_t max_file_size = 0);
+    ~CLogBinFileManager();
+
+    bool store(FdbMsgCode_t code, const void *data, int32_t size);
+protected:
+    bool openFile(const char *abs_path, int64_t size);
+    int64_t closeFile();
+    bool fileFull(int64_t size);
+private:
+    int mFd;
+    uint8_t *mBase;
+    int64_t mMappedSize;
+    CLogBinFileHead *mHead;
+    CLogBinIndexEntry *mIndex;
+
+    static int64_t recordSize(int64_t size)
+    {
+        return FDB_LOG_BIN_ALIGN_UP((int64_t)sizeof(CLogBinRecordHead) + size);
+    }
+    static int64_t dataOffset(int64_t file_size, uint32_t &index_capacity);
+};
+
+#endif
@@ -32,7 +32,7 @@
 
 #define FDB_LOG_FILE_INDEX_SIZE 8
 
-#define _fdb_filename_format(_size) "%0" #_size "d-%s-%s.txt"
+#define _fdb_filename_format(_size) "%0" #_size "d-%s-%s.%s"
 #define fdb_filename_format(_size) _fdb_filename_format(_size)
 
 #ifdef __WIN32__
@@ -47,12 +47,14 @@ CLogFileManager::CLogFileManager(const char *log_path,
                                  const char *base_name,
                                  int64_t max_total_size,
                                  int64_t max_file_size)
-    : mLogPath(log_path ? log_path : "")
+    : mMaxFileSize(max_file_size ? max_file_size : mDefaultMaxFileSize)
+    , mLogPath(log_path ? log_path : "")
     , mBaseName(base_name ? base_name : mDefaultBaseName)
+    , mFileSuffix("txt")
     , mMaxStorageSize(max_total_size ? max_total_size : mDefaultMaxStorageSize)
-    , mMaxFileSize(max_file_size ? max_file_size : mDefaultMaxFileSize)
     , mCurrentStorageSize(0)
     , mCurrentFp(0)
+    , mFileOpened(false)
     , mFileId(-1)
     , mEnableBuffer(false)
     , mBuffer(0)
@@ -76,11 +78,7 @@ bool CLogFileManager::setWorkingPath(const char *path)
 {
     if (path && (path[0] != '\0') && (mMaxStorageSize > mMaxFileSize) && mLogPath.compare(path))
     {
-        if (mCurrentFp)
-        {
-            fclose(mCurrentFp);
-            mCurrentFp = 0;
-        }
+        closeCurrentFile();
         mCurrentStorageSize = 0;
         mFilePool.clear();
         mLogPath = path;
@@ -255,25 +253,68 @@ void CLogFileManager::nextFileName()
     sysdep_gettimestamp(date_buf, sizeof(date_buf), 0, 1);
     date_buf[63] = '\0';
     snprintf(name_buf, sizeof(name_buf), fdb_filename_format(FDB_LOG_FILE_INDEX_SIZE),
-             mFileId++, mBaseName.c_str(), date_buf);
+             mFileId++, mBaseName.c_str(), date_buf, mFileSuffix.c_str());
     mCurrentFileName = name_buf;
 }
 
-void CLogFileManager::checkFileSize()
+bool CLogFileManager::openFile(const char *abs_path, int64_t size)
 {
-    if (mCurrentFp)
+    mCurrentFp = fopen(abs_path, "wb");
+    if (!mCurrentFp)
     {
-        int64_t file_size = (int64_t)ftell(mCurrentFp);
-        if (file_size >= mMaxFileSize)
+        return false;
+    }
+    if (mEnableBuffer)
+    {
+        if (mBuffer && mBufferSize)
         {
-            fclose(mCurrentFp);
-            mCurrentFp = 0;
-            mFilePool.push_back(CFileInfo(mCurrentFileName.c_str(), file_size));
-            mCurrentStorageSize += file_size;
+            setvbuf(mCurrentFp, mBuffer, _IOFBF, mBufferSize);
         }
     }
+    else
+    {
+        setbuf(mCurrentFp, 0);
+    }
+    return true;
+}
+
+int64_t CLogFileManager::closeFile()
+{
+    int64_t file_size = 0;
+    if (mCurrentFp)
+    {
+        file_size = (int64_t)ftell(mCurrentFp);
+        fclose(mCurrentFp);
+        mCurrentFp = 0;
+    }
+    return file_size;
+}
 
-    if (!mCurrentFp)
+bool CLogFileManager::fileFull(int64_t size)
+{
+    return mCurrentFp && ((int64_t)ftell(mCurrentFp) >= mMaxFileSize);
+}
+
+void CLogFileManager::closeCurrentFile()
+{
+    if (mFileOpened)
+    {
+        closeFile();
+        mFileOpened = false;
+    }
+}
+
+bool CLogFileManager::checkFileSize(int64_t size)
+{
+    if (mFileOpened && fileFull(size))
+    {
+        int64_t file_size = closeFile();
+        mFileOpened = false;
+        mFilePool.push_back(CFileInfo(mCurrentFileName.c_str(), file_size));
+        mCurrentStorageSize += file_size;
+    }
+
+    if (!mFileOpened)
     {
         while ((mCurrentStorageSize + mMaxFileSize) > mMaxStorageSize)
         {
@@ -298,29 +339,12 @@ void CLogFileManager::checkFileSize()
             }
         }
         
-        while (!mCurrentFp)
-        {
-            nextFileName();
-            std::string current_file;
-            getAbsPath(current_file);
-            mCurrentFp = fopen(current_file.c_str(), "wb");
-        }
-
-        if (mCurrentFp)
-        {
-            if (mEnableBuffer)
-            {
-                if (mBuffer && mBufferSize)
-                {
-                    setvbuf(mCurrentFp, mBuffer, _IOFBF, mBufferSize);
-                }
-            }
-            else
-            {
-                setbuf(mCurrentFp, 0);
-            }
-        }
+        nextFileName();
+        std::string current_file;
+        getAbsPath(current_file);
+        mFileOpened = openFile(current_file.c_str(), size);
     }
+    return mFileOpened;
 }
 
 bool CLogFileManager::store(const std::string &ostring)
@@ -329,8 +353,7 @@ bool CLogFileManager::store(const std::string &ostring)
     {
         return false;
     }
-    checkFileSize();
-    if (mCurrentFp)
+    if (checkFileSize((int64_t)ostring.size()) && mCurrentFp)
     {
         auto size = ostring.size();
         auto n = fwrite(ostring.c_str(), 1, size, mCurrentFp);
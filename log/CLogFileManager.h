@@ -49,6 +49,24 @@ public:
     bool setWorkingPath(const char *path);
     bool setStorageSize(int64_t max_storage_size = mDefaultMaxStorageSize,
                         int64_t max_file_size = mDefaultMaxFileSize);
+protected:
+    int64_t mMaxFileSize;
+
+    /*
+     * Make sure a file able to hold 'size' more bytes is opened; full file
+     * is closed and oldest files are removed if storage runs out.
+     */
+    bool checkFileSize(int64_t size);
+    void setFileSuffix(const char *suffix)
+    {
+        mFileSuffix = suffix;
+    }
+    // open a new file at abs_path, which should hold at least 'size' bytes
+    virtual bool openFile(const char *abs_path, int64_t size);
+    // close current file and return its final size
+    virtual int64_t closeFile();
+    // whether current file can not take 'size' more bytes
+    virtual bool fileFull(int64_t size);
 private:
     struct CFileInfo
     {
@@ -66,16 +84,17 @@ private:
     std::string mCurrentFileName;
     std::string mLogPath;
     std::string mBaseName;
+    std::string mFileSuffix;
     int64_t mMaxStorageSize;
-    int64_t mMaxFileSize;
     int64_t mCurrentStorageSize;
     FILE *mCurrentFp;
+    bool mFileOpened;
     int32_t mFileId;
     bool mEnableBuffer;
     char *mBuffer;
     uint32_t mBufferSize;
 
-    void checkFileSize();
+    void closeCurrentFile();
     bool getLatestFile(std::string &latest_file);
     int32_t getFileIndex(const char *file_name);
     bool addFile(const char *file_name);
@@ -53,9 +53,8 @@ void CLogPrinter::outputFdbLog(LogInfo &log_info, std::ostream &output)
     }
 }
 
-void CLogPrinter::outputFdbLog(CFdbSimpleDeserializer &deserializer, CFdbMessage *log_msg, std::ostream &output)
+bool CLogPrinter::parseFdbLog(CFdbSimpleDeserializer &deserializer, LogInfo &info)
 {
-    LogInfo info;
     deserializer >> info.mPid
                  >> info.mHostName
                  >> info.mSender
@@ -81,6 +80,13 @@ void CLogPrinter::outputFdbLog(CFdbSimpleDeserializer &deserializer, CFdbMessage
         deserializer >> info.mDataSize;
         info.mData = 0;
     }
+    return !deserializer.error();
+}
+
+void CLogPrinter::outputFdbLog(CFdbSimpleDeserializer &deserializer, CFdbMessage *log_msg, std::ostream &output)
+{
+    LogInfo info;
+    parseFdbLog(deserializer, info);
     outputFdbLog(info, output);
 
 }
@@ -102,9 +108,8 @@ void CLogPrinter::outputTraceLog(TraceInfo &trace_info, std::ostream &output)
            << trace_info.mData;
 }
 
-void CLogPrinter::outputTraceLog(CFdbSimpleDeserializer &deserializer, CFdbMessage *trace_msg, std::ostream &output)
+bool CLogPrinter::parseTraceLog(CFdbSimpleDeserializer &deserializer, TraceInfo &info)
 {
-    TraceInfo info;
     deserializer >> info.mPid
                  >> info.mTag
                  >> info.mHostName
@@ -112,11 +117,41 @@ void CLogPrinter::outputTraceLog(CFdbSimpleDeserializer &deserializer, CFdbMessa
                  >> info.mLogLevel;
     if (info.mLogLevel >= FDB_LL_MAX)
     {
-        return;
+        return false;
     }
 
     fdb_string_len_t str_len = 0;
     deserializer >> str_len;
     info.mData = str_len ? (const char *)deserializer.pos() : "\n";
+    return !deserializer.error();
+}
+
+void CLogPrinter::outputTraceLog(CFdbSimpleDeserializer &deserializer, CFdbMessage *trace_msg, std::ostream &output)
+{
+    TraceInfo info;
+    if (!parseTraceLog(deserializer, info))
+    {
+        return;
+    }
     outputTraceLog(info, output);
 }
+
+bool CLogPrinter::splitLogBatch(const uint8_t *data, int32_t size, tLogRecordFn record_fn)
+{
+    int32_t offset = 0;
+    while (offset < size)
+    {
+        CFdbSimpleDeserializer deserializer(data + offset, size - offset);
+        int32_t code = 0;
+        int32_t record_size = 0;
+        deserializer >> code >> record_size;
+        if (deserializer.error() || (record_size < 0) ||
+            (record_size > (size - offset - deserializer.index())))
+        {
+            return false;
+        }
+        record_fn(code, deserializer.pos(), record_size);
+        offset += deserializer.index() + record_size;
+    }
+    return true;
+}
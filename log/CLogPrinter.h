@@ -18,6 +18,7 @@
 #define __CLOGPRINTER_H__
 #include <string>
 #include <iostream>
+#include <functional>
 #include <common_base/CFdbMessage.h>
 
 class CFdbSimpleDeserializer;
@@ -54,7 +55,17 @@ public:
     CLogPrinter();
     void outputFdbLog(CFdbSimpleDeserializer &log_info, CFdbMessage *log_msg, std::ostream &output);
     static void outputFdbLog(LogInfo &log_info, std::ostream &output);
+    static bool parseFdbLog(CFdbSimpleDeserializer &deserializer, LogInfo &log_info);
     void outputTraceLog(CFdbSimpleDeserializer &trace_info, CFdbMessage *trace_msg, std::ostream &output);
     static void outputTraceLog(TraceInfo &trace_info, std::ostream &output);
+    static bool parseTraceLog(CFdbSimpleDeserializer &deserializer, TraceInfo &trace_info);
+
+    typedef std::function<void(FdbMsgCode_t code, const uint8_t *data, int32_t size)> tLogRecordFn;
+    /*
+     * Split payload of REQ_LOG_BATCH into records of REQ_FDBUS_LOG and
+     * REQ_TRACE_LOG. Each record is serialized as:
+     * [int32_t code][int32_t size][payload of the log in 'size' bytes]
+     */
+    static bool splitLogBatch(const uint8_t *data, int32_t size, tLogRecordFn record_fn);
 };
 #endif
@@ -27,6 +27,9 @@
 #include <string.h>
 #include <stdarg.h>
 #include <inttypes.h>
+#include <time.h>
+#include <chrono>
+#include <unordered_map>
 #include <utils/Log.h>
 #include "CFdbLogCache.h"
 #include "CLogPrinter.h"
@@ -46,6 +49,270 @@ const char *CLogProducer::mBreakMark =
 
 EFdbLogLevel CLogProducer::mStaticLogLevel = FDB_LL_INFO;
 
+// size of per-thread trace ring; must be power of 2
+#define FDB_TRACE_RING_SIZE         (64 * 1024)
+#define FDB_TRACE_RECORD_ALIGN      8
+// interned tags are kept in chunks which are never moved or freed
+#define FDB_TRACE_TAG_CHUNK_SIZE    256
+#define FDB_TRACE_TAG_MAX_CHUNKS    64
+// number of tags cached by each thread; must be power of 2
+#define FDB_TRACE_TAG_CACHE_SIZE    64
+// tag is stored in record since tag table is full
+#define FDB_TRACE_INLINE_TAG        0xFFFFFFFE
+// record to skip the end of ring
+#define FDB_TRACE_PADDING           0xFFFFFFFF
+#define FDB_TRACE_DROP_TAG          "FDBus"
+// latency of log batch if not specified
+#define FDB_LOG_BATCH_DEFAULT_LATENCY   20
+
+struct CTraceFilter
+{
+    EFdbLogLevel mLogLevel;
+    bool mDisableGlobal;
+    bool mHostEnabled;
+    bool mReverseTags;
+    std::set<std::string> mTagWhiteList;
+    CTraceFilter()
+        : mLogLevel(FDB_LL_INFO)
+        , mDisableGlobal(false)
+        , mHostEnabled(true)
+        , mReverseTags(false)
+    {}
+};
+
+struct CTraceRecordHead
+{
+    uint64_t mTime;     // nanoseconds since epoch
+    uint32_t mSize;     // size of whole record including padding
+    uint32_t mTagId;
+    uint16_t mInfoSize; // including '\0'
+    uint8_t mLevel;
+};
+
+#define FDB_TRACE_ALIGN_UP(_size) \
+    (((_size) + FDB_TRACE_RECORD_ALIGN - 1) & ~(uint64_t)(FDB_TRACE_RECORD_ALIGN - 1))
+
+/*
+ * Single-producer single-consumer ring of variable-sized trace records: the
+ * owner thread pushes and context of CLogProducer drains. Positions are
+ * free-running so that full and empty can be told apart. It is referred by
+ * both the thread and CLogProducer and freed by the one releasing it last.
+ */
+class CTraceRing
+{
+public:
+    CTraceRing(CLogProducer *owner)
+        : mOwner(owner)
+        , mHead(0)
+        , mTail(0)
+        , mDropped(0)
+        , mRefCount(2)
+        , mThreadExited(false)
+        , mOwnerGone(false)
+    {}
+
+    bool push(EFdbLogLevel log_level, uint32_t tag_id, const char *tag,
+              uint64_t time_ns, const char *info)
+    {
+        uint32_t tag_size = (tag_id == FDB_TRACE_INLINE_TAG) ? (uint32_t)strlen(tag) + 1 : 0;
+        uint32_t info_size = (uint32_t)strlen(info) + 1;
+        uint64_t size = FDB_TRACE_ALIGN_UP(sizeof(CTraceRecordHead) + tag_size + info_size);
+
+        auto head = mHead.load(std::memory_order_relaxed);
+        auto tail = mTail.load(std::memory_order_acquire);
+        uint64_t contiguous = FDB_TRACE_RING_SIZE - (head & (FDB_TRACE_RING_SIZE - 1));
+        uint64_t needed = (contiguous < size) ? (contiguous + size) : size;
+        if ((head + needed - tail) > FDB_TRACE_RING_SIZE)
+        {
+            mDropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        if (contiguous < size)
+        {
+            // too small room at the end is skipped by consumer implicitly
+            if (contiguous >= sizeof(CTraceRecordHead))
+            {
+                auto padding = (CTraceRecordHead *)(mBuffer + (head & (FDB_TRACE_RING_SIZE - 1)));
+                padding->mSize = (uint32_t)contiguous;
+                padding->mTagId = FDB_TRACE_PADDING;
+            }
+            head += contiguous;
+        }
+
+        auto record = (CTraceRecordHead *)(mBuffer + (head & (FDB_TRACE_RING_SIZE - 1)));
+        record->mTime = time_ns;
+        record->mSize = (uint32_t)size;
+        record->mTagId = tag_id;
+        record->mInfoSize = (uint16_t)info_size;
+        record->mLevel = (uint8_t)log_level;
+        auto data = (char *)(record + 1);
+        if (tag_size)
+        {
+            memcpy(data, tag, tag_size);
+        }
+        memcpy(data + tag_size, info, info_size);
+        mHead.store(head + size, std::memory_order_release);
+        return true;
+    }
+
+    template<typename T>
+    void drain(T &&consume)
+    {
+        auto tail = mTail.load(std::memory_order_relaxed);
+        auto head = mHead.load(std::memory_order_acquire);
+        while (tail != head)
+        {
+            uint64_t contiguous = FDB_TRACE_RING_SIZE - (tail & (FDB_TRACE_RING_SIZE - 1));
+            if (contiguous < sizeof(CTraceRecordHead))
+            {
+                tail += contiguous;
+                continue;
+            }
+            auto record = (const CTraceRecordHead *)(mBuffer + (tail & (FDB_TRACE_RING_SIZE - 1)));
+            if (record->mTagId != FDB_TRACE_PADDING)
+            {
+                consume(record);
+            }
+            tail += record->mSize;
+            mTail.store(tail, std::memory_order_release);
+        }
+        mTail.store(tail, std::memory_order_release);
+    }
+
+    bool empty() const
+    {
+        return mTail.load(std::memory_order_acquire) == mHead.load(std::memory_order_acquire);
+    }
+
+    void unref()
+    {
+        if (mRefCount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            delete this;
+        }
+    }
+
+    CLogProducer *mOwner;
+    std::atomic<uint64_t> mHead;
+    std::atomic<uint64_t> mTail;
+    std::atomic<uint32_t> mDropped;
+    std::atomic<int32_t> mRefCount;
+    std::atomic<bool> mThreadExited;
+    std::atomic<bool> mOwnerGone;
+private:
+    alignas(FDB_TRACE_RECORD_ALIGN) uint8_t mBuffer[FDB_TRACE_RING_SIZE];
+};
+
+class CTraceRingHolder
+{
+public:
+    CTraceRingHolder()
+        : mRing(0)
+    {}
+    ~CTraceRingHolder()
+    {
+        release();
+    }
+    void release()
+    {
+        if (mRing)
+        {
+            mRing->mThreadExited.store(true, std::memory_order_release);
+            mRing->unref();
+            mRing = 0;
+        }
+    }
+    CTraceRing *mRing;
+};
+
+static thread_local CTraceRingHolder tTraceRing;
+
+/*
+ * Tags are interned to ids process-wide. Each thread caches ids of the tags
+ * it uses so that the table lock is taken only the first time.
+ */
+static std::mutex gTraceTagLock;
+static std::unordered_map<std::string, uint32_t> gTraceTagIds;
+static std::string *gTraceTagNames[FDB_TRACE_TAG_MAX_CHUNKS];
+static uint32_t gTraceTagCount = 0;
+
+struct CTraceTagCache
+{
+    uint32_t mHash[FDB_TRACE_TAG_CACHE_SIZE];
+    uint32_t mId[FDB_TRACE_TAG_CACHE_SIZE]; // id + 1; 0 for empty
+};
+
+static thread_local CTraceTagCache tTraceTagCache;
+
+static const char *traceTagName(uint32_t id)
+{
+    return gTraceTagNames[id / FDB_TRACE_TAG_CHUNK_SIZE][id % FDB_TRACE_TAG_CHUNK_SIZE].c_str();
+}
+
+static uint32_t internTraceTag(const char *tag)
+{
+    uint32_t hash = 2166136261U;
+    for (auto p = (const uint8_t *)tag; *p; ++p)
+    {
+        hash = (hash ^ *p) * 16777619U;
+    }
+    auto &cache = tTraceTagCache;
+    auto slot = hash & (FDB_TRACE_TAG_CACHE_SIZE - 1);
+    if (cache.mId[slot] && (cache.mHash[slot] == hash) && !strcmp(traceTagName(cache.mId[slot] - 1), tag))
+    {
+        return cache.mId[slot] - 1;
+    }
+
+    uint32_t id;
+    {
+        std::lock_guard<std::mutex> _l(gTraceTagLock);
+        auto it = gTraceTagIds.find(tag);
+        if (it != gTraceTagIds.end())
+        {
+            id = it->second;
+        }
+        else
+        {
+            if (gTraceTagCount >= (FDB_TRACE_TAG_CHUNK_SIZE * FDB_TRACE_TAG_MAX_CHUNKS))
+            {
+                return FDB_TRACE_INLINE_TAG;
+            }
+            id = gTraceTagCount++;
+            auto &chunk = gTraceTagNames[id / FDB_TRACE_TAG_CHUNK_SIZE];
+            if (!chunk)
+            {
+                chunk = new std::string[FDB_TRACE_TAG_CHUNK_SIZE];
+            }
+            chunk[id % FDB_TRACE_TAG_CHUNK_SIZE] = tag;
+            gTraceTagIds[tag] = id;
+        }
+    }
+    cache.mHash[slot] = hash;
+    cache.mId[slot] = id + 1;
+    return id;
+}
+
+class CDrainTraceJob : public CBaseJob
+{
+public:
+    CDrainTraceJob(CLogProducer *producer, bool flush_batch = false)
+        : mProducer(producer)
+        , mFlushBatch(flush_batch)
+    {}
+protected:
+    void run(CBaseWorker *worker, Ptr &ref)
+    {
+        mProducer->drainTraceRings();
+        if (mFlushBatch)
+        {
+            mProducer->flushBatch();
+        }
+    }
+private:
+    CLogProducer *mProducer;
+    bool mFlushBatch;
+};
+
 CLogProducer::CLogProducer(int32_t log_cache_size)
     : CBaseClient(FDB_LOG_SERVER_NAME)
     , mPid(CBaseThread::getPid())
@@ -55,16 +322,18 @@ CLogProducer::CLogProducer(int32_t log_cache_size)
     , mDisableBroadcast(false)
     , mDisableSubscribe(false)
     , mRawDataClippingSize(0)
-    , mLogLevel(FDB_LL_INFO)
-    , mTraceDisableGlobal(false)
     , mLogHostEnabled(true)
-    , mTraceHostEnabled(true)
     , mReverseEndpoints(false)
     , mReverseBusNames(false)
-    , mReverseTags(false)
+    , mTraceFilter(new CTraceFilter())
+    , mTraceDrainPending(false)
+    , mBatchMaxSize(0)
+    , mBatchMaxLatency(0)
+    , mBatchTimer(this)
     , mLogCache(log_cache_size ? new CFdbLogCache(log_cache_size, true) : 0)
 {
     enableLog(false);
+    mBatchTimer.attach(context(), false);
 }
 
 CLogProducer::~CLogProducer()
@@ -73,6 +342,15 @@ CLogProducer::~CLogProducer()
     {
         delete mLogCache;
     }
+    {
+    std::lock_guard<std::mutex> _l(mTraceRingLock);
+    for (auto it = mTraceRings.begin(); it != mTraceRings.end(); ++it)
+    {
+        (*it)->mOwnerGone.store(true, std::memory_order_release);
+        (*it)->unref();
+    }
+    mTraceRings.clear();
+    }
 }
 
 void CLogProducer::sendCheckpoint(const char *check_point)
@@ -103,6 +381,8 @@ void CLogProducer::onOnline(FdbSessionId_t sid, bool is_first)
 
 void CLogProducer::onOffline(FdbSessionId_t sid, bool is_last)
 {
+    // logs in batch go to cache, if any
+    flushBatch();
 }
 
 void CLogProducer::onBroadcast(CBaseJob::Ptr &msg_ref)
@@ -142,12 +422,13 @@ void CLogProducer::onBroadcast(CBaseJob::Ptr &msg_ref)
                 LOG_E("CLogProducer: Unable to deserialize FdbTraceConfig!\n");
                 return;
             }
-            mLogLevel = (EFdbLogLevel)cfg.log_level();
-            mTraceDisableGlobal = !cfg.global_enable();
-            mTraceHostEnabled = checkHostEnabled(cfg.host_white_list());
-            std::lock_guard<std::mutex> _l(mTraceLock);
-            populateWhiteList(cfg.tag_white_list(), mTraceTagWhiteList);
-            mReverseTags = cfg.reverse_tag();
+            auto filter = std::make_shared<CTraceFilter>();
+            filter->mLogLevel = (EFdbLogLevel)cfg.log_level();
+            filter->mDisableGlobal = !cfg.global_enable();
+            filter->mHostEnabled = checkHostEnabled(cfg.host_white_list());
+            populateWhiteList(cfg.tag_white_list(), filter->mTagWhiteList);
+            filter->mReverseTags = cfg.reverse_tag();
+            std::atomic_store(&mTraceFilter, std::shared_ptr<const CTraceFilter>(filter));
         }
         break;
         default:
@@ -354,36 +635,80 @@ void CLogProducer::logFDBus(CFdbMessage *msg, const char *receiver_name, CBaseEn
 
 bool CLogProducer::checkLogTraceEnabled(EFdbLogLevel log_level, const char *tag)
 {
-    if (mTraceDisableGlobal || !mTraceHostEnabled || !checkCacheEnabled()
-        || (log_level < mLogLevel) || (log_level >= FDB_LL_SILENT))
+    auto filter = std::atomic_load(&mTraceFilter);
+    if (filter->mDisableGlobal || !filter->mHostEnabled || !checkCacheEnabled()
+        || (log_level < filter->mLogLevel) || (log_level >= FDB_LL_SILENT))
     {
         return false;
     }
 
-    if (!mTraceTagWhiteList.empty())
+    if (!filter->mTagWhiteList.empty())
     {
-        std::lock_guard<std::mutex> _l(mTraceLock);
-        if (!mTraceTagWhiteList.empty())
+        auto it_tag = filter->mTagWhiteList.find(tag);
+        bool exclude = (it_tag == filter->mTagWhiteList.end());
+        if (filter->mReverseTags ^ exclude)
         {
-            auto it_tag = mTraceTagWhiteList.find(tag);
-            bool exclude = (it_tag == mTraceTagWhiteList.end());
-            if (mReverseTags ^ exclude)
-            {
-                return false;
-            }
+            return false;
         }
     }
 
     return true;
 }
 
+CTraceRing *CLogProducer::traceRing()
+{
+    auto &holder = tTraceRing;
+    if (holder.mRing && ((holder.mRing->mOwner != this) ||
+                          holder.mRing->mOwnerGone.load(std::memory_order_acquire)))
+    {
+        holder.release();
+    }
+    if (!holder.mRing)
+    {
+        auto ring = new CTraceRing(this);
+        {
+        std::lock_guard<std::mutex> _l(mTraceRingLock);
+        mTraceRings.push_back(ring);
+        }
+        holder.mRing = ring;
+    }
+    return holder.mRing;
+}
+
 void CLogProducer::logTrace(EFdbLogLevel log_level, const char *tag, const char *info)
+{
+    auto time_ns = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::system_clock::now().time_since_epoch()).count();
+    if (!tag)
+    {
+        tag = "";
+    }
+    if (!traceRing()->push(log_level, internTraceTag(tag), tag, time_ns, info ? info : ""))
+    {
+        return;
+    }
+    // one drain job is enough for all traces queued before it runs
+    if (!mTraceDrainPending.exchange(true))
+    {
+        context()->sendAsync(new CDrainTraceJob(this));
+    }
+}
+
+void CLogProducer::sendTrace(EFdbLogLevel log_level, const char *tag, uint64_t time_ns, const char *info)
 {
     auto proxy = FDB_CONTEXT->getNameProxy();
     char date_buf[64];
-    sysdep_gettimestamp(date_buf, sizeof(date_buf), 1, 0);
+    time_t seconds = (time_t)(time_ns / 1000000000);
+    struct tm local_time;
+#ifdef __WIN32__
+    localtime_s(&local_time, &seconds);
+#else
+    localtime_r(&seconds, &local_time);
+#endif
+    auto len = strftime(date_buf, sizeof(date_buf), "%F %H:%M:%S", &local_time);
+    snprintf(date_buf + len, sizeof(date_buf) - len, ":%03u",
+             (uint32_t)((time_ns / 1000000) % 1000));
     date_buf[63] = '\0';
-    std::string date_str = date_buf;
     CFdbRawMsgBuilder builder;
     builder.serializer() << (uint32_t)mPid
                          << tag
@@ -395,6 +720,62 @@ void CLogProducer::logTrace(EFdbLogLevel log_level, const char *tag, const char
     sendLog(NFdbBase::REQ_TRACE_LOG, builder);
 }
 
+void CLogProducer::drainTraceRings()
+{
+    // clear before draining: traces pushed from now on schedule another drain
+    mTraceDrainPending.exchange(false);
+
+    std::vector<CTraceRing *> rings;
+    {
+    std::lock_guard<std::mutex> _l(mTraceRingLock);
+    rings = mTraceRings;
+    }
+
+    for (auto it = rings.begin(); it != rings.end(); ++it)
+    {
+        (*it)->drain([this](const CTraceRecordHead *record)
+            {
+                auto data = (const char *)(record + 1);
+                const char *tag;
+                if (record->mTagId == FDB_TRACE_INLINE_TAG)
+                {
+                    tag = data;
+                    data += strlen(tag) + 1;
+                }
+                else
+                {
+                    tag = traceTagName(record->mTagId);
+                }
+                sendTrace((EFdbLogLevel)record->mLevel, tag, record->mTime, data);
+            });
+        auto dropped = (*it)->mDropped.exchange(0, std::memory_order_relaxed);
+        if (dropped)
+        {
+            char info[64];
+            snprintf(info, sizeof(info), "CLogProducer: %u traces dropped!\n", dropped);
+            auto time_ns = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                std::chrono::system_clock::now().time_since_epoch()).count();
+            sendTrace(FDB_LL_WARNING, FDB_TRACE_DROP_TAG, time_ns, info);
+        }
+    }
+
+    // rings of exited threads are released once drained
+    std::lock_guard<std::mutex> _l(mTraceRingLock);
+    for (auto it = mTraceRings.begin(); it != mTraceRings.end();)
+    {
+        auto ring = *it;
+        if (ring->mThreadExited.load(std::memory_order_acquire) && ring->empty())
+        {
+            it = mTraceRings.erase(it);
+            ring->unref();
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
+
 void CLogProducer::printTrace(EFdbLogLevel log_level, const char *tag, const char *info)
 {
     auto proxy = FDB_CONTEXT->getNameProxy();
@@ -448,7 +829,11 @@ void CLogProducer::populateWhiteList(const CFdbParcelableArray<std::string> &in_
 void CLogProducer::callSendLog(CBaseJob::Ptr &msg_ref)
 {
     auto msg = castToMessage<CFdbMessage *>(msg_ref);
-    if (connected())
+    if (connected() && (mBatchMaxSize > 0))
+    {
+        batchLog(msg->code(), (const uint8_t *)msg->getPayloadBuffer(), msg->getPayloadSize());
+    }
+    else if (connected())
     {
         msg->expectReply(false);
         auto session = mEndpoint->preferredPeer();
@@ -489,7 +874,11 @@ bool CLogProducer::sendLog(FdbMsgCode_t code, const uint8_t *buffer, int32_t siz
 {
     if (context()->isSelf())
     {
-        if (connected())
+        if (connected() && (mBatchMaxSize > 0))
+        {
+            batchLog(code, buffer, size);
+        }
+        else if (connected())
         {
             CBaseMessage msg(code, this);
             msg.expectReply(false);
@@ -522,6 +911,80 @@ bool CLogProducer::sendLog(FdbMsgCode_t code, const uint8_t *buffer, int32_t siz
     }
 }
 
+void CLogProducer::enableBatch(int32_t max_size, int32_t max_latency)
+{
+    mBatchMaxSize = max_size;
+    mBatchMaxLatency = (max_latency > 0) ? max_latency : FDB_LOG_BATCH_DEFAULT_LATENCY;
+}
+
+void CLogProducer::batchLog(FdbMsgCode_t code, const uint8_t *buffer, int32_t size)
+{
+    bool first = !mLogBatch.bufferSize();
+    mLogBatch << (int32_t)code << size;
+    mLogBatch.addRawData(buffer, size);
+    if (mLogBatch.bufferSize() >= mBatchMaxSize)
+    {
+        flushBatch();
+    }
+    else if (first)
+    {
+        mBatchTimer.enableOneShot(mBatchMaxLatency);
+    }
+}
+
+void CLogProducer::flushBatch()
+{
+    int32_t size = mLogBatch.bufferSize();
+    if (!size)
+    {
+        return;
+    }
+    mBatchTimer.disable();
+    if (connected())
+    {
+        sendBatch(mLogBatch.buffer(), size);
+    }
+    else if (mLogCache)
+    {
+        CLogPrinter::splitLogBatch(mLogBatch.buffer(), size,
+            [this](FdbMsgCode_t code, const uint8_t *data, int32_t size)
+            {
+                mLogCache->push(data, size, code);
+            });
+    }
+    mLogBatch.reset();
+}
+
+bool CLogProducer::sendBatch(const uint8_t *batch, int32_t size)
+{
+    CBaseMessage msg(NFdbBase::REQ_LOG_BATCH, this);
+    msg.expectReply(false);
+    if (!msg.serialize(batch, size))
+    {
+        return false;
+    }
+    auto session = mEndpoint->preferredPeer();
+    return session ? session->sendMessage(&msg) : false;
+}
+
+void CLogProducer::onBatchTimer(CMethodLoopTimer<CLogProducer> *timer)
+{
+    flushBatch();
+}
+
+void CLogProducer::flushLogs()
+{
+    if (context()->isSelf())
+    {
+        drainTraceRings();
+        flushBatch();
+    }
+    else
+    {
+        context()->sendAsync(new CDrainTraceJob(this, true));
+    }
+}
+
 #define FDB_DO_LOG(_level_, _tag_) do{ \
     CLogProducer *logger = FDB_CONTEXT->getLogger(); \
     if (!logger) \
@@ -336,6 +336,7 @@ void printHelp(bool is_viewer)
     if (!is_viewer)
     {
         std::cout << "    -o: disable terminal output" << std::endl;
+        std::cout << "    -B: store logs in binary format specified by '-j'; use logconv to convert them to text" << std::endl;
     }
     std::cout << "    -c: specify size of raw data to be clipped for fdbus logging" << std::endl;
     std::cout << "    -e: specify a list of endpoints separated by ',' as white list for fdbus logging" << std::endl;
@@ -406,6 +407,7 @@ bool initLogConfig(int argc, char **argv, bool is_viewer)
 
     // for logsvc
     gFdbLogConfig.fdb_disable_std_output = 0;
+    gFdbLogConfig.fdb_binary_log_storage = 0;
 
     // for logviewer
     gFdbLogConfig.fdb_config_mode = CFG_MODE_NONE;
@@ -441,6 +443,7 @@ bool initLogConfig(int argc, char **argv, bool is_viewer)
 
         // for logsvc
         { FDB_OPTION_BOOLEAN, "output", 'o', &gFdbLogConfig.fdb_disable_std_output },
+        { FDB_OPTION_BOOLEAN, "binary_storage", 'B', &gFdbLogConfig.fdb_binary_log_storage },
 
         // for logviewer
         { FDB_OPTION_BOOLEAN, "inc_cfg_mode", 'x', &increment_config_mode },
@@ -91,6 +91,8 @@ struct CFdbLogParams
 
     // for logclt
     int32_t fdb_disable_std_output;
+    // for logsvc: store raw log messages instead of text
+    int32_t fdb_binary_log_storage;
 
     // for logviewer
     EFdbCfgMode fdb_config_mode;
@@ -51,6 +51,28 @@ protected:
                 mLogPrinter.outputTraceLog(deserializer, msg, std::cout);
             }
             break;
+            case NFdbBase::NTF_LOG_BATCH:
+            {
+                // logs dumped from cache of log server
+                auto ret = CLogPrinter::splitLogBatch(msg->getPayloadBuffer(), msg->getPayloadSize(),
+                    [this, msg](FdbMsgCode_t code, const uint8_t *data, int32_t size)
+                    {
+                        CFdbSimpleDeserializer deserializer(data, size);
+                        if (code == NFdbBase::NTF_FDBUS_LOG)
+                        {
+                            mLogPrinter.outputFdbLog(deserializer, msg, std::cout);
+                        }
+                        else if (code == NFdbBase::NTF_TRACE_LOG)
+                        {
+                            mLogPrinter.outputTraceLog(deserializer, msg, std::cout);
+                        }
+                    });
+                if (!ret)
+                {
+                    LOG_E("CLogClient: Unable to split log batch!\n");
+                }
+            }
+            break;
             default:
             break;
         }
@@ -87,6 +109,7 @@ protected:
             //subscribe(subscribe_list);
             NFdbBase::FdbLogStart log_start;
             log_start.set_cache_size(gFdbLogConfig.fdb_cache_size);
+            log_start.set_batch(true);
             CFdbParcelableBuilder builder(log_start);
             send(NFdbBase::REQ_LOG_START, builder);
         }
@@ -0,0 +1,407 @@
+/*
+ * Copyright (C) 2015   Jeremy Chen jeremy_cz@yahoo.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Convert binary log files stored by 'logsvc -B' to text, optionally
+ * filtering them by log type, time, host, endpoint, bus name, tag and level.
+ * Text is the same as what logsvc prints.
+ */
+#include <common_base/fdb_option_parser.h>
+#include <common_base/fdb_log_trace.h>
+#include <common_base/CLogProducer.h>
+#include <common_base/CFdbSimpleSerializer.h>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <time.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#ifdef __WIN32__
+#include <io.h>
+#else
+#include <dirent.h>
+#endif
+#include "CLogPrinter.h"
+#include "CLogBinFileManager.h"
+
+#ifdef __WIN32__
+#define FDB_PATH_SEPARATOR "\\"
+#else
+#define FDB_PATH_SEPARATOR "/"
+#endif
+
+struct CLogFilter
+{
+    int32_t mFdbusOnly;
+    int32_t mTraceOnly;
+    int32_t mMinLevel;
+    uint64_t mBeginTime;
+    uint64_t mEndTime;
+    std::vector<std::string> mHosts;
+    std::vector<std::string> mEndpoints;
+    std::vector<std::string> mBusNames;
+    std::vector<std::string> mTags;
+};
+
+static void populateList(const char *filter_str, std::vector<std::string> &list)
+{
+    if (!filter_str)
+    {
+        return;
+    }
+    uint32_t num_filters = 0;
+    char **filters = strsplit(filter_str, ",", &num_filters);
+    for (uint32_t i = 0; i < num_filters; ++i)
+    {
+        list.push_back(filters[i]);
+    }
+    endstrsplit(filters, num_filters);
+}
+
+static bool inList(const std::vector<std::string> &list, const std::string &name)
+{
+    return list.empty() || (std::find(list.begin(), list.end(), name) != list.end());
+}
+
+// accept 'YYYY-MM-DD HH:MM:SS' or 'YYYY-MM-DD_HH:MM:SS' in local time
+static bool parseTime(const char *time_str, uint64_t &time_ms)
+{
+    struct tm tm_time;
+    memset(&tm_time, 0, sizeof(tm_time));
+    if (sscanf(time_str, "%d-%d-%d%*c%d:%d:%d", &tm_time.tm_year, &tm_time.tm_mon,
+               &tm_time.tm_mday, &tm_time.tm_hour, &tm_time.tm_min, &tm_time.tm_sec) != 6)
+    {
+        return false;
+    }
+    tm_time.tm_year -= 1900;
+    tm_time.tm_mon -= 1;
+    tm_time.tm_isdst = -1;
+    auto seconds = mktime(&tm_time);
+    if (seconds < 0)
+    {
+        return false;
+    }
+    time_ms = (uint64_t)seconds * 1000;
+    return true;
+}
+
+static std::string formatTime(uint64_t time_ms)
+{
+    char time_buf[64];
+    time_t seconds = (time_t)(time_ms / 1000);
+    strftime(time_buf, sizeof(time_buf), "%F %H:%M:%S", localtime(&seconds));
+    snprintf(time_buf + strlen(time_buf), sizeof(time_buf) - strlen(time_buf),
+             ".%03u", (uint32_t)(time_ms % 1000));
+    return time_buf;
+}
+
+static bool loadFile(const char *file_name, std::vector<uint8_t> &buffer)
+{
+    std::ifstream file(file_name, std::ios::in | std::ios::binary);
+    if (!file)
+    {
+        return false;
+    }
+    file.seekg(0, std::ios::end);
+    auto size = (int64_t)file.tellg();
+    file.seekg(0, std::ios::beg);
+    if (size < (int64_t)sizeof(CLogBinFileHead))
+    {
+        return false;
+    }
+    buffer.resize((size_t)size);
+    file.read((char *)buffer.data(), size);
+    return !!file;
+}
+
+static bool validFile(const std::vector<uint8_t> &buffer)
+{
+    auto head = (const CLogBinFileHead *)buffer.data();
+    return (head->mMagic == FDB_LOG_BIN_MAGIC) &&
+           (head->mVersion == FDB_LOG_BIN_VERSION) &&
+           (head->mHeadSize == sizeof(CLogBinFileHead)) &&
+           ((int64_t)head->mIndexOffset +
+                (int64_t)head->mIndexCapacity * sizeof(CLogBinIndexEntry) <= head->mDataOffset) &&
+           (head->mIndexCount <= head->mIndexCapacity) &&
+           (head->mDataOffset <= buffer.size());
+}
+
+/*
+ * Find where to start scanning records: the last indexed record before the
+ * begin time. Records are in arrival order so index time is ascending.
+ */
+static uint32_t startOffset(const std::vector<uint8_t> &buffer, uint64_t begin_time)
+{
+    auto head = (const CLogBinFileHead *)buffer.data();
+    auto index = (const CLogBinIndexEntry *)(buffer.data() + head->mIndexOffset);
+    uint32_t offset = head->mDataOffset;
+    if (!begin_time || !head->mIndexCount)
+    {
+        return offset;
+    }
+    auto it = std::upper_bound(index, index + head->mIndexCount, begin_time,
+                               [](uint64_t time, const CLogBinIndexEntry &entry)
+                               {
+                                   return time < entry.mTime;
+                               });
+    if (it != index)
+    {
+        offset = (it - 1)->mOffset;
+    }
+    return offset;
+}
+
+static bool filterFdbLog(const CLogFilter &filter, CLogPrinter::LogInfo &info)
+{
+    if (filter.mTraceOnly)
+    {
+        return false;
+    }
+    return inList(filter.mHosts, info.mHostName) &&
+           (inList(filter.mEndpoints, info.mSender) || inList(filter.mEndpoints, info.mReceiver)) &&
+           inList(filter.mBusNames, info.mBusName);
+}
+
+static bool filterTraceLog(const CLogFilter &filter, CLogPrinter::TraceInfo &info)
+{
+    if (filter.mFdbusOnly)
+    {
+        return false;
+    }
+    return (info.mLogLevel >= filter.mMinLevel) &&
+           inList(filter.mHosts, info.mHostName) &&
+           inList(filter.mTags, info.mTag);
+}
+
+static bool convertFile(const char *file_name, const CLogFilter &filter,
+                        bool info_only, std::ostream &output)
+{
+    std::vector<uint8_t> buffer;
+    if (!loadFile(file_name, buffer) || !validFile(buffer))
+    {
+        std::cerr << "logconv: " << file_name << " is not a binary log file!" << std::endl;
+        return false;
+    }
+
+    auto head = (const CLogBinFileHead *)buffer.data();
+    if (info_only)
+    {
+        output << file_name << ": " << head->mRecordCount << " records, "
+               << head->mIndexCount << " index entries, "
+               << (head->mRecordCount ? formatTime(head->mFirstTime) : std::string("-")) << " ~ "
+               << (head->mRecordCount ? formatTime(head->mLastTime) : std::string("-")) << std::endl;
+        return true;
+    }
+    if ((filter.mBeginTime && head->mRecordCount && (head->mLastTime < filter.mBeginTime)) ||
+        (filter.mEndTime && head->mRecordCount && (head->mFirstTime > filter.mEndTime)))
+    {
+        return true;
+    }
+
+    /*
+     * Don't trust mDataEnd since log server might be killed before updating
+     * it; a record is valid as long as its size is set and it fits the file.
+     */
+    int64_t offset = startOffset(buffer, filter.mBeginTime);
+    int64_t file_size = (int64_t)buffer.size();
+    while ((offset + (int64_t)sizeof(CLogBinRecordHead)) <= file_size)
+    {
+        auto record = (const CLogBinRecordHead *)(buffer.data() + offset);
+        if (!record->mSize ||
+            ((offset + (int64_t)sizeof(CLogBinRecordHead) + record->mSize) > file_size))
+        {
+            break;
+        }
+        offset += FDB_LOG_BIN_ALIGN_UP((int64_t)sizeof(CLogBinRecordHead) + record->mSize);
+
+        if (filter.mBeginTime && (record->mTime < filter.mBeginTime))
+        {
+            continue;
+        }
+        if (filter.mEndTime && (record->mTime > filter.mEndTime))
+        {
+            break;
+        }
+
+        CFdbSimpleDeserializer deserializer((const uint8_t *)(record + 1), (int32_t)record->mSize);
+        if (record->mCode == NFdbBase::NTF_FDBUS_LOG)
+        {
+            CLogPrinter::LogInfo info;
+            if (CLogPrinter::parseFdbLog(deserializer, info) && filterFdbLog(filter, info))
+            {
+                CLogPrinter::outputFdbLog(info, output);
+            }
+        }
+        else if (record->mCode == NFdbBase::NTF_TRACE_LOG)
+        {
+            CLogPrinter::TraceInfo info;
+            if (CLogPrinter::parseTraceLog(deserializer, info) && filterTraceLog(filter, info))
+            {
+                CLogPrinter::outputTraceLog(info, output);
+            }
+        }
+    }
+    return true;
+}
+
+static void addFiles(const char *path, std::vector<std::string> &files)
+{
+    struct stat statbuf;
+    if ((stat(path, &statbuf) < 0) || !(statbuf.st_mode & S_IFDIR))
+    {
+        files.push_back(path);
+        return;
+    }
+
+    std::vector<std::string> dir_files;
+    std::string suffix = "." FDB_LOG_BIN_SUFFIX;
+#ifdef __WIN32__
+    _finddata_t file;
+    intptr_t lf;
+    std::string file_path = std::string(path) + FDB_PATH_SEPARATOR "*." FDB_LOG_BIN_SUFFIX;
+    if ((lf = _findfirst(file_path.c_str(), &file)) != -1)
+    {
+        do
+        {
+            dir_files.push_back(file.name);
+        } while (_findnext(lf, &file) == 0);
+        _findclose(lf);
+    }
+#else
+    DIR *dir = opendir(path);
+    if (dir)
+    {
+        struct dirent *ptr;
+        while ((ptr = readdir(dir)) != 0)
+        {
+            std::string name = ptr->d_name;
+            if ((name.size() > suffix.size()) &&
+                !name.compare(name.size() - suffix.size(), suffix.size(), suffix))
+            {
+                dir_files.push_back(name);
+            }
+        }
+        closedir(dir);
+    }
+#endif
+    // file names start with index so that they are sorted in time order
+    std::sort(dir_files.begin(), dir_files.end());
+    for (auto it = dir_files.begin(); it != dir_files.end(); ++it)
+    {
+        files.push_back(std::string(path) + FDB_PATH_SEPARATOR + *it);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int32_t help = 0;
+    int32_t info_only = 0;
+    char *hosts = 0;
+    char *endpoints = 0;
+    char *bus_names = 0;
+    char *tags = 0;
+    char *begin_time = 0;
+    char *end_time = 0;
+    char *output_file = 0;
+    CLogFilter filter;
+    filter.mFdbusOnly = 0;
+    filter.mTraceOnly = 0;
+    filter.mMinLevel = FDB_LL_VERBOSE;
+    filter.mBeginTime = 0;
+    filter.mEndTime = 0;
+    const struct fdb_option core_options[] = {
+        { FDB_OPTION_BOOLEAN, "fdbus_only", 'f', &filter.mFdbusOnly },
+        { FDB_OPTION_BOOLEAN, "trace_only", 'd', &filter.mTraceOnly },
+        { FDB_OPTION_INTEGER, "level", 'l', &filter.mMinLevel },
+        { FDB_OPTION_STRING, "hosts", 'm', &hosts },
+        { FDB_OPTION_STRING, "endpoints", 'e', &endpoints },
+        { FDB_OPTION_STRING, "busnames", 'n', &bus_names },
+        { FDB_OPTION_STRING, "tags", 't', &tags },
+        { FDB_OPTION_STRING, "begin", 'b', &begin_time },
+        { FDB_OPTION_STRING, "end", 'z', &end_time },
+        { FDB_OPTION_STRING, "output", 'o', &output_file },
+        { FDB_OPTION_BOOLEAN, "info", 'i', &info_only },
+        { FDB_OPTION_BOOLEAN, "help", 'h', &help }
+    };
+    fdb_parse_options(core_options, ARRAY_LENGTH(core_options), &argc, argv);
+
+    if (help || (argc < 2))
+    {
+        std::cout << "Usage: logconv[ -f][ -d][ -l level][ -m host1,host2...][ -e ep1,ep2...][ -n bus1,bus2...]"
+                     "[ -t tag1,tag2...][ -b begin][ -z end][ -o output][ -i] file_or_dir..." << std::endl;
+        std::cout << "Convert binary log files stored by 'logsvc -B' to text." << std::endl;
+        std::cout << "    -f: only fdbus message logs" << std::endl;
+        std::cout << "    -d: only debug traces" << std::endl;
+        std::cout << "    -l: lowest debug trace level: 0-verbose 1-debug 2-info 3-warning 4-error 5-fatal" << std::endl;
+        std::cout << "    -m: a list of host names separated by ','" << std::endl;
+        std::cout << "    -e: a list of endpoints separated by ','; either sender or receiver matches" << std::endl;
+        std::cout << "    -n: a list of bus names separated by ','" << std::endl;
+        std::cout << "    -t: a list of debug trace tags separated by ','" << std::endl;
+        std::cout << "    -b: logs received by log server not before the time: 'YYYY-MM-DD HH:MM:SS'" << std::endl;
+        std::cout << "    -z: logs received by log server not after the time: 'YYYY-MM-DD HH:MM:SS'" << std::endl;
+        std::cout << "    -o: write text to the file instead of stdout" << std::endl;
+        std::cout << "    -i: only print number of records and time span of each file" << std::endl;
+        std::cout << "    directory is expanded to all *." FDB_LOG_BIN_SUFFIX " files in it" << std::endl;
+        return 0;
+    }
+
+    if ((begin_time && !parseTime(begin_time, filter.mBeginTime)) ||
+        (end_time && !parseTime(end_time, filter.mEndTime)))
+    {
+        std::cerr << "logconv: invalid time! Use 'YYYY-MM-DD HH:MM:SS'." << std::endl;
+        return -1;
+    }
+    if (filter.mEndTime)
+    {
+        // include the whole second
+        filter.mEndTime += 999;
+    }
+    populateList(hosts, filter.mHosts);
+    populateList(endpoints, filter.mEndpoints);
+    populateList(bus_names, filter.mBusNames);
+    populateList(tags, filter.mTags);
+
+    std::ofstream output_stream;
+    if (output_file)
+    {
+        output_stream.open(output_file, std::ios::out | std::ios::trunc);
+        if (!output_stream)
+        {
+            std::cerr << "logconv: unable to create " << output_file << std::endl;
+            return -1;
+        }
+    }
+    std::ostream &output = output_file ? output_stream : std::cout;
+
+    std::vector<std::string> files;
+    for (int i = 1; i < argc; ++i)
+    {
+        addFiles(argv[i], files);
+    }
+    int ret = 0;
+    for (auto it = files.begin(); it != files.end(); ++it)
+    {
+        if (!convertFile(it->c_str(), filter, !!info_only, output))
+        {
+            ret = -1;
+        }
+    }
+    return ret;
+}
@@ -28,6 +28,7 @@
 #include "CLogPrinter.h"
 #include "CFdbLogCache.h"
 #include "CLogFileManager.h"
+#include "CLogBinFileManager.h"
 
 class CLogServer : public CBaseServer
 {
@@ -35,13 +36,28 @@ public:
     CLogServer()
         : CBaseServer(FDB_LOG_SERVER_NAME)
         , mLogCache(gFdbLogConfig.fdb_cache_size * 1024)
-        , mFileManager(gFdbLogConfig.fdb_log_path.c_str(), 0,
-                       gFdbLogConfig.fdb_max_log_storage_size * 1024,
-                       gFdbLogConfig.fdb_max_log_file_size * 1024)
+        , mBinFileManager(0)
     {
+        if (gFdbLogConfig.fdb_binary_log_storage)
+        {
+            mBinFileManager = new CLogBinFileManager(gFdbLogConfig.fdb_log_path.c_str(), 0,
+                                                     gFdbLogConfig.fdb_max_log_storage_size * 1024,
+                                                     gFdbLogConfig.fdb_max_log_file_size * 1024);
+            mFileManager = mBinFileManager;
+        }
+        else
+        {
+            mFileManager = new CLogFileManager(gFdbLogConfig.fdb_log_path.c_str(), 0,
+                                               gFdbLogConfig.fdb_max_log_storage_size * 1024,
+                                               gFdbLogConfig.fdb_max_log_file_size * 1024);
+        }
         mEnableGlogalLogger = checkLogEnabled(gFdbLogConfig.fdb_disable_global_logger, false);
         mEnableGlobalTrace = checkLogEnabled(gFdbLogConfig.fdb_disable_global_trace, false);
     }
+    ~CLogServer()
+    {
+        delete mFileManager;
+    }
 protected:
     void onInvoke(CBaseJob::Ptr &msg_ref)
     {
@@ -50,22 +66,26 @@ protected:
         {
             case NFdbBase::REQ_FDBUS_LOG:
             {
-                if (!gFdbLogConfig.fdb_disable_std_output || mFileManager.logEnabled())
+                onFdbusLog(msg, (const uint8_t *)msg->getPayloadBuffer(), msg->getPayloadSize());
+            }
+            break;
+            case NFdbBase::REQ_LOG_BATCH:
+            {
+                if (!CLogPrinter::splitLogBatch((const uint8_t *)msg->getPayloadBuffer(), msg->getPayloadSize(),
+                        [this, msg](FdbMsgCode_t code, const uint8_t *data, int32_t size)
+                        {
+                            if (code == NFdbBase::REQ_FDBUS_LOG)
+                            {
+                                onFdbusLog(msg, data, size);
+                            }
+                            else if (code == NFdbBase::REQ_TRACE_LOG)
+                            {
+                                onTraceLog(msg, data, size);
+                            }
+                        }))
                 {
-                    CFdbSimpleDeserializer deserializer(msg->getPayloadBuffer(), msg->getPayloadSize());
-                    std::ostringstream ostream;
-                    mLogPrinter.outputFdbLog(deserializer, msg, ostream);
-
-                    if (!gFdbLogConfig.fdb_disable_std_output)
-                    {
-                        std::cout << ostream.str();
-                    }
-                    if (mFileManager.logEnabled())
-                    {
-                        mFileManager.store(ostream.str());
-                    }
+                    LOG_E("CLogServer: Unable to split log batch!\n");
                 }
-                forwardLogData(NFdbBase::NTF_FDBUS_LOG, msg);
             }
             break;
             case NFdbBase::REQ_SET_LOGGER_CONFIG:
@@ -98,22 +118,7 @@ protected:
             break;
             case NFdbBase::REQ_TRACE_LOG:
             {
-                if (!gFdbLogConfig.fdb_disable_std_output || mFileManager.logEnabled())
-                {
-                    CFdbSimpleDeserializer deserializer(msg->getPayloadBuffer(), msg->getPayloadSize());
-                    std::ostringstream ostream;
-                    mLogPrinter.outputTraceLog(deserializer, msg, ostream);
-
-                    if (!gFdbLogConfig.fdb_disable_std_output)
-                    {
-                        std::cout << ostream.str();
-                    }
-                    if (mFileManager.logEnabled())
-                    {
-                        mFileManager.store(ostream.str());
-                    }
-                }
-                forwardLogData(NFdbBase::NTF_TRACE_LOG, msg);
+                onTraceLog(msg, (const uint8_t *)msg->getPayloadBuffer(), msg->getPayloadSize());
             }
             break;
             case NFdbBase::REQ_SET_TRACE_CONFIG:
@@ -128,9 +133,9 @@ protected:
                 fdb_dump_trace_config(in_config);
 
                 mLogCache.resize(gFdbLogConfig.fdb_cache_size * 1024);
-                mFileManager.setWorkingPath(gFdbLogConfig.fdb_log_path.c_str());
-                mFileManager.setStorageSize(gFdbLogConfig.fdb_max_log_storage_size * 1024,
-                                            gFdbLogConfig.fdb_max_log_file_size * 1024);
+                mFileManager->setWorkingPath(gFdbLogConfig.fdb_log_path.c_str());
+                mFileManager->setStorageSize(gFdbLogConfig.fdb_max_log_storage_size * 1024,
+                                             gFdbLogConfig.fdb_max_log_file_size * 1024);
 
                 mEnableGlobalTrace = checkLogEnabled(gFdbLogConfig.fdb_disable_global_trace,
                                                             mTraceClientTbl.empty());
@@ -167,12 +172,17 @@ protected:
                 subscribe(session, NFdbBase::NTF_TRACE_LOG, objId(), 0, FDB_SUB_TYPE_NORMAL);
                 onSubscribeTraceLogger(msg->session());
 
+                if (log_start.batch())
+                {
+                    subscribe(session, NFdbBase::NTF_LOG_BATCH, objId(), 0, FDB_SUB_TYPE_NORMAL);
+                }
+
                 auto cache_size = log_start.cache_size();
                 if (cache_size > 0)
                 {
                     cache_size *= 1024;
                 }
-                mLogCache.dump(this, session, cache_size);
+                mLogCache.dump(this, session, cache_size, log_start.batch());
             }
             default:
             break;
@@ -282,7 +292,9 @@ private:
 
     CLogPrinter mLogPrinter;
     CFdbLogCache mLogCache;
-    CLogFileManager mFileManager;
+    CLogFileManager *mFileManager;
+    // the same as mFileManager if logs are stored in binary format
+    CLogBinFileManager *mBinFileManager;
     bool mEnableGlogalLogger;
     bool mEnableGlobalTrace;
 
@@ -295,7 +307,7 @@ private:
         else if (mLogCache.size() ||            // log cache is enabled
                  !gFdbLogConfig.fdb_disable_std_output ||     // showing at stdout
                  !no_client_connected ||        // any log viewer is connected
-                 mFileManager.logEnabled())     // logging to file is enabled
+                 mFileManager->logEnabled())    // logging to file is enabled
         {
             return true;
         }
@@ -305,6 +317,11 @@ private:
         }
     }
 
+    bool textLogEnabled() const
+    {
+        return !mBinFileManager && mFileManager->logEnabled();
+    }
+
     void onSubscribeFDBusLogger(FdbSessionId_t sid)
     {
         bool is_first = mLoggerClientTbl.empty();
@@ -341,10 +358,56 @@ private:
         }
     }
 
-    void forwardLogData(FdbEventCode_t code, CFdbMessage *msg)
+    void onFdbusLog(CFdbMessage *msg, const uint8_t *payload, int32_t size)
+    {
+        if (!gFdbLogConfig.fdb_disable_std_output || textLogEnabled())
+        {
+            CFdbSimpleDeserializer deserializer(payload, size);
+            std::ostringstream ostream;
+            mLogPrinter.outputFdbLog(deserializer, msg, ostream);
+
+            if (!gFdbLogConfig.fdb_disable_std_output)
+            {
+                std::cout << ostream.str();
+            }
+            if (textLogEnabled())
+            {
+                mFileManager->store(ostream.str());
+            }
+        }
+        if (mBinFileManager && mBinFileManager->logEnabled())
+        {
+            mBinFileManager->store(NFdbBase::NTF_FDBUS_LOG, payload, size);
+        }
+        forwardLogData(NFdbBase::NTF_FDBUS_LOG, payload, size);
+    }
+
+    void onTraceLog(CFdbMessage *msg, const uint8_t *payload, int32_t size)
+    {
+        if (!gFdbLogConfig.fdb_disable_std_output || textLogEnabled())
+        {
+            CFdbSimpleDeserializer deserializer(payload, size);
+            std::ostringstream ostream;
+            mLogPrinter.outputTraceLog(deserializer, msg, ostream);
+
+            if (!gFdbLogConfig.fdb_disable_std_output)
+            {
+                std::cout << ostream.str();
+            }
+            if (textLogEnabled())
+            {
+                mFileManager->store(ostream.str());
+            }
+        }
+        if (mBinFileManager && mBinFileManager->logEnabled())
+        {
+            mBinFileManager->store(NFdbBase::NTF_TRACE_LOG, payload, size);
+        }
+        forwardLogData(NFdbBase::NTF_TRACE_LOG, payload, size);
+    }
+
+    void forwardLogData(FdbEventCode_t code, const uint8_t *payload, int32_t size)
     {
-        auto payload = (uint8_t *)msg->getPayloadBuffer();
-        int32_t size = msg->getPayloadSize();
         mLogCache.push(payload, size, code);
 
         if (((code == NFdbBase::NTF_FDBUS_LOG) && !mLoggerClientTbl.empty()) ||
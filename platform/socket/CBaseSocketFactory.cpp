@@ -129,6 +129,17 @@ bool CBaseSocketFactory::parseUrl(const char *url, CFdbSocketAddr &addr)
             return false;
         }
     }
+#ifdef CONFIG_FDB_SHM
+    else if (protocol == FDB_URL_SHM_IND)
+    {
+        // UDS carrying messages in shared memory; the same as IPC otherwise
+        addr.mType = FDB_SOCKET_IPC;
+        if (buildIPCAddress(addr_str.c_str(), addr))
+        {
+            return false;
+        }
+    }
+#endif
     else if (protocol == FDB_URL_SVC_IND)
     {
         addr.mType = FDB_SOCKET_SVC;
@@ -145,6 +156,11 @@ bool CBaseSocketFactory::parseUrl(const char *url, CFdbSocketAddr &addr)
     return true;
 }
 
+bool CBaseSocketFactory::isShmUrl(const std::string &url)
+{
+    return !url.compare(0, strlen(FDB_URL_SHM), FDB_URL_SHM);
+}
+
 int32_t CBaseSocketFactory::buildINetAddress(const char *host_addr, CFdbSocketAddr &addr)
 {
     const char *delimiter = strrchr (host_addr, ':');
@@ -16,6 +16,18 @@
 
 #include "CLinuxSocket.h"
 #include <common_base/CBaseSocketFactory.h>
+#ifndef __WIN32__
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define FDB_SOCKET_MAX_IOVECS 64
+#define FDB_SOCKET_MAX_DATAGRAMS 64
+#define FDB_UDP_SOCKET_BUFFER_SIZE (2 * 1024 * 1024)
+#endif
 
 CTCPTransportSocket::CTCPTransportSocket(sckt::TCPSocket *imp, EFdbSocketType type)
     : mSocketImp(imp)
@@ -58,6 +70,48 @@ int32_t CTCPTransportSocket::send(const uint8_t *data, int32_t size)
     return ret;
 }
 
+int32_t CTCPTransportSocket::send(const CFdbIoVec *vecs, int32_t count)
+{
+#ifdef __WIN32__
+    return CSocketImp::send(vecs, count);
+#else
+    int fd = getFd();
+    if (fd < 0)
+    {
+        return -1;
+    }
+
+    struct iovec iov[FDB_SOCKET_MAX_IOVECS];
+    if (count > FDB_SOCKET_MAX_IOVECS)
+    {
+        // the rest is sent by the caller as if the socket is full
+        count = FDB_SOCKET_MAX_IOVECS;
+    }
+    for (int32_t i = 0; i < count; ++i)
+    {
+        iov[i].iov_base = (void *)vecs[i].mData;
+        iov[i].iov_len = vecs[i].mSize;
+    }
+
+    struct msghdr hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.msg_iov = iov;
+    hdr.msg_iovlen = count;
+
+    ssize_t ret;
+    do
+    {
+        ret = sendmsg(fd, &hdr, MSG_NOSIGNAL);
+    } while ((ret < 0) && (errno == EINTR));
+
+    if (ret < 0)
+    {
+        return ((errno == EAGAIN) || (errno == EWOULDBLOCK)) ? 0 : -1;
+    }
+    return (int32_t)ret;
+#endif
+}
+
 int32_t CTCPTransportSocket::recv(uint8_t *data, int32_t size)
 {
     int32_t ret = -1;
@@ -84,55 +138,102 @@ int CTCPTransportSocket::getFd()
     return -1;
 }
 
+#ifdef CONFIG_FDB_SHM
+CShmTransportSocket::CShmTransportSocket(sckt::TCPSocket *imp, EFdbSocketType type)
+    : CTCPTransportSocket(imp, type)
+{
+}
+
+int32_t CShmTransportSocket::recv(uint8_t *data, int32_t size)
+{
+    int fd = getFd();
+    if (fd < 0)
+    {
+        return -1;
+    }
+    // region of peer might come along with data
+    return mChannel.recv(fd, data, size);
+}
+
+CFdbShmChannel *CShmTransportSocket::shmChannel()
+{
+    return &mChannel;
+}
+#endif
+
+static CTCPTransportSocket *createTransportSocket(sckt::TCPSocket *imp, const CFdbSocketAddr &addr)
+{
+#ifdef CONFIG_FDB_SHM
+    if ((addr.mType == FDB_SOCKET_IPC) && CBaseSocketFactory::isShmUrl(addr.mUrl))
+    {
+        return new CShmTransportSocket(imp, addr.mType);
+    }
+#endif
+    return new CTCPTransportSocket(imp, addr.mType);
+}
+
 CLinuxClientSocket::CLinuxClientSocket(CFdbSocketAddr &addr)
     : CClientSocketImp(addr)
+    , mConnectingImp(0)
 {
 }
 
 CLinuxClientSocket::~CLinuxClientSocket()
 {
+    cancelConnect();
 }
 
-CSocketImp *CLinuxClientSocket::connect(bool block, int32_t ka_interval, int32_t ka_retries)
+sckt::TCPSocket *CLinuxClientSocket::openSocket(sckt::Options &opt)
 {
-    CSocketImp *ret = 0;
-    sckt::Options opt(!block, ka_interval, ka_retries);
-    try
+    sckt::TCPSocket *sckt_imp = 0;
+    if (mConn.mSelfAddress.mType == FDB_SOCKET_TCP)
     {
-        sckt::TCPSocket *sckt_imp = 0;
-        if (mConn.mSelfAddress.mType == FDB_SOCKET_TCP)
+        if (mConn.mSelfAddress.mAddr.empty())
         {
-            if (mConn.mSelfAddress.mAddr.empty())
-            {
-                mConn.mSelfAddress.mAddr = "127.0.0.1";
-            }
-            sckt::IPAddress address(mConn.mSelfAddress.mAddr.c_str(), (sckt::u16)mConn.mSelfAddress.mPort);
-            sckt_imp = new sckt::TCPSocket(address, &opt);
+            mConn.mSelfAddress.mAddr = "127.0.0.1";
         }
+        sckt::IPAddress address(mConn.mSelfAddress.mAddr.c_str(), (sckt::u16)mConn.mSelfAddress.mPort);
+        sckt_imp = new sckt::TCPSocket(address, &opt);
+    }
 #ifndef __WIN32__
-        else if (mConn.mSelfAddress.mType == FDB_SOCKET_IPC)
-        {
-            sckt::IPAddress address(mConn.mSelfAddress.mAddr.c_str());
-            sckt_imp = new sckt::TCPSocket(address, &opt);
-        }
+    else if (mConn.mSelfAddress.mType == FDB_SOCKET_IPC)
+    {
+        sckt::IPAddress address(mConn.mSelfAddress.mAddr.c_str());
+        sckt_imp = new sckt::TCPSocket(address, &opt);
+    }
 #endif
+    return sckt_imp;
+}
 
+CSocketImp *CLinuxClientSocket::createTransport(sckt::TCPSocket *sckt_imp)
+{
+    auto ret = createTransportSocket(sckt_imp, mConn.mSelfAddress);
+    CFdbSocketConnInfo &conn_info = const_cast<CFdbSocketConnInfo &>(ret->getConnectionInfo());
+    if (mConn.mSelfAddress.mType == FDB_SOCKET_IPC)
+    {
+        // For IPC socket, address of CTCPTransportSocket is the same as CLinuxServerSocket
+        // So you can get address either from container or session
+        conn_info.mSelfAddress = mConn.mSelfAddress;
+    }
+    else
+    {
+        CBaseSocketFactory::buildUrl(conn_info.mSelfAddress.mUrl,
+                                     conn_info.mSelfAddress.mAddr.c_str(),
+                                     conn_info.mSelfAddress.mPort);
+    }
+    return ret;
+}
+
+CSocketImp *CLinuxClientSocket::connect(bool block, int32_t ka_interval, int32_t ka_retries)
+{
+    CSocketImp *ret = 0;
+    sckt::Options opt(!block, ka_interval, ka_retries);
+    try
+    {
+        auto sckt_imp = openSocket(opt);
         if (sckt_imp)
         {
-            ret = new CTCPTransportSocket(sckt_imp, mConn.mSelfAddress.mType);
-            CFdbSocketConnInfo &conn_info = const_cast<CFdbSocketConnInfo &>(ret->getConnectionInfo());
-            if (mConn.mSelfAddress.mType == FDB_SOCKET_IPC)
-            {
-                // For IPC socket, address of CTCPTransportSocket is the same as CLinuxServerSocket
-                // So you can get address either from container or session
-                conn_info.mSelfAddress = mConn.mSelfAddress;
-            }
-            else
-            {
-                CBaseSocketFactory::buildUrl(conn_info.mSelfAddress.mUrl,
-                                             conn_info.mSelfAddress.mAddr.c_str(),
-                                             conn_info.mSelfAddress.mPort);
-            }
+            ret = createTransport(sckt_imp);
         }
     }
     catch (...)
@@ -142,6 +243,59 @@ CSocketImp *CLinuxClientSocket::connect(bool block, int32_t ka_interval, int32_t
     return ret;
 }
 
+int32_t CLinuxClientSocket::startConnect(bool block, int32_t ka_interval, int32_t ka_retries)
+{
+    cancelConnect();
+    mConnectOptions = sckt::Options(!block, ka_interval, ka_retries, true);
+    try
+    {
+        mConnectingImp = openSocket(mConnectOptions);
+    }
+    catch (...)
+    {
+        mConnectingImp = 0;
+    }
+    if (!mConnectingImp)
+    {
+        return -1;
+    }
+    return mConnectingImp->IsConnecting() ? 1 : 0;
+}
+
+CSocketImp *CLinuxClientSocket::finishConnect()
+{
+    auto sckt_imp = mConnectingImp;
+    mConnectingImp = 0;
+    if (!sckt_imp)
+    {
+        return 0;
+    }
+    try
+    {
+        sckt_imp->FinishConnect(&mConnectOptions);
+        return createTransport(sckt_imp);
+    }
+    catch (...)
+    {
+        delete sckt_imp;
+    }
+    return 0;
+}
+
+void CLinuxClientSocket::cancelConnect()
+{
+    if (mConnectingImp)
+    {
+        delete mConnectingImp;
+        mConnectingImp = 0;
+    }
+}
+
+int CLinuxClientSocket::getFd()
+{
+    return mConnectingImp ? mConnectingImp->getNativeSocket() : -1;
+}
+
 CLinuxServerSocket::CLinuxServerSocket(CFdbSocketAddr &addr)
     : CServerSocketImp(addr)
     , mServerSocketImp(0)
@@ -205,7 +359,7 @@ CSocketImp *CLinuxServerSocket::accept(bool block, int32_t ka_interval, int32_t
         {
             sock_imp = new sckt::TCPSocket();
             mServerSocketImp->Accept(*sock_imp, &opt);
-            ret = new CTCPTransportSocket(sock_imp, mConn.mSelfAddress.mType);
+            ret = createTransportSocket(sock_imp, mConn.mSelfAddress);
             CFdbSocketConnInfo &conn_info = const_cast<CFdbSocketConnInfo &>(ret->getConnectionInfo());
             if (mConn.mSelfAddress.mType == FDB_SOCKET_IPC)
             {
@@ -258,6 +412,19 @@ CUDPTransportSocket::CUDPTransportSocket(sckt::UDPSocket *imp)
     : mSocketImp(imp)
 {
     mConn.mSelfAddress.mType = FDB_SOCKET_UDP;
+#ifndef __WIN32__
+    /*
+     * Fragments of a big message arrive in a burst; ask for room of several
+     * messages. It is limited by net.core.rmem_max and wmem_max.
+     */
+    int fd = getFd();
+    if (fd >= 0)
+    {
+        int size = FDB_UDP_SOCKET_BUFFER_SIZE;
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+        setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+    }
+#endif
 }
 
 CUDPTransportSocket::~CUDPTransportSocket()
@@ -304,6 +471,120 @@ int32_t CUDPTransportSocket::recv(uint8_t *data, int32_t size)
     return ret;
 }
 
+int32_t CUDPTransportSocket::send(const CFdbDatagram *datagrams, int32_t count)
+{
+#ifdef __WIN32__
+    return CSocketImp::send(datagrams, count);
+#else
+    int fd = getFd();
+    if (fd < 0)
+    {
+        return -1;
+    }
+    if (count > FDB_SOCKET_MAX_DATAGRAMS)
+    {
+        // the rest is sent by the caller
+        count = FDB_SOCKET_MAX_DATAGRAMS;
+    }
+
+    struct mmsghdr msgs[FDB_SOCKET_MAX_DATAGRAMS];
+    // head, data and tail of each datagram
+    struct iovec iov[FDB_SOCKET_MAX_DATAGRAMS * 3];
+    struct sockaddr_in addrs[FDB_SOCKET_MAX_DATAGRAMS];
+    memset(msgs, 0, sizeof(msgs[0]) * count);
+    memset(addrs, 0, sizeof(addrs[0]) * count);
+    for (int32_t i = 0; i < count; ++i)
+    {
+        auto &datagram = datagrams[i];
+        addrs[i].sin_family = AF_INET;
+        addrs[i].sin_port = htons((uint16_t)datagram.mDestAddr->mPort);
+        if (inet_pton(AF_INET, datagram.mDestAddr->mAddr.c_str(), &addrs[i].sin_addr) != 1)
+        {
+            // datagrams before it are still sent
+            count = i;
+            break;
+        }
+        auto vec = &iov[i * 3];
+        int32_t nr_vecs = 0;
+        if (datagram.mHeadSize)
+        {
+            vec[nr_vecs].iov_base = (void *)datagram.mHead;
+            vec[nr_vecs++].iov_len = datagram.mHeadSize;
+        }
+        vec[nr_vecs].iov_base = (void *)datagram.mData;
+        vec[nr_vecs++].iov_len = datagram.mSize;
+        if (datagram.mTailSize)
+        {
+            vec[nr_vecs].iov_base = (void *)datagram.mTail;
+            vec[nr_vecs++].iov_len = datagram.mTailSize;
+        }
+        msgs[i].msg_hdr.msg_name = &addrs[i];
+        msgs[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
+        msgs[i].msg_hdr.msg_iov = vec;
+        msgs[i].msg_hdr.msg_iovlen = nr_vecs;
+    }
+    if (!count)
+    {
+        return -1;
+    }
+
+    int ret;
+    do
+    {
+        ret = sendmmsg(fd, msgs, count, MSG_NOSIGNAL);
+    } while ((ret < 0) && (errno == EINTR));
+    return (ret < 0) ? -1 : ret;
+#endif
+}
+
+int32_t CUDPTransportSocket::recv(uint8_t **buffers, int32_t size, int32_t *sizes, int32_t count)
+{
+#ifdef __WIN32__
+    return CSocketImp::recv(buffers, size, sizes, count);
+#else
+    int fd = getFd();
+    if (fd < 0)
+    {
+        return -1;
+    }
+    if (count > FDB_SOCKET_MAX_DATAGRAMS)
+    {
+        count = FDB_SOCKET_MAX_DATAGRAMS;
+    }
+    if (count <= 0)
+    {
+        return 0;
+    }
+
+    struct mmsghdr msgs[FDB_SOCKET_MAX_DATAGRAMS];
+    struct iovec iov[FDB_SOCKET_MAX_DATAGRAMS];
+    memset(msgs, 0, sizeof(msgs[0]) * count);
+    for (int32_t i = 0; i < count; ++i)
+    {
+        iov[i].iov_base = buffers[i];
+        iov[i].iov_len = size;
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    int ret;
+    do
+    {
+        // only take what is pending; the socket is readable when called
+        ret = recvmmsg(fd, msgs, count, MSG_DONTWAIT, 0);
+    } while ((ret < 0) && (errno == EINTR));
+    if (ret < 0)
+    {
+        return ((errno == EAGAIN) || (errno == EWOULDBLOCK)) ? 0 : -1;
+    }
+    for (int i = 0; i < ret; ++i)
+    {
+        sizes[i] = (int32_t)msgs[i].msg_len;
+    }
+    return ret;
+#endif
+}
+
 int CUDPTransportSocket::getFd()
 {
     if (mSocketImp)
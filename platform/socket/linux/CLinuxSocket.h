@@ -18,6 +18,7 @@
 #define _CLINUXSOCKET_H_
 
 #include <common_base/CSocketImp.h>
+#include <common_base/CFdbShmChannel.h>
 #include <platform/socket/sckt-0.5/sckt.hpp>
 
 bool getLinuxIpAddress(std::map<std::string, std::string> &addr_tbl);
@@ -28,6 +29,7 @@ public:
     CTCPTransportSocket(sckt::TCPSocket *imp, EFdbSocketType type);
     ~CTCPTransportSocket();
     int32_t send(const uint8_t *data, int32_t size);
+    int32_t send(const CFdbIoVec *vecs, int32_t count);
     int32_t recv(uint8_t *data, int32_t size);
     int getFd();
 private:
@@ -35,12 +37,35 @@ private:
     sckt::TCPSocket *mSocketImp;
 };
 
+#ifdef CONFIG_FDB_SHM
+class CShmTransportSocket : public CTCPTransportSocket
+{
+public:
+    CShmTransportSocket(sckt::TCPSocket *imp, EFdbSocketType type);
+    int32_t recv(uint8_t *data, int32_t size);
+    CFdbShmChannel *shmChannel();
+private:
+    CFdbShmChannel mChannel;
+};
+#endif
+
 class CLinuxClientSocket : public CClientSocketImp
 {
 public:
     CLinuxClientSocket(CFdbSocketAddr &addr);
     ~CLinuxClientSocket();
     CSocketImp *connect(bool block = false, int32_t ka_interval = 0, int32_t ka_retries = 0);
+    int32_t startConnect(bool block = false, int32_t ka_interval = 0, int32_t ka_retries = 0);
+    CSocketImp *finishConnect();
+    void cancelConnect();
+    int getFd();
+private:
+    // socket with connect in progress
+    sckt::TCPSocket *mConnectingImp;
+    sckt::Options mConnectOptions;
+
+    sckt::TCPSocket *openSocket(sckt::Options &opt);
+    CSocketImp *createTransport(sckt::TCPSocket *sckt_imp);
 };
 
 class CLinuxServerSocket : public CServerSocketImp
@@ -61,7 +86,9 @@ public:
     CUDPTransportSocket(sckt::UDPSocket *imp);
     ~CUDPTransportSocket();
     int32_t send(const uint8_t *data, int32_t size, const CFdbSocketAddr &dest_addr);
+    int32_t send(const CFdbDatagram *datagrams, int32_t count);
     int32_t recv(uint8_t *data, int32_t size);
+    int32_t recv(uint8_t **buffers, int32_t size, int32_t *sizes, int32_t count);
     int getFd();
 private:
     sckt::UDPSocket *mSocketImp;
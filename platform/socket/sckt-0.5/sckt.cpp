@@ -49,6 +49,8 @@ THE SOFTWARE. */
 #define M_INVALID_SOCKET INVALID_SOCKET
 #define M_SOCKET_ERROR SOCKET_ERROR
 #define M_EINTR WSAEINTR
+#define M_EINPROGRESS WSAEWOULDBLOCK
+#define M_SOCKET_ERRNO WSAGetLastError()
 #define M_FD_SETSIZE FD_SETSIZE
 #define MSG_NOSIGNAL 0
 #define MSG_DONTWAIT 0
@@ -78,6 +80,8 @@ typedef int socklen_t;
 #define M_INVALID_SOCKET (-1)
 #define M_SOCKET_ERROR (-1)
 #define M_EINTR EINTR
+#define M_EINPROGRESS EINPROGRESS
+#define M_SOCKET_ERRNO errno
 #define M_FD_SETSIZE FD_SETSIZE
 typedef int T_Socket;
 #define MAXINTERFACES 16
@@ -504,7 +508,11 @@ void TCPSocket::Open(const IPAddress& ip, Options *options, bool disableNaggle){
         sockAddr.sin_port = htons(ip.port);
 
         // Connect to the remote host
-        if (CONFIG_SOCKET_CONNECT_TIMEOUT)
+        if (options && options->mAsyncConnect)
+        {
+            this->setNonBlock(true);
+        }
+        else if (CONFIG_SOCKET_CONNECT_TIMEOUT)
         {
             struct timeval tv;
             
@@ -518,6 +526,12 @@ void TCPSocket::Open(const IPAddress& ip, Options *options, bool disableNaggle){
             }
         }
         if( connect(CastToSocket(this->socket), reinterpret_cast<sockaddr *>(&sockAddr), sizeof(sockAddr)) == M_SOCKET_ERROR ){
+            if (options && options->mAsyncConnect && (M_SOCKET_ERRNO == M_EINPROGRESS))
+            {
+                // completed by FinishConnect() once the socket is writable
+                this->connecting = true;
+                return;
+            }
             this->Close();
             throw sckt::Exc("TCPSocket::Open(): Couldn't connect to remote host");
         }
@@ -542,7 +556,11 @@ void TCPSocket::Open(const IPAddress& ip, Options *options, bool disableNaggle){
         addr_len = sizeof(sockAddr);
 #endif
 
-        // Bind the socket for listening
+        // unix domain socket connects at once or fails; never wait for full backlog
+        if (options && options->mAsyncConnect)
+        {
+            this->setNonBlock(true);
+        }
         if( connect(CastToSocket(this->socket), reinterpret_cast<sockaddr*>(&sockAddr), addr_len) == M_SOCKET_ERROR ){
             this->Close();
             throw sckt::Exc("TCPServerSocket::Open(): Couldn't bind to local address");
@@ -550,6 +568,24 @@ void TCPSocket::Open(const IPAddress& ip, Options *options, bool disableNaggle){
         socket_type = SCKT_SOCKET_UNIX;
     }
 #endif
+    this->Established(options, disableNaggle);
+};
+
+void TCPSocket::FinishConnect(Options *options, bool disableNaggle){
+    if(!this->connecting)
+        return;
+    this->connecting = false;
+
+    int error = 0;
+    socklen_t len = sizeof(error);
+    if( (getsockopt(CastToSocket(this->socket), SOL_SOCKET, SO_ERROR, (char*)&error, &len) == M_SOCKET_ERROR) || error ){
+        this->Close();
+        throw sckt::Exc("TCPSocket::FinishConnect(): Couldn't connect to remote host");
+    }
+    this->Established(options, disableNaggle);
+};
+
+void TCPSocket::Established(Options *options, bool disableNaggle){
     this->setNonBlock(options ? options->mNonBlock : true);
     
     //Disable Naggle algorithm if required
@@ -68,10 +68,14 @@ struct Options
     bool mNonBlock;
     int32_t mKAInterval;
     int32_t mKARetries;
-    Options(bool non_block = true, int32_t ka_interval = 0, int32_t ka_retries = 0)
+    // TCPSocket::Open() returns with connect in progress instead of blocking
+    bool mAsyncConnect;
+    Options(bool non_block = true, int32_t ka_interval = 0, int32_t ka_retries = 0,
+            bool async_connect = false)
         : mNonBlock(non_block)
         , mKAInterval(ka_interval)
         , mKARetries(ka_retries)
+        , mAsyncConnect(async_connect)
     {}
 };
 
@@ -332,6 +336,7 @@ public:
         , peer_port(0)
         , self_port(0)
         , socket_type(SCKT_SOCKET_INET)
+        , connecting(false)
     {
     };
     
@@ -344,6 +349,7 @@ public:
     */
     //copy constructor
     TCPSocket(const TCPSocket& s)
+        : connecting(false)
     {
         //NOTE: that operator= calls destructor, so this->socket should be invalid, base class constructor takes care about it.
         this->operator=(s);//same as auto_ptr
@@ -363,6 +369,7 @@ public:
         , peer_port(0)
         , self_port(0)
         , socket_type(SCKT_SOCKET_INET)
+        , connecting(false)
     {
         this->Open(ip, options, disableNaggle);
     };
@@ -385,6 +392,22 @@ public:
     @param disableNaggle - enable/disable Naggle algorithm.
     */
     void Open(const IPAddress& ip, Options *options = 0, bool disableNaggle = false);
+
+    /**
+    @brief Tells whether connect started by Open() with Options::mAsyncConnect is in progress.
+    The socket becomes writable once connect completes or fails.
+    */
+    inline bool IsConnecting()const{
+        return this->connecting;
+    };
+
+    /**
+    @brief Completes connect in progress.
+    Throws if connect fails; the socket is closed then.
+    @param options - options applied to the connected socket.
+    @param disableNaggle - enable/disable Naggle algorithm.
+    */
+    void FinishConnect(Options *options = 0, bool disableNaggle = false);
     
     /**
     @brief Send data to connected socket.
@@ -418,7 +441,10 @@ public:
     SocketType socket_type;
     
 private:
+    bool connecting;
+
     void DisableNaggle();
+    void Established(Options *options, bool disableNaggle);
 };
 
 /**
@@ -22,6 +22,8 @@
 #include "common_defs.h"
 #include "CBaseEndpoint.h"
 #include "CMethodJob.h"
+#include "CMethodLoopTimer.h"
+#include "CBaseFdWatch.h"
 
 class CBaseClient;
 class CBaseWorker;
@@ -42,6 +44,17 @@ public:
                   , int32_t udp_port);
     ~CClientSocket();
     CFdbSession *connect();
+    /*
+     * Connect without blocking. Return the session if connected at once;
+     * otherwise connect goes on in background, retried with backoff, and
+     * the session is set up by the owner once connected.
+     */
+    CFdbSession *startConnect();
+    // connect started by startConnect() is still going on
+    bool connecting() const
+    {
+        return mConnecting;
+    }
     void setSocket(CClientSocketImp *skt)
     {
         mSocket = skt;
@@ -65,7 +78,33 @@ public:
 protected:
     void onSessionDeleted(CFdbSession *session);
 private:
+    // completes connect in progress once the socket is writable
+    class CConnectWatch : public CBaseFdWatch
+    {
+    public:
+        CConnectWatch(CClientSocket *socket, int fd);
+    protected:
+        void onOutput();
+        void onHup();
+        void onError();
+    private:
+        CClientSocket *mSocket;
+    };
+
     std::string mConnectedHost;
+    bool mConnecting;
+    int32_t mConnectRetries;
+    int32_t mConnectInterval;
+    CConnectWatch *mConnectWatch;
+    // fires retry of connect, or timeout of connect in progress
+    CMethodLoopTimer<CClientSocket> mConnectTimer;
+
+    CFdbSession *tryConnect();
+    void retryConnect();
+    void completeConnect();
+    void onConnectTimer(CMethodLoopTimer<CClientSocket> *timer);
+    void onConnectDone(CFdbSession *session);
+    void dropConnectWatch();
 };
 
 class CBaseClient : public CBaseEndpoint
@@ -81,7 +120,9 @@ public:
      *     when creating CBaseClient
      * @return: the session the client is established with server. To check
      *     the return value, using isValidFdbId();
-     *     Note that for "SVC://", isValidFdbId() always return false
+     *     Note that for "SVC://", isValidFdbId() always return false; so
+     *     does it if connect is still in progress (see enableAsyncConnect()),
+     *     in which case onOnline() is called once connected.
      *
      * The supported address format is:
      * tcp://ip address:port number
@@ -117,6 +158,10 @@ public:
         return 0;
     }
 protected:
+    /*
+     * Connect to url. With async connect, the socket might be returned with
+     * connect still in progress (CClientSocket::connecting()).
+     */
     CClientSocket *doConnect(const char *url, const char *host_name = 0, 
                              int32_t udp_port = FDB_INET_PORT_INVALID);
     void doDisconnect(FdbSessionId_t sid = FDB_INVALID_ID);
@@ -139,6 +184,8 @@ private:
         mIsLocal = is_local;
     }
     void updateSecurityLevel(void);
+    bool setupSession(CClientSocket *sk, CFdbSession *session);
+    CClientSocket *pendingSocket(const CFdbSocketAddr &addr);
 
     friend class CFdbContext;
     friend class CConnectClientJob;
@@ -19,8 +19,10 @@
 
 #include <string>
 #include <vector>
+#include <atomic>
 #include "common_defs.h"
 #include "CEntityContainer.h"
+#include "CEntitySlotMap.h"
 #include "CFdbBaseObject.h"
 #include "CMethodJob.h"
 #include "CFdbToken.h"
@@ -30,6 +32,7 @@ class CBaseWorker;
 class CFdbSessionContainer;
 class CFdbMessage;
 struct CFdbSocketAddr;
+struct CFdbFlowStatistics;
 class CFdbSession;
 class CApiSecurityConfig;
 class CFdbBaseContext;
@@ -47,6 +50,11 @@ public:
 #define FDB_EP_IPC_BLOCKING_MODE        (1 << 13)
 #define FDB_EP_READ_ASYNC               (1 << 14)
 #define FDB_EP_WRITE_ASYNC              (1 << 15)
+#define FDB_EP_READ_STREAM              (1 << 16)
+#define FDB_EP_NO_COMPACT_HEAD          (1 << 17)
+#define FDB_EP_BLOCKING_CONNECT         (1 << 18)
+
+#define FDB_UDP_DEFAULT_BATCH_SIZE      16
 
     CBaseEndpoint(const char *name = 0, CBaseWorker *worker = 0, CFdbBaseContext *context = 0,
                   EFdbEndpointRole role = FDB_OBJECT_ROLE_UNKNOWN);
@@ -164,6 +172,11 @@ public:
         return !!(mFlag & FDB_EP_IPC_BLOCKING_MODE);
     }
 
+    /*
+     * Output the socket can not take at once is queued and written upon
+     * POLLOUT either way. If set, log of a message is sent once the message
+     * is written; otherwise once it is submitted.
+     */
     void enableAysncWrite(bool active)
     {
         if (active)
@@ -197,6 +210,114 @@ public:
         return !!(mFlag & FDB_EP_READ_ASYNC);
     }
 
+    /*
+     * In stream read mode, sessions read as much as available into a
+     * receive buffer upon each POLLIN and dispatch all complete messages
+     * in one pass without copying them; a message kept by the application
+     * keeps the receive buffer it is in. It takes precedence over async
+     * read. Should be set before connect() or bind().
+     */
+    void enableStreamRead(bool active)
+    {
+        if (active)
+        {
+            mFlag |= FDB_EP_READ_STREAM;
+        }
+        else
+        {
+            mFlag &= ~FDB_EP_READ_STREAM;
+        }
+    }
+    bool enableStreamRead()
+    {
+        return !!(mFlag & FDB_EP_READ_STREAM);
+    }
+
+    /*
+     * Compact message head is offered to peers at session setup and used
+     * once the peer offers it as well. Enabled by default; should be set
+     * before connect() or bind().
+     */
+    void enableCompactHead(bool active)
+    {
+        if (active)
+        {
+            mFlag &= ~FDB_EP_NO_COMPACT_HEAD;
+        }
+        else
+        {
+            mFlag |= FDB_EP_NO_COMPACT_HEAD;
+        }
+    }
+    bool enableCompactHead()
+    {
+        return !(mFlag & FDB_EP_NO_COMPACT_HEAD);
+    }
+
+    /*
+     * Clients connect without blocking by default: connect in progress is
+     * completed and retried in background, and onOnline() is called once
+     * connected. Should be set before connect().
+     */
+    void enableAsyncConnect(bool active)
+    {
+        if (active)
+        {
+            mFlag &= ~FDB_EP_BLOCKING_CONNECT;
+        }
+        else
+        {
+            mFlag |= FDB_EP_BLOCKING_CONNECT;
+        }
+    }
+    bool enableAsyncConnect()
+    {
+        return !(mFlag & FDB_EP_BLOCKING_CONNECT);
+    }
+
+    /*
+     * Max number of UDP datagrams received or sent with one system call.
+     * Receive buffers of 64K are added as traffic goes up to the number.
+     */
+    void udpBatchSize(int32_t size)
+    {
+        mUDPBatchSize = size;
+    }
+    int32_t udpBatchSize() const
+    {
+        return mUDPBatchSize;
+    }
+
+    /*
+     * Bound output pending at each session. Once pending output reaches
+     * high_mark bytes, policy applies to further messages and
+     * onBackpressure(sid, true) is called; onBackpressure(sid, false)
+     * follows when it falls to low_mark. Only broadcasts are dropped;
+     * requests and replies are queued up to FDB_BP_HARD_LIMIT_SCALE times
+     * high_mark and the session is dropped beyond. high_mark of 0 means
+     * no limit.
+     */
+    void setOutputWatermark(int32_t high_mark, int32_t low_mark = 0,
+                            EFdbBackpressurePolicy policy = FDB_BP_DROP_NEWEST);
+    int32_t outputHighMark() const
+    {
+        return mOutputHighMark;
+    }
+    int32_t outputLowMark() const
+    {
+        return mOutputLowMark;
+    }
+    EFdbBackpressurePolicy backpressurePolicy() const
+    {
+        return (EFdbBackpressurePolicy)mBackpressurePolicy.load();
+    }
+
+    /*
+     * Get counters of output flow of a session. Return false if the session
+     * does not exist.
+     */
+    bool getFlowStatistics(FdbSessionId_t sid, CFdbFlowStatistics &stats);
+
     void enableBlockingMode(bool active)
     {
         if (active)
@@ -230,7 +351,8 @@ public:
 
     // Internal use only!!!
     CFdbSession *getSession(FdbSessionId_t session_id);
-    void registerSession(CFdbSession *session);
+    // false if the session can not get a sid; it should be dropped then
+    bool registerSession(CFdbSession *session);
     void unregisterSession(FdbSessionId_t session_id);
     void deleteSession(FdbSessionId_t session_id);
     void deleteSession(CFdbSessionContainer *container);
@@ -257,6 +379,13 @@ protected:
     virtual bool onMessageAuthentication(CFdbMessage *msg);
     virtual bool onEventAuthentication(CFdbMessage *msg);
 
+    /*
+     * Called at context of endpoint when pending output of session sid
+     * reaches the high watermark (congested) or falls to the low one.
+     */
+    virtual void onBackpressure(FdbSessionId_t sid, bool congested)
+    {}
+
     void setNsName(const char *name)
     {
         if (name)
@@ -271,7 +400,8 @@ protected:
     void onPublish(CBaseJob :: Ptr &msg_ref);
     CFdbBaseContext *mContext;
 private:
-    typedef CEntityContainer<FdbSessionId_t, CFdbSession *> tSessionContainer;
+    // sid of a closed session is never taken by a later one
+    typedef CEntitySlotMap<FdbSessionId_t, CFdbSession *> tSessionContainer;
     tSessionContainer mSessionContainer;
 
     tObjectContainer mObjectContainer;
@@ -280,6 +410,11 @@ private:
     FdbObjectId_t mSnAllocator;
     FdbEndpointId_t mEpid;
     CFdbEventRouter mEventRouter;
+    int32_t mUDPBatchSize;
+    // read by sessions at I/O workers
+    std::atomic<int32_t> mOutputHighMark;
+    std::atomic<int32_t> mOutputLowMark;
+    std::atomic<int32_t> mBackpressurePolicy;
     
     CFdbSession *preferredPeer();
     void checkAutoRemove();
@@ -308,6 +443,7 @@ private:
     }
 
     void callKickOutSession(CBaseWorker *worker, CMethodJob<CBaseEndpoint> *job, CBaseJob::Ptr &ref);
+    void callGetFlowStatistics(CBaseWorker *worker, CMethodJob<CBaseEndpoint> *job, CBaseJob::Ptr &ref);
 
     friend class CFdbSession;
     friend class CFdbUDPSession;
@@ -324,6 +460,8 @@ private:
     friend class CDestroyJob;
     friend class CLogProducer;
     friend class CKickOutSessionJob;
+    friend class CFlowStatisticsJob;
+    friend class CSessionBackpressureJob;
 };
 
 #endif
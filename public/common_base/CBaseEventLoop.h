@@ -17,9 +17,10 @@
 #ifndef _CBASEEVENTLOOP_H_
 #define _CBASEEVENTLOOP_H_
 
-#include <list>
 #include <set>
+#include <vector>
 #include <mutex>
+#include <cstdint>
 
 class CSysLoopTimer;
 class CBaseWorker;
@@ -56,11 +57,20 @@ protected:
     
 #define LOOP_DEFAULT_INTERVAL       20
 private:
-    typedef std::list< CSysLoopTimer *> tLoopTimerList;
+    typedef std::vector<CSysLoopTimer *> tLoopTimerTbl;
     typedef std::set<CSysLoopTimer *> tTimerTbl;
 
-    tLoopTimerList mTimerList;
-    tLoopTimerList mTimerWorkingList;
+    // all timers installed at the loop
+    tLoopTimerTbl mTimerList;
+    /*
+     * Enabled timers in a 4-ary min-heap ordered by expiration. Each timer
+     * remembers its position so that it is removed without searching.
+     */
+    tLoopTimerTbl mTimerHeap;
+    // expired timers of current tick; reused to avoid allocation
+    tLoopTimerTbl mExpiredTimers;
+    // keep enabling order of timers expiring at the same time
+    uint64_t mTimerSequence;
     tTimerTbl mTimerBlackList;
     int32_t mTimerRecursiveCnt;
 
@@ -71,6 +81,12 @@ private:
     void beginTimerBlackList();
     void endTimerBlackList();
 
+    static bool timerBefore(CSysLoopTimer *left, CSysLoopTimer *right);
+    void pushTimer(CSysLoopTimer *timer);
+    void eraseTimer(CSysLoopTimer *timer);
+    void siftTimerUp(uint32_t index);
+    void siftTimerDown(uint32_t index);
+
     friend CSysLoopTimer;
 };
 
@@ -20,6 +20,7 @@
 #include <memory>
 #include <condition_variable>
 #include <mutex>
+#include <atomic>
 #include "CBaseSemaphore.h"
 #include "common_defs.h"
 
@@ -117,6 +118,13 @@ private:
     int32_t mFlag;
     std::mutex mSyncLock;
     CSyncRequest *mSyncReq;
+    /*
+     * Link of lock-free job queue of CBaseWorker. mQueueRef holds the job
+     * while it is linked; a job is in at most one lock-free queue at a time.
+     */
+    std::atomic<CBaseJob *> mQueueNext;
+    std::atomic<bool> mQueueLinked;
+    Ptr mQueueRef;
     friend class CBaseWorker;
 };
 
@@ -32,6 +32,8 @@ public:
     static CUDPSocketImp *createUDPSocket(CFdbSocketAddr &addr);
     static CUDPSocketImp *createUDPSocket(const char *url);
     static bool parseUrl(const char *url, CFdbSocketAddr &addr);
+    // if the url is IPC carrying messages in shared memory
+    static bool isShmUrl(const std::string &url);
     static bool getIpAddress(tIpAddressTbl &addr_tbl);
     static bool getIpAddress(std::string &address, const char *if_name = 0);
     static void buildUrl(std::string &url, const char *ip_addr, const char *port);
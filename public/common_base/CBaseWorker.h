@@ -18,6 +18,7 @@
 #define _CBASEWORKER_H_
 
 #include <vector>
+#include <atomic>
 #include "CBaseThread.h"
 #include "CBaseJob.h"
 
@@ -27,7 +28,20 @@
  * allowed
  */
 #define FDB_WORKER_ENABLE_FD_LOOP   (1 << (FDB_BASE_WORKER_FLAG_SHIFT + 0))
-#define FDB_WORKER_FLAG_SHIFT       (FDB_BASE_WORKER_FLAG_SHIFT + 1)
+/*
+ * Used along with FDB_WORKER_ENABLE_FD_LOOP: if set, watches are polled with
+ * epoll() rather than poll(). It is ignored if epoll is not built in.
+ */
+#define FDB_WORKER_ENABLE_EPOLL     (1 << (FDB_BASE_WORKER_FLAG_SHIFT + 1))
+/*
+ * If set, normal and urgent job queues are lock-free multi-producer/
+ * single-consumer queues: sending jobs doesn't contend on the mutex of event
+ * loop and the worker is woken up only when a queue becomes non-empty. Jobs
+ * are linked into the queue directly, so a job can not be sent to a
+ * lock-free queue again before it is taken by the worker.
+ */
+#define FDB_WORKER_LOCKFREE_QUEUE   (1 << (FDB_BASE_WORKER_FLAG_SHIFT + 2))
+#define FDB_WORKER_FLAG_SHIFT       (FDB_BASE_WORKER_FLAG_SHIFT + 3)
 
 class CBaseEventLoop;
 class CBaseWorker : public CBaseThread
@@ -39,8 +53,9 @@ public:
     /*
      * start work thread of the worker
      *
-     * @iparam flag - can be none or or-ed by FDB_WORKER_EXE_IN_PLACE and
-     *      FDB_WORKER_ENABLE_FD_LOOP
+     * @iparam flag - can be none or or-ed by FDB_WORKER_EXE_IN_PLACE,
+     *      FDB_WORKER_ENABLE_FD_LOOP, FDB_WORKER_ENABLE_EPOLL and
+     *      FDB_WORKER_LOCKFREE_QUEUE
      * @return true - success; false - fail
      */
     bool start(uint32_t flag = FDB_WORKER_DEFAULT);
@@ -206,8 +221,12 @@ private:
     {
     public:
         CJobQueue(uint32_t max_size = 0);
+        ~CJobQueue();
         bool enqueue(CBaseJob::Ptr &job);
+        // take jobs of mutex protected queue; called with event loop locked
         void dumpJobs(tJobContainer &job_queue);
+        // take jobs of lock-free queue; called without locking event loop
+        void dumpJobsLockFree(tJobContainer &job_queue);
         void discardJobs();
         void pickupJobs();
         bool jobDiscarded();
@@ -218,6 +237,14 @@ private:
         {
             mEventLoop = event_loop;
         }
+        void lockFree(bool enable)
+        {
+            mLockFree = enable;
+        }
+        bool lockFree() const
+        {
+            return mLockFree;
+        }
         tJobContainer &jobQueue()
         {
             return mJobQueue;
@@ -228,6 +255,21 @@ private:
         CBaseEventLoop *mEventLoop;
         tJobContainer mJobQueue;
 
+        /*
+         * intrusive MPSC queue linked by CBaseJob::mQueueNext: producers
+         * push at mHead; worker pops at mTail
+         */
+        bool mLockFree;
+        std::atomic<CBaseJob *> mHead;
+        CBaseJob *mTail;
+        CBaseJob mStub;
+        // jobs pushed but not dumped yet; 0 -> 1 wakes up the worker
+        std::atomic<uint32_t> mPending;
+
+        bool enqueueLockFree(CBaseJob::Ptr &job);
+        void pushNode(CBaseJob *job);
+        CBaseJob *popNode();
+
         friend class CBaseWorker;
     };
     
@@ -0,0 +1,256 @@
+/*
+ * Copyright (C) 2015   Jeremy Chen jeremy_cz@yahoo.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _CENTITYSLOTMAP_H_
+#define _CENTITYSLOTMAP_H_
+
+#include <vector>
+#include <type_traits>
+#include <utility>
+#include "common_defs.h"
+
+/*
+ * Container of entries whose ids are assigned by the container. Entries
+ * live in a vector of slots; an id holds index of the slot in low
+ * FDB_SLOT_INDEX_BITS bits and generation of the slot in the rest. The
+ * generation increases each time the slot is freed, so that the id of an
+ * erased entry is not found even after the slot is reused. Insert, lookup
+ * and erase take constant time and do not allocate once the slots have
+ * grown to the max number of entries ever held.
+ *
+ * Freed slots are reused in FIFO order, and only when more than
+ * FDB_SLOT_MIN_FREE of them are free; thus a slot comes back with the same
+ * generation after at least FDB_SLOT_MIN_FREE << generation bits erasures.
+ */
+#define FDB_SLOT_INDEX_BITS 18
+#define FDB_SLOT_MIN_FREE 256
+#define FDB_SLOT_NONE ((uint32_t)~0)
+
+template<typename IDX, typename EP>
+class CEntitySlotMap
+{
+private:
+    struct CSlot
+    {
+        EP mEntry;
+        uint32_t mGeneration;
+        // next free slot if the slot is free
+        uint32_t mNextFree;
+        bool mUsed;
+        CSlot()
+            : mEntry()
+            , mGeneration(0)
+            , mNextFree(FDB_SLOT_NONE)
+            , mUsed(false)
+        {}
+    };
+    typedef std::vector<CSlot> tSlotTable;
+
+    // keep ids of signed type positive
+    static const uint32_t mGenerationBits = (uint32_t)(sizeof(IDX) * 8) - FDB_SLOT_INDEX_BITS
+                                            - (std::is_signed<IDX>::value ? 1 : 0);
+    static const uint32_t mIndexMask = (1 << FDB_SLOT_INDEX_BITS) - 1;
+    static const uint32_t mGenerationMask = (uint32_t)((1ULL << mGenerationBits) - 1);
+    // the last index is not used so that no id equals to FDB_INVALID_ID
+    static const uint32_t mMaxSlots = mIndexMask;
+
+public:
+    class iterator
+    {
+    public:
+        iterator(tSlotTable *slots, uint32_t index)
+            : mSlots(slots)
+            , mIndex(index)
+        {
+            skipFree();
+        }
+        bool operator!=(const iterator &other) const
+        {
+            return mIndex != other.mIndex;
+        }
+        bool operator==(const iterator &other) const
+        {
+            return mIndex == other.mIndex;
+        }
+        // entry at the iterator can be erased before moving on
+        iterator &operator++()
+        {
+            ++mIndex;
+            skipFree();
+            return *this;
+        }
+        EP &operator*()
+        {
+            return (*mSlots)[mIndex].mEntry;
+        }
+        IDX id() const
+        {
+            return makeId(mIndex, (*mSlots)[mIndex].mGeneration);
+        }
+    private:
+        tSlotTable *mSlots;
+        uint32_t mIndex;
+
+        void skipFree()
+        {
+            while ((mIndex < (uint32_t)mSlots->size()) && !(*mSlots)[mIndex].mUsed)
+            {
+                ++mIndex;
+            }
+        }
+    };
+
+    CEntitySlotMap()
+        : mSize(0)
+        , mNrFree(0)
+        , mFreeHead(FDB_SLOT_NONE)
+        , mFreeTail(FDB_SLOT_NONE)
+    {}
+
+    /*
+     * Add an entry. Return its id, or FDB_INVALID_ID if the container
+     * is full.
+     */
+    IDX insertEntry(const EP &ep)
+    {
+        uint32_t index;
+        if ((mNrFree > FDB_SLOT_MIN_FREE) || (mNrFree && (mSlots.size() >= mMaxSlots)))
+        {
+            index = mFreeHead;
+            mFreeHead = mSlots[index].mNextFree;
+            if (mFreeHead == FDB_SLOT_NONE)
+            {
+                mFreeTail = FDB_SLOT_NONE;
+            }
+            mNrFree--;
+        }
+        else if (mSlots.size() < mMaxSlots)
+        {
+            index = (uint32_t)mSlots.size();
+            mSlots.push_back(CSlot());
+        }
+        else
+        {
+            return (IDX)FDB_INVALID_ID;
+        }
+
+        auto &slot = mSlots[index];
+        slot.mEntry = ep;
+        slot.mUsed = true;
+        slot.mNextFree = FDB_SLOT_NONE;
+        mSize++;
+        return makeId(index, slot.mGeneration);
+    }
+
+    // Return the entry of id, or null if id is not (or no longer) valid.
+    EP *retrieveEntry(IDX id)
+    {
+        auto slot = findSlot(id);
+        return slot ? &slot->mEntry : 0;
+    }
+
+    bool deleteEntry(IDX id)
+    {
+        auto slot = findSlot(id);
+        if (!slot)
+        {
+            return false;
+        }
+        slot->mEntry = EP();
+        freeSlot(slot);
+        return true;
+    }
+
+    // Move entry of id out to ep and erase it.
+    bool removeEntry(IDX id, EP &ep)
+    {
+        auto slot = findSlot(id);
+        if (!slot)
+        {
+            return false;
+        }
+        ep = std::move(slot->mEntry);
+        slot->mEntry = EP();
+        freeSlot(slot);
+        return true;
+    }
+
+
+    uint32_t size() const
+    {
+        return mSize;
+    }
+    bool empty() const
+    {
+        return !mSize;
+    }
+    iterator begin()
+    {
+        return iterator(&mSlots, 0);
+    }
+    iterator end()
+    {
+        return iterator(&mSlots, (uint32_t)mSlots.size());
+    }
+
+private:
+    tSlotTable mSlots;
+    uint32_t mSize;
+    uint32_t mNrFree;
+    uint32_t mFreeHead;
+    uint32_t mFreeTail;
+
+    static IDX makeId(uint32_t index, uint32_t generation)
+    {
+        return (IDX)((generation << FDB_SLOT_INDEX_BITS) | index);
+    }
+
+    void freeSlot(CSlot *slot)
+    {
+        slot->mUsed = false;
+        slot->mGeneration = (slot->mGeneration + 1) & mGenerationMask;
+
+        auto index = (uint32_t)(slot - &mSlots[0]);
+        if (mFreeTail == FDB_SLOT_NONE)
+        {
+            mFreeHead = index;
+        }
+        else
+        {
+            mSlots[mFreeTail].mNextFree = index;
+        }
+        mFreeTail = index;
+        mNrFree++;
+        mSize--;
+    }
+
+    CSlot *findSlot(IDX id)
+    {
+        auto index = (uint32_t)id & mIndexMask;
+        if (index >= (uint32_t)mSlots.size())
+        {
+            return 0;
+        }
+        auto &slot = mSlots[index];
+        if (!slot.mUsed || (slot.mGeneration != ((uint32_t)id >> FDB_SLOT_INDEX_BITS)))
+        {
+            return 0;
+        }
+        return &slot;
+    }
+};
+
+#endif
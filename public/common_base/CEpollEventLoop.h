@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2015   Jeremy Chen jeremy_cz@yahoo.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _CEPOLLEVENTLOOP_H_
+#define _CEPOLLEVENTLOOP_H_
+
+#include "CFdEventLoop.h"
+
+#ifdef CONFIG_FDB_EPOLL
+#include <sys/epoll.h>
+
+/*
+ * epoll() backend of fd event loop. Watches are registered to the kernel
+ * when enabled and modified in place when flags change so that nothing is
+ * rebuilt when sessions come and go; only ready watches are dispatched.
+ */
+class CEpollEventLoop : public CFdEventLoop
+{
+public:
+    CEpollEventLoop();
+    ~CEpollEventLoop();
+
+    void dispatch();
+    void dispatchInput(int32_t timeout);
+    bool init(CBaseWorker *worker);
+
+protected:
+    bool enableWatch(CSysFdWatch *watch, bool enable);
+    void updateWatch(CSysFdWatch *watch);
+
+private:
+    typedef std::vector<epoll_event> tEpollEventTbl;
+
+    int mEpollFd;
+    int32_t mNrEnabledWatches;
+    tEpollEventTbl mEpollEvents;
+    // enabled watches which enter fatal error and are waiting for onError()
+    tWatchTbl mErrorWatches;
+
+    bool controlWatch(CSysFdWatch *watch, int op);
+    void processErrorWatches();
+    void processEpollEvents(epoll_event *events, int32_t nr_events, bool input_only);
+};
+#endif
+
+#endif
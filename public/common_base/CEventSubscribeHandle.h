@@ -20,10 +20,13 @@
 #include <map>
 #include <set>
 #include <string>
+#include <vector>
+#include <unordered_map>
 #include "common_defs.h"
 
 class CFdbSession;
 class CFdbMessage;
+class CFdbSessionContainer;
 
 enum CFdbSubscribeType {
   FDB_SUB_TYPE_NORMAL = 0,
@@ -34,17 +37,17 @@ typedef std::set<std::string> tFdbFilterSets;
 typedef std::map<FdbMsgCode_t, tFdbFilterSets> tFdbSubscribeMsgTbl;
 typedef std::set<CFdbSession *> tSubscribedSessionSets;
 
+/*
+ * Subscriptions of an object indexed by event code. Subscribers of an
+ * event are kept in a flat vector so that broadcast is a contiguous scan;
+ * topics (filters) are interned to ids so that matching is an integer
+ * compare. Each session refers back to its own subscribers so that its
+ * teardown does not scan the whole table.
+ */
 class CEventSubscribeHandle
 {
 public:
-    struct CSubscribeItem
-    {
-        CFdbSubscribeType mType;
-    };
-    typedef std::map<std::string, CSubscribeItem> SubItemTable_t;
-    typedef std::map<FdbObjectId_t, SubItemTable_t> ObjectTable_t;
-    typedef std::map<CFdbSession *, ObjectTable_t> SessionTable_t;
-    typedef std::map<FdbMsgCode_t, SessionTable_t> SubscribeTable_t;
+    CEventSubscribeHandle();
 
     void subscribe(CFdbSession *session, FdbMsgCode_t msg, FdbObjectId_t obj_id,
                    const char *filter, CFdbSubscribeType type);
@@ -54,7 +57,6 @@ public:
     void unsubscribe(FdbObjectId_t obj_id);
     void broadcast(CFdbMessage *msg, FdbMsgCode_t event);
     bool broadcast(CFdbMessage *msg, CFdbSession *session, FdbMsgCode_t event);
-    void getSubscribeTable(SessionTable_t &sessions, tFdbFilterSets &filter_tbl);
     void getSubscribeTable(tFdbSubscribeMsgTbl &table);
     void getSubscribeTable(FdbMsgCode_t code, tFdbFilterSets &filters);
     void getSubscribeTable(FdbMsgCode_t code, CFdbSession *session,
@@ -62,10 +64,60 @@ public:
     void getSubscribeTable(FdbMsgCode_t code, const char *filter,
                            tSubscribedSessionSets &session_tbl);
 private:
-    SubscribeTable_t mEventSubscribeTable;
+    // topic id of filter "", which matches any filter
+    static const uint32_t mAnyTopic = 0;
+    static const uint32_t mInvalidTopic = ~0U;
+
+    struct CSubscriber
+    {
+        CFdbSession *mSession;
+        FdbObjectId_t mObjId;
+        uint32_t mTopic;
+        CFdbSubscribeType mType;
+        // position of back reference in session table
+        uint32_t mSessionSlot;
+    };
+    typedef std::vector<CSubscriber> tSubscriberTbl;
+
+    struct CTopic
+    {
+        std::string mName;
+        uint32_t mRefCount;
+    };
+
+    struct CSubscriberRef
+    {
+        FdbMsgCode_t mEvent;
+        // subscribers of the event; stable since events are hashed by node
+        tSubscriberTbl *mSubscribers;
+        uint32_t mIndex;
+    };
+    typedef std::vector<CSubscriberRef> tSubscriberRefTbl;
+
+    typedef std::unordered_map<FdbMsgCode_t, tSubscriberTbl> tEventTbl;
+    typedef std::unordered_map<CFdbSession *, tSubscriberRefTbl> tSessionTbl;
+    typedef std::unordered_map<std::string, uint32_t> tTopicIdTbl;
+
+    tEventTbl mEventTable;
+    tSessionTbl mSessionTable;
+    std::vector<CTopic> mTopics;
+    std::vector<uint32_t> mFreeTopics;
+    tTopicIdTbl mTopicIds;
+    // empty subscriber tables are kept while being scanned
+    int32_t mScanDepth;
+    // containers holding UDP datagrams queued by broadcast
+    std::vector<CFdbSessionContainer *> mUDPBatches;
+
+    uint32_t internTopic(const char *filter);
+    void releaseTopic(uint32_t topic);
+    uint32_t findTopic(const char *filter) const;
+    tSubscriberTbl *findSubscribers(FdbMsgCode_t event);
+    void removeSubscriber(tSubscriberTbl &subscribers, uint32_t index);
+    void dropEmptyEvent(FdbMsgCode_t event);
     void broadcastOneMsg(CFdbSession *session, CFdbMessage *msg,
-                         CSubscribeItem &sub_item);
+                         CSubscriber &sub_item, bool batch_udp = false);
+    void flushUDPBatches();
+    void getSubscribeTable(const tSubscriberTbl &subscribers, tFdbFilterSets &filter_tbl);
 };
 
 #endif
-
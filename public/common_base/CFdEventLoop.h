@@ -39,39 +39,53 @@ public:
     bool notify();
     bool init(CBaseWorker *worker);
 
+protected:
+    typedef std::set<CSysFdWatch *> tWatchTbl;
+
+    CNotifyFdWatch *mNotifyWatch;
+
+    bool watchDestroyed(CSysFdWatch *watch);
+    bool isNotifyWatch(CSysFdWatch *watch) const;
+    void uninstallWatches();
+    void beginWatchBlackList();
+    void endWatchBlackList();
+    /*
+     * handle events returned by poll()/epoll_wait() for one watch; the
+     * caller should enclose it with beginWatchBlackList()/endWatchBlackList()
+     */
+    void processOneWatch(CSysFdWatch *w, int32_t revents);
+    void processWatchError(CSysFdWatch *w);
+
+    /*
+     * called when a watch is enabled or disabled, and when flags or fatal
+     * error status of a watch changes. Backend of the loop overrides them
+     * to keep its own view of the watches up to date.
+     */
+    virtual bool enableWatch(CSysFdWatch *watch, bool enable);
+    virtual void updateWatch(CSysFdWatch *watch);
+
 private:
     typedef std::list< CSysFdWatch *> tCFdWatchList;
-    typedef std::set<CSysFdWatch *> tWatchTbl;
     typedef std::vector<CSysFdWatch *> tWatchPollTbl;
     typedef std::vector<pollfd> tFdPollTbl;
 
     tFdPollTbl mPollFds;
-    tCFdWatchList mWatchList;
+    tWatchTbl mWatchList;
     tCFdWatchList mWatchWorkingList;
     tWatchPollTbl mPollWatches;
     tWatchTbl mWatchBlackList;
     int32_t mWatchRecursiveCnt;
-    CNotifyFdWatch *mNotifyWatch;
     CEventFd mEventFd;
     bool mRebuildPollFd;
     
-    bool watchDestroyed(CSysFdWatch *watch);
     void addWatchToBlacklist(CSysFdWatch *watch);
-    void uninstallWatches();
-    void beginWatchBlackList();
-    void endWatchBlackList();
 
     void buildFdArray();
     void buildInputFdArray(tWatchPollTbl &watches, tFdPollTbl &fds);
     void processWatches();
     void processInputWatches(tWatchPollTbl &watches, tFdPollTbl &fds);
     bool registerWatch(CSysFdWatch *watch, bool enable);
-    bool enableWatch(CSysFdWatch *watch, bool enable);
     bool addWatchToList(tCFdWatchList &wlist, CSysFdWatch *watch, bool enable);
-    void rebuildPollFd()
-    {
-        mRebuildPollFd = true;
-    }
 
     friend CSysFdWatch;
     friend CNotifyFdWatch;
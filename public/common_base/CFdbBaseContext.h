@@ -18,11 +18,13 @@
 #ifndef _CFDBBASECONTEXT_H_
 #define _CFDBBASECONTEXT_H_
 
+#include <vector>
 #include "common_defs.h"
 #include "CEntityContainer.h"
 #include "CBaseWorker.h"
 
 class CBaseEndpoint;
+class CFdbBufferPool;
 
 class CFdbBaseContext : public CBaseWorker
 {
@@ -51,6 +53,33 @@ public:
     {
         mCtxId = id;
     }
+    /*
+     * Pool of buffers receiving messages for endpoints of the context
+     */
+    CFdbBufferPool *bufferPool()
+    {
+        return mBufferPool;
+    }
+
+    /*
+     * Serve sockets of sessions accepted by servers of the context with
+     * nr_workers I/O workers. Sessions are sharded to the workers by
+     * session id. Messages are read and written at the I/O worker while
+     * still dispatched at the context in the order received, so callbacks
+     * of endpoints and objects run as before. Call it before servers bind.
+     *
+     * @iparam nr_workers: number of I/O workers
+     * @return true - success
+     */
+    bool enableIoWorkers(uint32_t nr_workers);
+
+    /*
+     * Get I/O worker serving the session; 0 if I/O workers are not enabled.
+     */
+    CFdbBaseContext *ioWorker(FdbSessionId_t sid)
+    {
+        return mIoWorkers.empty() ? 0 : mIoWorkers[(uint32_t)sid % mIoWorkers.size()];
+    }
 
 protected:
     FdbContextId_t mCtxId;
@@ -59,6 +88,8 @@ protected:
 
 private:
     tEndpointContainer mEndpointContainer;
+    CFdbBufferPool *mBufferPool;
+    std::vector<CFdbBaseContext *> mIoWorkers;
 };
 
 #endif
@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2015   Jeremy Chen jeremy_cz@yahoo.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _CFDBBUFFERPOOL_H_
+#define _CFDBBUFFERPOOL_H_
+
+#include <stdint.h>
+#include <vector>
+#include <list>
+#include <mutex>
+#include <atomic>
+
+// block size of the smallest class: 256 bytes
+#define FDB_POOL_MIN_BLOCK_SHIFT    8
+// number of small classes: 256 bytes ~ 128K bytes
+#define FDB_POOL_NR_SMALL_CLASSES   10
+// small blocks are carved from slabs of the size at least
+#define FDB_POOL_SLAB_SIZE          (64 * 1024)
+// how many big buffers are kept for reuse
+#define FDB_POOL_MAX_CACHED_BIG     8
+
+/*
+ * Size-classed pool of receive buffers. Small buffers are carved from
+ * slabs and kept in per-class free lists; big buffers are mapped from the
+ * system (backed by huge pages if possible) and a few of them are cached
+ * for reuse. Buffers can be released from any thread.
+ */
+class CFdbBufferPool
+{
+public:
+    struct CStatistics
+    {
+        uint64_t mSmallHits;
+        uint64_t mSmallMisses;
+        uint64_t mBigHits;
+        uint64_t mBigMisses;
+        uint32_t mNrSlabs;
+        uint32_t mNrCachedBig;
+    };
+
+    CFdbBufferPool();
+
+    /*
+     * Destroy the pool by its owner. Memory is returned to the system once
+     * all buffers are released.
+     */
+    void destroy();
+
+    /*
+     * Allocate a buffer of at least size bytes; return 0 if out of memory.
+     */
+    uint8_t *alloc(int32_t size);
+
+    /*
+     * Release a buffer obtained from alloc() back to its pool.
+     */
+    static void release(uint8_t *buffer);
+
+    /*
+     * Get size of a buffer requested by alloc().
+     */
+    static int32_t size(const uint8_t *buffer);
+
+    void getStatistics(CStatistics &stat);
+
+private:
+    struct CBlockHead
+    {
+        union
+        {
+            CFdbBufferPool *mPool;
+            CBlockHead *mNext;
+        };
+        int32_t mClass;
+        int32_t mSize;
+        int32_t mCapacity;
+    };
+    // keep buffers following the head aligned
+    static const int32_t mHeadSize = 32;
+
+    struct CSmallClass
+    {
+        std::mutex mLock;
+        CBlockHead *mFreeList;
+        std::vector<uint8_t *> mSlabs;
+        uint64_t mHits;
+        uint64_t mMisses;
+    };
+
+    typedef std::list<CBlockHead *> tBigBlockList;
+
+    CSmallClass mSmallClasses[FDB_POOL_NR_SMALL_CLASSES];
+    std::mutex mBigLock;
+    tBigBlockList mCachedBig;
+    uint64_t mBigHits;
+    uint64_t mBigMisses;
+    // one for the owner and one for each buffer in use
+    std::atomic<int32_t> mRefCount;
+
+    ~CFdbBufferPool();
+    CBlockHead *allocSmall(int32_t cls);
+    CBlockHead *allocBig(int32_t block_size);
+    void releaseBlock(CBlockHead *head);
+    void unref();
+    static CBlockHead *mapBig(int32_t capacity);
+    static void unmapBig(CBlockHead *head);
+};
+
+#endif
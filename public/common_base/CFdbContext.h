@@ -72,6 +72,15 @@ public:
     {
         mLogCacheSize = size;
     }
+    /*
+     * Send logs to log server in batch of max_size bytes, or max_latency ms
+     * after the first log in batch; should be called before start().
+     */
+    void setLogBatch(int32_t max_size, int32_t max_latency = 0)
+    {
+        mLogBatchSize = max_size;
+        mLogBatchLatency = max_latency;
+    }
 
 protected:
     bool asyncReady();
@@ -89,6 +98,8 @@ private:
     tContextContainer mContextContainer;
     bool mEnableLogCache;
     int32_t mLogCacheSize;
+    int32_t mLogBatchSize;
+    int32_t mLogBatchLatency;
 
     CFdbContext();
     friend class CRegisterContextJob;
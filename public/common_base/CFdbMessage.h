@@ -19,6 +19,7 @@
 
 #include <string>
 #include <functional>
+#include <memory>
 #include "common_defs.h"
 #include "CBaseJob.h"
 #include "CBaseLoopTimer.h"
@@ -213,10 +214,16 @@ private:
 #define MSG_FLAG_FORCE_UPDATE       (1 << 8)
 
 #define MSG_FLAG_HEAD_OK            (1 << (MSG_LOCAL_FLAG_SHIFT + 0))
+#define MSG_FLAG_HEAD_COMPACT       (1 << (MSG_LOCAL_FLAG_SHIFT + 1))
 #define MSG_FLAG_REPLIED            (1 << (MSG_LOCAL_FLAG_SHIFT + 2))
 #define MSG_FLAG_ENABLE_LOG         (1 << (MSG_LOCAL_FLAG_SHIFT + 3))
 #define MSG_FLAG_EXTERNAL_BUFFER    (1 << (MSG_LOCAL_FLAG_SHIFT + 4))
+#define MSG_FLAG_POOLED_BUFFER      (1 << (MSG_LOCAL_FLAG_SHIFT + 5))
 #define MSG_FLAG_MANUAL_UPDATE      (1 << (MSG_LOCAL_FLAG_SHIFT + 6))
+
+// head and payload
+#define FDB_MSG_MAX_FRAME_PIECES    2
+
     static const int32_t mPrefixSize = sizeof(CFdbMsgPrefix);
     static const int32_t mMaxHeadSize = 256;
 
@@ -244,6 +251,10 @@ public:
                 , const char *peer_name = 0);
     CFdbMessage(NFdbBase::CFdbMessageHeader &head
                 , CFdbSession *session);
+    /*
+     * Clone msg for another handler. Payload is shared by msg and the clone
+     * and is copied only when one of them takes or rebuilds it.
+     */
     CFdbMessage(const CFdbMessage *msg);
     virtual ~CFdbMessage();
 
@@ -331,6 +342,11 @@ public:
         return getPayloadOffset() + mPayloadSize;
     }
 
+    /*
+     * Get raw buffer starting with prefix. Head is not in it if it is built
+     * while the buffer is shared with pending output; use getFrame() to get
+     * what is to be sent.
+     */
     uint8_t *getRawBuffer() const
     {
         return mBuffer ? (mBuffer + mOffset) : 0;
@@ -350,14 +366,12 @@ public:
     }
 
     /*
-     * Own the buffer (so that user should release it manually)
+     * Own the buffer (so that user should release it manually). Buffer
+     * from receive pool or shared with pending output is copied before
+     * returning, so take payload at getPayloadOffset() of the returned
+     * buffer rather than from getPayloadBuffer() called before.
      */
-    void *ownBuffer()
-    {
-        void *buf = mBuffer;
-        mBuffer = 0;
-        return buf;
-    }
+    void *ownBuffer();
 
     void releaseBuffer(void *buf)
     {
@@ -675,7 +689,18 @@ private:
     static bool update(CBaseJob::Ptr &msg_ref, int32_t timeout = 0);
 
     void run(CBaseWorker *worker, Ptr &ref);
-    bool buildHeader();
+    /*
+     * Build head in compact encoding if the peer supports it; head already
+     * built in the other encoding is built again.
+     */
+    bool buildHeader(bool compact = false);
+    /*
+     * Replace object id in head built by buildHeader() instead of building
+     * the head again. If the head is still referred by pending output, only
+     * the head is copied. Return false if head is not built; use
+     * updateObjectId() then.
+     */
+    bool patchObjectId(FdbObjectId_t object_id);
     bool serialize(IFdbMsgBuilder &data, const CFdbBaseObject *object = 0);
     bool serialize(const void *buffer, int32_t size, const CFdbBaseObject *object = 0);
 
@@ -702,7 +727,30 @@ private:
     static void autoReply(CFdbSession *session, CBaseJob::Ptr &msg_ref, int32_t error_code, const char *description = 0);
 
     void releaseBuffer();
-    void replaceBuffer(uint8_t *buffer, int32_t payload_size = 0, int32_t head_size = 0, int32_t offset = 0);
+    void replaceBuffer(uint8_t *buffer, int32_t payload_size = 0, int32_t head_size = 0,
+                       int32_t offset = 0, bool pooled = false);
+    // take received buffer held by a reference, e.g. in shared memory
+    void replaceBuffer(const std::shared_ptr<uint8_t> &buffer, int32_t payload_size, int32_t head_size);
+    /*
+     * Share raw buffer with pending output so that it is not copied when
+     * it can not be sent at once. Shared buffer is released with delete[]
+     * once both the message and the output drop it.
+     */
+    const std::shared_ptr<uint8_t> &shareBuffer() const;
+    // Get a private buffer before modifying buffer shared with pending output
+    void unshareBuffer();
+    /*
+     * Get frame to be sent: prefix and head followed by payload. They are
+     * in one piece of raw buffer unless head is built while the buffer is
+     * shared with pending output; then head is in a buffer of its own and
+     * payload is still shared. Return number of pieces in vecs, at most
+     * FDB_MSG_MAX_FRAME_PIECES.
+     */
+    int32_t getFrame(CFdbIoVec *vecs) const;
+    // Like shareBuffer() but get buffers holding each piece of getFrame()
+    void shareFrame(std::shared_ptr<uint8_t> *buffer_refs);
+    // Get buffer where head can be written without touching pending output
+    uint8_t *writableHead(bool keep_head);
     static void feedDogNoQueue(CBaseJob::Ptr &msg_ref);
 
     void code(FdbMsgCode_t code)
@@ -776,6 +824,10 @@ private:
     FdbSessionId_t mSid;
     FdbObjectId_t mOid;
     uint8_t *mBuffer;
+    // non-empty if mBuffer is shared with pending output; owns mBuffer then
+    mutable std::shared_ptr<uint8_t> mSharedBuffer;
+    // non-empty if head is built apart from payload shared with pending output
+    std::shared_ptr<uint8_t> mHeadBuffer;
     uint32_t mFlag;
     CMessageTimer *mTimer;
     std::string mStringData;
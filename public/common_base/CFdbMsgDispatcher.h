@@ -20,6 +20,7 @@
 #include <functional>
 #include <string>
 #include <vector>
+#include <unordered_set>
 #include "CBaseJob.h"
 #include "CFdbMessage.h"
 #include "CBaseWorker.h"
@@ -152,7 +153,8 @@ public:
         tEvtHandleTbl mTable;
         friend class CFdbEventDispatcher;
     };
-    typedef std::vector<tRegEntryId> tRegistryHandleTbl;
+    // events registered by a component; looked up for each event dispatched
+    typedef std::unordered_set<tRegEntryId> tRegistryHandleTbl;
     CFdbEventDispatcher()
         : mRegIdAllocator(0)
     {}
@@ -0,0 +1,336 @@
+/*
+ * Copyright (C) 2015   Jeremy Chen jeremy_cz@yahoo.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __CFDBSCHEMA_H__
+#define __CFDBSCHEMA_H__
+
+#include "CFdbSimpleSerializer.h"
+
+/*
+ * Compile-time schema of IFdbParcelable. Instead of writing serialize() and
+ * deserialize() by hand, a parcelable lists its fields once:
+ *
+ *     class CCar : public IFdbParcelable
+ *     {
+ *     public:
+ *         FDB_SCHEMA_FIELDS(mBrand, mModel, mPrice)
+ *         std::string mBrand;
+ *         ...
+ *     };
+ *
+ * Fields are serialized in the listed order with exactly the same format as
+ * operator<<. Size of fixed part of the fields (scalars, length prefixes of
+ * strings and arrays) is computed at compile time and the variable part is
+ * added in one pass before writing, so that the buffer is sized once;
+ * arrays of integers are copied as a whole. Fields of types unknown to the
+ * schema (e.g. CFdbByteArray) are serialized through their own serialize()
+ * and may still grow the buffer.
+ */
+template <typename T>
+struct CFdbSchemaVoid
+{
+    typedef void type;
+};
+
+// T is declared with FDB_SCHEMA_FIELDS
+template <typename T, typename Enable = void>
+struct CFdbHasSchema
+{
+    static const bool value = false;
+};
+
+template <typename T>
+struct CFdbHasSchema<T, typename CFdbSchemaVoid<typename T::tFdbSchemaTag>::type>
+{
+    static const bool value = true;
+};
+
+// T is CFdbRepeatedParcelable or derived from it
+template <typename T, typename Enable = void>
+struct CFdbIsRepeated
+{
+    static const bool value = false;
+};
+
+template <typename T>
+struct CFdbIsRepeated<T, typename CFdbSchemaVoid<typename T::tData>::type>
+{
+    static const bool value = std::is_base_of<CFdbRepeatedParcelable<typename T::tData>, T>::value;
+};
+
+/*
+ * How a field is sized and serialized:
+ * mPrefixSize: bytes known at compile time;
+ * mFixed: mPrefixSize is all the size;
+ * dynamicSize(): bytes known only at runtime.
+ */
+template <typename T, typename Enable = void>
+struct CFdbSchemaField
+{
+    static const int32_t mPrefixSize = 0;
+    static const bool mFixed = false;
+    static int32_t dynamicSize(const T &field)
+    {
+        return 0; // unknown
+    }
+    static void write(CFdbSimpleSerializer &serializer, const T &field)
+    {
+        serializer << field;
+    }
+    static void read(CFdbSimpleDeserializer &deserializer, T &field)
+    {
+        deserializer >> field;
+    }
+};
+
+template <typename T>
+struct CFdbSchemaField<T, typename std::enable_if<std::is_integral<T>::value>::type>
+{
+    static const int32_t mPrefixSize = (int32_t)sizeof(T);
+    static const bool mFixed = true;
+    static int32_t dynamicSize(const T &field)
+    {
+        return 0;
+    }
+    static void write(CFdbSimpleSerializer &serializer, const T &field)
+    {
+#ifdef FDB_HOST_LITTLE_ENDIAN
+        if (!std::is_same<T, bool>::value)
+        {
+            memcpy(serializer.allocRawData((int32_t)sizeof(T)), &field, sizeof(T));
+            return;
+        }
+#endif
+        serializer << field;
+    }
+    static void read(CFdbSimpleDeserializer &deserializer, T &field)
+    {
+        deserializer >> field;
+    }
+};
+
+template <>
+struct CFdbSchemaField<std::string>
+{
+    static const int32_t mPrefixSize = (int32_t)sizeof(fdb_string_len_t);
+    static const bool mFixed = false;
+    static int32_t dynamicSize(const std::string &field)
+    {
+        return (int32_t)field.size() + 1;
+    }
+    static void write(CFdbSimpleSerializer &serializer, const std::string &field)
+    {
+        serializer.addString(field.c_str(), (fdb_string_len_t)field.size());
+    }
+    static void read(CFdbSimpleDeserializer &deserializer, std::string &field)
+    {
+        deserializer >> field;
+    }
+};
+
+template <>
+struct CFdbSchemaField<CFdbStringView>
+{
+    static const int32_t mPrefixSize = (int32_t)sizeof(fdb_string_len_t);
+    static const bool mFixed = false;
+    static int32_t dynamicSize(const CFdbStringView &field)
+    {
+        return (int32_t)field.size() + 1;
+    }
+    static void write(CFdbSimpleSerializer &serializer, const CFdbStringView &field)
+    {
+        field.serialize(serializer);
+    }
+    static void read(CFdbSimpleDeserializer &deserializer, CFdbStringView &field)
+    {
+        field.deserialize(deserializer);
+    }
+};
+
+template <typename L>
+struct CFdbSchemaField<CFdbBaseBytesView<L> >
+{
+    static const int32_t mPrefixSize = (int32_t)sizeof(L);
+    static const bool mFixed = false;
+    static int32_t dynamicSize(const CFdbBaseBytesView<L> &field)
+    {
+        return field.size();
+    }
+    static void write(CFdbSimpleSerializer &serializer, const CFdbBaseBytesView<L> &field)
+    {
+        field.serialize(serializer);
+    }
+    static void read(CFdbSimpleDeserializer &deserializer, CFdbBaseBytesView<L> &field)
+    {
+        field.deserialize(deserializer);
+    }
+};
+
+template <typename T>
+struct CFdbSchemaField<T, typename std::enable_if<CFdbHasSchema<T>::value>::type>
+{
+    static const int32_t mPrefixSize = 0;
+    static const bool mFixed = false;
+    static int32_t dynamicSize(const T &field)
+    {
+        return field.schemaSize();
+    }
+    static void write(CFdbSimpleSerializer &serializer, const T &field)
+    {
+        field.schemaWrite(serializer);
+    }
+    static void read(CFdbSimpleDeserializer &deserializer, T &field)
+    {
+        field.schemaRead(deserializer);
+    }
+};
+
+template <typename T>
+struct CFdbSchemaField<T, typename std::enable_if<CFdbIsRepeated<T>::value>::type>
+{
+    typedef typename T::tData tElement;
+    typedef CFdbSchemaField<tElement> tElementField;
+    static const int32_t mPrefixSize = (int32_t)sizeof(fdb_struct_arr_len_t);
+    static const bool mFixed = false;
+    static int32_t dynamicSize(const T &field)
+    {
+        if (tElementField::mFixed)
+        {
+            return (int32_t)field.size() * tElementField::mPrefixSize;
+        }
+        int32_t size = 0;
+        for (auto it = field.pool().begin(); it != field.pool().end(); ++it)
+        {
+            size += tElementField::mPrefixSize + tElementField::dynamicSize(*it);
+        }
+        return size;
+    }
+    static void write(CFdbSimpleSerializer &serializer, const T &field)
+    {
+        if (CFdbIsBulkScalar<tElement>::value || !CFdbHasSchema<tElement>::value)
+        {
+            // elements are copied as a whole or serialized by themselves
+            field.serialize(serializer);
+            return;
+        }
+        serializer << (fdb_struct_arr_len_t)field.size();
+        for (auto it = field.pool().begin(); it != field.pool().end(); ++it)
+        {
+            tElementField::write(serializer, *it);
+        }
+    }
+    static void read(CFdbSimpleDeserializer &deserializer, T &field)
+    {
+        field.deserialize(deserializer);
+    }
+};
+
+class CFdbSchema
+{
+public:
+    // size of fields known at compile time
+    template <typename... Fields>
+    struct CPrefixSize;
+
+    // serialized size of fields
+    template <typename... Fields>
+    static int32_t size(const Fields &... fields)
+    {
+        return CPrefixSize<Fields...>::value + dynamicSize(fields...);
+    }
+
+    // serialize fields without sizing buffer
+    static void write(CFdbSimpleSerializer &serializer)
+    {
+    }
+    template <typename Field, typename... Fields>
+    static void write(CFdbSimpleSerializer &serializer, const Field &field, const Fields &... fields)
+    {
+        CFdbSchemaField<Field>::write(serializer, field);
+        write(serializer, fields...);
+    }
+
+    // size buffer once and serialize fields
+    template <typename... Fields>
+    static void serialize(CFdbSimpleSerializer &serializer, const Fields &... fields)
+    {
+        serializer.reserve(size(fields...));
+        write(serializer, fields...);
+    }
+
+    static void read(CFdbSimpleDeserializer &deserializer)
+    {
+    }
+    template <typename Field, typename... Fields>
+    static void read(CFdbSimpleDeserializer &deserializer, Field &field, Fields &... fields)
+    {
+        CFdbSchemaField<Field>::read(deserializer, field);
+        read(deserializer, fields...);
+    }
+
+private:
+    static int32_t dynamicSize()
+    {
+        return 0;
+    }
+    template <typename Field, typename... Fields>
+    static int32_t dynamicSize(const Field &field, const Fields &... fields)
+    {
+        return CFdbSchemaField<Field>::dynamicSize(field) + dynamicSize(fields...);
+    }
+};
+
+template <>
+struct CFdbSchema::CPrefixSize<>
+{
+    static const int32_t value = 0;
+};
+
+template <typename Field, typename... Fields>
+struct CFdbSchema::CPrefixSize<Field, Fields...>
+{
+    static const int32_t value = CFdbSchemaField<Field>::mPrefixSize + CPrefixSize<Fields...>::value;
+};
+
+/*
+ * Implement serialize() and deserialize() of IFdbParcelable with the listed
+ * fields. Put it in public section of the class.
+ */
+#define FDB_SCHEMA_FIELDS(...) \
+    typedef void tFdbSchemaTag; \
+    int32_t schemaSize() const \
+    { \
+        return CFdbSchema::size(__VA_ARGS__); \
+    } \
+    void schemaWrite(CFdbSimpleSerializer &serializer) const \
+    { \
+        CFdbSchema::write(serializer, __VA_ARGS__); \
+    } \
+    void schemaRead(CFdbSimpleDeserializer &deserializer) \
+    { \
+        CFdbSchema::read(deserializer, __VA_ARGS__); \
+    } \
+    void serialize(CFdbSimpleSerializer &serializer) const \
+    { \
+        serializer.reserve(schemaSize()); \
+        schemaWrite(serializer); \
+    } \
+    void deserialize(CFdbSimpleDeserializer &deserializer) \
+    { \
+        schemaRead(deserializer); \
+    }
+
+#endif
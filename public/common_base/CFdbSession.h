@@ -23,8 +23,10 @@
 //#include "CFdbMessage.h"
 #include <common_base/CBaseJob.h>
 #include <common_base/CEntityContainer.h>
+#include <common_base/CEntitySlotMap.h>
 #include <common_base/CFdbSessionContainer.h>
 #include <common_base/CFdbMessage.h>
+#include <common_base/CMethodLoopTimer.h>
 
 struct CFdbSessionInfo
 {
@@ -33,9 +35,26 @@ struct CFdbSessionInfo
     CFdbSocketConnInfo const *mConn;
 };
 
+// counters of asynchronous output of a session
+struct CFdbFlowStatistics
+{
+    // bytes queued but not written yet
+    int64_t mPendingBytes;
+    // max of mPendingBytes ever
+    int64_t mPeakPendingBytes;
+    // times of reaching the high watermark
+    uint32_t mCongestions;
+    // times of writing pending output in place (FDB_BP_BLOCK)
+    uint32_t mBlocks;
+    uint32_t mDroppedMessages;
+    int64_t mDroppedBytes;
+};
+
 class CFdbSessionContainer;
 class CSocketImp;
 class CFdbMessage;
+class CFdbBaseContext;
+class CFdbBufferPool;
 
 namespace NFdbBase {
     class CFdbMessageHeader;
@@ -49,7 +68,11 @@ public:
     bool sendMessage(const uint8_t *buffer, int32_t size);
     bool sendMessage(CBaseJob::Ptr &ref);
     bool sendMessage(CFdbMessage *msg);
-    bool sendUDPMessage(CFdbMessage *msg);
+    /*
+     * If batch is set, datagram is queued and sent by
+     * CFdbSessionContainer::flushUDPBatch() together with others.
+     */
+    bool sendUDPMessage(CFdbMessage *msg, bool batch = false);
     FdbSessionId_t sid() const
     {
         return mSid;
@@ -88,6 +111,24 @@ public:
     {
         mPid = pid;
     }
+    // peer parses compact message head; negotiated with FdbSessionInfo
+    bool compactHead() const
+    {
+        return mCompactHead;
+    }
+    void compactHead(bool enable)
+    {
+        mCompactHead = enable;
+    }
+    // peer reassembles UDP messages too big for a datagram
+    bool udpFragment() const
+    {
+        return mUDPFragment;
+    }
+    void udpFragment(bool enable)
+    {
+        mUDPFragment = enable;
+    }
     const CFdbSocketAddr &getPeerUDPAddress() const
     {
         return mUDPAddr;
@@ -99,10 +140,16 @@ public:
     void terminateMessage(CBaseJob::Ptr &job, int32_t status, const char *reason);
     void terminateMessage(FdbMsgSn_t msg, int32_t status, const char *reason = 0);
     void getSessionInfo(CFdbSessionInfo &info);
+    void getFlowStatistics(CFdbFlowStatistics &stats);
     CFdbMessage *peepPendingMessage(FdbMsgSn_t sn);
 
     bool connected(const CFdbSocketAddr &addr);
     bool bound(const CFdbSocketAddr &addr);
+    /*
+     * Run socket of the session at an I/O worker instead of the context
+     * of endpoint. Return false if unable to; the session is not attached.
+     */
+    bool attachIoWorker(CFdbBaseContext *io_worker);
     CSocketImp *getSocket()
     {
         return mSocket;
@@ -115,15 +162,44 @@ public:
     {
         return mPayloadBuffer;
     }
+    // set if payload buffer is not from pool but held by the reference
+    const std::shared_ptr<uint8_t> &payloadRef() const
+    {
+        return mPayloadRef;
+    }
 protected:
     void onInput();
     void onError();
     void onHup();
     void onInputReady(const uint8_t *data, int32_t size);
+    void onOutputWritten();
     int32_t writeStream(const uint8_t *data, int32_t size);
+    int32_t writeStream(const CFdbIoVec *vecs, int32_t count);
     int32_t readStream(uint8_t *data, int32_t size);
 private:
-    typedef CEntityContainer<FdbMsgSn_t, CBaseJob::Ptr> PendingMsgTable_t;
+    // serial number of request is the id in the table
+    typedef CEntitySlotMap<FdbMsgSn_t, CBaseJob::Ptr> PendingMsgTable_t;
+
+    void submitOutput(CFdbMessage *msg, const uint8_t *log_buffer, int32_t log_size);
+    void writeOutput(const std::shared_ptr<uint8_t> *buffer_refs, const CFdbIoVec *vecs,
+                     int32_t count, bool droppable);
+    bool admitOutput(int32_t size, bool droppable);
+    int64_t pendingOutputSize();
+    void updateCongestion();
+    void notifyBackpressure(bool congested);
+    void pollShmRelease(bool enable);
+    void onShmReleaseTimer(CMethodLoopTimer<CFdbSession> *timer);
+    void collectFlowStatistics(CFdbFlowStatistics &stats);
+    bool postOutput(CFdbMessage *msg);
+    void raiseFatalError();
+    void destroy();
+    void detachIoWorker();
+    CFdbBufferPool *rxBufferPool();
+    void dispatchStreamPayload();
+    void processStreamPayload(const CFdbMsgPrefix &prefix, uint8_t *buffer,
+                              const std::shared_ptr<uint8_t> &buffer_ref);
+    void setRxBuffer(uint8_t *buffer);
+    bool compactRxBuffer();
 
     void doRequest(NFdbBase::CFdbMessageHeader &head);
     void doResponse(NFdbBase::CFdbMessageHeader &head);
@@ -133,6 +209,12 @@ private:
     bool receiveData(uint8_t *buf, int32_t size);
     void parsePrefix(const uint8_t *data, int32_t size);
     void processPayload(const uint8_t *data, int32_t size);
+    void onStreamInput();
+    void releasePayload();
+#ifdef CONFIG_FDB_SHM
+    bool putShmFrame(CFdbMessage *msg, uint8_t *doorbell);
+    void processShmDoorbell(const uint8_t *data, int32_t size);
+#endif
 
     PendingMsgTable_t mPendingMsgTable;
     FdbSessionId_t mSid;
@@ -141,12 +223,61 @@ private:
     int32_t mSecurityLevel;
     std::string mToken;
     std::string mSenderName;
-    int32_t mRecursiveDepth;
     CFdbSocketAddr mUDPAddr;
     CBASE_tProcId mPid;
+    bool mCompactHead;
+    bool mUDPFragment;
     uint8_t *mPayloadBuffer;
+    std::shared_ptr<uint8_t> mPayloadRef;
     uint8_t mPrefixBuffer[CFdbMessage::mPrefixSize];
     CFdbMsgPrefix mMsgPrefix;
+    /*
+     * receive buffer of stream read mode; data in [mRxBegin, mRxEnd). It is
+     * also held by large messages dispatched in place via mRxBufferRef.
+     */
+    uint8_t *mRxBuffer;
+    std::shared_ptr<uint8_t> mRxBufferRef;
+    int32_t mRxBegin;
+    int32_t mRxEnd;
+    // message being received in stream read mode
+    CFdbMsgPrefix mRxPrefix;
+    uint8_t *mRxPayload;
+    // set instead of mRxPayload if the message is in receive buffer
+    std::shared_ptr<uint8_t> mRxPayloadRef;
+    // bytes of big message received directly to mRxPayload
+    int32_t mPayloadReceived;
+    // set if the session is destroyed while dispatching stream
+    bool *mDestroyed;
+    /*
+     * If set, socket is read and written at the I/O worker; messages
+     * are dispatched at mIoContext by endpoint mIoEndpointId.
+     */
+    CFdbBaseContext *mIoWorker;
+    CFdbBaseContext *mIoContext;
+    FdbEndpointId_t mIoEndpointId;
+    CFdbFlowStatistics mFlowStats;
+    // pending output is above the low watermark after reaching the high one
+    bool mCongested;
+
+    class CShmReleaseTimer : public CMethodLoopTimer<CFdbSession>
+    {
+    public:
+        CShmReleaseTimer(CFdbSession *session, int32_t interval)
+            : CMethodLoopTimer<CFdbSession>(interval, true, session,
+                                            &CFdbSession::onShmReleaseTimer)
+        {
+        }
+    };
+    // peer releases frames in shared memory silently: poll while congested
+    CShmReleaseTimer mShmReleaseTimer;
+
+    friend class CSessionInputJob;
+    friend class CSessionOutputJob;
+    friend class CSessionHupJob;
+    friend class CSessionFatalJob;
+    friend class CSessionDetachJob;
+    friend class CSessionBackpressureJob;
+    friend class CSessionFlowJob;
 };
 
 #endif
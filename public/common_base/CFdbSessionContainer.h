@@ -56,7 +56,10 @@ public:
     }
 
     bool bindUDPSocket(const char *ip_address = 0, int32_t udp_port = FDB_INET_PORT_INVALID);
-    bool sendUDPmessage(CFdbMessage *msg, const CFdbSocketAddr &dest_addr);
+    bool sendUDPmessage(CFdbMessage *msg, const CFdbSocketAddr &dest_addr,
+                        bool compact_head = false, bool batch = false, bool fragment = false);
+    // send UDP datagrams queued with batch
+    void flushUDPBatch();
     bool getUDPSocketInfo(CFdbSocketInfo &info);
 
     CFdbSession *connected(const CFdbSocketAddr &addr);
@@ -66,6 +69,10 @@ public:
     {
         mPendingUDPPort = udp_port;
     }
+    int32_t pendingUDPPort() const
+    {
+        return mPendingUDPPort;
+    }
 protected:
     FdbSocketId_t mSkid;
     virtual void onSessionDeleted(CFdbSession *session) {}
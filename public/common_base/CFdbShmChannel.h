@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2015   Jeremy Chen jeremy_cz@yahoo.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _CFDBSHMCHANNEL_H_
+#define _CFDBSHMCHANNEL_H_
+
+#ifdef CONFIG_FDB_SHM
+#include <stdint.h>
+#include <deque>
+#include <memory>
+#include "common_defs.h"
+
+// size of ring in shared memory created by each side for sending
+#define FDB_SHM_REGION_SIZE         (4 * 1024 * 1024)
+// message not smaller than the size is carried by shared memory
+#define FDB_SHM_MIN_FRAME_SIZE      (4 * 1024)
+// size of doorbell sent through socket in place of message: prefix + body
+#define FDB_SHM_DOORBELL_SIZE       (8 + 16)
+
+class CFdbShmRxRegion;
+struct CFdbMsgPrefix;
+
+/*
+ * Shared memory channel of a UDS connection. Each side creates a memfd
+ * backed ring and sends it to the peer once by SCM_RIGHTS. Messages are
+ * then copied to the ring and only doorbells (offset and size of message
+ * in the ring) go through the socket. Receiver dispatches messages in
+ * place and hands the slot back once the message is released.
+ * Sending side is accessed from context thread only; frames can be
+ * released from any thread.
+ */
+class CFdbShmChannel
+{
+public:
+    CFdbShmChannel();
+    ~CFdbShmChannel();
+
+    /*
+     * Receive from socket like recv(); region of peer attached to the data
+     * is held until its doorbell arrives. Return 0 if nothing is available
+     * and -1 upon error or peer close.
+     */
+    int32_t recv(int sock_fd, uint8_t *data, int32_t size);
+
+    /*
+     * Whether the ring for sending is created and sent to the peer.
+     */
+    bool txReady() const
+    {
+        return mTxSent;
+    }
+
+    /*
+     * Create the ring for sending and send it to the peer along with a
+     * doorbell of its own, which is built in doorbell. Must not be called
+     * when output is pending in the socket since the doorbell can not be
+     * interleaved with it. Return bytes of doorbell written, 0 if the
+     * socket is full, or -1 if shared memory is not available. The rest of
+     * doorbell, if any, should be sent as normal data.
+     */
+    int32_t sendRegion(int sock_fd, uint8_t *doorbell);
+
+    /*
+     * Copy a frame (prefix + head + payload), given in pieces, to the ring
+     * and build the doorbell in place of it. Return false if the ring is
+     * full.
+     */
+    bool putFrame(const CFdbIoVec *vecs, int32_t count, uint8_t *doorbell);
+
+    /*
+     * Hand back the slot of a frame put by putFrame() whose doorbell can
+     * not be sent; otherwise the slot is never freed by the peer and
+     * blocks reclaiming of all slots after it.
+     */
+    void cancelFrame(const uint8_t *doorbell);
+
+    /*
+     * Bytes of the ring held by frames the peer has not released yet;
+     * they count as pending output of the session.
+     */
+    int64_t pendingSize();
+
+    /*
+     * Parse body of a doorbell. If it refers to a frame, the frame is
+     * returned in frame_ref along with its validated prefix, and is handed
+     * back to the peer when the last reference is dropped. Return false if
+     * the doorbell is invalid.
+     */
+    bool getFrame(const uint8_t *body, int32_t size, std::shared_ptr<uint8_t> &frame_ref,
+                  CFdbMsgPrefix &prefix);
+
+private:
+    struct CTxSlot
+    {
+        uint32_t mOffset;
+        uint32_t mSize;
+        // space at end of ring skipped when wrapping around
+        bool mSkip;
+    };
+    typedef std::deque<CTxSlot> tTxSlotTbl;
+
+    int mTxFd;
+    uint8_t *mTxBase;
+    uint32_t mTxSize;
+    uint32_t mTxHead;
+    bool mTxSent;
+    bool mTxBroken;
+    // slots in use from the oldest one; sizes are never read from the ring
+    tTxSlotTbl mTxSlots;
+    // sum of sizes of mTxSlots
+    int64_t mTxUsed;
+
+    CFdbShmRxRegion *mRxRegion;
+    // fd of peer region received but not yet mapped
+    int mRxPendingFd;
+
+    int32_t allocSlot(uint32_t size);
+    void reclaimSlots();
+    bool createRegion();
+    bool mapRegion();
+};
+#endif
+
+#endif
@@ -21,13 +21,25 @@
 #include <vector>
 #include <string>
 #include <sstream>
+#include <type_traits>
 
 #define FDB_SCRATCH_CACHE_SIZE 2048 
+// byte order of host is the same as that of serialized data
+#if (defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)) || defined(_WIN32)
+#define FDB_HOST_LITTLE_ENDIAN
+#endif
 #define FDB_BYTEARRAY_PRINT_SIZE 16
 typedef uint16_t fdb_string_len_t;
 typedef uint16_t fdb_struct_arr_len_t;
 typedef int32_t fdb_byte_arr_len_t;
 
+// integers whose arrays are serialized as a whole
+template <typename T>
+struct CFdbIsBulkScalar
+{
+    static const bool value = std::is_integral<T>::value && !std::is_same<T, bool>::value;
+};
+
 class CFdbSimpleSerializer;
 class CFdbSimpleDeserializer;
 class IFdbParcelable
@@ -97,6 +109,40 @@ public:
     void reset();
     void addRawData(const uint8_t *p_data, int32_t size);
     void addString(const char *string, fdb_string_len_t str_len);
+    // make room for at least size more bytes so that adding them never reallocates
+    void reserve(int32_t size)
+    {
+        if (size > 0)
+        {
+            addMemory(size);
+        }
+    }
+    // append size bytes to be filled by caller
+    uint8_t *allocRawData(int32_t size)
+    {
+        if ((mPos + size) > mTotalSize)
+        {
+            addMemory(size);
+        }
+        uint8_t *data = mBuffer + mPos;
+        mPos += size;
+        return data;
+    }
+    template <typename T>
+    void addScalarArray(const T *data, int32_t count)
+    {
+#ifdef FDB_HOST_LITTLE_ENDIAN
+        if (count > 0)
+        {
+            memcpy(allocRawData(count * (int32_t)sizeof(T)), data, count * sizeof(T));
+        }
+#else
+        for (int32_t i = 0; i < count; ++i)
+        {
+            *this << data[i];
+        }
+#endif
+    }
 
 private:
     uint8_t *mBuffer;
@@ -160,12 +206,51 @@ public:
         return mPos;
     }
 
+    int32_t size() const
+    {
+        return mSize;
+    }
+
     const uint8_t *pos() const
     {
         return mBuffer ? mBuffer + mPos : 0;
     }
     
     bool retrieveRawData(uint8_t *p_data, int32_t size);
+    /*
+     * Return where the next size bytes are in the buffer being deserialized
+     * and skip them, or 0 with error set if there is not enough data.
+     */
+    const uint8_t *viewRawData(int32_t size)
+    {
+        if (mError || (size < 0) || (mSize && ((mPos + size) > mSize)))
+        {
+            mError = true;
+            return 0;
+        }
+        const uint8_t *data = mBuffer + mPos;
+        mPos += size;
+        return data;
+    }
+    template <typename T>
+    void retrieveScalarArray(T *data, int32_t count)
+    {
+        if (mError)
+        {
+            return;
+        }
+#ifdef FDB_HOST_LITTLE_ENDIAN
+        if ((count > 0) && !retrieveRawData((uint8_t *)data, count * (int32_t)sizeof(T)))
+        {
+            mError = true;
+        }
+#else
+        for (int32_t i = 0; i < count; ++i)
+        {
+            *this >> data[i];
+        }
+#endif
+    }
 
 private:
     const uint8_t *mBuffer;
@@ -288,10 +373,7 @@ public:
     void serialize(CFdbSimpleSerializer &serializer) const
     {
         serializer << (fdb_struct_arr_len_t)mPool.size();
-        for (typename tPool::const_iterator it = mPool.begin(); it != mPool.end(); ++it)
-        {
-            serializer << *it;
-        }
+        serializeElements(serializer, std::integral_constant<bool, CFdbIsBulkScalar<T>::value>());
     }
 
     void deserialize(CFdbSimpleDeserializer &deserializer)
@@ -304,15 +386,7 @@ public:
         fdb_struct_arr_len_t size = 0;
         deserializer >> size;
         mPool.resize(size);
-        for (fdb_struct_arr_len_t i = 0; i < size; ++i)
-        {
-            if (deserializer.error())
-            {
-                return;
-            }
-            T &value = mPool[i];
-            deserializer >> value;
-        }
+        deserializeElements(deserializer, std::integral_constant<bool, CFdbIsBulkScalar<T>::value>());
     }
 
     std::ostringstream &format(std::ostringstream &stream) const
@@ -325,6 +399,40 @@ public:
 
 protected:
     tPool mPool;
+
+private:
+    void serializeElements(CFdbSimpleSerializer &serializer, std::true_type) const
+    {
+        if (!mPool.empty())
+        {
+            serializer.addScalarArray(&mPool[0], (int32_t)mPool.size());
+        }
+    }
+    void serializeElements(CFdbSimpleSerializer &serializer, std::false_type) const
+    {
+        for (typename tPool::const_iterator it = mPool.begin(); it != mPool.end(); ++it)
+        {
+            serializer << *it;
+        }
+    }
+    void deserializeElements(CFdbSimpleDeserializer &deserializer, std::true_type)
+    {
+        if (!mPool.empty())
+        {
+            deserializer.retrieveScalarArray(&mPool[0], (int32_t)mPool.size());
+        }
+    }
+    void deserializeElements(CFdbSimpleDeserializer &deserializer, std::false_type)
+    {
+        for (typename tPool::iterator it = mPool.begin(); it != mPool.end(); ++it)
+        {
+            if (deserializer.error())
+            {
+                return;
+            }
+            deserializer >> *it;
+        }
+    }
 };
 
 template<typename T>
@@ -520,7 +628,7 @@ public:
     {
         if (mVBuffer)
         {
-            delete mVBuffer;
+            delete[] mVBuffer;
         }
     }
 
@@ -615,5 +723,171 @@ private:
     uint8_t *mVBuffer;
 };
 
+/*
+ * Views below are serialized the same as their owning counterparts, but
+ * deserializing them does not copy: they point into the buffer being
+ * deserialized, usually the payload of a CFdbMessage, and are valid only
+ * as long as the buffer is. When serializing, the viewed data is not owned
+ * and must outlive the serializer.
+ */
+
+// serialized as std::string
+class CFdbStringView : public IFdbParcelable
+{
+public:
+    CFdbStringView(const char *data = 0, fdb_string_len_t size = 0)
+        : mData(data)
+        , mSize(size)
+    {}
+
+    CFdbStringView(const std::string &str)
+        : mData(str.c_str())
+        , mSize((fdb_string_len_t)str.size())
+    {}
+
+    // terminated with '\0' if deserialized or made from std::string
+    const char *data() const
+    {
+        return mData ? mData : "";
+    }
+
+    fdb_string_len_t size() const
+    {
+        return mSize;
+    }
+
+    bool empty() const
+    {
+        return !mSize;
+    }
+
+    std::string str() const
+    {
+        return std::string(data(), mSize);
+    }
+
+    void serialize(CFdbSimpleSerializer &serializer) const
+    {
+        // viewed data might not be terminated
+        serializer << (fdb_string_len_t)(mSize + 1);
+        serializer.addRawData((const uint8_t *)data(), mSize);
+        serializer << (uint8_t)0;
+    }
+
+    void deserialize(CFdbSimpleDeserializer &deserializer)
+    {
+        mData = 0;
+        mSize = 0;
+        fdb_string_len_t len = 0;
+        deserializer >> len;
+        if (deserializer.error() || !len)
+        {
+            return;
+        }
+        auto data = (const char *)deserializer.viewRawData(len);
+        if (!data)
+        {
+            return;
+        }
+        if (data[len - 1] != '\0')
+        {
+            deserializer.error(true);
+            return;
+        }
+        mData = data;
+        mSize = len - 1;
+    }
+
+    std::ostringstream &format(std::ostringstream &stream) const
+    {
+        stream << data();
+        return stream;
+    }
+
+private:
+    const char *mData;
+    fdb_string_len_t mSize;
+};
+
+template <typename L>
+class CFdbBaseBytesView : public IFdbParcelable
+{
+public:
+    CFdbBaseBytesView(const uint8_t *data = 0, int32_t size = 0)
+        : mData(data)
+        , mSize(data ? size : 0)
+    {}
+
+    const uint8_t *data() const
+    {
+        return mData;
+    }
+
+    int32_t size() const
+    {
+        return mSize;
+    }
+
+    bool empty() const
+    {
+        return !mSize;
+    }
+
+    void serialize(CFdbSimpleSerializer &serializer) const
+    {
+        serializer << (L)mSize;
+        if (mSize)
+        {
+            serializer.addRawData(mData, mSize);
+        }
+    }
+
+    void deserialize(CFdbSimpleDeserializer &deserializer)
+    {
+        mData = 0;
+        mSize = 0;
+        L size = 0;
+        deserializer >> size;
+        if (deserializer.error() || !size)
+        {
+            return;
+        }
+        mData = deserializer.viewRawData((int32_t)size);
+        if (mData)
+        {
+            mSize = (int32_t)size;
+        }
+    }
+
+    std::ostringstream &format(std::ostringstream &stream) const
+    {
+        int32_t psize = mSize;
+        if (psize > FDB_BYTEARRAY_PRINT_SIZE)
+        {
+            stream << mSize << "[";
+            psize = FDB_BYTEARRAY_PRINT_SIZE;
+        }
+        else
+        {
+            stream << "[";
+        }
+        for (int32_t i = 0; i < psize; ++i)
+        {
+            stream << (unsigned)mData[i] << ",";
+        }
+        stream << "]";
+        return stream;
+    }
+
+private:
+    const uint8_t *mData;
+    int32_t mSize;
+};
+
+// serialized as CFdbByteArray and CFdbByteArrayExt
+typedef CFdbBaseBytesView<fdb_byte_arr_len_t> CFdbByteArrayView;
+// serialized as CFdbParcelableArray<uint8_t>
+typedef CFdbBaseBytesView<fdb_struct_arr_len_t> CFdbUint8ArrayView;
+
 #endif
 
@@ -21,7 +21,11 @@
 #include "CBaseClient.h"
 #include "CFdbMessage.h"
 #include "CFdbSimpleSerializer.h"
+#include "CMethodLoopTimer.h"
 #include <mutex>
+#include <atomic>
+#include <vector>
+#include <memory>
 
 class CBaseEndpoint;
 namespace NFdbBase {
@@ -37,12 +41,16 @@ enum FdbMessageLoggerCode
     REQ_GET_TRACE_CONFIG        = 5,
 
     REQ_LOG_START               = 10,
+    // many REQ_FDBUS_LOG/REQ_TRACE_LOG records in one message
+    REQ_LOG_BATCH               = 11,
 
     NTF_LOGGER_CONFIG           = 6,
     NTF_TRACE_CONFIG            = 7,
 
     NTF_FDBUS_LOG               = 8,
     NTF_TRACE_LOG               = 9,
+    // many NTF_FDBUS_LOG/NTF_TRACE_LOG records in one message
+    NTF_LOG_BATCH               = 12,
 } ;
 
 class FdbMsgLogConfig : public IFdbParcelable
@@ -330,6 +338,11 @@ private:
 class FdbLogStart : public IFdbParcelable
 {
 public:
+    FdbLogStart()
+        : mCacheSize(0)
+        , mBatch(false)
+    {
+    }
     int32_t cache_size() const
     {
         return mCacheSize;
@@ -338,21 +351,39 @@ public:
     {
         mCacheSize = size;
     }
+    // viewer is able to handle NTF_LOG_BATCH
+    bool batch() const
+    {
+        return mBatch;
+    }
+    void set_batch(bool batch)
+    {
+        mBatch = batch;
+    }
     void serialize(CFdbSimpleSerializer &serializer) const
     {
-        serializer << mCacheSize;
+        serializer << mCacheSize << mBatch;
     }
     void deserialize(CFdbSimpleDeserializer &deserializer)
     {
         deserializer >> mCacheSize;
+        // not sent by old viewer
+        mBatch = false;
+        if (deserializer.index() < deserializer.size())
+        {
+            deserializer >> mBatch;
+        }
     }
 private:
     int32_t mCacheSize;
+    bool mBatch;
 };
 }
 
 class CFdbRawMsgBuilder;
 class CFdbLogCache;
+class CTraceRing;
+struct CTraceFilter;
 class CLogProducer : public CBaseClient
 {
 public:
@@ -378,6 +409,14 @@ public:
     }
     bool sendLog(FdbMsgCode_t code, IFdbMsgBuilder &builder);
     bool sendLog(FdbMsgCode_t code, const uint8_t *buffer, int32_t size);
+    /*
+     * Coalesce logs into REQ_LOG_BATCH messages; a batch is sent once it
+     * reaches max_size bytes or max_latency ms after its first log.
+     * max_size 0 disables batching. Called at context before connecting.
+     */
+    void enableBatch(int32_t max_size, int32_t max_latency);
+    // send queued traces and logs in batch immediately; can be called anywhere
+    void flushLogs();
     static const int32_t mMaxTraceLogSize = 4096;
 protected:
     void onBroadcast(CBaseJob::Ptr &msg_ref);
@@ -393,21 +432,39 @@ private:
     bool mDisableBroadcast;
     bool mDisableSubscribe;
     int32_t mRawDataClippingSize;
-    EFdbLogLevel mLogLevel;
-    bool mTraceDisableGlobal;
 
     tFilterTbl mLogEndpointWhiteList;
     tFilterTbl mLogBusnameWhiteList;
     bool mLogHostEnabled;
 
-    tFilterTbl mTraceTagWhiteList;
-    bool mTraceHostEnabled;
-
     bool mReverseEndpoints;
     bool mReverseBusNames;
-    bool mReverseTags;
 
-    std::mutex mTraceLock; // protect mTraceTagWhiteList
+    /*
+     * Trace config is an immutable snapshot replaced as a whole with
+     * std::atomic_store() and read with std::atomic_load() by tracing
+     * threads. A replaced snapshot is freed once its last reader drops it.
+     */
+    std::shared_ptr<const CTraceFilter> mTraceFilter;
+
+    // traces are queued to per-thread rings and drained by context
+    std::mutex mTraceRingLock; // protect mTraceRings
+    std::vector<CTraceRing *> mTraceRings;
+    std::atomic<bool> mTraceDrainPending;
+
+    class CBatchTimer : public CMethodLoopTimer<CLogProducer>
+    {
+    public:
+        CBatchTimer(CLogProducer *producer)
+            : CMethodLoopTimer<CLogProducer>(0, false, producer, &CLogProducer::onBatchTimer)
+        {
+        }
+    };
+    CFdbSimpleSerializer mLogBatch;
+    int32_t mBatchMaxSize;
+    int32_t mBatchMaxLatency;
+    CBatchTimer mBatchTimer;
+
     std::mutex mFdbusLogLock; // protect mLogEndpointWhiteList and mLogBusnameWhiteList
 
     static EFdbLogLevel mStaticLogLevel;
@@ -423,5 +480,15 @@ private:
     void callSendLog(CBaseJob::Ptr &msg_ref);
     bool checkCacheEnabled();
     void sendCheckpoint(const char *check_point);
+    CTraceRing *traceRing();
+    void drainTraceRings();
+    void sendTrace(EFdbLogLevel log_level, const char *tag, uint64_t time_ns, const char *info);
+    void batchLog(FdbMsgCode_t code, const uint8_t *buffer, int32_t size);
+    void flushBatch();
+    bool sendBatch(const uint8_t *batch, int32_t size);
+    void onBatchTimer(CMethodLoopTimer<CLogProducer> *timer);
+
+    friend class CDrainTraceJob;
+    friend class CFdbLogCache;
 };
 #endif
@@ -19,8 +19,11 @@
 
 #include <stdint.h>
 #include <string>
+#include <vector>
 #include "common_defs.h"
 
+class CFdbShmChannel;
+
 enum EFdbSocketType
 {
     FDB_SOCKET_TCP,
@@ -38,6 +41,20 @@ struct CFdbSocketAddr
     int32_t mPort;
 };
 
+// a datagram in batch output
+struct CFdbDatagram
+{
+    // sent ahead of data in the same datagram if mHeadSize is not 0
+    const uint8_t *mHead;
+    int32_t mHeadSize;
+    const uint8_t *mData;
+    int32_t mSize;
+    // sent after data in the same datagram if mTailSize is not 0
+    const uint8_t *mTail;
+    int32_t mTailSize;
+    const CFdbSocketAddr *mDestAddr;
+};
+
 struct CFdbSocketCredentials
 {
     uint32_t pid;
@@ -124,10 +141,94 @@ public:
         return -1;
     }
 
+    /*
+     * Send pieces of data in order. Return bytes sent in total, which might
+     * be less than requested if the socket is full, or -1 upon error.
+     * By default pieces are sent one by one.
+     */
+    virtual int32_t send(const CFdbIoVec *vecs, int32_t count)
+    {
+        int32_t total = 0;
+        for (int32_t i = 0; i < count; ++i)
+        {
+            auto ret = send(vecs[i].mData, vecs[i].mSize);
+            if (ret < 0)
+            {
+                return -1;
+            }
+            total += ret;
+            if (ret < vecs[i].mSize)
+            {
+                break;
+            }
+        }
+        return total;
+    }
+
     virtual int32_t recv(uint8_t *data, int32_t size)
     {
         return -1;
     }
+
+    /*
+     * Send datagrams in order. Return number of datagrams sent, which might
+     * be less than requested, or -1 if none is sent upon error. By default
+     * datagrams are sent one by one.
+     */
+    virtual int32_t send(const CFdbDatagram *datagrams, int32_t count)
+    {
+        int32_t i;
+        std::vector<uint8_t> joined;
+        for (i = 0; i < count; ++i)
+        {
+            auto &datagram = datagrams[i];
+            auto data = datagram.mData;
+            auto size = datagram.mSize;
+            if (datagram.mHeadSize || datagram.mTailSize)
+            {
+                joined.assign(datagram.mHead, datagram.mHead + datagram.mHeadSize);
+                joined.insert(joined.end(), datagram.mData, datagram.mData + datagram.mSize);
+                joined.insert(joined.end(), datagram.mTail, datagram.mTail + datagram.mTailSize);
+                data = joined.data();
+                size = (int32_t)joined.size();
+            }
+            if (send(data, size, *datagram.mDestAddr) != size)
+            {
+                break;
+            }
+        }
+        return ((i == 0) && (count > 0)) ? -1 : i;
+    }
+
+    /*
+     * Receive pending datagrams, at most one into each of buffers of size
+     * bytes; size of each datagram is returned in sizes. Return number of
+     * datagrams received, 0 if none is pending, or -1 upon error. By default
+     * one datagram is received.
+     */
+    virtual int32_t recv(uint8_t **buffers, int32_t size, int32_t *sizes, int32_t count)
+    {
+        if (count <= 0)
+        {
+            return 0;
+        }
+        auto ret = recv(buffers[0], size);
+        if (ret < 0)
+        {
+            return -1;
+        }
+        sizes[0] = ret;
+        return 1;
+    }
+
+    /*
+     * Shared memory channel carrying messages of the socket; 0 if messages
+     * go through the socket only.
+     */
+    virtual CFdbShmChannel *shmChannel()
+    {
+        return 0;
+    }
 };
 
 class CClientSocketImp : public CBaseSocket
@@ -147,6 +248,31 @@ public:
     {
         return 0;
     }
+
+    /*
+     * Connect without blocking. Return 1 if connect is in progress, in which
+     * case getFd() becomes writable once it completes; 0 if connected at
+     * once; -1 upon failure. Either way finishConnect() gives the connected
+     * socket.
+     */
+    virtual int32_t startConnect(bool block = false, int32_t ka_interval = 0, int32_t ka_retries = 0)
+    {
+        return -1;
+    }
+
+    /*
+     * Complete connect started by startConnect(). Return the connected
+     * socket or 0 if connect fails.
+     */
+    virtual CSocketImp *finishConnect()
+    {
+        return 0;
+    }
+
+    // drop connect in progress
+    virtual void cancelConnect()
+    {
+    }
 };
 
 class CServerSocketImp : public CBaseSocket
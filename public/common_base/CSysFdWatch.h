@@ -18,6 +18,7 @@
 #define _CSYSFDWATCH_H_
 
 #include <list>
+#include <memory>
 #include "common_defs.h"
 
 class CFdEventLoop;
@@ -42,20 +43,31 @@ private:
     };
     struct COutputDataChunk
     {
+        // private copy of data; null if data is held by mBufferRef
         uint8_t *mBuffer;
+        std::shared_ptr<uint8_t> mBufferRef;
+        const uint8_t *mData;
         int32_t mSize;
         int32_t mConsumed;
         uint8_t *mLogBuffer;
         int32_t mLogSize;
+        // can be dropped as a whole if not written yet
+        bool mDroppable;
+        // rest of the message in the previous chunk; dropped along with it
+        bool mLinked;
         COutputDataChunk()
             : mBuffer(0)
+            , mData(0)
             , mSize(0)
             , mConsumed(0)
             , mLogBuffer(0)
             , mLogSize(0)
+            , mDroppable(false)
+            , mLinked(false)
         {}
-        COutputDataChunk(const uint8_t *msg_buffer, int32_t msg_size, int32_t consumed,
-                         const uint8_t *log_buffer, int32_t log_size);
+        COutputDataChunk(const std::shared_ptr<uint8_t> &buffer_ref,
+                         const uint8_t *msg_buffer, int32_t msg_size, int32_t consumed,
+                         const uint8_t *log_buffer, int32_t log_size, bool droppable);
         ~COutputDataChunk();
     };
 public:
@@ -103,7 +115,14 @@ public:
      */
     void flags(uint32_t flgs)
     {
-        mFlags = flgs;
+        if (mEventLoop)
+        {
+            updateFlags(~0, flgs);
+        }
+        else
+        {
+            mFlags = flgs;
+        }
     }
 
     /*
@@ -134,6 +153,12 @@ public:
         return (uint32_t)mOutputChunkList.size();
     }
 
+    // bytes queued but not written yet
+    int64_t getPendingOutputSize() const
+    {
+        return mPendingOutputSize;
+    }
+
 protected:
     /*-----------------------------------------------------------------------------
      * The virtual function should be implemented by subclass
@@ -180,11 +205,23 @@ protected:
     virtual void onInputReady(const uint8_t *data, int32_t size)
     {}
 
+    /*
+     * callback invoked after pending output is written upon POLLOUT
+     */
+    virtual void onOutputWritten()
+    {}
+
     virtual int32_t writeStream(const uint8_t *data, int32_t size)
     {
         return -1;
     }
 
+    /*
+     * Write pieces of data in one shot if possible. Return bytes written
+     * in total or -1 upon error. By default pieces are written one by one.
+     */
+    virtual int32_t writeStream(const CFdbIoVec *vecs, int32_t count);
+
     virtual int32_t readStream(uint8_t *data, int32_t size)
     {
         return -1;
@@ -200,9 +237,60 @@ protected:
 
     void submitInput(uint8_t *buffer, int32_t size, bool trigger_read);
 
+    /*
+     * Drop buffer submitted by submitInput() so that onInput() is called
+     * again upon POLLIN.
+     */
+    void cancelInput()
+    {
+        mInputChunk = CInputDataChunk();
+    }
+
     void submitOutput(const uint8_t *msg_buffer, int32_t msg_size,
                       const uint8_t *log_buffer, int32_t log_size);
 
+    /*
+     * Write data at once if no output is pending. Return bytes written, or
+     * -1 if nothing can be written due to error. The rest should be queued
+     * with queueOutput().
+     */
+    int32_t tryOutput(const uint8_t *msg_buffer, int32_t msg_size,
+                      const uint8_t *log_buffer, int32_t log_size);
+
+    /*
+     * Queue data not written by tryOutput(). If buffer_ref is given, data
+     * is held by it until written; otherwise data is copied. Droppable
+     * data can be discarded later by dropOutput() if not written at all.
+     */
+    void queueOutput(const std::shared_ptr<uint8_t> &buffer_ref,
+                     const uint8_t *msg_buffer, int32_t msg_size, int32_t consumed,
+                     const uint8_t *log_buffer, int32_t log_size, bool droppable = false);
+
+    /*
+     * Like tryOutput() and queueOutput() but for a message in pieces held by
+     * buffer_refs, e.g. head and payload in different buffers. Pieces are
+     * written in one shot if possible; the rest is queued and dropped as a
+     * whole.
+     */
+    int32_t tryOutput(const CFdbIoVec *vecs, int32_t count,
+                      const uint8_t *log_buffer, int32_t log_size);
+    void queueOutput(const std::shared_ptr<uint8_t> *buffer_refs,
+                     const CFdbIoVec *vecs, int32_t count, int32_t consumed,
+                     const uint8_t *log_buffer, int32_t log_size, bool droppable = false);
+
+    /*
+     * Discard droppable output not written yet, oldest first, until at
+     * least size bytes are discarded. Return bytes discarded; nr_dropped
+     * is increased by the number of chunks discarded.
+     */
+    int64_t dropOutput(int64_t size, uint32_t &nr_dropped);
+
+    /*
+     * Write pending output in place as much as the fd takes without waiting.
+     * Return false if more than size bytes are still pending or error happens.
+     */
+    bool flushOutput(int64_t size);
+
     void updateFlags(uint32_t mask, uint32_t value);
 
 private:
@@ -218,6 +306,7 @@ private:
     }
 
     void clearOutputChunkList();
+    void sendOutputLog(const uint8_t *log_buffer, int32_t log_size);
 
     void processInput();
     void processOutput();
@@ -229,9 +318,11 @@ private:
     CFdEventLoop *mEventLoop;
     CInputDataChunk mInputChunk;
     tOutputChunkList mOutputChunkList;
+    int64_t mPendingOutputSize;
     int32_t mInputRecursiveDepth;
     
     friend class CFdEventLoop;
+    friend class CEpollEventLoop;
     friend class CNotifyFdWatch;
 };
 
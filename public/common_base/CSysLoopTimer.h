@@ -105,6 +105,11 @@ private:
     bool mEnable;
     uint64_t mExpiration;
     CBaseEventLoop *mEventLoop;
+    // position in timer heap of event loop; -1 if not enabled
+    int32_t mHeapIndex;
+    // position in timer list of event loop; -1 if not installed
+    int32_t mLoopIndex;
+    uint64_t mSequence;
     friend class CBaseEventLoop;
     friend class CFdEventLoop;
 };
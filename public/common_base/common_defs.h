@@ -34,6 +34,13 @@ typedef uint32_t FdbObjectId_t;
 typedef uint8_t FdbEventGroup_t;
 typedef uint16_t FdbContextId_t;
 
+// a piece of data in scatter-gather output
+struct CFdbIoVec
+{
+    const uint8_t *mData;
+    int32_t mSize;
+};
+
 #define FDB_NAME_SERVER_NAME            "org.fdbus.name-server"
 #define FDB_HOST_SERVER_NAME            "org.fdbus.host-server"
 #define FDB_LOG_SERVER_NAME             "org.fdbus.log-server"
@@ -44,11 +51,13 @@ typedef uint16_t FdbContextId_t;
 #define FDB_URL_IPC_IND "ipc"
 #define FDB_URL_SVC_IND "svc"
 #define FDB_URL_UDP_IND "udp"
+#define FDB_URL_SHM_IND "shm"
 
 #define FDB_URL_TCP FDB_URL_TCP_IND "://"
 #define FDB_URL_IPC FDB_URL_IPC_IND "://"
 #define FDB_URL_SVC FDB_URL_SVC_IND "://"
 #define FDB_URL_UDP FDB_URL_UDP_IND "://"
+#define FDB_URL_SHM FDB_URL_SHM_IND "://"
 
 #define FDB_IP_ALL_INTERFACE "0"
 
@@ -145,6 +154,26 @@ enum EFdbQOS
     FDB_QOS_BEST_EFFORTS
 };
 
+// what to do with a message sent to a session whose pending output has
+// reached the high watermark (see CBaseEndpoint::setOutputWatermark())
+enum EFdbBackpressurePolicy
+{
+    // write pending output in place once; if it is still above the high
+    // watermark, the new message is handled as FDB_BP_DROP_NEWEST
+    FDB_BP_BLOCK,
+    // drop broadcasts pending for longest to make room for the new message
+    FDB_BP_DROP_OLDEST,
+    // drop the new message if it is a broadcast
+    FDB_BP_DROP_NEWEST,
+    // drop the session
+    FDB_BP_DISCONNECT
+};
+
+// messages never dropped, e.g. requests and replies, are still queued until
+// pending output reaches this many times the high watermark; then the
+// session is dropped
+#define FDB_BP_HARD_LIMIT_SCALE 4
+
 #define FDB_EVENT_GROUP_SHIFT 24
 #define FDB_EVENT_GROUP_BITS 0xFF
 #define FDB_DEFAULT_GROUP 0
@@ -165,6 +194,10 @@ enum EFdbQOS
 
 #define FDB_ADDRESS_CONNECT_RETRY_NR    3
 #define FDB_ADDRESS_CONNECT_RETRY_INTERVAL 50
+// asynchronous connect: retry interval doubles up to the max; connect in
+// progress longer than timeout is retried
+#define FDB_ADDRESS_CONNECT_MAX_INTERVAL 1000
+#define FDB_ADDRESS_CONNECT_TIMEOUT     2000
 
 #define FDB_ADDRESS_BIND_RETRY_NR    3
 #define FDB_ADDRESS_BIND_RETRY_INTERVAL 50
@@ -32,6 +32,7 @@
 #include "CBaseThread.h"
 #include "CBaseWorker.h"
 #include "CEntityContainer.h"
+#include "CEntitySlotMap.h"
 #include "CEventFd.h"
 #include "CFdbBaseObject.h"
 #include "CFdbContext.h"
@@ -56,6 +57,7 @@
 #include "IFdbMsgBuilder.h"
 #include "fdb_log_trace.h"
 #include "CFdbSimpleSerializer.h"
+#include "CFdbSchema.h"
 #include "CFdbSession.h"
 #include "CFdbAFComponent.h"
 
@@ -37,6 +37,7 @@ FdbServerType IAddressAllocator::getSvcType(const char *svc_name)
 
 CIPCAddressAllocator::CIPCAddressAllocator()
     : mSocketId(0)
+    , mShmEnabled(false)
 {
 }
 
@@ -57,9 +58,17 @@ void CIPCAddressAllocator::allocate(CFdbSocketAddr &sckt_addr, FdbServerType svc
         uint32_t id = mSocketId++;
         char id_string[64];
         sprintf(id_string, "%u", id);
-        sckt_addr.mAddr = CNsConfig::getIPCPathBase();
+        if (mShmEnabled)
+        {
+            sckt_addr.mAddr = CNsConfig::getShmPathBase();
+            sckt_addr.mUrl = CNsConfig::getShmUrlBase();
+        }
+        else
+        {
+            sckt_addr.mAddr = CNsConfig::getIPCPathBase();
+            sckt_addr.mUrl = CNsConfig::getIPCUrlBase();
+        }
         sckt_addr.mAddr += id_string;
-        sckt_addr.mUrl = CNsConfig::getIPCUrlBase();
         sckt_addr.mUrl += id_string;
     }
 
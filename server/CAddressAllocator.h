@@ -42,9 +42,15 @@ public:
     CIPCAddressAllocator();
     void allocate(CFdbSocketAddr &sckt_addr, FdbServerType svc_type);
     void reset();
+    // allocate shm:// rather than ipc:// for user services
+    void enableShm(bool enable)
+    {
+        mShmEnabled = enable;
+    }
 
 private:
     uint32_t mSocketId;
+    bool mShmEnabled;
 };
 
 class CTCPAddressAllocator : public IAddressAllocator
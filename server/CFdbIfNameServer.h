@@ -41,7 +41,15 @@ enum FdbNsMsgCode
     NTF_HOST_ONLINE_LOCAL = 11,
     NTF_HOST_INFO = 12,
 
-    NTF_WATCHDOG = 13
+    NTF_WATCHDOG = 13,
+
+    /*
+     * Changes of local services coalesced over a short window; one
+     * FdbMsgServiceDelta per window instead of one message per change.
+     */
+    NTF_SERVICE_ONLINE_MONITOR_BATCH = 14,
+    // FdbMsgServiceDelta with base_generation() in; changes since it out
+    REQ_QUERY_SERVICE_DELTA = 15
 };
 
 enum FdbHsMsgCode
@@ -363,6 +371,64 @@ private:
     std::string mName;
 };
 
+/*
+ * Changes of service registry from base_generation() to generation(). Each
+ * item is the whole address list of a service; empty list means the service
+ * is dropped. base_generation() of 0 means the items are the full registry.
+ * A delta can be applied upon a copy of the registry at any generation from
+ * base_generation() to generation(); otherwise changes are missed and the
+ * copy should be resynced with REQ_QUERY_SERVICE_DELTA.
+ */
+class FdbMsgServiceDelta : public IFdbParcelable
+{
+public:
+    FdbMsgServiceDelta()
+        : mBaseGeneration(0)
+        , mGeneration(0)
+    {}
+    uint32_t base_generation() const
+    {
+        return mBaseGeneration;
+    }
+    void set_base_generation(uint32_t generation)
+    {
+        mBaseGeneration = generation;
+    }
+    uint32_t generation() const
+    {
+        return mGeneration;
+    }
+    void set_generation(uint32_t generation)
+    {
+        mGeneration = generation;
+    }
+    CFdbParcelableArray<FdbMsgAddressList> &services()
+    {
+        return mServices;
+    }
+    FdbMsgAddressList *add_services()
+    {
+        return mServices.Add();
+    }
+
+    void serialize(CFdbSimpleSerializer &serializer) const
+    {
+        serializer << mBaseGeneration
+                   << mGeneration
+                   << mServices;
+    }
+    void deserialize(CFdbSimpleDeserializer &deserializer)
+    {
+        deserializer >> mBaseGeneration
+                     >> mGeneration
+                     >> mServices;
+    }
+private:
+    uint32_t mBaseGeneration;
+    uint32_t mGeneration;
+    CFdbParcelableArray<FdbMsgAddressList> mServices;
+};
+
 class FdbMsgHostAddress : public IFdbParcelable
 {
 public:
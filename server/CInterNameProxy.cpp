@@ -78,6 +78,8 @@ CInterNameProxy::CInterNameProxy(CHostProxy *host_proxy,
 {
     mName = host_proxy->hostName();
     mName += "(remote)";
+    // listeners are added by host proxy right after connected
+    enableAsyncConnect(false);
 }
 
 CInterNameProxy::~CInterNameProxy()
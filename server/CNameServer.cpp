@@ -31,6 +31,10 @@
 CNameServer::CNameServer()
     : CBaseServer()
     , mHostProxy(0)
+    , mGeneration(0)
+    , mDeltaFloor(0)
+    , mBatchGeneration(0)
+    , mBatchTimer(CNsConfig::getSvcBatchWindow(), false, this, &CNameServer::broadcastServiceBatch)
 {
     setNsName(CNsConfig::getNameServerName());
     mServerSecruity.importSecurity();
@@ -44,6 +48,7 @@ CNameServer::CNameServer()
     mMsgHdl.registerCallback(NFdbBase::REQ_QUERY_SERVICE_INTER_MACHINE, &CNameServer::onQueryServiceInterMachineReq);
 
     mMsgHdl.registerCallback(NFdbBase::REQ_QUERY_HOST_LOCAL, &CNameServer::onQueryHostReq);
+    mMsgHdl.registerCallback(NFdbBase::REQ_QUERY_SERVICE_DELTA, &CNameServer::onQueryServiceDeltaReq);
 
     mSubscribeHdl.registerCallback(NFdbBase::NTF_SERVICE_ONLINE, &CNameServer::onServiceOnlineReg);
     mSubscribeHdl.registerCallback(NFdbBase::NTF_SERVICE_ONLINE_INTER_MACHINE, &CNameServer::onServiceOnlineReg);
@@ -54,6 +59,8 @@ CNameServer::CNameServer()
     mSubscribeHdl.registerCallback(NFdbBase::NTF_HOST_INFO, &CNameServer::onHostInfoReg);
 
     mSubscribeHdl.registerCallback(NFdbBase::NTF_WATCHDOG, &CNameServer::onWatchdogReg);
+    mSubscribeHdl.registerCallback(NFdbBase::NTF_SERVICE_ONLINE_MONITOR_BATCH, &CNameServer::onServiceBatchReg);
+    mBatchTimer.attach(mContext, false);
 
 #ifdef __WIN32__
     mLocalAllocator.setInterfaceIp(FDB_LOCAL_HOST);
@@ -557,6 +564,10 @@ void CNameServer::onRegisterServiceReq(CBaseJob::Ptr &msg_ref)
 
     if (addr_tbl.mAddrTbl.empty())
     {
+        if (addr_tbl.mGeneration)
+        {
+            registryChanged(svc_name, 0);
+        }
         mRegistryTbl.erase(reg_it);
         LOG_I("CNameServer: Service %s: registry fails.\n", svc_name.c_str());
         return;
@@ -564,6 +575,7 @@ void CNameServer::onRegisterServiceReq(CBaseJob::Ptr &msg_ref)
     else
     {
         LOG_I("CNameServer: Registry request of service %s is processed.\n", svc_name.c_str());
+        registryChanged(svc_name, &addr_tbl);
     }
     
     if (is_host_server)
@@ -777,6 +789,7 @@ void CNameServer::removeService(tRegistryTbl::iterator &reg_it)
     broadcast(NFdbBase::NTF_SERVICE_ONLINE_MONITOR_INTER_MACHINE, builder, svc_name);
     }
 
+    registryChanged(reg_it->first, 0);
     mRegistryTbl.erase(reg_it);
 }
 
@@ -944,6 +957,139 @@ void CNameServer::onWatchdogReg(CBaseJob::Ptr &msg_ref, const CFdbMsgSubscribeIt
     msg->broadcast(sub_item->msg_code(), builder);
 }
 
+void CNameServer::registryChanged(const std::string &svc_name, CSvcRegistryEntry *entry)
+{
+    mGeneration++;
+    if (entry)
+    {
+        entry->mGeneration = mGeneration;
+        mDroppedSvcTbl.erase(svc_name);
+    }
+    else
+    {
+        mDroppedSvcTbl[svc_name] = mGeneration;
+        if ((int32_t)mDroppedSvcTbl.size() > CNsConfig::getMaxDroppedServices())
+        {
+            // forget the earliest dropped; delta before it is no longer known
+            auto earliest = mDroppedSvcTbl.begin();
+            for (auto it = mDroppedSvcTbl.begin(); it != mDroppedSvcTbl.end(); ++it)
+            {
+                if (it->second < earliest->second)
+                {
+                    earliest = it;
+                }
+            }
+            mDeltaFloor = earliest->second;
+            mDroppedSvcTbl.erase(earliest);
+        }
+    }
+
+    if (mPendingSvcTbl.empty())
+    {
+        mBatchTimer.enableOneShot(CNsConfig::getSvcBatchWindow());
+    }
+    mPendingSvcTbl.insert(svc_name);
+}
+
+void CNameServer::populateServiceDelta(const std::string &svc_name, NFdbBase::FdbMsgServiceDelta &delta)
+{
+    auto addr_list = delta.add_services();
+    addr_list->set_service_name(svc_name);
+    addr_list->set_host_name(mHostProxy->hostName());
+    addr_list->set_is_local(true);
+    // never give token to monitors!!!
+    auto it = mRegistryTbl.find(svc_name);
+    if (it != mRegistryTbl.end())
+    {
+        populateAddrList(it->second.mAddrTbl, *addr_list, FDB_SOCKET_MAX);
+    }
+}
+
+void CNameServer::populateServiceDelta(uint32_t base_generation, NFdbBase::FdbMsgServiceDelta &delta)
+{
+    if (base_generation < mDeltaFloor)
+    {
+        base_generation = 0;
+    }
+    delta.set_base_generation(base_generation);
+    delta.set_generation(mGeneration);
+    for (auto it = mRegistryTbl.begin(); it != mRegistryTbl.end(); ++it)
+    {
+        if (base_generation)
+        {
+            if (it->second.mGeneration > base_generation)
+            {
+                populateServiceDelta(it->first, delta);
+            }
+            continue;
+        }
+        // full registry: only services online, including those never changed
+        for (auto addr_it = it->second.mAddrTbl.begin(); addr_it != it->second.mAddrTbl.end(); ++addr_it)
+        {
+            if (addr_it->mStatus == CFdbAddressDesc::ADDR_BOUND)
+            {
+                populateServiceDelta(it->first, delta);
+                break;
+            }
+        }
+    }
+    if (base_generation)
+    {
+        for (auto it = mDroppedSvcTbl.begin(); it != mDroppedSvcTbl.end(); ++it)
+        {
+            if (it->second > base_generation)
+            {
+                populateServiceDelta(it->first, delta);
+            }
+        }
+    }
+}
+
+void CNameServer::broadcastServiceBatch(CMethodLoopTimer<CNameServer> *timer)
+{
+    tSubscribedSessionSets sessions;
+    getSubscribeTable(NFdbBase::NTF_SERVICE_ONLINE_MONITOR_BATCH, "", sessions);
+    if (!sessions.empty())
+    {
+        NFdbBase::FdbMsgServiceDelta delta;
+        delta.set_base_generation(mBatchGeneration);
+        delta.set_generation(mGeneration);
+        for (auto it = mPendingSvcTbl.begin(); it != mPendingSvcTbl.end(); ++it)
+        {
+            populateServiceDelta(*it, delta);
+        }
+        CFdbParcelableBuilder builder(delta);
+        broadcast(NFdbBase::NTF_SERVICE_ONLINE_MONITOR_BATCH, builder);
+    }
+    mPendingSvcTbl.clear();
+    mBatchGeneration = mGeneration;
+}
+
+void CNameServer::onServiceBatchReg(CBaseJob::Ptr &msg_ref, const CFdbMsgSubscribeItem *sub_item)
+{
+    auto msg = castToMessage<CFdbMessage *>(msg_ref);
+    NFdbBase::FdbMsgServiceDelta delta;
+    populateServiceDelta(0, delta);
+    CFdbParcelableBuilder builder(delta);
+    msg->broadcast(sub_item->msg_code(), builder);
+}
+
+void CNameServer::onQueryServiceDeltaReq(CBaseJob::Ptr &msg_ref)
+{
+    auto msg = castToMessage<CFdbMessage *>(msg_ref);
+    NFdbBase::FdbMsgServiceDelta delta_in;
+    CFdbParcelableParser parser(delta_in);
+    if (!msg->deserialize(parser))
+    {
+        msg->status(msg_ref, NFdbBase::FDB_ST_MSG_DECODE_FAIL);
+        return;
+    }
+    NFdbBase::FdbMsgServiceDelta delta;
+    populateServiceDelta(delta_in.base_generation(), delta);
+    CFdbParcelableBuilder builder(delta);
+    msg->reply(msg_ref, builder);
+}
+
 CNameServer::CFdbAddressDesc *CNameServer::findAddress(EFdbSocketType type, const char *url)
 {
     for (auto it = mRegistryTbl.begin(); it != mRegistryTbl.end(); ++it)
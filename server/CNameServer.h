@@ -19,6 +19,7 @@
 
 #include <list>
 #include <map>
+#include <unordered_map>
 #include <string>
 #include <set>
 #include <vector>
@@ -26,6 +27,7 @@
 #include <common_base/CSocketImp.h>
 #include <security/CServerSecurityConfig.h>
 #include <common_base/CFdbMsgDispatcher.h>
+#include <common_base/CMethodLoopTimer.h>
 #include "CAddressAllocator.h"
 
 namespace NFdbBase {
@@ -33,6 +35,7 @@ namespace NFdbBase {
     class FdbMsgAddressList;
     class FdbMsgServiceInfo;
     class FdbMsgAddressItem;
+    class FdbMsgServiceDelta;
 }
 class CFdbMessage;
 class CHostProxy;
@@ -72,6 +75,13 @@ public:
     void populateServerTable(CFdbSession *session, NFdbBase::FdbMsgServiceTable &svc_tbl, bool is_local);
 
     void notifyRemoteNameServerDrop(const char *host_name);
+#ifdef CONFIG_FDB_SHM
+    // services on this host are connected with shared memory
+    void enableShm(bool enable)
+    {
+        mIPCAllocator.enableShm(enable);
+    }
+#endif
     void onHostOnline(bool online);
 protected:
     void onSubscribe(CBaseJob::Ptr &msg_ref);
@@ -82,11 +92,18 @@ private:
     typedef std::list<CFdbAddressDesc> tAddressDescTbl;
     struct CSvcRegistryEntry
     {
+        CSvcRegistryEntry()
+            : mGeneration(0)
+        {}
         FdbSessionId_t mSid;
         tAddressDescTbl mAddrTbl;
         CFdbToken::tTokenList mTokens;
+        // generation of registry when the service changes last time
+        uint32_t mGeneration;
     };
-    typedef std::map<std::string, CSvcRegistryEntry> tRegistryTbl;
+    typedef std::unordered_map<std::string, CSvcRegistryEntry> tRegistryTbl;
+    // dropped service -> generation of registry when it is dropped
+    typedef std::map<std::string, uint32_t> tDroppedSvcTbl;
     typedef std::map<std::string, CTCPAddressAllocator> tTCPAllocatorTbl;
     typedef std::map<std::string, CUDPPortAllocator> tUDPAllocatorTbl;
     typedef std::vector<CFdbSocketAddr> tSocketAddrTbl;
@@ -108,6 +125,16 @@ private:
     tInterfaceTbl mIpInterfaces;
     tInterfaceTbl mNameInterfaces;
 
+    // increased upon each change of registry
+    uint32_t mGeneration;
+    // delta before the generation is unknown since dropped services are forgotten
+    uint32_t mDeltaFloor;
+    tDroppedSvcTbl mDroppedSvcTbl;
+    // services changed since the last NTF_SERVICE_ONLINE_MONITOR_BATCH
+    std::set<std::string> mPendingSvcTbl;
+    uint32_t mBatchGeneration;
+    CMethodLoopTimer<CNameServer> mBatchTimer;
+
     void populateAddrList(const tAddressDescTbl &addr_tbl, NFdbBase::FdbMsgAddressList &list,
                           EFdbSocketType type);
 
@@ -117,11 +144,18 @@ private:
     void onQueryServiceReq(CBaseJob::Ptr &msg_ref);
     void onQueryServiceInterMachineReq(CBaseJob::Ptr &msg_ref);
     void onQueryHostReq(CBaseJob::Ptr &msg_ref);
+    void onQueryServiceDeltaReq(CBaseJob::Ptr &msg_ref);
     
     void onServiceOnlineReg(CBaseJob::Ptr &msg_ref, const CFdbMsgSubscribeItem *sub_item);
     void onHostOnlineReg(CBaseJob::Ptr &msg_ref, const CFdbMsgSubscribeItem *sub_item);
     void onHostInfoReg(CBaseJob::Ptr &msg_ref, const CFdbMsgSubscribeItem *sub_item);
     void onWatchdogReg(CBaseJob::Ptr &msg_ref, const CFdbMsgSubscribeItem *sub_item);
+    void onServiceBatchReg(CBaseJob::Ptr &msg_ref, const CFdbMsgSubscribeItem *sub_item);
+
+    void registryChanged(const std::string &svc_name, CSvcRegistryEntry *entry);
+    void populateServiceDelta(const std::string &svc_name, NFdbBase::FdbMsgServiceDelta &delta);
+    void populateServiceDelta(uint32_t base_generation, NFdbBase::FdbMsgServiceDelta &delta);
+    void broadcastServiceBatch(CMethodLoopTimer<CNameServer> *timer);
 
     CFdbAddressDesc *findAddress(EFdbSocketType type, const char *url);
     void createTCPAllocator();
@@ -25,12 +25,14 @@
 
 static int32_t ls_verbose = 0;
 static int32_t ls_follow = 0;
+static int32_t ls_batch = 0;
 
 class CNameServerProxy : public CBaseClient
 {
 public:
     CNameServerProxy()
         : CBaseClient(FDB_NAME_SERVER_NAME)
+        , mGeneration(0)
     {
 
     }
@@ -105,6 +107,18 @@ protected:
                 }
             }
             break;
+            case NFdbBase::REQ_QUERY_SERVICE_DELTA:
+            {
+                NFdbBase::FdbMsgServiceDelta delta;
+                CFdbParcelableParser parser(delta);
+                if (!msg->deserialize(parser))
+                {
+                    LOG_E("CNameServerProxy: unable to decode NFdbBase::FdbMsgServiceDelta.\n");
+                    quit();
+                }
+                applyDelta(delta);
+            }
+            break;
             default:
             break;
         }
@@ -128,35 +142,7 @@ protected:
                     LOG_E("CNameServerProxy: unable to decode NFdbBase::FdbMsgAddressList.\n");
                     return;
                 }
-                const char *location = msg_addr_list.is_local() ? "(local)" : "(remote)";
-                
-                if (msg_addr_list.address_list().empty())
-                {
-                    std::cout << "[" << msg_addr_list.service_name()
-                              << "]@" << msg_addr_list.host_name() << location
-                              << " - Dropped" << std::endl;
-                }
-                else
-                {
-                    std::cout << "[" << msg_addr_list.service_name()
-                              << "]@" << msg_addr_list.host_name() << location
-                              << " - Online" << std::endl;
-                    auto &addr_list = msg_addr_list.address_list();
-                    for (auto it = addr_list.vpool().begin(); it != addr_list.vpool().end(); ++it)
-                    {
-                        if (it->has_udp_port() && FDB_VALID_PORT(it->udp_port()))
-                        {
-                            std::cout << "    > " << it->tcp_ipc_url()
-                                      << " udp://" << it->udp_port()
-                                      << std::endl;
-                        }
-                        else
-                        {
-                            std::cout << "    > " << it->tcp_ipc_url()
-                                      << std::endl;
-                        }
-                    }
-                }
+                printService(msg_addr_list);
                 
                 if (ls_verbose)
                 {
@@ -164,6 +150,18 @@ protected:
                 }
             }
             break;
+            case NFdbBase::NTF_SERVICE_ONLINE_MONITOR_BATCH:
+            {
+                NFdbBase::FdbMsgServiceDelta delta;
+                CFdbParcelableParser parser(delta);
+                if (!msg->deserialize(parser))
+                {
+                    LOG_E("CNameServerProxy: unable to decode NFdbBase::FdbMsgServiceDelta.\n");
+                    return;
+                }
+                applyDelta(delta);
+            }
+            break;
             default:
             break;
         }
@@ -171,7 +169,14 @@ protected:
 
     void onOnline(FdbSessionId_t sid, bool is_first)
     {
-        if (ls_follow)
+        if (ls_batch)
+        {
+            mGeneration = 0;
+            CFdbMsgSubscribeList subscribe_list;
+            addNotifyItem(subscribe_list, NFdbBase::NTF_SERVICE_ONLINE_MONITOR_BATCH);
+            subscribe(subscribe_list);
+        }
+        else if (ls_follow)
         {
             CFdbMsgSubscribeList subscribe_list;
             addNotifyItem(subscribe_list, NFdbBase::NTF_SERVICE_ONLINE_MONITOR);
@@ -184,6 +189,67 @@ protected:
     }
     
 private:
+    // registry of local services is known up to this generation
+    uint32_t mGeneration;
+
+    void printService(NFdbBase::FdbMsgAddressList &msg_addr_list)
+    {
+        const char *location = msg_addr_list.is_local() ? "(local)" : "(remote)";
+        
+        if (msg_addr_list.address_list().empty())
+        {
+            std::cout << "[" << msg_addr_list.service_name()
+                      << "]@" << msg_addr_list.host_name() << location
+                      << " - Dropped" << std::endl;
+        }
+        else
+        {
+            std::cout << "[" << msg_addr_list.service_name()
+                      << "]@" << msg_addr_list.host_name() << location
+                      << " - Online" << std::endl;
+            auto &addr_list = msg_addr_list.address_list();
+            for (auto it = addr_list.vpool().begin(); it != addr_list.vpool().end(); ++it)
+            {
+                if (it->has_udp_port() && FDB_VALID_PORT(it->udp_port()))
+                {
+                    std::cout << "    > " << it->tcp_ipc_url()
+                              << " udp://" << it->udp_port()
+                              << std::endl;
+                }
+                else
+                {
+                    std::cout << "    > " << it->tcp_ipc_url()
+                              << std::endl;
+                }
+            }
+        }
+    }
+
+    void applyDelta(NFdbBase::FdbMsgServiceDelta &delta)
+    {
+        if (delta.base_generation() > mGeneration)
+        {
+            // changes are missed: resync from the generation already known
+            NFdbBase::FdbMsgServiceDelta query;
+            query.set_base_generation(mGeneration);
+            CFdbParcelableBuilder builder(query);
+            invoke(NFdbBase::REQ_QUERY_SERVICE_DELTA, builder);
+            return;
+        }
+        if (mGeneration && (delta.generation() <= mGeneration))
+        {
+            return;
+        }
+        std::cout << "Generation " << delta.generation() << ": "
+                  << delta.services().size() << " service(s) changed" << std::endl;
+        auto &services = delta.services();
+        for (auto it = services.vpool().begin(); it != services.vpool().end(); ++it)
+        {
+            printService(*it);
+        }
+        mGeneration = delta.generation();
+    }
+
     void quit()
     {
         exit(0);
@@ -196,6 +262,7 @@ int main(int argc, char **argv)
 	const struct fdb_option core_options[] = {
             { FDB_OPTION_BOOLEAN, "follow", 'f', &ls_follow },
             { FDB_OPTION_BOOLEAN, "verbose", 'v', &ls_verbose },
+            { FDB_OPTION_BOOLEAN, "batch", 'b', &ls_batch },
             { FDB_OPTION_BOOLEAN, "help", 'h', &help }
     };
 
@@ -207,13 +274,19 @@ int main(int argc, char **argv)
                                            FDB_DEF_TO_STR(FDB_VERSION_MINOR) "."
                                            FDB_DEF_TO_STR(FDB_VERSION_BUILD) << std::endl;
         std::cout << "    LIB version " << CFdbContext::getFdbLibVersion() << std::endl;
-        std::cout << "Usage: lssvc[ -f][ -v]" << std::endl;
+        std::cout << "Usage: lssvc[ -f][ -v][ -b]" << std::endl;
         std::cout << "List name of all services" << std::endl;
         std::cout << "    -f: keep monitoring service name" << std::endl;
         std::cout << "    -v: verbose mode" << std::endl;
+        std::cout << "    -b: keep monitoring local services with changes batched" << std::endl;
         return 0;
     }
 
+    if (ls_batch)
+    {
+        ls_follow = 1;
+    }
+
     FDB_CONTEXT->enableLogger(false);
     FDB_CONTEXT->init();
     
@@ -85,7 +85,7 @@ public:
         enableUDP(true);
         enableTimeStamp(true);
         enableAysncWrite(true);
-        enableAysncRead(true);
+        enableStreamRead(true);
     }
     void doStatistic(CMethodLoopTimer<CXClient> *timer)
     {
@@ -381,6 +381,54 @@ CStatisticTimer::CStatisticTimer(CXClient *client)
     : CMethodLoopTimer<CXClient>(1000, true, client, &CXClient::doStatistic)
 {}
 
+/*
+ * Send traces to log server as fast as possible and measure how many of
+ * them are processed by log server per second. Log server should print
+ * or store the logs; otherwise logs are dropped at producer.
+ */
+static void runLogTest(uint32_t nr_records)
+{
+    FDB_CONTEXT->start();
+    CNanoTimer timer;
+    timer.start();
+    CLogProducer *logger = 0;
+    while (!(logger = FDB_CONTEXT->getLogger()) || !logger->connected())
+    {
+        if (timer.snapshotMilliseconds() > 5000)
+        {
+            std::cout << "log server is not available!" << std::endl;
+            return;
+        }
+        sysdep_sleep(10);
+    }
+    // wait for log config from log server
+    sysdep_sleep(100);
+
+    std::string text(fdb_block_size, 'x');
+    timer.start();
+    for (uint32_t i = 0; i < nr_records; ++i)
+    {
+        FDB_TLOG_I("fdbxclient", "%u %s\n", i, text.c_str());
+        if (!((i + 1) % fdb_burst_size))
+        {
+            // let context catch up so that trace ring never overflows
+            FDB_CONTEXT->flush();
+        }
+    }
+    logger->flushLogs();
+    // log server replies after all logs before the request are processed
+    CBaseJob::Ptr ref(new CBaseMessage(NFdbBase::REQ_GET_TRACE_CONFIG));
+    logger->invoke(ref);
+    auto elapse = timer.snapshotMicroseconds();
+    if (!elapse)
+    {
+        elapse = 1;
+    }
+    std::cout << "log records: " << nr_records
+              << ", elapse: " << elapse << " us"
+              << ", " << ((uint64_t)nr_records * 1000000 / elapse) << " records/s" << std::endl;
+}
+
 void CXTestJob::run(CBaseWorker *worker, Ptr &ref)
 {
     if (fdb_stop_job)
@@ -427,12 +475,16 @@ int main(int argc, char **argv)
     uint32_t block_size = 1024;
     uint32_t delay = 0;
     int32_t sync_invoke = 0;
+    uint32_t log_records = 0;
+    uint32_t log_batch = 0;
     const struct fdb_option core_options[] = {
         { FDB_OPTION_INTEGER, "block_size", 'b', &block_size},
         { FDB_OPTION_INTEGER, "burst_size", 's', &burst_size},
         { FDB_OPTION_INTEGER, "delay", 'd', &delay},
         { FDB_OPTION_BOOLEAN, "udp_test", 'u', &udp_test},
         { FDB_OPTION_BOOLEAN, "sync", 'y', &sync_invoke},
+        { FDB_OPTION_INTEGER, "log_test", 'l', &log_records},
+        { FDB_OPTION_INTEGER, "log_batch", 'g', &log_batch},
         { FDB_OPTION_BOOLEAN, "help", 'h', &help}
     };
     fdb_parse_options(core_options, ARRAY_LENGTH(core_options), &argc, argv);
@@ -457,12 +509,22 @@ int main(int argc, char **argv)
                                            FDB_DEF_TO_STR(FDB_VERSION_MINOR) "."
                                            FDB_DEF_TO_STR(FDB_VERSION_BUILD) << std::endl;
         std::cout << "    LIB version " << CFdbContext::getFdbLibVersion() << std::endl;
-        std::cout << "Usage: fdbxclient[ -b block size][ -s burst size][-d delay][ -u]" << std::endl;
+        std::cout << "Usage: fdbxclient[ -b block size][ -s burst size][-d delay][ -u][ -l records[ -g batch size]]" << std::endl;
         std::cout << "    -b block size: specify size of date sent for each request" << std::endl;
         std::cout << "    -s burst size: specify how many requests are sent in batch for a burst" << std::endl;
         std::cout << "    -d delay: specify delay between two bursts in micro second" << std::endl;
         std::cout << "    -u: if set, UDP is tested; otherwise TCP/UDS will be tested" << std::endl;
         std::cout << "    -y: if set, TCP test with synchronous API; otherwise asynchronous API will be called" << std::endl;
+        std::cout << "    -l records: send the number of traces of 'block size' to log server and measure records/s" << std::endl;
+        std::cout << "        traces are sent in bursts of 'burst size'" << std::endl;
+        std::cout << "    -g batch size: if set, logs are sent in batch of the size" << std::endl;
+        exit(0);
+    }
+
+    if (log_records)
+    {
+        FDB_CONTEXT->setLogBatch((int32_t)log_batch);
+        runLogTest(log_records);
         exit(0);
     }
 
@@ -40,7 +40,7 @@ public:
         mTimer = new CStatisticTimer(this);
         mTimer->attach(fdb_statistic_worker, false);
         enableUDP(true);
-        enableAysncRead(true);
+        enableStreamRead(true);
         enableAysncWrite(true);
     }
     void doStatistic(CMethodLoopTimer<CXServer> *timer)
@@ -93,9 +93,9 @@ protected:
             case XCLT_TEST_BI_DIRECTION:
             {
                 incrementReceived(msg->getPayloadSize());
-                auto buffer = msg->getPayloadBuffer();
                 auto size = msg->getPayloadSize();
                 auto to_be_release = msg->ownBuffer();
+                auto buffer = (uint8_t *)to_be_release + msg->getPayloadOffset();
                 msg->reply(msg_ref, buffer, size);
                 msg->releaseBuffer(to_be_release);
             }
@@ -146,9 +146,30 @@ CStatisticTimer::CStatisticTimer(CXServer *server)
 
 int main(int argc, char **argv)
 {
+    int32_t help = 0;
+    uint32_t io_workers = 0;
+    const struct fdb_option core_options[] = {
+        { FDB_OPTION_INTEGER, "io_workers", 'i', &io_workers},
+        { FDB_OPTION_BOOLEAN, "help", 'h', &help}
+    };
+    fdb_parse_options(core_options, ARRAY_LENGTH(core_options), &argc, argv);
+
+    if (help)
+    {
+        std::cout << "Usage: fdbxserver[ -i I/O workers]" << std::endl;
+        std::cout << "    -i I/O workers: if set, sockets of clients are served by the number of I/O workers;" << std::endl;
+        std::cout << "        start several fdbxclient and compare data rate with 1, 2, 4... 16 I/O workers" << std::endl;
+        exit(0);
+    }
+    std::cout << "I/O workers: " << io_workers << std::endl;
+
     FDB_CONTEXT->enableLogger(false);
     /* start fdbus context thread */
     FDB_CONTEXT->start();
+    if (io_workers)
+    {
+        FDB_CONTEXT->enableIoWorkers(io_workers);
+    }
 
     fdb_statistic_worker = new CBaseWorker();
     fdb_statistic_worker->start();
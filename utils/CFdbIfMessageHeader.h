@@ -17,11 +17,41 @@
 #ifndef __CFDBMESSAGEHEADER_H__
 #define __CFDBMESSAGEHEADER_H__
 
+#include <string.h>
+#include <stddef.h>
 #include <string>
 #include <common_base/CFdbSimpleMsgBuilder.h>
+#include <common_base/CFdbSchema.h>
 #include "CFdbIfMsgTokens.h"
 #include <common_base/common_defs.h>
 
+/*
+ * Compact head: CFdbCompactHead followed by TLVs of optional fields, all in
+ * little endian. A TLV is [uint8 tag][uint8 length][value] where tag is the
+ * option mask of the field; strings are without terminating '\0'. TLVs of
+ * unknown tag are skipped. Legacy head starts with message type which is
+ * less than FDB_COMPACT_HEAD_MARKER so the encoding is told by the first
+ * byte. Compact head is only sent to peers which claim to support it in
+ * FdbSessionInfo.
+ */
+#define FDB_COMPACT_HEAD_MARKER     0x80
+#define FDB_COMPACT_TLV_HEAD_SIZE   2
+#define FDB_COMPACT_TLV_MAX_LENGTH  0xff
+
+struct CFdbCompactHead
+{
+    // FDB_COMPACT_HEAD_MARKER | message type
+    uint8_t mMarkerType;
+    uint8_t mQOS;
+    uint16_t mReserved;
+    int32_t mSn;
+    int32_t mCode;
+    uint32_t mFlag;
+    uint32_t mObjId;
+    uint32_t mPayloadSize;
+};
+static_assert(sizeof(CFdbCompactHead) == 24, "CFdbCompactHead should be 24 bytes!");
+
 namespace NFdbBase {
 class CFdbMessageHeader : public IFdbParcelable
 {
@@ -140,32 +170,216 @@ public:
 
     void serialize(CFdbSimpleSerializer &serializer) const
     {
-        serializer << (uint8_t)mType
-                   << mSn
-                   << mCode
-                   << mFlag
-                   << mObjId
-                   << mPayloadSize
-                   << (uint8_t)mQOS
-                   << mOptions;
+        // size of fixed fields is known at compile time
+        int32_t size = CFdbSchema::size((uint8_t)mType, mSn, mCode, mFlag, mObjId,
+                                        mPayloadSize, (uint8_t)mQOS, mOptions);
+        if (mOptions & mMaskHeadFilter)
+        {
+            size += CFdbSchema::size(mFilter);
+        }
+        if (mOptions & mMaskSenderArriveTime)
+        {
+            size += CFdbSchema::size(mSendArriveTime);
+        }
+        if (mOptions & mMaskReplyTime)
+        {
+            size += CFdbSchema::size(mReplyTime);
+        }
+        if (mOptions & mMaskToken)
+        {
+            size += CFdbSchema::size(mToken);
+        }
+        serializer.reserve(size);
+
+        CFdbSchema::write(serializer, (uint8_t)mType, mSn, mCode, mFlag, mObjId,
+                          mPayloadSize, (uint8_t)mQOS, mOptions);
         if (mOptions & mMaskHeadFilter)
         {
-            serializer << mFilter;
+            CFdbSchema::write(serializer, mFilter);
         }
         if (mOptions & mMaskSenderArriveTime)
         {
-            serializer << mSendArriveTime;
+            CFdbSchema::write(serializer, mSendArriveTime);
         }
         if (mOptions & mMaskReplyTime)
         {
-            serializer << mReplyTime;
+            CFdbSchema::write(serializer, mReplyTime);
         }
         if (mOptions & mMaskToken)
         {
-            serializer << mToken;
+            CFdbSchema::write(serializer, mToken);
         }
     }
 
+    static bool isCompact(const uint8_t *head, int32_t head_size)
+    {
+        return (head_size > 0) && (head[0] & FDB_COMPACT_HEAD_MARKER);
+    }
+
+    // size of compact head; -1 if an optional field is too long
+    int32_t compactSize() const
+    {
+        int32_t size = (int32_t)sizeof(CFdbCompactHead);
+        if (mOptions & mMaskHeadFilter)
+        {
+            if (mFilter.size() > FDB_COMPACT_TLV_MAX_LENGTH)
+            {
+                return -1;
+            }
+            size += FDB_COMPACT_TLV_HEAD_SIZE + (int32_t)mFilter.size();
+        }
+        if (mOptions & mMaskSenderArriveTime)
+        {
+            size += FDB_COMPACT_TLV_HEAD_SIZE + (int32_t)sizeof(mSendArriveTime);
+        }
+        if (mOptions & mMaskReplyTime)
+        {
+            size += FDB_COMPACT_TLV_HEAD_SIZE + (int32_t)sizeof(mReplyTime);
+        }
+        if (mOptions & mMaskToken)
+        {
+            if (mToken.size() > FDB_COMPACT_TLV_MAX_LENGTH)
+            {
+                return -1;
+            }
+            size += FDB_COMPACT_TLV_HEAD_SIZE + (int32_t)mToken.size();
+        }
+        return size;
+    }
+
+    // write compact head to buffer of at least compactSize() bytes
+    void encodeCompact(uint8_t *buffer) const
+    {
+        CFdbCompactHead fixed;
+        fixed.mMarkerType = (uint8_t)(FDB_COMPACT_HEAD_MARKER | mType);
+        fixed.mQOS = (uint8_t)mQOS;
+        fixed.mReserved = 0;
+        fixed.mSn = toLittleEndian(mSn);
+        fixed.mCode = toLittleEndian(mCode);
+        fixed.mFlag = toLittleEndian(mFlag);
+        fixed.mObjId = toLittleEndian(mObjId);
+        fixed.mPayloadSize = toLittleEndian(mPayloadSize);
+        memcpy(buffer, &fixed, sizeof(fixed));
+        buffer += sizeof(fixed);
+
+        if (mOptions & mMaskHeadFilter)
+        {
+            buffer = encodeTlv(buffer, mMaskHeadFilter, mFilter.c_str(), (int32_t)mFilter.size());
+        }
+        if (mOptions & mMaskSenderArriveTime)
+        {
+            auto time = toLittleEndian(mSendArriveTime);
+            buffer = encodeTlv(buffer, mMaskSenderArriveTime, &time, (int32_t)sizeof(time));
+        }
+        if (mOptions & mMaskReplyTime)
+        {
+            auto time = toLittleEndian(mReplyTime);
+            buffer = encodeTlv(buffer, mMaskReplyTime, &time, (int32_t)sizeof(time));
+        }
+        if (mOptions & mMaskToken)
+        {
+            buffer = encodeTlv(buffer, mMaskToken, mToken.c_str(), (int32_t)mToken.size());
+        }
+    }
+
+    // read head written by encodeCompact(); return false if it is broken
+    bool decodeCompact(const uint8_t *buffer, int32_t size)
+    {
+        if (size < (int32_t)sizeof(CFdbCompactHead))
+        {
+            return false;
+        }
+        CFdbCompactHead fixed;
+        memcpy(&fixed, buffer, sizeof(fixed));
+        mType = (EFdbMessageType)(fixed.mMarkerType & ~FDB_COMPACT_HEAD_MARKER);
+        mQOS = (EFdbQOS)fixed.mQOS;
+        mSn = toLittleEndian(fixed.mSn);
+        mCode = toLittleEndian(fixed.mCode);
+        mFlag = toLittleEndian(fixed.mFlag);
+        mObjId = toLittleEndian(fixed.mObjId);
+        mPayloadSize = toLittleEndian(fixed.mPayloadSize);
+        mOptions = 0;
+
+        auto pos = buffer + sizeof(fixed);
+        auto end = buffer + size;
+        while (pos < end)
+        {
+            if ((end - pos) < FDB_COMPACT_TLV_HEAD_SIZE)
+            {
+                return false;
+            }
+            uint8_t tag = pos[0];
+            int32_t length = pos[1];
+            pos += FDB_COMPACT_TLV_HEAD_SIZE;
+            if ((end - pos) < length)
+            {
+                return false;
+            }
+            switch (tag)
+            {
+                case mMaskHeadFilter:
+                    mFilter.assign((const char *)pos, length);
+                break;
+                case mMaskSenderArriveTime:
+                    if (!decodeTime(pos, length, mSendArriveTime))
+                    {
+                        return false;
+                    }
+                break;
+                case mMaskReplyTime:
+                    if (!decodeTime(pos, length, mReplyTime))
+                    {
+                        return false;
+                    }
+                break;
+                case mMaskToken:
+                    mToken.assign((const char *)pos, length);
+                break;
+                default:
+                    // added by newer version
+                    tag = 0;
+                break;
+            }
+            mOptions |= tag;
+            pos += length;
+        }
+        return true;
+    }
+
+    // parse head of either encoding
+    bool parse(const uint8_t *head, int32_t head_size)
+    {
+        if (isCompact(head, head_size))
+        {
+            return decodeCompact(head, head_size);
+        }
+        CFdbParcelableParser parser(*this);
+        return parser.parse(head, head_size);
+    }
+
+    /*
+     * Replace object id in a head serialized by serialize() or
+     * encodeCompact(). Fields before it are of fixed size so it is patched
+     * in place without building the head again. Return false if the head
+     * is too short.
+     */
+    static bool patchObjectId(uint8_t *head, int32_t head_size, uint32_t obj_id)
+    {
+        // type, serial number, code and flag
+        int32_t offset = (int32_t)(sizeof(uint8_t) + sizeof(int32_t) * 2 + sizeof(uint32_t));
+        if (isCompact(head, head_size))
+        {
+            offset = (int32_t)offsetof(CFdbCompactHead, mObjId);
+        }
+        if (head_size < (int32_t)(offset + sizeof(obj_id)))
+        {
+            return false;
+        }
+        obj_id = toLittleEndian(obj_id);
+        memcpy(head + offset, &obj_id, sizeof(obj_id));
+        return true;
+    }
+
     void deserialize(CFdbSimpleDeserializer &deserializer)
     {
         uint8_t msg_type;
@@ -215,7 +429,41 @@ private:
         static const uint8_t mMaskSenderArriveTime = 1 << 2;
         static const uint8_t mMaskReplyTime = 1 << 3;
         static const uint8_t mMaskToken = 1 << 4;
-    
+
+    // also converts back from little endian
+    template <typename T>
+    static T toLittleEndian(T value)
+    {
+#ifdef FDB_HOST_LITTLE_ENDIAN
+        return value;
+#else
+        T swapped;
+        auto src = (const uint8_t *)&value;
+        auto dst = (uint8_t *)&swapped;
+        for (uint32_t i = 0; i < sizeof(T); ++i)
+        {
+            dst[i] = src[sizeof(T) - 1 - i];
+        }
+        return swapped;
+#endif
+    }
+    static uint8_t *encodeTlv(uint8_t *buffer, uint8_t tag, const void *value, int32_t length)
+    {
+        buffer[0] = tag;
+        buffer[1] = (uint8_t)length;
+        memcpy(buffer + FDB_COMPACT_TLV_HEAD_SIZE, value, length);
+        return buffer + FDB_COMPACT_TLV_HEAD_SIZE + length;
+    }
+    static bool decodeTime(const uint8_t *value, int32_t length, uint64_t &time)
+    {
+        if (length != (int32_t)sizeof(time))
+        {
+            return false;
+        }
+        memcpy(&time, value, sizeof(time));
+        time = toLittleEndian(time);
+        return true;
+    }
 };
 
 class FdbMsgErrorInfo : public IFdbParcelable
@@ -352,6 +600,24 @@ public:
     {
         mPid = pid;
     }
+    // sender parses compact head; ignored by older version
+    bool compact_head() const
+    {
+        return !!(mOptions & mMaskCompactHead);
+    }
+    void set_compact_head()
+    {
+        mOptions |= mMaskCompactHead;
+    }
+    // sender reassembles fragmented UDP messages
+    bool udp_fragment() const
+    {
+        return !!(mOptions & mMaskUDPFragment);
+    }
+    void set_udp_fragment()
+    {
+        mOptions |= mMaskUDPFragment;
+    }
     void serialize(CFdbSimpleSerializer &serializer) const
     {
         serializer << mSenderName
@@ -378,6 +644,8 @@ private:
     uint32_t mPid;
     uint8_t mOptions;
         static const uint8_t mMaskHasUDPPort = 1 << 0;
+        static const uint8_t mMaskCompactHead = 1 << 1;
+        static const uint8_t mMaskUDPFragment = 1 << 2;
 };
 }
 
@@ -18,12 +18,35 @@
 #define __CFDBUDPSESSION_H__
 
 #include <string>
+#include <vector>
+#include <map>
 #include <common_base/common_defs.h>
 #include <common_base/CBaseFdWatch.h>
+#include <common_base/CSocketImp.h>
+
+// upper limit of CBaseEndpoint::udpBatchSize()
+#define FDB_UDP_MAX_BATCH_SIZE          64
+
+/*
+ * Message too big for a datagram is sent in fragments to peers which
+ * reassemble it (see FdbSessionInfo). A fragment is
+ * [CFdbMsgPrefix][sender id][message id][message size][offset][data]
+ * where head length of the prefix is 0 and the rest are uint32 in little
+ * endian. Data is a piece of the whole message (prefix, head and payload)
+ * at offset; all pieces but the last are FDB_UDP_FRAGMENT_DATA_SIZE bytes.
+ * If any fragment is missing the message is dropped as a lost datagram.
+ */
+#define FDB_UDP_MAX_DATAGRAM_SIZE       65507
+#define FDB_UDP_FRAGMENT_HEAD_SIZE      24
+#define FDB_UDP_FRAGMENT_DATA_SIZE      (FDB_UDP_MAX_DATAGRAM_SIZE - FDB_UDP_FRAGMENT_HEAD_SIZE)
+// bigger message falls back to TCP
+#define FDB_UDP_MAX_MESSAGE_SIZE        (1024 * 1024)
+// incomplete message is dropped after this many milliseconds
+#define FDB_UDP_REASSEMBLY_TIMEOUT      1000
+// memory held by incomplete messages; the oldest is dropped for new one
+#define FDB_UDP_REASSEMBLY_MEMORY       (4 * 1024 * 1024)
 
 class CFdbSessionContainer;
-class CSocketImp;
-struct CFdbSocketAddr;
 class CFdbMessage;
 struct CFdbMsgPrefix;
 namespace NFdbBase {
@@ -37,7 +60,19 @@ public:
     virtual ~CFdbUDPSession();
 
     bool sendMessage(const uint8_t *buffer, int32_t size, const CFdbSocketAddr &dest_addr);
-    bool sendMessage(CFdbMessage *msg, const CFdbSocketAddr &dest_addr);
+    /*
+     * If fragment is set, message too big for a datagram is sent in
+     * fragments; otherwise it fails.
+     */
+    bool sendMessage(CFdbMessage *msg, const CFdbSocketAddr &dest_addr,
+                     bool compact_head = false, bool fragment = false);
+    /*
+     * Queue datagram of message, which is sent by flushBatch() along with
+     * others in one system call; big datagram is sent at once.
+     */
+    bool queueMessage(CFdbMessage *msg, const CFdbSocketAddr &dest_addr,
+                      bool compact_head = false, bool fragment = false);
+    void flushBatch();
 
     CSocketImp *getSocket()
     {
@@ -49,10 +84,51 @@ protected:
     void onHup();
 
 private:
+    struct CTxDatagram
+    {
+        int32_t mOffset;
+        int32_t mSize;
+        CFdbSocketAddr mDestAddr;
+    };
     CFdbSessionContainer *mContainer;
     CSocketImp *mSocket;
+    // pooled buffers receiving datagrams; handed over to big message
+    uint8_t *mRxBuffers[FDB_UDP_MAX_BATCH_SIZE];
+    // number of buffers in use; grows with traffic
+    int32_t mNrRxBuffers;
+    // set if the session is destroyed while dispatching
+    bool *mDestroyed;
+    // queued datagrams are copied to mTxBuffer; both are kept for reuse
+    std::vector<uint8_t> mTxBuffer;
+    std::vector<CTxDatagram> mTxDatagrams;
+    int32_t mTxCount;
+    int32_t mTxSize;
+
+    // fragmented message being reassembled
+    struct CReassembly
+    {
+        uint8_t *mBuffer;
+        int32_t mMsgSize;
+        int32_t mNrReceived;
+        uint64_t mStartTime;
+        std::vector<bool> mReceived;
+    };
+    // indexed by sender id and message id
+    typedef std::map<uint64_t, CReassembly> tReassemblyTbl;
+    tReassemblyTbl mReassemblyTbl;
+    int32_t mReassemblySize;
+    // tells fragments of this session from those of other senders
+    uint32_t mSenderId;
+    uint32_t mTxMsgId;
+    std::vector<uint8_t> mFragmentHeads;
 
-    int32_t receiveData(uint8_t *buf, int32_t size);
+    int32_t batchSize() const;
+    bool sendFragments(const CFdbIoVec *vecs, int32_t count, int32_t size,
+                       const CFdbSocketAddr &dest_addr);
+    void processDatagram(uint8_t *&rx_buffer, int32_t rx_size);
+    void processFragment(const uint8_t *data, int32_t size);
+    void dropReassembly(tReassemblyTbl::iterator it);
+    void dispatchMessage(CFdbMsgPrefix &prefix, uint8_t *whole_buf);
     void doBroadcast(NFdbBase::CFdbMessageHeader &head, CFdbMsgPrefix &prefix, uint8_t *buffer);
     void doRequest(NFdbBase::CFdbMessageHeader &head, CFdbMsgPrefix &prefix, uint8_t *buffer);
 };
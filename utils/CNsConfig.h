@@ -34,6 +34,10 @@ public:
 #define NS_CFG_NS_RECONNECT_INTERVAL    500
 #define NS_CFG_CHECK_IP_INTERVAL        500
 #define NS_CFG_ADDRESS_BIND_RETRY_CNT   5
+// window in ms over which changes of registry are batched
+#define NS_CFG_SVC_BATCH_WINDOW         50
+// services dropped and remembered for delta query
+#define NS_CFG_MAX_DROPPED_SERVICES     256
 #ifdef FDB_CONFIG_UDS_ABSTRACT
     #define NS_CFG_UDS_ADDRESS_PREFIX  "@"
 #else
@@ -100,6 +104,16 @@ public:
         return FDB_URL_IPC NS_CFG_UDS_ADDRESS_PREFIX FDB_CFG_SOCKET_PATH "/" "fdb-ipc";
     }
 
+    static const char *getShmPathBase()
+    {
+        return NS_CFG_UDS_ADDRESS_PREFIX FDB_CFG_SOCKET_PATH "/" "fdb-shm";
+    }
+
+    static const char *getShmUrlBase()
+    {
+        return FDB_URL_SHM NS_CFG_UDS_ADDRESS_PREFIX FDB_CFG_SOCKET_PATH "/" "fdb-shm";
+    }
+
     static int32_t getTCPPortMin()
     {
         return 60002;
@@ -147,6 +161,16 @@ public:
     {
         return NS_CFG_ADDRESS_BIND_RETRY_CNT;
     }
+
+    static int32_t getSvcBatchWindow()
+    {
+        return NS_CFG_SVC_BATCH_WINDOW;
+    }
+
+    static int32_t getMaxDroppedServices()
+    {
+        return NS_CFG_MAX_DROPPED_SERVICES;
+    }
 };
 
 #endif
@@ -32,6 +32,9 @@ CSysLoopTimer::CSysLoopTimer(int32_t interval, bool rpt)
     , mEnable(false)
     , mExpiration(0)
     , mEventLoop(0)
+    , mHeapIndex(-1)
+    , mLoopIndex(-1)
+    , mSequence(0)
 {
 }
 
@@ -43,7 +46,7 @@ void CSysLoopTimer::enable(bool enb, uint64_t time_start, int32_t init_value)
 {
     if (mEnable)
     {
-        fdb_remove_value_from_container(mEventLoop->mTimerWorkingList, this);
+        mEventLoop->eraseTimer(this);
         mEnable = false;
     }
 
@@ -66,15 +69,7 @@ void CSysLoopTimer::enable(bool enb, uint64_t time_start, int32_t init_value)
             LOG_E("CBaseEventLoop: Unable to enable timer since interval is invalid!\n");
             return;
         }
-        auto ti = mEventLoop->mTimerWorkingList.begin();
-        for (; ti != mEventLoop->mTimerWorkingList.end(); ++ti)
-        {
-            if ((*ti)->expiration() > mExpiration)
-            {
-                break;
-            }
-        }
-        mEventLoop->mTimerWorkingList.insert(ti, this);
+        mEventLoop->pushTimer(this);
         mEnable = true;
     }
 }
@@ -106,7 +101,8 @@ void CSysLoopTimer::config(EEnable enb, EEnable rpt, int32_t interval, int32_t i
 }
 
 CBaseEventLoop::CBaseEventLoop()
-    : mTimerRecursiveCnt(0)
+    : mTimerSequence(0)
+    , mTimerRecursiveCnt(0)
 {
 }
 
@@ -127,15 +123,13 @@ bool CBaseEventLoop::timerDestroyed(CSysLoopTimer *timer)
 
 void CBaseEventLoop::addTimer(CSysLoopTimer *timer, bool enb)
 {
-    for (auto ti = mTimerList.begin(); ti != mTimerList.end(); ++ti)
+    if ((timer->mLoopIndex >= 0) && (timer->eventloop() == this))
     {
-        if ((*ti) == timer)
-        {
-            return; // alredy added
-        }
+        return; // alredy added
     }
 
     timer->eventloop(this);
+    timer->mLoopIndex = (int32_t)mTimerList.size();
     mTimerList.push_back(timer);
     timer->enable(enb);
 }
@@ -144,33 +138,133 @@ void CBaseEventLoop::removeTimer(CSysLoopTimer *timer)
 {
     addTimerToBlacklist(timer);
     timer->enable(false);
-    fdb_remove_value_from_container(mTimerList, timer);
+    auto index = timer->mLoopIndex;
+    if ((index >= 0) && (timer->eventloop() == this))
+    {
+        auto last = mTimerList.back();
+        mTimerList[index] = last;
+        last->mLoopIndex = index;
+        mTimerList.pop_back();
+        timer->mLoopIndex = -1;
+    }
     timer->eventloop(0);
 }
 
 void CBaseEventLoop::addTimerToBlacklist(CSysLoopTimer *timer)
 {
-    mTimerBlackList.insert(timer);
+    // black list is only checked while running expired timers
+    if (mTimerRecursiveCnt)
+    {
+        mTimerBlackList.insert(timer);
+    }
 }
 
 void CBaseEventLoop::uninstallTimers()
 {
-    for (auto ti = mTimerList.begin(); ti != mTimerList.end();)
+    while (!mTimerList.empty())
     {
-        CSysLoopTimer *timer = *ti;
-        ++ti;
-        removeTimer(timer);
+        removeTimer(mTimerList.back());
+    }
+}
+
+bool CBaseEventLoop::timerBefore(CSysLoopTimer *left, CSysLoopTimer *right)
+{
+    if (left->mExpiration != right->mExpiration)
+    {
+        return left->mExpiration < right->mExpiration;
+    }
+    return left->mSequence < right->mSequence;
+}
+
+#define FDB_TIMER_HEAP_ARITY        4
+
+void CBaseEventLoop::siftTimerUp(uint32_t index)
+{
+    auto timer = mTimerHeap[index];
+    while (index)
+    {
+        auto parent = (index - 1) / FDB_TIMER_HEAP_ARITY;
+        if (!timerBefore(timer, mTimerHeap[parent]))
+        {
+            break;
+        }
+        mTimerHeap[index] = mTimerHeap[parent];
+        mTimerHeap[index]->mHeapIndex = (int32_t)index;
+        index = parent;
+    }
+    mTimerHeap[index] = timer;
+    timer->mHeapIndex = (int32_t)index;
+}
+
+void CBaseEventLoop::siftTimerDown(uint32_t index)
+{
+    auto timer = mTimerHeap[index];
+    auto size = (uint32_t)mTimerHeap.size();
+    while (true)
+    {
+        auto first = index * FDB_TIMER_HEAP_ARITY + 1;
+        if (first >= size)
+        {
+            break;
+        }
+        auto end = std::min(first + FDB_TIMER_HEAP_ARITY, size);
+        auto min_child = first;
+        for (auto child = first + 1; child < end; ++child)
+        {
+            if (timerBefore(mTimerHeap[child], mTimerHeap[min_child]))
+            {
+                min_child = child;
+            }
+        }
+        if (!timerBefore(mTimerHeap[min_child], timer))
+        {
+            break;
+        }
+        mTimerHeap[index] = mTimerHeap[min_child];
+        mTimerHeap[index]->mHeapIndex = (int32_t)index;
+        index = min_child;
+    }
+    mTimerHeap[index] = timer;
+    timer->mHeapIndex = (int32_t)index;
+}
+
+void CBaseEventLoop::pushTimer(CSysLoopTimer *timer)
+{
+    timer->mSequence = mTimerSequence++;
+    mTimerHeap.push_back(timer);
+    siftTimerUp((uint32_t)(mTimerHeap.size() - 1));
+}
+
+void CBaseEventLoop::eraseTimer(CSysLoopTimer *timer)
+{
+    auto index = timer->mHeapIndex;
+    if (index < 0)
+    {
+        return;
+    }
+    timer->mHeapIndex = -1;
+    auto last = mTimerHeap.back();
+    mTimerHeap.pop_back();
+    if (last != timer)
+    {
+        // fill the hole with the last one and restore heap order
+        mTimerHeap[index] = last;
+        last->mHeapIndex = index;
+        siftTimerUp((uint32_t)index);
+        if (last->mHeapIndex == index)
+        {
+            siftTimerDown((uint32_t)index);
+        }
     }
 }
 
 int32_t CBaseEventLoop::getMostRecentTime()
 {
     int32_t wait_time = -1; // wait forever
-    auto ti = mTimerWorkingList.begin();
-    if (ti != mTimerWorkingList.end())
+    if (!mTimerHeap.empty())
     {
         uint64_t now_millis = sysdep_getsystemtime_milli();
-        uint64_t min_expire = (*ti)->expiration();
+        uint64_t min_expire = mTimerHeap.front()->expiration();
         if (min_expire > now_millis)
         {
             wait_time = (int)(min_expire - now_millis); // wait until timeout
@@ -206,47 +300,48 @@ void CBaseEventLoop::endTimerBlackList()
 void CBaseEventLoop::processTimers()
 {
     uint64_t now_millis = sysdep_getsystemtime_milli();
-    std::vector<CSysLoopTimer *> tos;
-    for (auto ti = mTimerWorkingList.begin(); ti != mTimerWorkingList.end(); ++ti)
+    if (mTimerHeap.empty() || (mTimerHeap.front()->expiration() > now_millis))
     {
-        if (now_millis >= (*ti)->expiration())
-        {
-            tos.push_back(*ti);
-        }
-        else
-        {
-            break;
-        }
+        return;
     }
-    if (!tos.empty())
+
+    // timers run recursively from callback can't share the buffer
+    tLoopTimerTbl nested_tos;
+    auto &tos = mTimerRecursiveCnt ? nested_tos : mExpiredTimers;
+    /*
+     * Repeated timers are enabled again from now_millis so they expire
+     * later than now_millis; others are removed from heap. Either way
+     * the loop ends.
+     */
+    while (!mTimerHeap.empty() && (now_millis >= mTimerHeap.front()->expiration()))
     {
-        beginTimerBlackList();
-        for (auto ti = tos.begin(); ti != tos.end(); ++ti)
+        auto timer = mTimerHeap.front();
+        tos.push_back(timer);
+        timer->enable(timer->repeat(), now_millis);
+    }
+
+    beginTimerBlackList();
+    for (auto ti = tos.begin(); ti != tos.end(); ++ti)
+    {
+        if (timerDestroyed((*ti)))
         {
-            (*ti)->enable((*ti)->repeat(), now_millis);
+            continue;
         }
-
-        for (auto ti = tos.begin(); ti != tos.end(); ++ti)
+        try
         {
-            if (timerDestroyed((*ti)))
-            {
-                continue;
-            }
-            try
-            {
-                (*ti)->run();
-            }
-            catch (...)
+            (*ti)->run();
+        }
+        catch (...)
+        {
+            LOG_E("CFdEventLoop: Exception received at line %d of file %s!\n", __LINE__, __FILE__);
+            if (!timerDestroyed(*ti))
             {
-                LOG_E("CFdEventLoop: Exception received at line %d of file %s!\n", __LINE__, __FILE__);
-                if (!timerDestroyed(*ti))
-                {
-                    removeTimer(*ti);
-                }
+                removeTimer(*ti);
             }
         }
-        endTimerBlackList();
     }
+    endTimerBlackList();
+    tos.clear();
 }
 
 void CBaseEventLoop::lock()
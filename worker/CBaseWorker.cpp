@@ -22,6 +22,7 @@
 #include <common_base/CBaseFdWatch.h>
 #include <utils/Log.h>
 #include <common_base/CFdEventLoop.h>
+#include <common_base/CEpollEventLoop.h>
 #include <common_base/CThreadEventLoop.h>
 
 /*-----------------------------------------------------------------------------
@@ -30,6 +31,8 @@
 CBaseJob::CBaseJob(uint32_t flag)
     : mFlag(flag)
     , mSyncReq(0)
+    , mQueueNext(0)
+    , mQueueLinked(false)
 {
 }
 
@@ -458,11 +461,30 @@ CBaseWorker::CJobQueue::CJobQueue(uint32_t max_size)
         : mMaxSize(max_size)
         , mDiscardCnt(0)
         , mEventLoop(0)
+        , mLockFree(false)
+        , mHead(&mStub)
+        , mTail(&mStub)
+        , mPending(0)
 {
 }
 
+CBaseWorker::CJobQueue::~CJobQueue()
+{
+    CBaseJob *job;
+    while ((job = popNode()))
+    {
+        job->mQueueLinked.store(false, std::memory_order_relaxed);
+        job->mQueueRef.reset();
+    }
+}
+
 bool CBaseWorker::CJobQueue::enqueue(CBaseJob::Ptr &job)
 {
+    if (mLockFree)
+    {
+        return enqueueLockFree(job);
+    }
+
     bool ret = false;
     
     if (!mMaxSize || (mJobQueue.size() < mMaxSize))
@@ -485,10 +507,127 @@ bool CBaseWorker::CJobQueue::enqueue(CBaseJob::Ptr &job)
 
 void CBaseWorker::CJobQueue::dumpJobs(tJobContainer &job_queue)
 {
+    if (mLockFree)
+    {
+        return;
+    }
     job_queue = mJobQueue;
     mJobQueue.clear();
 }
 
+void CBaseWorker::CJobQueue::pushNode(CBaseJob *job)
+{
+    job->mQueueNext.store(0, std::memory_order_relaxed);
+    auto prev = mHead.exchange(job, std::memory_order_acq_rel);
+    prev->mQueueNext.store(job, std::memory_order_release);
+}
+
+/*
+ * return 0 if queue is empty or the next job is being pushed by producer
+ */
+CBaseJob *CBaseWorker::CJobQueue::popNode()
+{
+    auto tail = mTail;
+    auto next = tail->mQueueNext.load(std::memory_order_acquire);
+    if (tail == &mStub)
+    {
+        if (!next)
+        {
+            return 0;
+        }
+        mTail = next;
+        tail = next;
+        next = next->mQueueNext.load(std::memory_order_acquire);
+    }
+    if (next)
+    {
+        mTail = next;
+        return tail;
+    }
+    if (tail != mHead.load(std::memory_order_acquire))
+    {
+        return 0;
+    }
+    pushNode(&mStub);
+    next = tail->mQueueNext.load(std::memory_order_acquire);
+    if (next)
+    {
+        mTail = next;
+        return tail;
+    }
+    return 0;
+}
+
+bool CBaseWorker::CJobQueue::enqueueLockFree(CBaseJob::Ptr &job)
+{
+    auto the_job = job.get();
+    if (the_job->mQueueLinked.exchange(true, std::memory_order_acquire))
+    {
+        LOG_E("CBaseWorker: job is already in a lock-free queue!\n");
+        return false;
+    }
+
+    /*
+     * Reserve a slot before pushing so that size limit is never exceeded.
+     * A slot reserved but not pushed yet is left by the consumer until the
+     * next round.
+     */
+    auto pending = mPending.load(std::memory_order_acquire);
+    do
+    {
+        if (mMaxSize && (pending >= mMaxSize))
+        {
+            the_job->mQueueLinked.store(false, std::memory_order_release);
+            return false;
+        }
+    } while (!mPending.compare_exchange_weak(pending, pending + 1, std::memory_order_acq_rel,
+                                             std::memory_order_acquire));
+    the_job->mQueueRef = job;
+    pushNode(the_job);
+
+    if (!pending)
+    {
+        /*
+         * Wake up the worker only when the queue becomes non-empty. Lock is
+         * held shortly so that the worker can not miss the wakeup between
+         * checking the queue and waiting for signal.
+         */
+        mEventLoop->lock();
+        mEventLoop->unlock();
+        mEventLoop->notify();
+    }
+    return true;
+}
+
+void CBaseWorker::CJobQueue::dumpJobsLockFree(tJobContainer &job_queue)
+{
+    if (!mLockFree)
+    {
+        return;
+    }
+
+    uint32_t nr_jobs = 0;
+    CBaseJob *job;
+    // stop at a job whose producer has not finished pushing yet
+    while ((job = popNode()))
+    {
+        CBaseJob::Ptr job_ref;
+        job_ref.swap(job->mQueueRef);
+        job->mQueueLinked.store(false, std::memory_order_release);
+        job_queue.push_back(std::move(job_ref));
+        nr_jobs++;
+    }
+
+    if (mPending.fetch_sub(nr_jobs, std::memory_order_acq_rel) != nr_jobs)
+    {
+        /*
+         * Jobs arriving meanwhile didn't wake up the worker, and jobs being
+         * pushed are not taken yet: come back for them.
+         */
+        mEventLoop->notify();
+    }
+}
+
 void CBaseWorker::CJobQueue::discardJobs()
 {
     mEventLoop->lock();
@@ -526,6 +665,10 @@ uint32_t CBaseWorker::CJobQueue::sizeLimit() const
 
 uint32_t CBaseWorker::CJobQueue::size() const
 {
+    if (mLockFree)
+    {
+        return mPending.load(std::memory_order_acquire);
+    }
     return (uint32_t)mJobQueue.size();
 }
 
@@ -558,7 +701,19 @@ bool CBaseWorker::init(uint32_t flag)
             }
             if (flag & FDB_WORKER_ENABLE_FD_LOOP)
             {
-                mEventLoop = new CFdEventLoop();
+#ifdef CONFIG_FDB_EPOLL
+#ifdef CONFIG_FDB_EPOLL_DEFAULT
+                flag |= FDB_WORKER_ENABLE_EPOLL;
+#endif
+                if (flag & FDB_WORKER_ENABLE_EPOLL)
+                {
+                    mEventLoop = new CEpollEventLoop();
+                }
+                else
+#endif
+                {
+                    mEventLoop = new CFdEventLoop();
+                }
             }
             else
             {
@@ -567,6 +722,8 @@ bool CBaseWorker::init(uint32_t flag)
         }
         mNormalJobQueue.eventLoop(mEventLoop);
         mUrgentJobQueue.eventLoop(mEventLoop);
+        mNormalJobQueue.lockFree(!!(flag & FDB_WORKER_LOCKFREE_QUEUE));
+        mUrgentJobQueue.lockFree(!!(flag & FDB_WORKER_LOCKFREE_QUEUE));
         if (mEventLoop->init(this))
         {
             return asyncReady();
@@ -657,12 +814,19 @@ void CBaseWorker::processUrgentJobs(tJobContainer &jobs)
 
 void CBaseWorker::processUrgentJobs()
 {
-    if (!mUrgentJobQueue.jobQueue().empty())
+    if (mUrgentJobQueue.size())
     {
-        mEventLoop->lock();
         tJobContainer jobs;
-        mUrgentJobQueue.dumpJobs(jobs);
-        mEventLoop->unlock();
+        if (mUrgentJobQueue.lockFree())
+        {
+            mUrgentJobQueue.dumpJobsLockFree(jobs);
+        }
+        else
+        {
+            mEventLoop->lock();
+            mUrgentJobQueue.dumpJobs(jobs);
+            mEventLoop->unlock();
+        }
 
         processUrgentJobs(jobs);
     }
@@ -678,6 +842,9 @@ void CBaseWorker::processJobQueue()
     mNormalJobQueue.dumpJobs(normal_jobs);
     mUrgentJobQueue.dumpJobs(urgent_jobs);
     mEventLoop->unlock();
+    // producers of lock-free queues never take the lock
+    mNormalJobQueue.dumpJobsLockFree(normal_jobs);
+    mUrgentJobQueue.dumpJobsLockFree(urgent_jobs);
 
     processUrgentJobs(urgent_jobs);
     for (auto it = normal_jobs.begin(); it != normal_jobs.end(); ++it)
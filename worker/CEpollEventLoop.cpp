@@ -0,0 +1,301 @@
+/*
+ * Copyright (C) 2015   Jeremy Chen jeremy_cz@yahoo.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <common_base/CEpollEventLoop.h>
+
+#ifdef CONFIG_FDB_EPOLL
+#include <errno.h>
+#include <unistd.h>
+#include <utils/Log.h>
+#include <common_base/CSysFdWatch.h>
+
+#define FDB_EPOLL_INIT_EVENTS       64
+#define FDB_EPOLL_MAX_EVENTS        1024
+#define FDB_EPOLL_INPUT_EVENTS      32
+
+static uint32_t fdbPollToEpoll(uint32_t flags)
+{
+    uint32_t events = 0;
+    if (flags & POLLIN)
+    {
+        events |= EPOLLIN;
+    }
+    if (flags & POLLOUT)
+    {
+        events |= EPOLLOUT;
+    }
+    if (flags & POLLPRI)
+    {
+        events |= EPOLLPRI;
+    }
+    // EPOLLERR and EPOLLHUP are always reported
+    return events;
+}
+
+static int32_t fdbEpollToPoll(uint32_t events)
+{
+    int32_t revents = 0;
+    if (events & EPOLLIN)
+    {
+        revents |= POLLIN;
+    }
+    if (events & EPOLLOUT)
+    {
+        revents |= POLLOUT;
+    }
+    if (events & EPOLLPRI)
+    {
+        revents |= POLLPRI;
+    }
+    if (events & EPOLLERR)
+    {
+        revents |= POLLERR;
+    }
+    if (events & EPOLLHUP)
+    {
+        revents |= POLLHUP;
+    }
+    return revents;
+}
+
+CEpollEventLoop::CEpollEventLoop()
+    : mEpollFd(-1)
+    , mNrEnabledWatches(0)
+    , mEpollEvents(FDB_EPOLL_INIT_EVENTS)
+{
+}
+
+CEpollEventLoop::~CEpollEventLoop()
+{
+    // ~CFdEventLoop() can not reach enableWatch() of this class; uninstall here
+    uninstallWatches();
+    if (mEpollFd >= 0)
+    {
+        close(mEpollFd);
+    }
+}
+
+bool CEpollEventLoop::controlWatch(CSysFdWatch *watch, int op)
+{
+    int fd = watch->descriptor();
+    if (fd < 0)
+    {
+        LOG_E("CEpollEventLoop: Bad file descriptor: %d!\n", fd);
+        return false;
+    }
+
+    epoll_event ev;
+    ev.events = fdbPollToEpoll(watch->flags());
+    ev.data.ptr = watch;
+    if (epoll_ctl(mEpollFd, op, fd, &ev) < 0)
+    {
+        if ((op == EPOLL_CTL_ADD) && (errno == EEXIST))
+        {
+            // fd is reused before stale registration is cleared
+            return epoll_ctl(mEpollFd, EPOLL_CTL_MOD, fd, &ev) == 0;
+        }
+        if ((op == EPOLL_CTL_DEL) && ((errno == EBADF) || (errno == ENOENT)))
+        {
+            // fd is closed or not registered: nothing to remove
+            return true;
+        }
+        LOG_E("CEpollEventLoop: fail to control fd %d with op %d; error: %d!\n", fd, op, errno);
+        return false;
+    }
+    return true;
+}
+
+bool CEpollEventLoop::enableWatch(CSysFdWatch *watch, bool enable)
+{
+    // fatal error is cleared when a watch is enabled
+    mErrorWatches.erase(watch);
+    if (enable == watch->enable())
+    {
+        return false;
+    }
+
+    if (enable)
+    {
+        if (controlWatch(watch, EPOLL_CTL_ADD))
+        {
+            mNrEnabledWatches++;
+            return true;
+        }
+        return false;
+    }
+    // the watch is disabled by the caller anyway; don't count it any more
+    mNrEnabledWatches--;
+    return controlWatch(watch, EPOLL_CTL_DEL);
+}
+
+void CEpollEventLoop::updateWatch(CSysFdWatch *watch)
+{
+    if (!watch->enable())
+    {
+        return;
+    }
+    if (watch->fatalError())
+    {
+        mErrorWatches.insert(watch);
+    }
+    else
+    {
+        mErrorWatches.erase(watch);
+        controlWatch(watch, EPOLL_CTL_MOD);
+    }
+}
+
+void CEpollEventLoop::processErrorWatches()
+{
+    if (mErrorWatches.empty())
+    {
+        return;
+    }
+
+    std::vector<CSysFdWatch *> error_watches(mErrorWatches.begin(), mErrorWatches.end());
+    mErrorWatches.clear();
+    beginWatchBlackList();
+    for (auto wi = error_watches.begin(); wi != error_watches.end(); ++wi)
+    {
+        auto w = *wi;
+        if (watchDestroyed(w) || !w->enable() || !w->fatalError())
+        {
+            continue;
+        }
+        processWatchError(w);
+    }
+    endWatchBlackList();
+}
+
+void CEpollEventLoop::processEpollEvents(epoll_event *events, int32_t nr_events, bool input_only)
+{
+    CSysFdWatch *notify_watch = 0;
+    int32_t notify_events = 0;
+    beginWatchBlackList();
+    for (int32_t i = 0; i < nr_events; ++i)
+    {
+        auto w = (CSysFdWatch *)events[i].data.ptr;
+        auto revents = fdbEpollToPoll(events[i].events);
+        if (isNotifyWatch(w))
+        {
+            /*
+             * Since the notify watch is for job processing and might delete
+             * other watches, handle it at last.
+             */
+            notify_watch = w;
+            notify_events = revents;
+            continue;
+        }
+        if (!input_only)
+        {
+            processOneWatch(w, revents);
+            continue;
+        }
+
+        if (watchDestroyed(w) || w->fatalError())
+        {
+            continue;
+        }
+        if (w->convertRetEvents(revents) & POLLIN)
+        {
+            try
+            {
+                w->processInput();
+            }
+            catch (...)
+            {
+                LOG_E("CEpollEventLoop: Exception received at line %d of file %s!\n", __LINE__, __FILE__);
+            }
+        }
+    }
+    if (notify_watch && !input_only)
+    {
+        processOneWatch(notify_watch, notify_events);
+    }
+    endWatchBlackList();
+}
+
+void CEpollEventLoop::dispatch()
+{
+    processErrorWatches();
+    if (!mNrEnabledWatches)
+    {
+        LOG_E("CEpollEventLoop: no watch fds enabled!\n");
+        // avoid exhaustive of CPU power
+        sysdep_sleep(LOOP_DEFAULT_INTERVAL);
+        return;
+    }
+
+    int32_t wait_time = getMostRecentTime();
+    int32_t max_events = (int32_t)mEpollEvents.size();
+    int ret = epoll_wait(mEpollFd, mEpollEvents.data(), max_events, wait_time);
+    if (ret == 0) // timeout
+    {
+        processTimers();
+    }
+    else if (ret > 0) // watch ready
+    {
+        processEpollEvents(mEpollEvents.data(), ret, false);
+        if ((ret == max_events) && (max_events < FDB_EPOLL_MAX_EVENTS))
+        {
+            // more watches might be ready than received; enlarge for next round
+            mEpollEvents.resize(max_events << 1);
+        }
+    }
+    else if (errno != EINTR)
+    {
+        LOG_E("CEpollEventLoop: Error polling: %d!\n", errno);
+        // avoid exhaustive of CPU power
+        sysdep_sleep(LOOP_DEFAULT_INTERVAL);
+    }
+}
+
+void CEpollEventLoop::dispatchInput(int32_t timeout)
+{
+    // the only watch is the one for job queue, which is not handled here.
+    if (mNrEnabledWatches <= 1)
+    {
+        sysdep_sleep(timeout);
+        return;
+    }
+
+    // dispatchInput() can be called inside callback: don't touch mEpollEvents
+    epoll_event events[FDB_EPOLL_INPUT_EVENTS];
+    int ret = epoll_wait(mEpollFd, events, FDB_EPOLL_INPUT_EVENTS, timeout);
+    if (ret > 0)
+    {
+        processEpollEvents(events, ret, true);
+    }
+    else if (ret < 0)
+    {
+        sysdep_sleep(timeout);
+    }
+}
+
+bool CEpollEventLoop::init(CBaseWorker *worker)
+{
+    if (mEpollFd < 0)
+    {
+        mEpollFd = epoll_create1(EPOLL_CLOEXEC);
+        if (mEpollFd < 0)
+        {
+            LOG_E("CEpollEventLoop: fail to create epoll fd: %d!\n", errno);
+            return false;
+        }
+    }
+    return CFdEventLoop::init(worker);
+}
+#endif
@@ -54,8 +54,8 @@ private:
 };
 
 CFdEventLoop::CFdEventLoop()
-    : mWatchRecursiveCnt(0)
-    , mNotifyWatch(0)
+    : mNotifyWatch(0)
+    , mWatchRecursiveCnt(0)
     , mRebuildPollFd(false)
 {
 }
@@ -79,6 +79,11 @@ bool CFdEventLoop::watchDestroyed(CSysFdWatch *watch)
     return false;
 }
 
+bool CFdEventLoop::isNotifyWatch(CSysFdWatch *watch) const
+{
+    return watch == mNotifyWatch;
+}
+
 void CFdEventLoop::addWatchToBlacklist(CSysFdWatch *watch)
 {
     mWatchBlackList.insert(watch);
@@ -121,22 +126,26 @@ void CFdEventLoop::buildFdArray()
     for (auto wi = fatal_error_watches.begin(); wi != fatal_error_watches.end(); ++wi)
     {
         beginWatchBlackList();
-        auto w = *wi;
-        try
+        processWatchError(*wi);
+        endWatchBlackList();
+    }
+}
+
+void CFdEventLoop::processWatchError(CSysFdWatch *w)
+{
+    try
+    {
+        w->enable(false);
+        w->onError();
+    }
+    catch (...)
+    {
+        LOG_E("CFdEventLoop: Exception received at line %d of file %s!\n", __LINE__, __FILE__);
+        if (!watchDestroyed(w))
         {
-            w->enable(false);
-            w->onError();
+            removeWatch(w);
+            delete w;
         }
-        catch (...)
-        {
-            LOG_E("CFdEventLoop: Exception received at line %d of file %s!\n", __LINE__, __FILE__);
-            if (!watchDestroyed(w))
-            {
-                removeWatch(w);
-                delete w;
-            }
-        }
-        endWatchBlackList();
     }
 }
 
@@ -182,115 +191,81 @@ void CFdEventLoop::processWatches()
     for (auto i = (unsigned)0; i < size; ++i)
     {
         auto j = size - 1 - i;
-        auto w = mPollWatches[j];
-        if (watchDestroyed(w))
+        auto revents = mPollFds[j].revents;
+        mPollFds[j].revents = 0;
+        processOneWatch(mPollWatches[j], revents);
+    }
+    endWatchBlackList();
+}
+
+void CFdEventLoop::processOneWatch(CSysFdWatch *w, int32_t revents)
+{
+    if (watchDestroyed(w))
+    {
+        return;
+    }
+    if (w->fatalError())
+    {
+        processWatchError(w);
+        return;
+    }
+
+    int32_t events = w->convertRetEvents(revents);
+    if (events & (POLLIN | POLLOUT | POLLERR | POLLHUP))
+    {
+        if (events & POLLERR)
         {
-            continue;
+            processWatchError(w);
+            return;
         }
-        if (w->fatalError())
+        if (events & POLLHUP)
         {
             try
             {
-                w->enable(false);
-                w->onError();
+                w->onHup();
             }
             catch (...)
             {
                 LOG_E("CFdEventLoop: Exception received at line %d of file %s!\n", __LINE__, __FILE__);
-                if (!watchDestroyed(w))
-                {
-                    removeWatch(w);
-                    delete w;
-                }
             }
-            continue;
+            return;
         }
-
-        int32_t events = w->convertRetEvents(mPollFds[j].revents);
-        mPollFds[j].revents = 0;
-        if (events & (POLLIN | POLLOUT | POLLERR | POLLHUP))
+        if (events & POLLIN)
         {
-            if (events & POLLERR)
+            try
             {
-                try
-                {
-                    w->enable(false);
-                    w->onError();
-                }
-                catch (...)
-                {
-                    LOG_E("CFdEventLoop: Exception received at line %d of file %s!\n", __LINE__, __FILE__);
-                    if (!watchDestroyed(w))
-                    {
-                        removeWatch(w);
-                        delete w;
-                    }
-                }
-                continue;
+                w->processInput();
             }
-            if (events & POLLHUP)
+            catch (...)
             {
-                try
-                {
-                    w->onHup();
-                }
-                catch (...)
-                {
-                    LOG_E("CFdEventLoop: Exception received at line %d of file %s!\n", __LINE__, __FILE__);
-                }
-                continue;
+                LOG_E("CFdEventLoop: Exception received at line %d of file %s!\n", __LINE__, __FILE__);
             }
-            if (events & POLLIN)
+            if (watchDestroyed(w))
             {
-                try
-                {
-                    w->processInput();
-                }
-                catch (...)
-                {
-                    LOG_E("CFdEventLoop: Exception received at line %d of file %s!\n", __LINE__, __FILE__);
-                }
-                if (watchDestroyed(w))
-                {
-                    continue;
-                }
+                return;
             }
-            if (events & POLLOUT)
+        }
+        if (events & POLLOUT)
+        {
+            try
             {
-                try
-                {
-                    w->processOutput();
-                }
-                catch (...)
-                {
-                    LOG_E("CFdEventLoop: Exception received at line %d of file %s!\n", __LINE__, __FILE__);
-                }
-                if (watchDestroyed(w))
-                {
-                    continue;
-                }
+                w->processOutput();
             }
-
-            if (w->fatalError())
+            catch (...)
             {
-                try
-                {
-                    w->enable(false);
-                    w->onError();
-                }
-                catch (...)
-                {
-                    LOG_E("CFdEventLoop: Exception received at line %d of file %s!\n", __LINE__, __FILE__);
-                    if (!watchDestroyed(w))
-                    {
-                        removeWatch(w);
-                        delete w;
-                    }
-                }
+                LOG_E("CFdEventLoop: Exception received at line %d of file %s!\n", __LINE__, __FILE__);
+            }
+            if (watchDestroyed(w))
+            {
+                return;
             }
         }
+
+        if (w->fatalError())
+        {
+            processWatchError(w);
+        }
     }
-    endWatchBlackList();
 }
 
 void CFdEventLoop::processInputWatches(tWatchPollTbl &watches, tFdPollTbl &fds)
@@ -425,7 +400,11 @@ bool CFdEventLoop::addWatchToList(tCFdWatchList &wlist, CSysFdWatch *watch, bool
 
 bool CFdEventLoop::registerWatch(CSysFdWatch *watch, bool enable)
 {
-    return addWatchToList(mWatchList, watch, enable);
+    if (enable)
+    {
+        return mWatchList.insert(watch).second;
+    }
+    return mWatchList.erase(watch) != 0;
 }
 
 bool CFdEventLoop::enableWatch(CSysFdWatch *watch, bool enable)
@@ -434,6 +413,11 @@ bool CFdEventLoop::enableWatch(CSysFdWatch *watch, bool enable)
     return addWatchToList(mWatchWorkingList, watch, enable);
 }
 
+void CFdEventLoop::updateWatch(CSysFdWatch *watch)
+{
+    mRebuildPollFd = true;
+}
+
 void CFdEventLoop::uninstallWatches()
 {
     for (auto wi = mWatchList.begin(); wi != mWatchList.end();)
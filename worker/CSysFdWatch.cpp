@@ -24,6 +24,7 @@
 #include <common_base/CLogProducer.h>
 
 #define FDB_MAX_RECURSIVE_SIZE   	32
+#define FDB_MAX_OUTPUT_IOVECS       64
 
 CSysFdWatch::CSysFdWatch(int fd, uint32_t flags)
     : mFd(fd)
@@ -31,6 +32,7 @@ CSysFdWatch::CSysFdWatch(int fd, uint32_t flags)
     , mEnable(false)
     , mFatalError(false)
     , mEventLoop(0)
+    , mPendingOutputSize(0)
     , mInputRecursiveDepth(0)
 {}
 
@@ -58,9 +60,9 @@ void CSysFdWatch::fatalError(bool enb)
 {
     if (mFatalError != enb)
     {
-        mEventLoop->rebuildPollFd();
+        mFatalError = enb;
+        mEventLoop->updateWatch(this);
     }
-    mFatalError = enb;
 }
 
 void CSysFdWatch::updateFlags(uint32_t mask, uint32_t value)
@@ -69,21 +71,32 @@ void CSysFdWatch::updateFlags(uint32_t mask, uint32_t value)
     if (mFlags != flags)
     {
         mFlags = flags;
-        mEventLoop->rebuildPollFd();
+        mEventLoop->updateWatch(this);
     }
 }
 
-CSysFdWatch::COutputDataChunk::COutputDataChunk(const uint8_t *msg_buffer, int32_t msg_size, int32_t consumed,
-                                                const uint8_t *log_buffer, int32_t log_size)
-    : mSize(msg_size)
+CSysFdWatch::COutputDataChunk::COutputDataChunk(const std::shared_ptr<uint8_t> &buffer_ref,
+                                                const uint8_t *msg_buffer, int32_t msg_size, int32_t consumed,
+                                                const uint8_t *log_buffer, int32_t log_size,
+                                                bool droppable)
+    : mBuffer(0)
+    , mData(msg_buffer)
+    , mSize(msg_size)
     , mConsumed(consumed)
     , mLogBuffer(0)
     , mLogSize(log_size)
+    , mDroppable(droppable)
+    , mLinked(false)
 {
-    if (msg_size && msg_buffer)
+    if (buffer_ref)
+    {
+        mBufferRef = buffer_ref;
+    }
+    else if (msg_size && msg_buffer)
     {
         mBuffer = new uint8_t[msg_size];
         memcpy(mBuffer, msg_buffer, msg_size);
+        mData = mBuffer;
     }
 
     if (log_size && log_buffer)
@@ -147,38 +160,161 @@ void CSysFdWatch::submitInput(uint8_t *buffer, int32_t size, bool trigger_read)
     mInputRecursiveDepth--;
 }
 
-void CSysFdWatch::submitOutput(const uint8_t *msg_buffer, int32_t msg_size,
+void CSysFdWatch::sendOutputLog(const uint8_t *log_buffer, int32_t log_size)
+{
+    if (log_buffer && log_size)
+    {
+        auto logger = FDB_CONTEXT->getLogger();
+        if (logger)
+        {
+            logger->sendLog(NFdbBase::REQ_FDBUS_LOG, log_buffer, log_size);
+        }
+    }
+}
+
+int32_t CSysFdWatch::tryOutput(const uint8_t *msg_buffer, int32_t msg_size,
                                const uint8_t *log_buffer, int32_t log_size)
 {
     if (!msg_buffer || !msg_size || fatalError())
     {
-        return;
+        return -1;
     }
-    if (mOutputChunkList.size())
+    if (!mOutputChunkList.empty())
     {
-        mOutputChunkList.push_back(new COutputDataChunk(msg_buffer, msg_size, 0, log_buffer, log_size));
+        // keep order with pending output
+        return 0;
     }
-    else
+
+    auto consumed = writeStream(msg_buffer, msg_size);
+    if (consumed < 0)
     {
-        auto consumed = writeStream(msg_buffer, msg_size);
-        if (consumed < 0)
+        fatalError(true);
+    }
+    else if (consumed >= msg_size)
+    {
+        sendOutputLog(log_buffer, log_size);
+    }
+    return consumed;
+}
+
+void CSysFdWatch::queueOutput(const std::shared_ptr<uint8_t> &buffer_ref,
+                              const uint8_t *msg_buffer, int32_t msg_size, int32_t consumed,
+                              const uint8_t *log_buffer, int32_t log_size, bool droppable)
+{
+    mOutputChunkList.push_back(new COutputDataChunk(buffer_ref, msg_buffer, msg_size, consumed,
+                                                    log_buffer, log_size, droppable && !consumed));
+    mPendingOutputSize += msg_size - consumed;
+    updateFlags(POLLOUT, POLLOUT);
+}
+
+int32_t CSysFdWatch::tryOutput(const CFdbIoVec *vecs, int32_t count,
+                               const uint8_t *log_buffer, int32_t log_size)
+{
+    if (count == 1)
+    {
+        return tryOutput(vecs[0].mData, vecs[0].mSize, log_buffer, log_size);
+    }
+    if ((count <= 0) || fatalError())
+    {
+        return -1;
+    }
+    if (!mOutputChunkList.empty())
+    {
+        return 0;
+    }
+
+    int32_t size = 0;
+    for (int32_t i = 0; i < count; ++i)
+    {
+        size += vecs[i].mSize;
+    }
+    auto consumed = writeStream(vecs, count);
+    if (consumed < 0)
+    {
+        fatalError(true);
+    }
+    else if (consumed >= size)
+    {
+        sendOutputLog(log_buffer, log_size);
+    }
+    return consumed;
+}
+
+void CSysFdWatch::queueOutput(const std::shared_ptr<uint8_t> *buffer_refs,
+                              const CFdbIoVec *vecs, int32_t count, int32_t consumed,
+                              const uint8_t *log_buffer, int32_t log_size, bool droppable)
+{
+    // nothing is dropped once part of the message is written
+    droppable = droppable && !consumed;
+    bool linked = false;
+    for (int32_t i = 0; i < count; ++i)
+    {
+        if (consumed >= vecs[i].mSize)
         {
-            fatalError(true);
+            consumed -= vecs[i].mSize;
+            continue;
         }
-        else if (consumed < msg_size)
+        // log goes after the last piece
+        bool last = i == (count - 1);
+        auto chunk = new COutputDataChunk(buffer_refs[i], vecs[i].mData, vecs[i].mSize, consumed,
+                                          last ? log_buffer : 0, last ? log_size : 0,
+                                          droppable && !linked);
+        chunk->mLinked = linked;
+        mOutputChunkList.push_back(chunk);
+        mPendingOutputSize += vecs[i].mSize - consumed;
+        consumed = 0;
+        linked = true;
+    }
+    updateFlags(POLLOUT, POLLOUT);
+}
+
+int64_t CSysFdWatch::dropOutput(int64_t size, uint32_t &nr_dropped)
+{
+    int64_t dropped = 0;
+    for (auto it = mOutputChunkList.begin(); (it != mOutputChunkList.end()) && (dropped < size);)
+    {
+        auto chunk = *it;
+        if (!chunk->mDroppable || chunk->mConsumed)
         {
-            mOutputChunkList.push_back(new COutputDataChunk(msg_buffer, msg_size, consumed, log_buffer, log_size));
-            updateFlags(POLLOUT, POLLOUT);
+            ++it;
+            continue;
         }
-        else if (log_buffer && log_size)
+        dropped += chunk->mSize;
+        nr_dropped++;
+        delete chunk;
+        it = mOutputChunkList.erase(it);
+        while ((it != mOutputChunkList.end()) && (*it)->mLinked)
         {
-            auto logger = FDB_CONTEXT->getLogger();
-            if (logger)
-            {
-                logger->sendLog(NFdbBase::REQ_FDBUS_LOG, log_buffer, log_size);
-            }
+            dropped += (*it)->mSize;
+            delete *it;
+            it = mOutputChunkList.erase(it);
         }
     }
+    mPendingOutputSize -= dropped;
+    if (mOutputChunkList.empty())
+    {
+        updateFlags(POLLOUT, 0);
+    }
+    return dropped;
+}
+
+bool CSysFdWatch::flushOutput(int64_t size)
+{
+    if (mPendingOutputSize > size)
+    {
+        processOutput();
+    }
+    return !fatalError() && (mPendingOutputSize <= size);
+}
+
+void CSysFdWatch::submitOutput(const uint8_t *msg_buffer, int32_t msg_size,
+                               const uint8_t *log_buffer, int32_t log_size)
+{
+    auto consumed = tryOutput(msg_buffer, msg_size, log_buffer, log_size);
+    if ((consumed >= 0) && (consumed < msg_size))
+    {
+        queueOutput(std::shared_ptr<uint8_t>(), msg_buffer, msg_size, consumed, log_buffer, log_size);
+    }
 }
 
 void CSysFdWatch::processInput()
@@ -215,6 +351,26 @@ void CSysFdWatch::clearOutputChunkList()
         delete *it;
         mOutputChunkList.pop_front();
     }
+    mPendingOutputSize = 0;
+}
+
+int32_t CSysFdWatch::writeStream(const CFdbIoVec *vecs, int32_t count)
+{
+    int32_t total = 0;
+    for (int32_t i = 0; i < count; ++i)
+    {
+        auto consumed = writeStream(vecs[i].mData, vecs[i].mSize);
+        if (consumed < 0)
+        {
+            return -1;
+        }
+        total += consumed;
+        if (consumed < vecs[i].mSize)
+        {
+            break;
+        }
+    }
+    return total;
 }
 
 void CSysFdWatch::processOutput()
@@ -225,42 +381,60 @@ void CSysFdWatch::processOutput()
         return;
     }
 
+    CFdbIoVec vecs[FDB_MAX_OUTPUT_IOVECS];
+    bool written = false;
     while (!mOutputChunkList.empty())
     {
-        auto it = mOutputChunkList.begin();
-        auto chunk = *it;
-        auto buffer = chunk->mBuffer + chunk->mConsumed;
-        auto size = chunk->mSize - chunk->mConsumed;
-        auto consumed = writeStream(buffer, size);
+        // gather pending chunks and write them in one shot
+        int32_t count = 0;
+        int32_t size = 0;
+        for (auto it = mOutputChunkList.begin();
+                (it != mOutputChunkList.end()) && (count < FDB_MAX_OUTPUT_IOVECS); ++it, ++count)
+        {
+            auto chunk = *it;
+            vecs[count].mData = chunk->mData + chunk->mConsumed;
+            vecs[count].mSize = chunk->mSize - chunk->mConsumed;
+            size += vecs[count].mSize;
+        }
+
+        auto consumed = writeStream(vecs, count);
         if (consumed < 0)
         {
             fatalError(true);
             clearOutputChunkList();
             break;
         }
-        else if (consumed < size)
-        {
-            chunk->mConsumed += consumed;
-            break;
-        }
-        else
+
+        mPendingOutputSize -= consumed;
+        written = written || (consumed > 0);
+        auto left = consumed;
+        while (!mOutputChunkList.empty())
         {
-            if (chunk->mLogBuffer)
+            auto chunk = mOutputChunkList.front();
+            auto chunk_size = chunk->mSize - chunk->mConsumed;
+            if (left < chunk_size)
             {
-                auto logger = FDB_CONTEXT->getLogger();
-                if (logger)
-                {
-                    logger->sendLog(NFdbBase::REQ_FDBUS_LOG, chunk->mLogBuffer, chunk->mLogSize);
-                }
+                chunk->mConsumed += left;
+                break;
             }
+            left -= chunk_size;
+            sendOutputLog(chunk->mLogBuffer, chunk->mLogSize);
             delete chunk;
             mOutputChunkList.pop_front();
         }
+
+        if (consumed < size)
+        {
+            break;
+        }
     }
 
     if (mOutputChunkList.empty())
     {
         updateFlags(POLLOUT, 0);
     }
+    if (written)
+    {
+        onOutputWritten();
+    }
 }
-